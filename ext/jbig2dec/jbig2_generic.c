@@ -1101,6 +1101,9 @@ jbig2_decode_generic_template1_TPGDON(Jbig2Ctx *ctx,
     uint32_t CONTEXT;
     uint32_t x, y;
     int LTP = 0;
+    /* The nominal adaptive pixel (3, -1) is already in the sliding
+     * window of the row above, so it need not be fetched per pixel. */
+    const int nominal = params->gbat[0] == 3 && params->gbat[1] == -1;
 
     if (pixel_outside_field(params->gbat[0], params->gbat[1]))
         return jbig2_error(ctx, JBIG2_SEVERITY_FATAL, segment->number,
@@ -1134,8 +1137,12 @@ jbig2_decode_generic_template1_TPGDON(Jbig2Ctx *ctx,
                     bit = 0;
                 } else {
                     CONTEXT  = out_byte & 0x0007; /* First 3 pixels */
-                    CONTEXT |= jbig2_image_get_pixel(image, x + params->gbat[0], y + params->gbat[1]) << 3;
-                    CONTEXT |= (pd>>9) & 0x01F0; /* next 5 pixels */
+                    if (nominal)
+                        CONTEXT |= (pd>>9) & 0x01F8; /* adaptive pixel, next 5 pixels */
+                    else {
+                        CONTEXT |= jbig2_image_get_pixel(image, x + params->gbat[0], y + params->gbat[1]) << 3;
+                        CONTEXT |= (pd>>9) & 0x01F0; /* next 5 pixels */
+                    }
                     CONTEXT |= (ppd>>4) & 0x1E00; /* next 4 pixels */
                     bit = jbig2_arith_decode(ctx, as, &GB_stats[CONTEXT]);
                     if (bit < 0)
@@ -1176,6 +1183,9 @@ jbig2_decode_generic_template2_TPGDON(Jbig2Ctx *ctx,
     uint32_t CONTEXT;
     uint32_t x, y;
     int LTP = 0;
+    /* The nominal adaptive pixel (2, -1) is already in the sliding
+     * window of the row above, so it need not be fetched per pixel. */
+    const int nominal = params->gbat[0] == 2 && params->gbat[1] == -1;
 
     if (pixel_outside_field(params->gbat[0], params->gbat[1]))
         return jbig2_error(ctx, JBIG2_SEVERITY_FATAL, segment->number,
@@ -1209,8 +1219,12 @@ jbig2_decode_generic_template2_TPGDON(Jbig2Ctx *ctx,
                     bit = 0;
                 } else {
                     CONTEXT  = out_byte & 0x003; /* First 2 pixels */
-                    CONTEXT |= jbig2_image_get_pixel(image, x + params->gbat[0], y + params->gbat[1]) << 2;
-                    CONTEXT |= (pd>>11) & 0x078; /* next 4 pixels */
+                    if (nominal)
+                        CONTEXT |= (pd>>11) & 0x07C; /* adaptive pixel, next 4 pixels */
+                    else {
+                        CONTEXT |= jbig2_image_get_pixel(image, x + params->gbat[0], y + params->gbat[1]) << 2;
+                        CONTEXT |= (pd>>11) & 0x078; /* next 4 pixels */
+                    }
                     CONTEXT |= (ppd>>7) & 0x380; /* next 3 pixels */
                     bit = jbig2_arith_decode(ctx, as, &GB_stats[CONTEXT]);
                     if (bit < 0)
@@ -1251,6 +1265,9 @@ jbig2_decode_generic_template3_TPGDON(Jbig2Ctx *ctx,
     uint32_t CONTEXT;
     uint32_t x, y;
     int LTP = 0;
+    /* The nominal adaptive pixel (2, -1) is already in the sliding
+     * window of the row above, so it need not be fetched per pixel. */
+    const int nominal = params->gbat[0] == 2 && params->gbat[1] == -1;
 
     if (pixel_outside_field(params->gbat[0], params->gbat[1]))
         return jbig2_error(ctx, JBIG2_SEVERITY_FATAL, segment->number,
@@ -1277,8 +1294,12 @@ jbig2_decode_generic_template3_TPGDON(Jbig2Ctx *ctx,
                     bit = 0;
                 } else {
                     CONTEXT  = out_byte & 0x0F; /* First 4 pixels */
-                    CONTEXT |= jbig2_image_get_pixel(image, x + params->gbat[0], y + params->gbat[1]) << 4;
-                    CONTEXT |= (pd>>9) & 0x3E0; /* next 5 pixels */
+                    if (nominal)
+                        CONTEXT |= (pd>>9) & 0x3F0; /* adaptive pixel, next 5 pixels */
+                    else {
+                        CONTEXT |= jbig2_image_get_pixel(image, x + params->gbat[0], y + params->gbat[1]) << 4;
+                        CONTEXT |= (pd>>9) & 0x3E0; /* next 5 pixels */
+                    }
                     bit = jbig2_arith_decode(ctx, as, &GB_stats[CONTEXT]);
                     if (bit < 0)
                         return jbig2_error(ctx, JBIG2_SEVERITY_WARNING, segment->number, "failed to decode arithmetic code when handling generic template3 TPGDON2");
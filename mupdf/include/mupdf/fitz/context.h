@@ -33,6 +33,8 @@ typedef struct fz_style_context fz_style_context;
 typedef struct fz_tuning_context fz_tuning_context;
 typedef struct fz_store fz_store;
 typedef struct fz_glyph_cache fz_glyph_cache;
+typedef struct fz_pixmap_pool fz_pixmap_pool;
+typedef struct fz_arena fz_arena;
 typedef struct fz_document_handler_context fz_document_handler_context;
 typedef struct fz_output fz_output;
 typedef struct fz_context fz_context;
@@ -365,6 +367,152 @@ void fz_tune_image_decode(fz_context *ctx, fz_tune_image_decode_fn *image_decode
 */
 void fz_tune_image_scale(fz_context *ctx, fz_tune_image_scale_fn *image_scale, void *arg);
 
+/**
+	Set the number of worker threads openjpeg may use to decode
+	the tiles and code-blocks of a JPEG 2000 image.
+
+	threads: 0 or 1 (the default) to decode on the calling thread
+	only. Values larger than the number of CPUs are clamped.
+	Ignored if openjpeg was built without thread support, for
+	small images, and for contexts without locking (each worker
+	thread allocates through its own clone of the context).
+*/
+void fz_tune_jpx_threads(fz_context *ctx, int threads);
+
+/**
+	Read the number of JPEG 2000 decoding threads set by
+	fz_tune_jpx_threads.
+*/
+int fz_jpx_threads(fz_context *ctx);
+
+/**
+	Enable caching of interpreted content streams.
+
+	When enabled, document handlers may record content that is run
+	repeatedly with the same state (PDF Form XObjects and pattern
+	cells) into display lists held in the store, and replay those
+	instead of interpreting the content again.
+
+	enable: 0 (the default) to disable, 1 to enable.
+*/
+void fz_tune_content_caching(fz_context *ctx, int enable);
+
+/**
+	Read the setting made by fz_tune_content_caching.
+*/
+int fz_content_caching(fz_context *ctx);
+
+/**
+	Enable caching of rendered soft masks.
+
+	When enabled, document handlers give the soft masks they run an
+	id (see fz_begin_mask_id), and the draw device keeps the masks
+	it renders in the store. Drawing the same mask at the same
+	transform again (for the next object it applies to, or for
+	another tile of the page) then reuses the stored mask instead
+	of rendering its contents again.
+
+	enable: 0 (the default) to disable, 1 to enable.
+*/
+void fz_tune_mask_caching(fz_context *ctx, int enable);
+
+/**
+	Read the setting made by fz_tune_mask_caching.
+*/
+int fz_mask_caching(fz_context *ctx);
+
+/**
+	Run count independent tasks and return once all of them have
+	completed.
+
+	arg: The caller supplied opaque argument.
+
+	count: The number of tasks.
+
+	task: Function to call once for each i in 0..count-1. It may be
+	called from any thread, in any order, and must not throw.
+
+	task_arg: Opaque argument to be passed to task.
+*/
+typedef void (fz_tune_parallel_fn)(void *arg, int count, void (*task)(void *task_arg, int i), void *task_arg);
+
+/**
+	Set the function used to run independent tasks in parallel.
+
+	MuPDF has no threads of its own; without this function, such
+	tasks are run one after another on the calling thread. Tasks
+	only use contexts made by fz_clone_context, so this has no
+	effect unless the context was created with locking functions.
+
+	parallel: Function to use, or NULL for the default.
+
+	arg: Opaque argument to be passed to parallel.
+*/
+void fz_tune_parallel(fz_context *ctx, fz_tune_parallel_fn *parallel, void *arg);
+
+/**
+	Return 1 if a function to run tasks in parallel has been set
+	with fz_tune_parallel, 0 otherwise.
+*/
+int fz_has_parallel(fz_context *ctx);
+
+/**
+	Run count tasks through the function set with
+	fz_tune_parallel, or one after another if there is none.
+*/
+void fz_run_parallel(fz_context *ctx, int count, void (*task)(void *task_arg, int i), void *task_arg);
+
+/**
+	Enable allocating the paths, texts and stroke states made while
+	running a page from a per-run arena.
+
+	Vector heavy pages make and drop these objects by the tens of
+	thousands. From an arena they are recycled through per-size
+	free lists, and the memory is released in bulk once the run has
+	ended and the last of them (some may be kept by display lists)
+	has been dropped.
+
+	enable: 0 (the default) to disable, 1 to enable.
+*/
+void fz_tune_run_arena(fz_context *ctx, int enable);
+
+/**
+	Read the setting made by fz_tune_run_arena.
+*/
+int fz_run_arena(fz_context *ctx);
+
+/**
+	Begin and end a run that allocates from an arena, if enabled
+	by fz_tune_run_arena.
+
+	Runs may nest; only the outermost one creates and ends the
+	arena. Every call to fz_begin_run_arena must be matched by a
+	call to fz_end_run_arena on the same context.
+*/
+void fz_begin_run_arena(fz_context *ctx);
+void fz_end_run_arena(fz_context *ctx);
+
+/**
+	Enable caching of text shaping results.
+
+	Reflowable documents (HTML, EPUB, FB2, ...) shape every run of
+	text each time they are laid out, and the same words occur over
+	and over. When enabled, the results are kept in a cache shared
+	by all documents (see fz_find_shaped_text), and laying the
+	document out again, for instance at another font size, reuses
+	them instead of shaping the text again.
+
+	max_size: The maximum number of bytes to use for the cache,
+	evicting the least recently used results when full. 0 (the
+	default) to disable.
+*/
+void fz_tune_shape_caching(fz_context *ctx, size_t max_size);
+
+/**
+	Read the setting made by fz_tune_shape_caching.
+*/
+size_t fz_shape_caching(fz_context *ctx);
+
 /**
 	Get the number of bits of antialiasing we are
 	using (for graphics). Between 0 and 8.
@@ -638,6 +786,7 @@ struct fz_context
 	int icc_enabled;
 #endif
 	int throw_on_repair;
+	fz_arena *arena;
 
 	/* TODO: should these be unshared? */
 	fz_document_handler_context *handler;
@@ -650,6 +799,7 @@ struct fz_context
 	fz_colorspace_context *colorspace;
 	fz_store *store;
 	fz_glyph_cache *glyph_cache;
+	fz_pixmap_pool *pixmap_pool;
 };
 
 fz_context *fz_new_context_imp(const fz_alloc_context *alloc, const fz_locks_context *locks, size_t max_store, const char *version);
@@ -180,6 +180,9 @@ struct fz_device
 	int container_len;
 	int container_cap;
 	fz_device_container_stack *container;
+
+	/* Optional, called instead of begin_mask if set (see fz_begin_mask_id). */
+	int (*begin_mask_id)(fz_context *, fz_device *, fz_rect area, int luminosity, fz_colorspace *, const float *bc, fz_color_params, fz_matrix ctm, int id);
 };
 
 /**
@@ -211,6 +214,16 @@ void fz_set_default_colorspaces(fz_context *ctx, fz_device *dev, fz_default_colo
 void fz_begin_layer(fz_context *ctx, fz_device *dev, const char *layer_name);
 void fz_end_layer(fz_context *ctx, fz_device *dev);
 
+/**
+	Begin a mask that the device may cache, as fz_begin_mask.
+
+	id identifies the contents of the mask (see fz_new_store_id),
+	which are drawn with the transform ctm; 0 disables caching. If
+	the device already has the mask, 1 is returned and the caller
+	must skip the contents, but still call fz_end_mask.
+*/
+int fz_begin_mask_id(fz_context *ctx, fz_device *dev, fz_rect area, int luminosity, fz_colorspace *colorspace, const float *bc, fz_color_params color_params, fz_matrix ctm, int id);
+
 /**
 	Devices are created by calls to device implementations, for
 	instance: foo_new_device(). These will be implemented by calling
@@ -326,6 +339,50 @@ typedef struct
 */
 fz_device *fz_new_trace_device(fz_context *ctx, fz_output *out);
 
+/**
+	Create a device that passes all calls through to target (which
+	may be NULL), timing each of them and measuring the area of its
+	bounding box in device space (clipped). Results are aggregated by operation
+	class (fill_path, stroke_path, clip, text, image, shade, group,
+	mask and tile) for the whole run and for each XObject run.
+
+	Images are decoded ahead of being passed on, so that decoding
+	and painting times are reported separately.
+
+	The target is neither closed nor dropped by this device.
+*/
+fz_device *fz_new_profile_device(fz_context *ctx, fz_device *target);
+
+/**
+	Tell a profile device that the contents of an XObject are
+	about to be run, or have been run. Interpreters call these for
+	every device; they do nothing for other devices.
+
+	num: The object number, used to aggregate repeated runs.
+
+	name: The resource name, or NULL.
+*/
+void fz_profile_begin_xobject(fz_context *ctx, fz_device *dev, int num, const char *name);
+void fz_profile_end_xobject(fz_context *ctx, fz_device *dev);
+
+/**
+	Write the results gathered by a closed profile device as a
+	JSON object. Times are in milliseconds and areas in pixels.
+*/
+void fz_write_profile_json(fz_context *ctx, fz_device *dev, fz_output *out);
+
+/**
+	Create a device that passes all calls on to both first and
+	second, e.g. to draw a page and record it into a display list
+	in a single run.
+
+	A tile or a mask that only one of the targets has cached is
+	run for the other target only.
+
+	The targets are neither closed nor dropped by this device.
+*/
+fz_device *fz_new_tee_device(fz_context *ctx, fz_device *first, fz_device *second);
+
 /**
 	Create a device to output raw information.
 */
@@ -27,6 +27,8 @@
 #include "mupdf/fitz/context.h"
 #include "mupdf/fitz/geometry.h"
 #include "mupdf/fitz/device.h"
+#include "mupdf/fitz/output.h"
+#include "mupdf/fitz/stream.h"
 
 /**
 	Display list device -- record and play back device commands.
@@ -139,4 +141,40 @@ fz_image *fz_new_image_from_display_list(fz_context *ctx, float w, float h, fz_d
 */
 int fz_display_list_is_empty(fz_context *ctx, const fz_display_list *list);
 
+/**
+	Return the approximate number of bytes used by a display list,
+	not counting the objects (images, fonts, text) it references.
+*/
+size_t fz_display_list_size(fz_context *ctx, const fz_display_list *list);
+
+/**
+	Write a display list to an output in a compact binary format,
+	so that it can be replayed later without interpreting the page
+	again.
+
+	Fonts, images, colorspaces and shadings are written once, along
+	with a digest of their contents by which fz_read_display_list
+	finds them in the store when they were read before.
+
+	blob_dir: If not NULL, a directory in which larger font, image
+	and ICC profile data is kept in files named by their digest,
+	so that it is written only once for all the lists referring to
+	it. The same directory must be given when reading the list.
+
+	Throws if the list uses something that cannot be serialized
+	(Type 3 fonts, Separation and DeviceN colorspaces). The output
+	should then be discarded.
+*/
+void fz_write_display_list(fz_context *ctx, fz_output *out, fz_display_list *list, const char *blob_dir);
+
+/**
+	Read a display list written by fz_write_display_list.
+
+	blob_dir: The directory given when writing the list.
+
+	Throws if the data is corrupt, or refers to a blob file that is
+	missing or damaged.
+*/
+fz_display_list *fz_read_display_list(fz_context *ctx, fz_stream *stm, const char *blob_dir);
+
 #endif
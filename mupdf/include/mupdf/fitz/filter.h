@@ -219,6 +219,13 @@ void fz_drop_jbig2_globals_imp(fz_context *ctx, fz_storable *globals);
 */
 fz_buffer * fz_jbig2_globals_data(fz_context *ctx, fz_jbig2_globals *globals);
 
+/**
+	Return the approximate number of bytes held by a jbig2 globals
+	record, including the decoded symbol dictionaries and the
+	source data.
+*/
+size_t fz_jbig2_globals_size(fz_context *ctx, fz_jbig2_globals *globals);
+
 /* Extra filters for tiff */
 
 /**
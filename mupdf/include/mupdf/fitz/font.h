@@ -646,6 +646,59 @@ float fz_font_descender(fz_context *ctx, fz_font *font);
 */
 void fz_font_digest(fz_context *ctx, fz_font *font, unsigned char digest[16]);
 
+/**
+	Look up the result of shaping a run of text with a font in the
+	shaping cache (see fz_tune_shape_caching).
+
+	Shaping is done in font units, so the result does not depend on
+	the font size. Results are found by the digest of the font data,
+	so that they are shared by all documents using the same font.
+
+	params: Opaque value identifying the other inputs of the shaping
+	(direction, script, language, features, ...).
+
+	text, len: The UTF-8 text that was shaped.
+
+	value, max: Buffer to copy the result into. Nothing is copied if
+	the result is larger than max.
+
+	Returns the size of the result, or 0 if it is not in the cache.
+*/
+size_t fz_find_shaped_text(fz_context *ctx, fz_font *font, int params, const char *text, size_t len, void *value, size_t max);
+
+/**
+	Store the result of shaping a run of text with a font in the
+	shaping cache, evicting the least recently used results if the
+	cache grows larger than the size set by fz_tune_shape_caching.
+
+	Caching is best effort: this never throws, and does nothing if
+	caching is disabled or the font has no data to take a digest of.
+*/
+void fz_store_shaped_text(fz_context *ctx, fz_font *font, int params, const char *text, size_t len, const void *value, size_t size);
+
+/**
+	Drop all results from the shaping cache.
+*/
+void fz_purge_shape_cache(fz_context *ctx);
+
+typedef struct
+{
+	int hits;
+	int misses;
+	int evicted;
+	int count;
+	size_t size;
+	size_t max_size;
+} fz_shape_cache_stats;
+
+/**
+	Read the number of lookups that found (hits) and did not find
+	(misses) a result in the shaping cache, the number of results
+	evicted to keep it within its maximum size, and the number and
+	total size of the results currently held.
+*/
+void fz_read_shape_cache_stats(fz_context *ctx, fz_shape_cache_stats *stats);
+
 /* Implementation details: subject to change. */
 
 void fz_decouple_type3_font(fz_context *ctx, fz_font *font, void *t3doc);
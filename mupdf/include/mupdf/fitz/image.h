@@ -412,6 +412,13 @@ void fz_set_pixmap_image_tile(fz_context *ctx, fz_pixmap_image *cimg, fz_pixmap
 */
 fz_pixmap *fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *cs);
 
+/**
+	Exposed for PDF. Reads the dimensions and the number of color
+	and alpha components from the header of a JPX image, without
+	decoding it.
+*/
+void fz_load_jpx_header(fz_context *ctx, const unsigned char *data, size_t size, int *w, int *h, int *n, int *alpha);
+
 /**
 	Exposed for CBZ.
 */
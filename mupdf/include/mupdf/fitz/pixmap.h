@@ -435,9 +435,72 @@ struct fz_pixmap
 enum
 {
 	FZ_PIXMAP_FLAG_INTERPOLATE = 1,
-	FZ_PIXMAP_FLAG_FREE_SAMPLES = 2
+	FZ_PIXMAP_FLAG_FREE_SAMPLES = 2,
+	FZ_PIXMAP_FLAG_POOLED_SAMPLES = 4
 };
 
+/**
+	Set the maximum number of bytes of pixmap sample buffers kept
+	for reuse in the pixmap pool.
+
+	Sample buffers of 64K and more are then returned to the pool
+	when their pixmap is dropped, instead of being freed, and new
+	pixmaps of about the same size take them from there. Rendering
+	tile after tile, and the transparency groups and soft masks of
+	the draw device, then reuse memory that is already mapped
+	rather than faulting in fresh buffers each time.
+
+	Buffers are pooled in size classes a quarter of a power of two
+	apart, and the least recently returned ones are freed first
+	when the pool is full. The pool is shared between a context and
+	its clones, is emptied when an allocation fails, and is disabled
+	(max 0) by default.
+*/
+void fz_set_pixmap_pool_size(fz_context *ctx, size_t max);
+
+/**
+	Free all the sample buffers in the pixmap pool.
+*/
+void fz_empty_pixmap_pool(fz_context *ctx);
+
+/**
+	Statistics of the pixmap pool.
+
+	max: The maximum size of the pool.
+
+	count, size: The number of buffers in the pool and their total
+	size (including the bookkeeping overhead of each buffer).
+
+	hits: Number of pixmaps that reused a pooled buffer.
+
+	misses: Number of pixmaps for which a buffer of their size class
+	had to be allocated.
+
+	returned: Number of buffers returned to the pool.
+
+	discarded: Number of buffers freed on return because they were
+	larger than the pool.
+
+	evicted: Number of pooled buffers freed to make space for others,
+	or because the pool was shrunk or emptied.
+*/
+typedef struct
+{
+	size_t max;
+	int count;
+	size_t size;
+	int hits;
+	int misses;
+	int returned;
+	int discarded;
+	int evicted;
+} fz_pixmap_pool_stats;
+
+/**
+	Read the statistics of the pixmap pool.
+*/
+void fz_get_pixmap_pool_stats(fz_context *ctx, fz_pixmap_pool_stats *stats);
+
 /* Create a new pixmap from a warped section of another.
  *
  * Colorspace, resolution etc are inherited from the original.
@@ -301,6 +301,28 @@ void fz_drop_store_context(fz_context *ctx);
 */
 void *fz_store_item(fz_context *ctx, void *key, void *val, size_t itemsize, const fz_store_type *type);
 
+/**
+	Add an item to the store, recording how expensive it was to
+	produce.
+
+	As fz_store_item, but with an additional cost value that
+	eviction policies (see fz_set_store_eviction_policy) can weigh
+	against the size of the item. Costs are in abstract units of
+	"work required to produce one byte of a trivially decoded
+	value"; an item stored with a cost of 0 is assumed to cost the
+	same as its size.
+*/
+void *fz_store_item_with_cost(fz_context *ctx, void *key, void *val, size_t itemsize, float cost, const fz_store_type *type);
+
+/**
+	Generate a non-zero id for use in keys of items in the store.
+
+	Ids are unique among the contexts sharing the store (until
+	INT_MAX of them have been given out), so a key holding one
+	cannot match items stored for anything else.
+*/
+int fz_new_store_id(fz_context *ctx);
+
 /**
 	Find an item within the store.
 
@@ -390,6 +412,101 @@ typedef int (fz_store_filter_fn)(fz_context *ctx, void *arg, void *key);
 */
 void fz_filter_store(fz_context *ctx, fz_store_filter_fn *fn, void *arg, const fz_store_type *type);
 
+/**
+	Information about a store item passed to eviction policies.
+
+	size: The size of the item as counted towards the store size.
+
+	cost: The cost of recreating the item (see
+	fz_store_item_with_cost); never 0.
+
+	hits: The number of times the item has been found in the store
+	since it was stored.
+
+	age: The number of store accesses since the item was last
+	stored or found.
+*/
+typedef struct
+{
+	const fz_store_type *type;
+	size_t size;
+	float cost;
+	int hits;
+	unsigned int age;
+} fz_store_item_info;
+
+/**
+	Callback function used to rank evictable items.
+
+	When the store makes room for a new item, every evictable item
+	is scored once, without the alloc lock held. When scavenging
+	memory for a failed allocation, the callback is called with the
+	alloc lock held, so it must never allocate or call back into
+	the store. Items with the lowest score are evicted first.
+*/
+typedef float (fz_store_score_fn)(fz_context *ctx, void *arg, const fz_store_item_info *info);
+
+/**
+	Install an eviction policy for the store.
+
+	By default (score == NULL), the store evicts least recently
+	used items first. With a policy installed, whenever the store
+	needs to make space it evicts the evictable item with the
+	lowest score instead.
+*/
+void fz_set_store_eviction_policy(fz_context *ctx, fz_store_score_fn *score, void *arg);
+
+/**
+	Cost/benefit eviction policy.
+
+	Scores an item by the cost of recreating it, weighted by how
+	often it has been reused, per byte it occupies, decaying with
+	age. Cheap, large, stale items go first; expensive images that
+	are reused (e.g. on scroll-back) are kept.
+*/
+float fz_store_cost_benefit_score(fz_context *ctx, void *arg, const fz_store_item_info *info);
+
+/**
+	Per type store statistics.
+
+	stored: Number of items of this type put into the store.
+
+	hits: Number of successful lookups.
+
+	evicted: Number of items evicted to make space (either by the
+	eviction policy or by scavenging).
+
+	recreated: Number of items stored again after having been
+	evicted (i.e. the number of re-decodes caused by eviction).
+
+	count, size: Number of items and their total size currently
+	in the store.
+*/
+typedef struct
+{
+	const char *name;
+	int stored;
+	int hits;
+	int evicted;
+	int recreated;
+	int count;
+	size_t size;
+} fz_store_type_stats;
+
+/**
+	Read the per type statistics of the store.
+
+	Fills in up to max entries of stats, and returns the number of
+	types for which statistics are kept.
+*/
+int fz_store_stats(fz_context *ctx, fz_store_type_stats *stats, int max);
+
+/**
+	Output the per type store statistics to the given output
+	channel.
+*/
+void fz_debug_store_stats(fz_context *ctx, fz_output *out);
+
 /**
 	Output debugging information for the current state of the store
 	to the given output channel.
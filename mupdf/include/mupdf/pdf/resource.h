@@ -30,9 +30,16 @@
 #include "mupdf/pdf/object.h"
 
 void pdf_store_item(fz_context *ctx, pdf_obj *key, void *val, size_t itemsize);
+void pdf_store_item_with_cost(fz_context *ctx, pdf_obj *key, void *val, size_t itemsize, float cost);
 void *pdf_find_item(fz_context *ctx, fz_store_drop_fn *drop, pdf_obj *key);
 void pdf_remove_item(fz_context *ctx, fz_store_drop_fn *drop, pdf_obj *key);
 void pdf_empty_store(fz_context *ctx, pdf_document *doc);
+
+/*
+	Remove the cached content stream display lists (see
+	fz_tune_content_caching) of a document from the store.
+*/
+void pdf_drop_contents_lists(fz_context *ctx, pdf_document *doc);
 void pdf_purge_locals_from_store(fz_context *ctx, pdf_document *doc);
 
 /*
@@ -55,6 +55,13 @@ struct fz_tuning_context
 	void *image_decode_arg;
 	fz_tune_image_scale_fn *image_scale;
 	void *image_scale_arg;
+	int jpx_threads;
+	int content_caching;
+	int mask_caching;
+	fz_tune_parallel_fn *parallel;
+	void *parallel_arg;
+	int run_arena;
+	size_t shape_cache_size;
 };
 
 void fz_default_image_decode(void *arg, int w, int h, int l2factor, fz_irect *subarea);
@@ -62,6 +69,37 @@ int fz_default_image_scale(void *arg, int dst_w, int dst_h, int src_w, int src_h
 
 void fz_init_aa_context(fz_context *ctx);
 
+void fz_new_pixmap_pool_context(fz_context *ctx);
+fz_pixmap_pool *fz_keep_pixmap_pool_context(fz_context *ctx);
+void fz_drop_pixmap_pool_context(fz_context *ctx);
+/* Free all pooled buffers; called with the alloc lock held. */
+int fz_scavenge_pixmap_pool(fz_context *ctx);
+
+/*
+	Allocate from the arena of the current run, or from the heap if
+	there is none. Either way the block carries a private header, so
+	it may only be reallocated by fz_arena_realloc and freed by
+	fz_arena_free. fz_arena_realloc takes the arena from owner if p
+	is NULL, and allocates from the heap if owner is NULL too.
+*/
+void *fz_arena_malloc(fz_context *ctx, size_t size);
+void *fz_arena_realloc(fz_context *ctx, void *owner, void *p, size_t size);
+void fz_arena_free(fz_context *ctx, void *p);
+
+/*
+	Whether a block from fz_arena_malloc came from a run arena rather
+	than the heap.
+*/
+int fz_is_arena_block(const void *p);
+
+/*
+	Keep a text or stroke state beyond the current run. Objects from
+	a run arena are copied to the heap instead, so that they do not
+	keep the chunks of their arena alive.
+*/
+fz_text *fz_keep_text_off_arena(fz_context *ctx, const fz_text *text);
+fz_stroke_state *fz_keep_stroke_state_off_arena(fz_context *ctx, const fz_stroke_state *stroke);
+
 void fz_new_glyph_cache_context(fz_context *ctx);
 fz_glyph_cache *fz_keep_glyph_cache(fz_context *ctx);
 void fz_drop_glyph_cache_context(fz_context *ctx);
@@ -126,6 +126,78 @@ void fz_tune_image_scale(fz_context *ctx, fz_tune_image_scale_fn *image_scale, v
 	ctx->tuning->image_scale_arg = arg;
 }
 
+void fz_tune_jpx_threads(fz_context *ctx, int threads)
+{
+	ctx->tuning->jpx_threads = threads > 0 ? threads : 0;
+}
+
+int fz_jpx_threads(fz_context *ctx)
+{
+	return ctx->tuning->jpx_threads;
+}
+
+void fz_tune_content_caching(fz_context *ctx, int enable)
+{
+	ctx->tuning->content_caching = !!enable;
+}
+
+int fz_content_caching(fz_context *ctx)
+{
+	return ctx->tuning->content_caching;
+}
+
+void fz_tune_mask_caching(fz_context *ctx, int enable)
+{
+	ctx->tuning->mask_caching = !!enable;
+}
+
+int fz_mask_caching(fz_context *ctx)
+{
+	return ctx->tuning->mask_caching;
+}
+
+void fz_tune_parallel(fz_context *ctx, fz_tune_parallel_fn *parallel, void *arg)
+{
+	ctx->tuning->parallel = parallel;
+	ctx->tuning->parallel_arg = arg;
+}
+
+int fz_has_parallel(fz_context *ctx)
+{
+	return ctx->tuning->parallel != NULL;
+}
+
+void fz_run_parallel(fz_context *ctx, int count, void (*task)(void *task_arg, int i), void *task_arg)
+{
+	int i;
+
+	if (ctx->tuning->parallel)
+		ctx->tuning->parallel(ctx->tuning->parallel_arg, count, task, task_arg);
+	else
+		for (i = 0; i < count; i++)
+			task(task_arg, i);
+}
+
+void fz_tune_run_arena(fz_context *ctx, int enable)
+{
+	ctx->tuning->run_arena = !!enable;
+}
+
+int fz_run_arena(fz_context *ctx)
+{
+	return ctx->tuning->run_arena;
+}
+
+void fz_tune_shape_caching(fz_context *ctx, size_t max_size)
+{
+	ctx->tuning->shape_cache_size = max_size;
+}
+
+size_t fz_shape_caching(fz_context *ctx)
+{
+	return ctx->tuning->shape_cache_size;
+}
+
 static void fz_init_random_context(fz_context *ctx)
 {
 	if (!ctx)
@@ -152,6 +224,7 @@ fz_drop_context(fz_context *ctx)
 	fz_drop_document_handler_context(ctx);
 	fz_drop_glyph_cache_context(ctx);
 	fz_drop_store_context(ctx);
+	fz_drop_pixmap_pool_context(ctx);
 	fz_drop_style_context(ctx);
 	fz_drop_tuning_context(ctx);
 	fz_drop_colorspace_context(ctx);
@@ -217,6 +290,7 @@ fz_new_context_imp(const fz_alloc_context *alloc, const fz_locks_context *locks,
 	/* Now initialise sections that are shared */
 	fz_try(ctx)
 	{
+		fz_new_pixmap_pool_context(ctx);
 		fz_new_store_context(ctx, max_store);
 		fz_new_glyph_cache_context(ctx);
 		fz_new_colorspace_context(ctx);
@@ -254,12 +328,16 @@ fz_clone_context(fz_context *ctx)
 	/* Reset error context to initial state. */
 	fz_init_error_context(new_ctx);
 
+	/* Runs on the new context do not share the arena of this one. */
+	new_ctx->arena = NULL;
+
 	/* Then keep lock checking happy by keeping shared contexts with new context */
 	fz_keep_document_handler_context(new_ctx);
 	fz_keep_style_context(new_ctx);
 	fz_keep_tuning_context(new_ctx);
 	fz_keep_font_context(new_ctx);
 	fz_keep_colorspace_context(new_ctx);
+	fz_keep_pixmap_pool_context(new_ctx);
 	fz_keep_store_context(new_ctx);
 	fz_keep_glyph_cache(new_ctx);
 
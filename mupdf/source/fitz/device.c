@@ -51,6 +51,7 @@ fz_disable_device(fz_context *ctx, fz_device *dev)
 	dev->clip_image_mask = NULL;
 	dev->pop_clip = NULL;
 	dev->begin_mask = NULL;
+	dev->begin_mask_id = NULL;
 	dev->end_mask = NULL;
 	dev->begin_group = NULL;
 	dev->end_group = NULL;
@@ -395,18 +396,34 @@ fz_clip_image_mask(fz_context *ctx, fz_device *dev, fz_image *image, fz_matrix c
 void
 fz_begin_mask(fz_context *ctx, fz_device *dev, fz_rect area, int luminosity, fz_colorspace *colorspace, const float *bc, fz_color_params color_params)
 {
+	(void)fz_begin_mask_id(ctx, dev, area, luminosity, colorspace, bc, color_params, fz_identity, 0);
+}
+
+int
+fz_begin_mask_id(fz_context *ctx, fz_device *dev, fz_rect area, int luminosity, fz_colorspace *colorspace, const float *bc, fz_color_params color_params, fz_matrix ctm, int id)
+{
+	int result = 0;
+
 	push_clip_stack(ctx, dev, area, fz_device_container_stack_is_mask);
 
-	if (dev->begin_mask)
+	if (dev->begin_mask_id || dev->begin_mask)
 	{
 		fz_try(ctx)
-			dev->begin_mask(ctx, dev, area, luminosity, colorspace, bc, color_params);
+		{
+			/* Devices that don't cache masks get their contents every time. */
+			if (dev->begin_mask_id)
+				result = dev->begin_mask_id(ctx, dev, area, luminosity, colorspace, bc, color_params, ctm, id);
+			else
+				dev->begin_mask(ctx, dev, area, luminosity, colorspace, bc, color_params);
+		}
 		fz_catch(ctx)
 		{
 			fz_disable_device(ctx, dev);
 			fz_rethrow(ctx);
 		}
 	}
+
+	return result;
 }
 
 void
@@ -61,6 +61,7 @@ typedef struct {
 	fz_matrix ctm;
 	float xstep, ystep;
 	fz_irect area;
+	unsigned char digest[16]; /* of a mask to be cached */
 } fz_draw_state;
 
 typedef struct fz_draw_device
@@ -2145,8 +2146,165 @@ fz_draw_pop_clip(fz_context *ctx, fz_device *devp)
 	}
 }
 
+/*
+ * Cache of rendered soft masks.
+ *
+ * A mask with an id is kept in the store once it has been converted
+ * to an alpha mask. Such masks are drawn over their whole area
+ * rather than only the part within the scissor (unless that would
+ * be larger than MAX_CACHED_MASK_AREA pixels), so that renders of
+ * other tiles of the page find them too.
+ */
+
+#define MAX_CACHED_MASK_AREA (4 << 20)
+
+typedef struct
+{
+	int refs;
+	int id;
+	/* Digest of the transform, bbox and everything else about the
+	 * device that the rendered mask depends on. */
+	unsigned char digest[16];
+} mask_key;
+
+static int
+fz_make_hash_mask_key(fz_context *ctx, fz_store_hash *hash, void *key_)
+{
+	mask_key *key = key_;
+
+	hash->u.pir.ptr = NULL;
+	hash->u.pir.i = key->id;
+	memcpy(&hash->u.pir.r, key->digest, sizeof(hash->u.pir.r));
+	return 1;
+}
+
+static void *
+fz_keep_mask_key(fz_context *ctx, void *key_)
+{
+	mask_key *key = key_;
+	return fz_keep_imp(ctx, key, &key->refs);
+}
+
+static void
+fz_drop_mask_key(fz_context *ctx, void *key_)
+{
+	mask_key *key = key_;
+	if (fz_drop_imp(ctx, key, &key->refs))
+		fz_free(ctx, key);
+}
+
+static int
+fz_cmp_mask_key(fz_context *ctx, void *k0_, void *k1_)
+{
+	mask_key *k0 = k0_;
+	mask_key *k1 = k1_;
+	if (k0->id != k1->id)
+		return 1;
+	return memcmp(k0->digest, k1->digest, sizeof(k0->digest));
+}
+
 static void
-fz_draw_begin_mask(fz_context *ctx, fz_device *devp, fz_rect area, int luminosity, fz_colorspace *colorspace_in, const float *colorfv, fz_color_params color_params)
+fz_format_mask_key(fz_context *ctx, char *s, size_t n, void *key_)
+{
+	mask_key *key = (mask_key *)key_;
+	fz_snprintf(s, n, "(mask id=%x)", key->id);
+}
+
+static const fz_store_type fz_mask_store_type =
+{
+	"fz_mask",
+	fz_make_hash_mask_key,
+	fz_keep_mask_key,
+	fz_drop_mask_key,
+	fz_cmp_mask_key,
+	fz_format_mask_key,
+	NULL
+};
+
+/*
+	Decide on the bbox of a mask with an id, and look for it in the
+	store. If it is there, set up state[1] to use it and return 1.
+	Otherwise make state[1] cache the mask once it is drawn.
+*/
+static int
+fz_draw_find_mask(fz_context *ctx, fz_draw_device *dev, fz_draw_state *state, fz_rect trect, fz_irect *bbox, int luminosity, int bc, fz_matrix ctm, int id)
+{
+	fz_irect full = fz_irect_from_rect(trect);
+	unsigned int w = fz_irect_width(full);
+	unsigned int h = fz_irect_height(full);
+	int graphics_aa = fz_rasterizer_graphics_aa_level(dev->rast);
+	int text_aa = fz_rasterizer_text_aa_level(dev->rast);
+	float min_line_width = fz_rasterizer_graphics_min_line_width(dev->rast);
+	mask_key key;
+	fz_pixmap *mask;
+	fz_md5 md5;
+
+	if (fz_is_empty_irect(*bbox))
+		return 0;
+	if (w > 0 && h > 0 && (double)w * h <= MAX_CACHED_MASK_AREA)
+		*bbox = full;
+
+	ctm = fz_concat(ctm, dev->transform);
+	fz_md5_init(&md5);
+	fz_md5_update(&md5, (const unsigned char *)&ctm, sizeof(ctm));
+	fz_md5_update(&md5, (const unsigned char *)bbox, sizeof(*bbox));
+	fz_md5_update(&md5, (const unsigned char *)&luminosity, sizeof(luminosity));
+	fz_md5_update(&md5, (const unsigned char *)&bc, sizeof(bc));
+	fz_md5_update(&md5, (const unsigned char *)&dev->flags, sizeof(dev->flags));
+	fz_md5_update(&md5, (const unsigned char *)&graphics_aa, sizeof(graphics_aa));
+	fz_md5_update(&md5, (const unsigned char *)&text_aa, sizeof(text_aa));
+	fz_md5_update(&md5, (const unsigned char *)&min_line_width, sizeof(min_line_width));
+	fz_md5_final(&md5, state[1].digest);
+
+	key.refs = 1;
+	key.id = id;
+	memcpy(key.digest, state[1].digest, sizeof(key.digest));
+	mask = fz_find_item(ctx, fz_drop_pixmap_imp, &key, &fz_mask_store_type);
+	if (mask)
+	{
+		/* There is nothing to draw; fz_draw_end_mask takes the
+		 * missing dest to mean that mask is complete. */
+		state[1].dest = NULL;
+		state[1].shape = NULL;
+		state[1].group_alpha = NULL;
+		state[1].mask = mask;
+		state[1].scissor = *bbox;
+		return 1;
+	}
+
+	state[1].id = id;
+	state[1].encache = 1;
+	return 0;
+}
+
+static void
+fz_draw_store_mask(fz_context *ctx, fz_draw_state *state, fz_pixmap *mask)
+{
+	mask_key *key = NULL;
+	size_t size = fz_pixmap_size(ctx, mask);
+
+	fz_var(key);
+
+	fz_try(ctx)
+	{
+		key = fz_malloc_struct(ctx, mask_key);
+		key->refs = 1;
+		key->id = state->id;
+		memcpy(key->digest, state->digest, sizeof(key->digest));
+		/* Weigh masks like other cached content, as getting them
+		 * back means running their contents again. */
+		fz_drop_pixmap(ctx, fz_store_item_with_cost(ctx, key, mask, size, 4.0f * size, &fz_mask_store_type));
+	}
+	fz_always(ctx)
+		fz_drop_mask_key(ctx, key);
+	fz_catch(ctx)
+	{
+		/* Do nothing; the mask is just not cached */
+	}
+}
+
+static int
+fz_draw_begin_mask_id(fz_context *ctx, fz_device *devp, fz_rect area, int luminosity, fz_colorspace *colorspace_in, const float *colorfv, fz_color_params color_params, fz_matrix ctm, int id)
 {
 	fz_draw_device *dev = (fz_draw_device*)devp;
 	fz_pixmap *dest;
@@ -2156,6 +2314,7 @@ fz_draw_begin_mask(fz_context *ctx, fz_device *devp, fz_rect area, int luminosit
 	fz_pixmap *group_alpha = state->group_alpha;
 	fz_rect trect;
 	fz_colorspace *colorspace = NULL;
+	float bc = 0;
 
 	if (dev->top == 0 && dev->resolve_spots)
 		state = push_group_for_separations(ctx, dev, color_params, dev->default_cs);
@@ -2169,6 +2328,23 @@ fz_draw_begin_mask(fz_context *ctx, fz_device *devp, fz_rect area, int luminosit
 	/* Reset the blendmode for the mask rendering. In particular,
 	 * don't carry forward knockout or isolated. */
 	state[1].blendmode = 0;
+	state[1].id = 0;
+	state[1].encache = 0;
+
+	if (luminosity)
+	{
+		if (!colorspace)
+			colorspace = fz_device_gray(ctx);
+		fz_convert_color(ctx, colorspace, colorfv, fz_device_gray(ctx), &bc, NULL, color_params);
+	}
+
+	if (id && fz_draw_find_mask(ctx, dev, state, trect, &bbox, luminosity, (int)(bc * 255), ctm, id))
+	{
+#ifdef DUMP_GROUP_BLENDS
+		dump_spaces(dev->top-1, "Mask begin (cached)\n");
+#endif
+		return 1;
+	}
 
 	/* If luminosity, then we generate a mask from the greyscale value of the shapes.
 	 * If !luminosity, then we generate a mask from the alpha value of the shapes.
@@ -2194,10 +2370,6 @@ fz_draw_begin_mask(fz_context *ctx, fz_device *devp, fz_rect area, int luminosit
 
 	if (luminosity)
 	{
-		float bc;
-		if (!colorspace)
-			colorspace = fz_device_gray(ctx);
-		fz_convert_color(ctx, colorspace, colorfv, fz_device_gray(ctx), &bc, NULL, color_params);
 		fz_clear_pixmap_with_value(ctx, dest, bc * 255);
 		if (shape)
 			fz_clear_pixmap_with_value(ctx, shape, 255);
@@ -2217,6 +2389,8 @@ fz_draw_begin_mask(fz_context *ctx, fz_device *devp, fz_rect area, int luminosit
 	dump_spaces(dev->top-1, "Mask begin\n");
 #endif
 	state[1].scissor = bbox;
+
+	return 0;
 }
 
 static void
@@ -2232,15 +2406,21 @@ fz_draw_end_mask(fz_context *ctx, fz_device *devp)
 
 	state = convert_stack(ctx, dev, "mask");
 
+	if (state[1].dest == NULL)
+	{
+		/* The mask came from the store */
+		temp = state[1].mask;
+	}
+	else
+	{
 #ifdef DUMP_GROUP_BLENDS
-	dump_spaces(dev->top-1, "Mask -> Clip: ");
-	fz_dump_blend(ctx, "Mask ", state[1].dest);
-	if (state[1].shape)
-		fz_dump_blend(ctx, "/S=", state[1].shape);
-	if (state[1].group_alpha)
-		fz_dump_blend(ctx, "/GA=", state[1].group_alpha);
+		dump_spaces(dev->top-1, "Mask -> Clip: ");
+		fz_dump_blend(ctx, "Mask ", state[1].dest);
+		if (state[1].shape)
+			fz_dump_blend(ctx, "/S=", state[1].shape);
+		if (state[1].group_alpha)
+			fz_dump_blend(ctx, "/GA=", state[1].group_alpha);
 #endif
-	{
 		/* convert to alpha mask */
 		temp = fz_alpha_from_gray(ctx, state[1].dest);
 		if (state[1].mask != state[0].mask)
@@ -2261,8 +2441,17 @@ fz_draw_end_mask(fz_context *ctx, fz_device *devp)
 		printf("\n");
 #endif
 
-		/* create new dest scratch buffer */
-		bbox = fz_pixmap_bbox(ctx, temp);
+		if (state[1].encache)
+		{
+			fz_draw_store_mask(ctx, &state[1], temp);
+			state[1].encache = 0;
+		}
+	}
+
+	{
+		/* create new dest scratch buffer; a cached mask can be
+		 * larger than the area we are drawing */
+		bbox = fz_intersect_irect(fz_pixmap_bbox(ctx, temp), state[0].scissor);
 		dest = fz_new_pixmap_with_bbox(ctx, state->dest->colorspace, bbox, state->dest->seps, state->dest->alpha);
 		fz_copy_pixmap_rect(ctx, dest, state->dest, bbox, dev->default_cs);
 
@@ -2996,7 +3185,7 @@ new_draw_device(fz_context *ctx, fz_matrix transform, fz_pixmap *dest, const fz_
 
 	dev->super.pop_clip = fz_draw_pop_clip;
 
-	dev->super.begin_mask = fz_draw_begin_mask;
+	dev->super.begin_mask_id = fz_draw_begin_mask_id;
 	dev->super.end_mask = fz_draw_end_mask;
 	dev->super.begin_group = fz_draw_begin_group;
 	dev->super.end_group = fz_draw_end_group;
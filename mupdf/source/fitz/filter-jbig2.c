@@ -28,6 +28,7 @@ typedef struct
 {
 	Jbig2Allocator alloc;
 	fz_context *ctx;
+	size_t used; /* bytes requested; an estimate, frees are not subtracted */
 } fz_jbig2_allocators;
 
 struct fz_jbig2_globals
@@ -36,6 +37,7 @@ struct fz_jbig2_globals
 	Jbig2GlobalCtx *gctx;
 	fz_jbig2_allocators alloc;
 	fz_buffer *data;
+	size_t size;
 };
 
 typedef struct
@@ -143,6 +145,7 @@ error_callback(void *data, const char *msg, Jbig2Severity severity, uint32_t seg
 static void *fz_jbig2_alloc(Jbig2Allocator *allocator, size_t size)
 {
 	fz_context *ctx = ((fz_jbig2_allocators *) allocator)->ctx;
+	((fz_jbig2_allocators *) allocator)->used += size;
 	return Memento_label(fz_malloc_no_throw(ctx, size), "jbig2_alloc");
 }
 
@@ -160,6 +163,7 @@ static void *fz_jbig2_realloc(Jbig2Allocator *allocator, void *p, size_t size)
 		fz_free(ctx, p);
 		return NULL;
 	}
+	((fz_jbig2_allocators *) allocator)->used += size;
 	if (p == NULL)
 		return Memento_label(fz_malloc(ctx, size), "jbig2_realloc");
 	return Memento_label(fz_realloc_no_throw(ctx, p, size), "jbig2_realloc");
@@ -194,6 +198,7 @@ fz_load_jbig2_globals(fz_context *ctx, fz_buffer *buf)
 	globals->gctx = jbig2_make_global_ctx(jctx);
 
 	globals->data = fz_keep_buffer(ctx, buf);
+	globals->size = sizeof(*globals) + globals->alloc.used + buf->len;
 
 	return globals;
 }
@@ -247,3 +252,9 @@ fz_jbig2_globals_data(fz_context *ctx, fz_jbig2_globals *globals)
 {
 	return globals ? globals->data : NULL;
 }
+
+size_t
+fz_jbig2_globals_size(fz_context *ctx, fz_jbig2_globals *globals)
+{
+	return globals ? globals->size : 0;
+}
@@ -300,6 +300,8 @@ float fz_font_descender(fz_context *ctx, fz_font *font)
  * Freetype hooks
  */
 
+typedef struct fz_shape_cache fz_shape_cache;
+
 struct fz_font_context
 {
 	int ctx_refs;
@@ -316,6 +318,9 @@ struct fz_font_context
 	struct { fz_font *serif, *sans; } fallback[256];
 	fz_font *symbol1, *symbol2, *math, *music;
 	fz_font *emoji;
+
+	/* Cached shaping results */
+	fz_shape_cache *shape_cache;
 };
 
 #undef __FTERRORS_H__
@@ -399,6 +404,8 @@ void fz_drop_font_context(fz_context *ctx)
 		fz_drop_font(ctx, ctx->font->math);
 		fz_drop_font(ctx, ctx->font->music);
 		fz_drop_font(ctx, ctx->font->emoji);
+		fz_purge_shape_cache(ctx);
+		fz_free(ctx, ctx->font->shape_cache);
 		fz_free(ctx, ctx->font);
 		ctx->font = NULL;
 	}
@@ -2087,3 +2094,248 @@ void fz_font_digest(fz_context *ctx, fz_font *font, unsigned char digest[16])
 	}
 	memcpy(digest, font->digest, 16);
 }
+
+/*
+ * Shaping cache
+ */
+
+#define SHAPE_HASH_LEN 4099
+
+typedef struct fz_shape_cache_entry fz_shape_cache_entry;
+
+struct fz_shape_cache_entry
+{
+	fz_shape_cache_entry *bucket_next;
+	fz_shape_cache_entry *lru_prev, *lru_next;
+	unsigned int hash;
+	unsigned char digest[16];
+	int index;
+	int params;
+	size_t text_len;
+	size_t value_len;
+	/* text_len bytes of text, followed by value_len bytes of value */
+	unsigned char data[1];
+};
+
+struct fz_shape_cache
+{
+	size_t total;
+	int hits;
+	int misses;
+	int evicted;
+	int count;
+	fz_shape_cache_entry *lru_head;
+	fz_shape_cache_entry *lru_tail;
+	fz_shape_cache_entry *bucket[SHAPE_HASH_LEN];
+};
+
+static unsigned int
+shape_hash(const unsigned char digest[16], int index, int params, const char *text, size_t len)
+{
+	unsigned int h = 2166136261u;
+	size_t i;
+	for (i = 0; i < 16; i++)
+		h = (h ^ digest[i]) * 16777619u;
+	h = (h ^ (unsigned int)index) * 16777619u;
+	h = (h ^ (unsigned int)params) * 16777619u;
+	for (i = 0; i < len; i++)
+		h = (h ^ (unsigned char)text[i]) * 16777619u;
+	return h;
+}
+
+static int
+shape_key(fz_context *ctx, fz_font *font, unsigned char digest[16], int *index)
+{
+	/* Only fonts we have the data for can be told apart by their digest. */
+	if (!font || !font->buffer || !font->ft_face)
+		return 0;
+	fz_font_digest(ctx, font, digest);
+	*index = (int)((FT_Face)font->ft_face)->face_index;
+	return 1;
+}
+
+static fz_shape_cache_entry *
+lookup_shape_cache_entry(fz_shape_cache *cache, unsigned int hash, const unsigned char digest[16], int index, int params, const char *text, size_t len)
+{
+	fz_shape_cache_entry *entry = cache->bucket[hash % SHAPE_HASH_LEN];
+	while (entry)
+	{
+		if (entry->hash == hash &&
+			entry->index == index &&
+			entry->params == params &&
+			entry->text_len == len &&
+			!memcmp(entry->digest, digest, 16) &&
+			!memcmp(entry->data, text, len))
+			return entry;
+		entry = entry->bucket_next;
+	}
+	return NULL;
+}
+
+/* Call with FZ_LOCK_FREETYPE held. Returns NULL if out of memory. */
+static fz_shape_cache *
+get_shape_cache(fz_context *ctx)
+{
+	if (!ctx->font->shape_cache)
+		ctx->font->shape_cache = fz_calloc_no_throw(ctx, 1, sizeof(fz_shape_cache));
+	return ctx->font->shape_cache;
+}
+
+static void
+unlink_shape_cache_lru(fz_shape_cache *cache, fz_shape_cache_entry *entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		cache->lru_head = entry->lru_next;
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_tail = entry->lru_prev;
+}
+
+static void
+link_shape_cache_lru(fz_shape_cache *cache, fz_shape_cache_entry *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_head;
+	if (cache->lru_head)
+		cache->lru_head->lru_prev = entry;
+	else
+		cache->lru_tail = entry;
+	cache->lru_head = entry;
+}
+
+static void
+drop_shape_cache_entry(fz_context *ctx, fz_shape_cache *cache, fz_shape_cache_entry *entry)
+{
+	fz_shape_cache_entry **pp = &cache->bucket[entry->hash % SHAPE_HASH_LEN];
+	while (*pp != entry)
+		pp = &(*pp)->bucket_next;
+	*pp = entry->bucket_next;
+	unlink_shape_cache_lru(cache, entry);
+	cache->total -= sizeof(fz_shape_cache_entry) + entry->text_len + entry->value_len;
+	cache->count--;
+	fz_free(ctx, entry);
+}
+
+size_t
+fz_find_shaped_text(fz_context *ctx, fz_font *font, int params, const char *text, size_t len, void *value, size_t max)
+{
+	fz_shape_cache *cache;
+	fz_shape_cache_entry *entry;
+	unsigned char digest[16];
+	unsigned int hash;
+	size_t found = 0;
+	int index;
+
+	if (fz_shape_caching(ctx) == 0 || !shape_key(ctx, font, digest, &index))
+		return 0;
+	hash = shape_hash(digest, index, params, text, len);
+
+	fz_lock(ctx, FZ_LOCK_FREETYPE);
+	cache = get_shape_cache(ctx);
+	entry = cache ? lookup_shape_cache_entry(cache, hash, digest, index, params, text, len) : NULL;
+	if (entry)
+	{
+		unlink_shape_cache_lru(cache, entry);
+		link_shape_cache_lru(cache, entry);
+		found = entry->value_len;
+		if (found <= max)
+			memcpy(value, entry->data + entry->text_len, found);
+		cache->hits++;
+	}
+	else if (cache)
+		cache->misses++;
+	fz_unlock(ctx, FZ_LOCK_FREETYPE);
+
+	return found;
+}
+
+void
+fz_store_shaped_text(fz_context *ctx, fz_font *font, int params, const char *text, size_t len, const void *value, size_t size)
+{
+	fz_shape_cache *cache;
+	fz_shape_cache_entry *entry;
+	unsigned char digest[16];
+	unsigned int hash;
+	size_t max_size = fz_shape_caching(ctx);
+	size_t entry_size = sizeof(fz_shape_cache_entry) + len + size;
+	int index;
+
+	/* Don't let a single result take up more than a small part of the cache. */
+	if (max_size == 0 || entry_size > max_size / 16)
+		return;
+	if (!shape_key(ctx, font, digest, &index))
+		return;
+	hash = shape_hash(digest, index, params, text, len);
+
+	/* Caching is best effort; quietly give up if we run out of memory. */
+	entry = fz_malloc_no_throw(ctx, entry_size);
+	if (!entry)
+		return;
+	entry->hash = hash;
+	memcpy(entry->digest, digest, 16);
+	entry->index = index;
+	entry->params = params;
+	entry->text_len = len;
+	entry->value_len = size;
+	memcpy(entry->data, text, len);
+	memcpy(entry->data + len, value, size);
+
+	fz_lock(ctx, FZ_LOCK_FREETYPE);
+	cache = get_shape_cache(ctx);
+	if (!cache || lookup_shape_cache_entry(cache, hash, digest, index, params, text, len))
+	{
+		/* Out of memory, or another thread got there first. */
+		fz_unlock(ctx, FZ_LOCK_FREETYPE);
+		fz_free(ctx, entry);
+		return;
+	}
+
+	entry->bucket_next = cache->bucket[hash % SHAPE_HASH_LEN];
+	cache->bucket[hash % SHAPE_HASH_LEN] = entry;
+	link_shape_cache_lru(cache, entry);
+	cache->total += entry_size;
+	cache->count++;
+
+	while (cache->total > max_size && cache->lru_tail != entry)
+	{
+		drop_shape_cache_entry(ctx, cache, cache->lru_tail);
+		cache->evicted++;
+	}
+	fz_unlock(ctx, FZ_LOCK_FREETYPE);
+}
+
+void
+fz_purge_shape_cache(fz_context *ctx)
+{
+	fz_shape_cache *cache;
+
+	fz_lock(ctx, FZ_LOCK_FREETYPE);
+	cache = ctx->font->shape_cache;
+	if (cache)
+		while (cache->lru_tail)
+			drop_shape_cache_entry(ctx, cache, cache->lru_tail);
+	fz_unlock(ctx, FZ_LOCK_FREETYPE);
+}
+
+void
+fz_read_shape_cache_stats(fz_context *ctx, fz_shape_cache_stats *stats)
+{
+	fz_shape_cache *cache;
+
+	memset(stats, 0, sizeof *stats);
+	fz_lock(ctx, FZ_LOCK_FREETYPE);
+	cache = ctx->font->shape_cache;
+	if (cache)
+	{
+		stats->hits = cache->hits;
+		stats->misses = cache->misses;
+		stats->evicted = cache->evicted;
+		stats->count = cache->count;
+		stats->size = cache->total;
+	}
+	fz_unlock(ctx, FZ_LOCK_FREETYPE);
+	stats->max_size = fz_shape_caching(ctx);
+}
@@ -32,6 +32,10 @@ fz_pixmap *fz_load_bmp(fz_context *ctx, const unsigned char *data, size_t size);
 fz_pixmap *fz_load_pnm(fz_context *ctx, const unsigned char *data, size_t size);
 fz_pixmap *fz_load_jbig2(fz_context *ctx, const unsigned char *data, size_t size);
 
+/* Decode only subarea of a JPX image, at a resolution reduced by up to 2^l2factor.
+ * Updates subarea to the area decoded and l2factor to the subsampling still to do. */
+fz_pixmap *fz_load_jpx_subarea(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs, fz_irect *subarea, int *l2factor);
+
 void fz_load_jpeg_info(fz_context *ctx, const unsigned char *data, size_t size, int *w, int *h, int *xres, int *yres, fz_colorspace **cspace, uint8_t *orientation);
 void fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *w, int *h, int *xres, int *yres, fz_colorspace **cspace);
 void fz_load_png_info(fz_context *ctx, const unsigned char *data, size_t size, int *w, int *h, int *xres, int *yres, fz_colorspace **cspace);
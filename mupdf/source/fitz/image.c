@@ -755,7 +755,20 @@ compressed_image_get_pixmap(fz_context *ctx, fz_image *image_, fz_irect *subarea
 		tile = fz_load_jxr(ctx, image->buffer->buffer->data, image->buffer->buffer->len);
 		break;
 	case FZ_IMAGE_JPX:
-		tile = fz_load_jpx(ctx, image->buffer->buffer->data, image->buffer->buffer->len, NULL);
+		/* openjpeg can decode just the area we need, at reduced resolution. */
+		tile = fz_load_jpx_subarea(ctx, image->buffer->buffer->data, image->buffer->buffer->len,
+			image->super.colorspace, subarea, l2factor);
+		can_sub = 1;
+		if (image->super.use_decode)
+		{
+			fz_try(ctx)
+				fz_decode_tile(ctx, tile, image->super.decode);
+			fz_catch(ctx)
+			{
+				fz_drop_pixmap(ctx, tile);
+				fz_rethrow(ctx);
+			}
+		}
 		break;
 	case FZ_IMAGE_JPEG:
 		/* Scan JPEG stream and patch missing height values in header */
@@ -871,6 +884,56 @@ void fz_default_image_decode(void *arg, int w, int h, int l2factor, fz_irect *su
 	}
 }
 
+/*
+	Estimate the cost of decoding the given area of an image, in the
+	units used by fz_store_item_with_cost (roughly, the work needed to
+	produce one byte of an uncompressed image). This lets the store
+	prefer to keep images that are slow to decode over those that
+	are merely big.
+*/
+static float
+fz_image_decode_cost(fz_context *ctx, fz_image *image, const fz_irect *rect)
+{
+	fz_compressed_buffer *buffer = fz_compressed_image_buffer(ctx, image);
+	float area = (float)(rect->x1 - rect->x0) * (rect->y1 - rect->y0) * image->n;
+	float weight;
+
+	switch (buffer ? buffer->params.type : FZ_IMAGE_UNKNOWN)
+	{
+	case FZ_IMAGE_RAW:
+	case FZ_IMAGE_RLD:
+		weight = 1;
+		break;
+	case FZ_IMAGE_FLATE:
+	case FZ_IMAGE_LZW:
+	case FZ_IMAGE_PNG:
+	case FZ_IMAGE_PNM:
+	case FZ_IMAGE_BMP:
+	case FZ_IMAGE_GIF:
+		weight = 2;
+		break;
+	case FZ_IMAGE_FAX:
+	case FZ_IMAGE_TIFF:
+		weight = 4;
+		break;
+	case FZ_IMAGE_JPEG:
+		weight = 8;
+		break;
+	case FZ_IMAGE_JBIG2:
+		weight = 24;
+		break;
+	case FZ_IMAGE_JPX:
+	case FZ_IMAGE_JXR:
+		weight = 32;
+		break;
+	default:
+		weight = 4;
+		break;
+	}
+
+	return area * weight;
+}
+
 static fz_pixmap *
 fz_find_image_tile(fz_context *ctx, fz_image *image, fz_image_key *key, fz_matrix *ctm)
 {
@@ -1006,7 +1069,8 @@ fz_get_pixmap_from_image(fz_context *ctx, fz_image *image, const fz_irect *subar
 		keyp->l2factor = l2factor;
 		keyp->rect = key.rect;
 
-		existing_tile = fz_store_item(ctx, keyp, tile, fz_pixmap_size(ctx, tile), &fz_image_store_type);
+		existing_tile = fz_store_item_with_cost(ctx, keyp, tile, fz_pixmap_size(ctx, tile),
+			fz_image_decode_cost(ctx, image, &key.rect), &fz_image_store_type);
 		if (existing_tile)
 		{
 			/* We already have a tile. This must have been produced by a
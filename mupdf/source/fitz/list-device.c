@@ -22,6 +22,8 @@
 
 #include "mupdf/fitz.h"
 
+#include "context-imp.h"
+
 #include <assert.h>
 #include <string.h>
 
@@ -207,6 +209,25 @@ static void align_node_for_pointer(fz_display_node **node)
 		(*node) = (fz_display_node *)((ptr + FZ_POINTER_ALIGN_MOD - 1) & ~(FZ_POINTER_ALIGN_MOD-1));
 }
 
+/* Stroke states from a run arena are copied when kept, so compare them by value. */
+static int
+same_stroke_state(const fz_stroke_state *a, const fz_stroke_state *b)
+{
+	if (a == b)
+		return 1;
+	if (a == NULL || b == NULL)
+		return 0;
+	return a->start_cap == b->start_cap &&
+		a->dash_cap == b->dash_cap &&
+		a->end_cap == b->end_cap &&
+		a->linejoin == b->linejoin &&
+		a->linewidth == b->linewidth &&
+		a->miterlimit == b->miterlimit &&
+		a->dash_phase == b->dash_phase &&
+		a->dash_len == b->dash_len &&
+		!memcmp(a->dash_list, b->dash_list, sizeof(a->dash_list[0]) * a->dash_len);
+}
+
 static void
 fz_append_display_node(
 	fz_context *ctx,
@@ -505,7 +526,7 @@ fz_append_display_node(
 			ctm_flags |= CTM_CHANGE_EF, size += SIZE_IN_NODES(2*sizeof(float));
 		node.ctm = ctm_flags;
 	}
-	if (stroke && (writer->stroke == NULL || stroke != writer->stroke))
+	if (stroke && !same_stroke_state(writer->stroke, stroke))
 	{
 		pad_size_for_pointer(list, &size);
 		stroke_off = size;
@@ -580,7 +601,7 @@ fz_append_display_node(
 	{
 		fz_try(ctx)
 		{
-			my_stroke = fz_keep_stroke_state(ctx, stroke);
+			my_stroke = fz_keep_stroke_state_off_arena(ctx, stroke);
 		}
 		fz_catch(ctx)
 		{
@@ -816,7 +837,7 @@ static void
 fz_list_fill_text(fz_context *ctx, fz_device *dev, const fz_text *text, fz_matrix ctm,
 	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
 {
-	fz_text *cloned_text = fz_keep_text(ctx, text);
+	fz_text *cloned_text = fz_keep_text_off_arena(ctx, text);
 	fz_try(ctx)
 	{
 		fz_rect rect = fz_bound_text(ctx, text, NULL, ctm);
@@ -846,7 +867,7 @@ static void
 fz_list_stroke_text(fz_context *ctx, fz_device *dev, const fz_text *text, const fz_stroke_state *stroke, fz_matrix ctm,
 	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
 {
-	fz_text *cloned_text = fz_keep_text(ctx, text);
+	fz_text *cloned_text = fz_keep_text_off_arena(ctx, text);
 	fz_try(ctx)
 	{
 		fz_rect rect = fz_bound_text(ctx, text, stroke, ctm);
@@ -875,7 +896,7 @@ fz_list_stroke_text(fz_context *ctx, fz_device *dev, const fz_text *text, const
 static void
 fz_list_clip_text(fz_context *ctx, fz_device *dev, const fz_text *text, fz_matrix ctm, fz_rect scissor)
 {
-	fz_text *cloned_text = fz_keep_text(ctx, text);
+	fz_text *cloned_text = fz_keep_text_off_arena(ctx, text);
 	fz_try(ctx)
 	{
 		fz_rect rect = fz_bound_text(ctx, text, NULL, ctm);
@@ -905,7 +926,7 @@ fz_list_clip_text(fz_context *ctx, fz_device *dev, const fz_text *text, fz_matri
 static void
 fz_list_clip_stroke_text(fz_context *ctx, fz_device *dev, const fz_text *text, const fz_stroke_state *stroke, fz_matrix ctm, fz_rect scissor)
 {
-	fz_text *cloned_text = fz_keep_text(ctx, text);
+	fz_text *cloned_text = fz_keep_text_off_arena(ctx, text);
 	fz_try(ctx)
 	{
 		fz_rect rect = fz_bound_text(ctx, text, stroke, ctm);
@@ -935,7 +956,7 @@ fz_list_clip_stroke_text(fz_context *ctx, fz_device *dev, const fz_text *text, c
 static void
 fz_list_ignore_text(fz_context *ctx, fz_device *dev, const fz_text *text, fz_matrix ctm)
 {
-	fz_text *cloned_text = fz_keep_text(ctx, text);
+	fz_text *cloned_text = fz_keep_text_off_arena(ctx, text);
 	fz_try(ctx)
 	{
 		fz_rect rect = fz_bound_text(ctx, text, NULL, ctm);
@@ -1099,9 +1120,10 @@ fz_list_clip_image_mask(fz_context *ctx, fz_device *dev, fz_image *image, fz_mat
 	}
 }
 
-static void
-fz_list_begin_mask(fz_context *ctx, fz_device *dev, fz_rect rect, int luminosity, fz_colorspace *colorspace, const float *color, fz_color_params color_params)
+static int
+fz_list_begin_mask_id(fz_context *ctx, fz_device *dev, fz_rect rect, int luminosity, fz_colorspace *colorspace, const float *color, fz_color_params color_params, fz_matrix ctm, int id)
 {
+	/* The transform only matters for masks that can be cached. */
 	fz_append_display_node(
 		ctx,
 		dev,
@@ -1112,10 +1134,12 @@ fz_list_begin_mask(fz_context *ctx, fz_device *dev, fz_rect rect, int luminosity
 		color,
 		colorspace,
 		NULL, /* alpha */
-		NULL, /* ctm */
+		id ? &ctm : NULL, /* ctm */
 		NULL, /* stroke */
-		NULL, /* private_data */
-		0); /* private_data_len */
+		&id, /* private_data */
+		sizeof(id)); /* private_data_len */
+
+	return 0;
 }
 
 static void
@@ -1381,7 +1405,7 @@ fz_new_list_device(fz_context *ctx, fz_display_list *list)
 
 	dev->super.pop_clip = fz_list_pop_clip;
 
-	dev->super.begin_mask = fz_list_begin_mask;
+	dev->super.begin_mask_id = fz_list_begin_mask_id;
 	dev->super.end_mask = fz_list_end_mask;
 	dev->super.begin_group = fz_list_begin_group;
 	dev->super.end_group = fz_list_end_group;
@@ -1554,6 +1578,11 @@ int fz_display_list_is_empty(fz_context *ctx, const fz_display_list *list)
 	return !list || list->len == 0;
 }
 
+size_t fz_display_list_size(fz_context *ctx, const fz_display_list *list)
+{
+	return list ? sizeof(*list) + list->max * sizeof(fz_display_node) : 0;
+}
+
 void
 fz_run_display_list(fz_context *ctx, fz_display_list *list, fz_device *dev, fz_matrix top_ctm, fz_rect scissor, fz_cookie *cookie)
 {
@@ -1578,6 +1607,7 @@ fz_run_display_list(fz_context *ctx, fz_display_list *list, fz_device *dev, fz_m
 	fz_rect trans_rect;
 	fz_matrix trans_ctm;
 	int tile_skip_depth = 0;
+	int mask_skip_depth = 0;
 
 	if (cookie)
 	{
@@ -1733,6 +1763,16 @@ fz_run_display_list(fz_context *ctx, fz_display_list *list, fz_device *dev, fz_m
 				continue;
 		}
 
+		if (mask_skip_depth > 0)
+		{
+			if (n.cmd == FZ_CMD_BEGIN_MASK)
+				mask_skip_depth++;
+			else if (n.cmd == FZ_CMD_END_MASK)
+				mask_skip_depth--;
+			if (mask_skip_depth > 0)
+				continue;
+		}
+
 		trans_rect = fz_transform_rect(rect, top_ctm);
 
 		/* cull objects to draw using a quick visibility test */
@@ -1856,9 +1896,15 @@ visible:
 				fz_pop_clip(ctx, dev);
 				break;
 			case FZ_CMD_BEGIN_MASK:
+			{
+				int cached;
 				fz_unpack_color_params(&color_params, n.flags);
-				fz_begin_mask(ctx, dev, trans_rect, n.flags & 1, colorspace, color, color_params);
+				align_node_for_pointer(&node);
+				cached = fz_begin_mask_id(ctx, dev, trans_rect, n.flags & 1, colorspace, color, color_params, trans_ctm, *(int *)node);
+				if (cached)
+					mask_skip_depth = 1;
 				break;
+			}
 			case FZ_CMD_END_MASK:
 				fz_end_mask(ctx, dev);
 				break;
@@ -0,0 +1,2405 @@
+// Copyright (C) 2004-2022 Artifex Software, Inc.
+//
+// This file is part of MuPDF.
+//
+// MuPDF is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// MuPDF is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with MuPDF. If not, see <https://www.gnu.org/licenses/agpl-3.0.en.html>
+//
+// Alternative licensing terms are available from the licensor.
+// For commercial licensing, see <https://www.artifex.com/> or contact
+// Artifex Software, Inc., 1305 Grant Avenue - Suite 200, Novato,
+// CA 94945, U.S.A., +1(415)492-9861, for further information.
+
+#include "mupdf/fitz.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/*
+	A display list is written by running it through a device that
+	encodes every call it gets, and read back by making the same
+	calls on a list device.
+
+	The file starts with a magic number, a version and the bounds of
+	the list. Then follows a record for each device call, starting
+	with an opcode, and ending with DL_END. Unsigned numbers are
+	written as varints, signed ones zig-zag encoded, and floats as
+	4 little endian bytes.
+
+	Fonts, images, colorspaces and shadings are defined in a record
+	of their own the first time they are used, and referred to by
+	index (1 based, 0 for none) after that. A definition carries the
+	MD5 of its contents (and of the definitions it refers to), which
+	is what the reader keys the objects it makes on in the store.
+	Larger data in a definition (font files, image data and ICC
+	profiles) is either written inline or, given a blob directory,
+	kept in a file named by its own MD5.
+*/
+
+#define DL_MAGIC "FZDL"
+#define DL_VERSION 1
+
+/* Blobs smaller than this are always written inline. */
+#define DL_MIN_BLOB_FILE 4096
+
+enum
+{
+	DL_END,
+	DL_DEFINE,
+	DL_FILL_PATH,
+	DL_STROKE_PATH,
+	DL_CLIP_PATH,
+	DL_CLIP_STROKE_PATH,
+	DL_FILL_TEXT,
+	DL_STROKE_TEXT,
+	DL_CLIP_TEXT,
+	DL_CLIP_STROKE_TEXT,
+	DL_IGNORE_TEXT,
+	DL_FILL_SHADE,
+	DL_FILL_IMAGE,
+	DL_FILL_IMAGE_MASK,
+	DL_CLIP_IMAGE_MASK,
+	DL_POP_CLIP,
+	DL_BEGIN_MASK,
+	DL_END_MASK,
+	DL_BEGIN_GROUP,
+	DL_END_GROUP,
+	DL_BEGIN_TILE,
+	DL_END_TILE,
+	DL_RENDER_FLAGS,
+	DL_DEFAULT_COLORSPACES,
+	DL_BEGIN_LAYER,
+	DL_END_LAYER
+};
+
+enum
+{
+	DL_COLORSPACE,
+	DL_FONT,
+	DL_IMAGE,
+	DL_SHADE,
+	DL_KINDS
+};
+
+enum
+{
+	DL_MOVETO,
+	DL_LINETO,
+	DL_CURVETO,
+	DL_CLOSEPATH,
+	DL_QUADTO,
+	DL_CURVETOV,
+	DL_CURVETOY,
+	DL_RECTTO,
+	DL_PATH_END
+};
+
+enum
+{
+	DL_CS_GRAY,
+	DL_CS_RGB,
+	DL_CS_BGR,
+	DL_CS_CMYK,
+	DL_CS_LAB,
+	DL_CS_ICC,
+	DL_CS_INDEXED
+};
+
+enum
+{
+	DL_IMAGE_COMPRESSED,
+	DL_IMAGE_PIXMAP
+};
+
+enum
+{
+	DL_BLOB_INLINE,
+	DL_BLOB_FILE
+};
+
+static void
+dl_blob_path(char *path, size_t size, const char *blob_dir, const unsigned char digest[16])
+{
+	char hex[33];
+	int i;
+	for (i = 0; i < 16; i++)
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+	fz_snprintf(path, size, "%s/%s.bin", blob_dir, hex);
+}
+
+static void
+dl_md5(const unsigned char *data, size_t len, unsigned char digest[16])
+{
+	fz_md5 md5;
+	fz_md5_init(&md5);
+	fz_md5_update(&md5, data, len);
+	fz_md5_final(&md5, digest);
+}
+
+static int
+dl_pack_color_params(fz_color_params color_params)
+{
+	return color_params.ri | (color_params.bp << 2) | (color_params.op << 3) | (color_params.opm << 4);
+}
+
+static fz_color_params
+dl_unpack_color_params(int flags)
+{
+	fz_color_params color_params;
+	color_params.ri = flags & 3;
+	color_params.bp = (flags >> 2) & 1;
+	color_params.op = (flags >> 3) & 1;
+	color_params.opm = (flags >> 4) & 1;
+	return color_params;
+}
+
+/* Writing */
+
+typedef struct
+{
+	void *obj;
+	unsigned char digest[16];
+} dl_resource;
+
+typedef struct
+{
+	int len, cap;
+	dl_resource *items;
+} dl_table;
+
+typedef struct
+{
+	fz_device super;
+	fz_output *out;
+	const char *blob_dir;
+	dl_table table[DL_KINDS];
+	const fz_stroke_state *stroke;
+	/* Digest of the definitions referred to by the one being written. */
+	fz_md5 *refs_md5;
+} fz_dl_writer;
+
+static void
+write_uint(fz_context *ctx, fz_output *out, unsigned int v)
+{
+	while (v >= 0x80)
+	{
+		fz_write_byte(ctx, out, (v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	fz_write_byte(ctx, out, v);
+}
+
+static void
+write_int(fz_context *ctx, fz_output *out, int v)
+{
+	write_uint(ctx, out, ((unsigned int)v << 1) ^ (unsigned int)(v >> 31));
+}
+
+static void
+write_floats(fz_context *ctx, fz_output *out, const float *v, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		fz_write_float_le(ctx, out, v[i]);
+}
+
+static void
+write_rect(fz_context *ctx, fz_output *out, fz_rect r)
+{
+	fz_write_float_le(ctx, out, r.x0);
+	fz_write_float_le(ctx, out, r.y0);
+	fz_write_float_le(ctx, out, r.x1);
+	fz_write_float_le(ctx, out, r.y1);
+}
+
+static void
+write_matrix(fz_context *ctx, fz_output *out, fz_matrix m)
+{
+	fz_write_float_le(ctx, out, m.a);
+	fz_write_float_le(ctx, out, m.b);
+	fz_write_float_le(ctx, out, m.c);
+	fz_write_float_le(ctx, out, m.d);
+	fz_write_float_le(ctx, out, m.e);
+	fz_write_float_le(ctx, out, m.f);
+}
+
+static void
+write_string(fz_context *ctx, fz_output *out, const char *s)
+{
+	size_t len = s ? strlen(s) : 0;
+	write_uint(ctx, out, (unsigned int)len);
+	fz_write_data(ctx, out, s, len);
+}
+
+static void
+write_blob(fz_context *ctx, fz_dl_writer *wri, fz_output *out, const unsigned char *data, size_t len)
+{
+	unsigned char digest[16];
+	char path[PATH_MAX];
+	fz_output *file;
+
+	if (len > UINT_MAX)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "display list data too large");
+
+	if (!wri->blob_dir || len < DL_MIN_BLOB_FILE)
+	{
+		fz_write_byte(ctx, out, DL_BLOB_INLINE);
+		write_uint(ctx, out, (unsigned int)len);
+		fz_write_data(ctx, out, data, len);
+		return;
+	}
+
+	dl_md5(data, len, digest);
+	dl_blob_path(path, sizeof path, wri->blob_dir, digest);
+	if (!fz_file_exists(ctx, path))
+	{
+		file = fz_new_output_with_path(ctx, path, 0);
+		fz_try(ctx)
+		{
+			fz_write_data(ctx, file, data, len);
+			fz_close_output(ctx, file);
+		}
+		fz_always(ctx)
+			fz_drop_output(ctx, file);
+		fz_catch(ctx)
+			fz_rethrow(ctx);
+	}
+
+	fz_write_byte(ctx, out, DL_BLOB_FILE);
+	write_uint(ctx, out, (unsigned int)len);
+	fz_write_data(ctx, out, digest, 16);
+}
+
+static void
+write_buffer_blob(fz_context *ctx, fz_dl_writer *wri, fz_output *out, fz_buffer *buf)
+{
+	unsigned char *data;
+	size_t len = fz_buffer_storage(ctx, buf, &data);
+	write_blob(ctx, wri, out, data, len);
+}
+
+static void
+write_ref(fz_context *ctx, fz_dl_writer *wri, fz_output *out, int kind, int ref)
+{
+	write_uint(ctx, out, ref);
+	if (ref && wri->refs_md5)
+		fz_md5_update(wri->refs_md5, wri->table[kind].items[ref - 1].digest, 16);
+}
+
+static int
+find_resource(fz_dl_writer *wri, int kind, const void *obj)
+{
+	dl_table *table = &wri->table[kind];
+	int i;
+	for (i = table->len - 1; i >= 0; i--)
+		if (table->items[i].obj == obj)
+			return i + 1;
+	return 0;
+}
+
+typedef void (dl_write_def_fn)(fz_context *ctx, fz_dl_writer *wri, fz_output *out, void *arg);
+
+/*
+	Write the definition of obj, and return its reference. Anything
+	the definition refers to must have been defined before.
+*/
+static int
+define_resource(fz_context *ctx, fz_dl_writer *wri, int kind, void *obj, dl_write_def_fn *write_def, void *arg)
+{
+	dl_table *table = &wri->table[kind];
+	unsigned char digest[16];
+	fz_buffer *buf = NULL;
+	fz_output *out = NULL;
+	unsigned char k = kind;
+	fz_md5 md5;
+
+	fz_var(buf);
+	fz_var(out);
+
+	fz_try(ctx)
+	{
+		buf = fz_new_buffer(ctx, 256);
+		out = fz_new_output_with_buffer(ctx, buf);
+		fz_md5_init(&md5);
+		fz_md5_update(&md5, &k, 1);
+		wri->refs_md5 = &md5;
+		write_def(ctx, wri, out, arg);
+		wri->refs_md5 = NULL;
+		fz_close_output(ctx, out);
+		fz_md5_update(&md5, buf->data, buf->len);
+		fz_md5_final(&md5, digest);
+
+		if (table->len == table->cap)
+		{
+			int cap = table->cap ? table->cap * 2 : 16;
+			table->items = fz_realloc_array(ctx, table->items, cap, dl_resource);
+			table->cap = cap;
+		}
+
+		fz_write_byte(ctx, wri->out, DL_DEFINE);
+		fz_write_byte(ctx, wri->out, k);
+		fz_write_data(ctx, wri->out, digest, 16);
+		write_uint(ctx, wri->out, (unsigned int)buf->len);
+		fz_write_data(ctx, wri->out, buf->data, buf->len);
+
+		table->items[table->len].obj = obj;
+		memcpy(table->items[table->len].digest, digest, 16);
+		table->len++;
+	}
+	fz_always(ctx)
+	{
+		wri->refs_md5 = NULL;
+		fz_drop_output(ctx, out);
+		fz_drop_buffer(ctx, buf);
+	}
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+
+	return table->len;
+}
+
+/* Colorspaces */
+
+typedef struct
+{
+	fz_colorspace *cs;
+	int base;
+} dl_colorspace_def;
+
+static void
+write_colorspace_def(fz_context *ctx, fz_dl_writer *wri, fz_output *out, void *arg)
+{
+	dl_colorspace_def *def = arg;
+	fz_colorspace *cs = def->cs;
+
+	if (cs == fz_device_gray(ctx))
+		fz_write_byte(ctx, out, DL_CS_GRAY);
+	else if (cs == fz_device_rgb(ctx))
+		fz_write_byte(ctx, out, DL_CS_RGB);
+	else if (cs == fz_device_bgr(ctx))
+		fz_write_byte(ctx, out, DL_CS_BGR);
+	else if (cs == fz_device_cmyk(ctx))
+		fz_write_byte(ctx, out, DL_CS_CMYK);
+	else if (cs == fz_device_lab(ctx))
+		fz_write_byte(ctx, out, DL_CS_LAB);
+	else if (cs->type == FZ_COLORSPACE_INDEXED)
+	{
+		int high = cs->u.indexed.high;
+		fz_write_byte(ctx, out, DL_CS_INDEXED);
+		write_ref(ctx, wri, out, DL_COLORSPACE, def->base);
+		write_uint(ctx, out, high);
+		fz_write_data(ctx, out, cs->u.indexed.lookup, (high + 1) * (size_t)fz_colorspace_n(ctx, cs->u.indexed.base));
+	}
+#if FZ_ENABLE_ICC
+	else if (cs->flags & FZ_COLORSPACE_IS_ICC)
+	{
+		fz_write_byte(ctx, out, DL_CS_ICC);
+		write_uint(ctx, out, cs->type);
+		write_uint(ctx, out, cs->flags & ~(FZ_COLORSPACE_IS_DEVICE | FZ_COLORSPACE_IS_ICC));
+		write_string(ctx, out, cs->name);
+		write_buffer_blob(ctx, wri, out, cs->u.icc.buffer);
+	}
+#endif
+	else
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cannot serialize colorspace %s", fz_colorspace_name(ctx, cs));
+}
+
+static int
+colorspace_ref(fz_context *ctx, fz_dl_writer *wri, fz_colorspace *cs)
+{
+	dl_colorspace_def def = { cs, 0 };
+	int ref;
+
+	if (cs == NULL)
+		return 0;
+	ref = find_resource(wri, DL_COLORSPACE, cs);
+	if (ref)
+		return ref;
+	if (cs->type == FZ_COLORSPACE_INDEXED)
+		def.base = colorspace_ref(ctx, wri, cs->u.indexed.base);
+	return define_resource(ctx, wri, DL_COLORSPACE, cs, write_colorspace_def, &def);
+}
+
+/* Fonts */
+
+static void
+write_font_def(fz_context *ctx, fz_dl_writer *wri, fz_output *out, void *arg)
+{
+	fz_font *font = arg;
+	fz_font_flags_t *flags = &font->flags;
+	int i;
+
+	write_string(ctx, out, font->name);
+	write_uint(ctx, out, (unsigned int)((FT_Face)font->ft_face)->face_index);
+	write_uint(ctx, out,
+		flags->is_mono |
+		(flags->is_serif << 1) |
+		(flags->is_bold << 2) |
+		(flags->is_italic << 3) |
+		(flags->ft_substitute << 4) |
+		(flags->ft_stretch << 5) |
+		(flags->fake_bold << 6) |
+		(flags->fake_italic << 7) |
+		(flags->has_opentype << 8) |
+		(flags->invalid_bbox << 9) |
+		(flags->cjk << 10) |
+		(flags->cjk_lang << 11));
+	write_uint(ctx, out, font->use_glyph_bbox);
+	write_rect(ctx, out, font->bbox);
+	write_uint(ctx, out, font->width_count);
+	write_int(ctx, out, font->width_default);
+	for (i = 0; i < font->width_count; i++)
+		write_int(ctx, out, font->width_table[i]);
+	write_buffer_blob(ctx, wri, out, font->buffer);
+}
+
+static int
+font_ref(fz_context *ctx, fz_dl_writer *wri, fz_font *font)
+{
+	int ref = find_resource(wri, DL_FONT, font);
+	if (ref)
+		return ref;
+	/* Type 3 glyphs are run by the interpreter of their document. */
+	if (!font->ft_face || !font->buffer)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cannot serialize type3 font %s", font->name);
+	return define_resource(ctx, wri, DL_FONT, font, write_font_def, font);
+}
+
+/* Images and shadings */
+
+static void
+write_compressed_buffer(fz_context *ctx, fz_dl_writer *wri, fz_output *out, fz_compressed_buffer *cbuf)
+{
+	fz_compression_params *params = &cbuf->params;
+
+	write_uint(ctx, out, params->type);
+	switch (params->type)
+	{
+	case FZ_IMAGE_JPEG:
+		write_int(ctx, out, params->u.jpeg.color_transform);
+		break;
+	case FZ_IMAGE_JPX:
+		write_int(ctx, out, params->u.jpx.smask_in_data);
+		break;
+	case FZ_IMAGE_JBIG2:
+		write_int(ctx, out, params->u.jbig2.embedded);
+		write_uint(ctx, out, params->u.jbig2.globals != NULL);
+		if (params->u.jbig2.globals)
+			write_buffer_blob(ctx, wri, out, fz_jbig2_globals_data(ctx, params->u.jbig2.globals));
+		break;
+	case FZ_IMAGE_FAX:
+		write_int(ctx, out, params->u.fax.columns);
+		write_int(ctx, out, params->u.fax.rows);
+		write_int(ctx, out, params->u.fax.k);
+		write_int(ctx, out, params->u.fax.end_of_line);
+		write_int(ctx, out, params->u.fax.encoded_byte_align);
+		write_int(ctx, out, params->u.fax.end_of_block);
+		write_int(ctx, out, params->u.fax.black_is_1);
+		write_int(ctx, out, params->u.fax.damaged_rows_before_error);
+		break;
+	case FZ_IMAGE_FLATE:
+		write_int(ctx, out, params->u.flate.columns);
+		write_int(ctx, out, params->u.flate.colors);
+		write_int(ctx, out, params->u.flate.predictor);
+		write_int(ctx, out, params->u.flate.bpc);
+		break;
+	case FZ_IMAGE_LZW:
+		write_int(ctx, out, params->u.lzw.columns);
+		write_int(ctx, out, params->u.lzw.colors);
+		write_int(ctx, out, params->u.lzw.predictor);
+		write_int(ctx, out, params->u.lzw.bpc);
+		write_int(ctx, out, params->u.lzw.early_change);
+		break;
+	}
+	write_buffer_blob(ctx, wri, out, cbuf->buffer);
+}
+
+typedef struct
+{
+	fz_image *image;
+	fz_compressed_buffer *cbuf;
+	fz_pixmap *pix;
+	int colorspace;
+	int pix_colorspace;
+	int mask;
+} dl_image_def;
+
+static void
+write_pixmap_samples(fz_context *ctx, fz_dl_writer *wri, fz_output *out, fz_pixmap *pix)
+{
+	size_t row = (size_t)pix->w * pix->n;
+	size_t len = row * pix->h;
+	unsigned char *data = NULL;
+	unsigned char *packed = NULL;
+	size_t packed_len;
+	int y;
+
+	fz_var(data);
+	fz_var(packed);
+
+	fz_try(ctx)
+	{
+		if ((size_t)pix->stride == row)
+			packed = fz_new_deflated_data(ctx, &packed_len, pix->samples, len, FZ_DEFLATE_DEFAULT);
+		else
+		{
+			data = fz_malloc(ctx, len);
+			for (y = 0; y < pix->h; y++)
+				memcpy(data + y * row, pix->samples + y * (size_t)pix->stride, row);
+			packed = fz_new_deflated_data(ctx, &packed_len, data, len, FZ_DEFLATE_DEFAULT);
+		}
+		write_blob(ctx, wri, out, packed, packed_len);
+	}
+	fz_always(ctx)
+	{
+		fz_free(ctx, data);
+		fz_free(ctx, packed);
+	}
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+}
+
+static void
+write_image_def(fz_context *ctx, fz_dl_writer *wri, fz_output *out, void *arg)
+{
+	dl_image_def *def = arg;
+	fz_image *image = def->image;
+	fz_pixmap *pix = def->pix;
+	int i;
+
+	write_uint(ctx, out, image->w);
+	write_uint(ctx, out, image->h);
+	write_uint(ctx, out, image->n);
+	write_uint(ctx, out, image->bpc);
+	write_ref(ctx, wri, out, DL_COLORSPACE, def->colorspace);
+	write_ref(ctx, wri, out, DL_IMAGE, def->mask);
+	write_uint(ctx, out, image->xres);
+	write_uint(ctx, out, image->yres);
+	write_uint(ctx, out,
+		image->imagemask |
+		(image->interpolate << 1) |
+		(image->use_colorkey << 2) |
+		(image->use_decode << 3) |
+		(image->invert_cmyk_jpeg << 4));
+	write_uint(ctx, out, image->orientation);
+	if (image->use_decode)
+		write_floats(ctx, out, image->decode, 2 * image->n);
+	if (image->use_colorkey)
+		for (i = 0; i < 2 * image->n; i++)
+			write_int(ctx, out, image->colorkey[i]);
+
+	if (def->cbuf)
+	{
+		fz_write_byte(ctx, out, DL_IMAGE_COMPRESSED);
+		write_compressed_buffer(ctx, wri, out, def->cbuf);
+	}
+	else
+	{
+		fz_write_byte(ctx, out, DL_IMAGE_PIXMAP);
+		write_ref(ctx, wri, out, DL_COLORSPACE, def->pix_colorspace);
+		write_uint(ctx, out, pix->w);
+		write_uint(ctx, out, pix->h);
+		write_uint(ctx, out, pix->n);
+		write_uint(ctx, out, pix->alpha);
+		write_pixmap_samples(ctx, wri, out, pix);
+	}
+}
+
+static int
+image_ref(fz_context *ctx, fz_dl_writer *wri, fz_image *image)
+{
+	dl_image_def def = { image };
+	int ref;
+
+	ref = find_resource(wri, DL_IMAGE, image);
+	if (ref)
+		return ref;
+
+	def.colorspace = colorspace_ref(ctx, wri, image->colorspace);
+	def.mask = image->mask ? image_ref(ctx, wri, image->mask) : 0;
+	def.cbuf = fz_compressed_image_buffer(ctx, image);
+	if (def.cbuf && def.cbuf->buffer)
+		return define_resource(ctx, wri, DL_IMAGE, image, write_image_def, &def);
+
+	/* Anything else is written as a decoded pixmap. */
+	def.cbuf = NULL;
+	def.pix = fz_get_unscaled_pixmap_from_image(ctx, image);
+	fz_try(ctx)
+	{
+		if (def.pix->s || def.pix->n != fz_colorspace_n(ctx, def.pix->colorspace) + def.pix->alpha)
+			fz_throw(ctx, FZ_ERROR_GENERIC, "cannot serialize image with spot colors");
+		def.pix_colorspace = colorspace_ref(ctx, wri, def.pix->colorspace);
+		ref = define_resource(ctx, wri, DL_IMAGE, image, write_image_def, &def);
+	}
+	fz_always(ctx)
+		fz_drop_pixmap(ctx, def.pix);
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+
+	return ref;
+}
+
+typedef struct
+{
+	fz_shade *shade;
+	int colorspace;
+} dl_shade_def;
+
+static void
+write_shade_def(fz_context *ctx, fz_dl_writer *wri, fz_output *out, void *arg)
+{
+	dl_shade_def *def = arg;
+	fz_shade *shade = def->shade;
+	int n = fz_colorspace_n(ctx, shade->colorspace);
+	int i;
+
+	write_ref(ctx, wri, out, DL_COLORSPACE, def->colorspace);
+	write_uint(ctx, out, shade->type);
+	write_rect(ctx, out, shade->bbox);
+	write_matrix(ctx, out, shade->matrix);
+	write_uint(ctx, out, shade->use_background);
+	if (shade->use_background)
+		write_floats(ctx, out, shade->background, n);
+	write_uint(ctx, out, shade->use_function);
+	if (shade->use_function)
+		for (i = 0; i < 256; i++)
+			write_floats(ctx, out, shade->function[i], n + 1);
+
+	switch (shade->type)
+	{
+	case FZ_FUNCTION_BASED:
+		write_matrix(ctx, out, shade->u.f.matrix);
+		write_uint(ctx, out, shade->u.f.xdivs);
+		write_uint(ctx, out, shade->u.f.ydivs);
+		write_floats(ctx, out, &shade->u.f.domain[0][0], 4);
+		write_floats(ctx, out, shade->u.f.fn_vals, (shade->u.f.xdivs + 1) * (shade->u.f.ydivs + 1) * n);
+		break;
+	case FZ_LINEAR:
+	case FZ_RADIAL:
+		write_uint(ctx, out, shade->u.l_or_r.extend[0]);
+		write_uint(ctx, out, shade->u.l_or_r.extend[1]);
+		write_floats(ctx, out, &shade->u.l_or_r.coords[0][0], 6);
+		break;
+	default:
+		write_int(ctx, out, shade->u.m.vprow);
+		write_int(ctx, out, shade->u.m.bpflag);
+		write_int(ctx, out, shade->u.m.bpcoord);
+		write_int(ctx, out, shade->u.m.bpcomp);
+		fz_write_float_le(ctx, out, shade->u.m.x0);
+		fz_write_float_le(ctx, out, shade->u.m.x1);
+		fz_write_float_le(ctx, out, shade->u.m.y0);
+		fz_write_float_le(ctx, out, shade->u.m.y1);
+		write_floats(ctx, out, shade->u.m.c0, n);
+		write_floats(ctx, out, shade->u.m.c1, n);
+		write_uint(ctx, out, shade->buffer != NULL);
+		if (shade->buffer)
+			write_compressed_buffer(ctx, wri, out, shade->buffer);
+		break;
+	}
+}
+
+static int
+shade_ref(fz_context *ctx, fz_dl_writer *wri, fz_shade *shade)
+{
+	dl_shade_def def = { shade };
+	int ref = find_resource(wri, DL_SHADE, shade);
+	if (ref)
+		return ref;
+	def.colorspace = colorspace_ref(ctx, wri, shade->colorspace);
+	return define_resource(ctx, wri, DL_SHADE, shade, write_shade_def, &def);
+}
+
+/* Paths, text and graphics state */
+
+static void
+path_moveto(fz_context *ctx, void *arg, float x, float y)
+{
+	fz_output *out = arg;
+	fz_write_byte(ctx, out, DL_MOVETO);
+	fz_write_float_le(ctx, out, x);
+	fz_write_float_le(ctx, out, y);
+}
+
+static void
+path_lineto(fz_context *ctx, void *arg, float x, float y)
+{
+	fz_output *out = arg;
+	fz_write_byte(ctx, out, DL_LINETO);
+	fz_write_float_le(ctx, out, x);
+	fz_write_float_le(ctx, out, y);
+}
+
+static void
+path_curveto(fz_context *ctx, void *arg, float x1, float y1, float x2, float y2, float x3, float y3)
+{
+	fz_output *out = arg;
+	fz_write_byte(ctx, out, DL_CURVETO);
+	fz_write_float_le(ctx, out, x1);
+	fz_write_float_le(ctx, out, y1);
+	fz_write_float_le(ctx, out, x2);
+	fz_write_float_le(ctx, out, y2);
+	fz_write_float_le(ctx, out, x3);
+	fz_write_float_le(ctx, out, y3);
+}
+
+static void
+path_closepath(fz_context *ctx, void *arg)
+{
+	fz_output *out = arg;
+	fz_write_byte(ctx, out, DL_CLOSEPATH);
+}
+
+static void
+path_quadto(fz_context *ctx, void *arg, float x1, float y1, float x2, float y2)
+{
+	fz_output *out = arg;
+	fz_write_byte(ctx, out, DL_QUADTO);
+	fz_write_float_le(ctx, out, x1);
+	fz_write_float_le(ctx, out, y1);
+	fz_write_float_le(ctx, out, x2);
+	fz_write_float_le(ctx, out, y2);
+}
+
+static void
+path_curvetov(fz_context *ctx, void *arg, float x2, float y2, float x3, float y3)
+{
+	fz_output *out = arg;
+	fz_write_byte(ctx, out, DL_CURVETOV);
+	fz_write_float_le(ctx, out, x2);
+	fz_write_float_le(ctx, out, y2);
+	fz_write_float_le(ctx, out, x3);
+	fz_write_float_le(ctx, out, y3);
+}
+
+static void
+path_curvetoy(fz_context *ctx, void *arg, float x1, float y1, float x3, float y3)
+{
+	fz_output *out = arg;
+	fz_write_byte(ctx, out, DL_CURVETOY);
+	fz_write_float_le(ctx, out, x1);
+	fz_write_float_le(ctx, out, y1);
+	fz_write_float_le(ctx, out, x3);
+	fz_write_float_le(ctx, out, y3);
+}
+
+static void
+path_rectto(fz_context *ctx, void *arg, float x1, float y1, float x2, float y2)
+{
+	fz_output *out = arg;
+	fz_write_byte(ctx, out, DL_RECTTO);
+	fz_write_float_le(ctx, out, x1);
+	fz_write_float_le(ctx, out, y1);
+	fz_write_float_le(ctx, out, x2);
+	fz_write_float_le(ctx, out, y2);
+}
+
+static const fz_path_walker path_writer =
+{
+	path_moveto,
+	path_lineto,
+	path_curveto,
+	path_closepath,
+	path_quadto,
+	path_curvetov,
+	path_curvetoy,
+	path_rectto
+};
+
+static void
+write_path(fz_context *ctx, fz_output *out, const fz_path *path)
+{
+	fz_walk_path(ctx, path, &path_writer, out);
+	fz_write_byte(ctx, out, DL_PATH_END);
+}
+
+/* Consecutive calls usually share their stroke state. */
+static void
+write_stroke(fz_context *ctx, fz_dl_writer *wri, const fz_stroke_state *stroke)
+{
+	fz_output *out = wri->out;
+
+	if (stroke == wri->stroke)
+	{
+		fz_write_byte(ctx, out, 0);
+		return;
+	}
+	fz_write_byte(ctx, out, 1);
+	write_uint(ctx, out, stroke->start_cap);
+	write_uint(ctx, out, stroke->dash_cap);
+	write_uint(ctx, out, stroke->end_cap);
+	write_uint(ctx, out, stroke->linejoin);
+	fz_write_float_le(ctx, out, stroke->linewidth);
+	fz_write_float_le(ctx, out, stroke->miterlimit);
+	fz_write_float_le(ctx, out, stroke->dash_phase);
+	write_uint(ctx, out, stroke->dash_len);
+	write_floats(ctx, out, stroke->dash_list, stroke->dash_len);
+	wri->stroke = stroke;
+}
+
+/* Define the fonts of text before writing it. */
+static void
+define_text_fonts(fz_context *ctx, fz_dl_writer *wri, const fz_text *text)
+{
+	fz_text_span *span;
+	for (span = text->head; span; span = span->next)
+		font_ref(ctx, wri, span->font);
+}
+
+static void
+write_text(fz_context *ctx, fz_dl_writer *wri, const fz_text *text)
+{
+	fz_output *out = wri->out;
+	fz_text_span *span;
+	int n = 0, i;
+
+	for (span = text->head; span; span = span->next)
+		n++;
+	write_uint(ctx, out, n);
+	for (span = text->head; span; span = span->next)
+	{
+		write_ref(ctx, wri, out, DL_FONT, find_resource(wri, DL_FONT, span->font));
+		fz_write_float_le(ctx, out, span->trm.a);
+		fz_write_float_le(ctx, out, span->trm.b);
+		fz_write_float_le(ctx, out, span->trm.c);
+		fz_write_float_le(ctx, out, span->trm.d);
+		write_uint(ctx, out, span->wmode);
+		write_uint(ctx, out, span->bidi_level);
+		write_uint(ctx, out, span->markup_dir);
+		write_uint(ctx, out, span->language);
+		write_uint(ctx, out, span->len);
+		for (i = 0; i < span->len; i++)
+		{
+			fz_write_float_le(ctx, out, span->items[i].x);
+			fz_write_float_le(ctx, out, span->items[i].y);
+			write_int(ctx, out, span->items[i].gid);
+			write_int(ctx, out, span->items[i].ucs);
+		}
+	}
+}
+
+static void
+write_color(fz_context *ctx, fz_dl_writer *wri, int cs, fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_output *out = wri->out;
+	write_ref(ctx, wri, out, DL_COLORSPACE, cs);
+	write_floats(ctx, out, color, colorspace ? fz_colorspace_n(ctx, colorspace) : 0);
+	fz_write_float_le(ctx, out, alpha);
+	fz_write_byte(ctx, out, dl_pack_color_params(color_params));
+}
+
+/* Device calls */
+
+static void
+dl_fill_path(fz_context *ctx, fz_device *dev, const fz_path *path, int even_odd, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int cs = colorspace_ref(ctx, wri, colorspace);
+	fz_write_byte(ctx, wri->out, DL_FILL_PATH);
+	write_path(ctx, wri->out, path);
+	fz_write_byte(ctx, wri->out, even_odd);
+	write_matrix(ctx, wri->out, ctm);
+	write_color(ctx, wri, cs, colorspace, color, alpha, color_params);
+}
+
+static void
+dl_stroke_path(fz_context *ctx, fz_device *dev, const fz_path *path, const fz_stroke_state *stroke, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int cs = colorspace_ref(ctx, wri, colorspace);
+	fz_write_byte(ctx, wri->out, DL_STROKE_PATH);
+	write_path(ctx, wri->out, path);
+	write_stroke(ctx, wri, stroke);
+	write_matrix(ctx, wri->out, ctm);
+	write_color(ctx, wri, cs, colorspace, color, alpha, color_params);
+}
+
+static void
+dl_clip_path(fz_context *ctx, fz_device *dev, const fz_path *path, int even_odd, fz_matrix ctm, fz_rect scissor)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_CLIP_PATH);
+	write_path(ctx, wri->out, path);
+	fz_write_byte(ctx, wri->out, even_odd);
+	write_matrix(ctx, wri->out, ctm);
+	write_rect(ctx, wri->out, scissor);
+}
+
+static void
+dl_clip_stroke_path(fz_context *ctx, fz_device *dev, const fz_path *path, const fz_stroke_state *stroke, fz_matrix ctm, fz_rect scissor)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_CLIP_STROKE_PATH);
+	write_path(ctx, wri->out, path);
+	write_stroke(ctx, wri, stroke);
+	write_matrix(ctx, wri->out, ctm);
+	write_rect(ctx, wri->out, scissor);
+}
+
+static void
+dl_fill_text(fz_context *ctx, fz_device *dev, const fz_text *text, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int cs = colorspace_ref(ctx, wri, colorspace);
+	define_text_fonts(ctx, wri, text);
+	fz_write_byte(ctx, wri->out, DL_FILL_TEXT);
+	write_text(ctx, wri, text);
+	write_matrix(ctx, wri->out, ctm);
+	write_color(ctx, wri, cs, colorspace, color, alpha, color_params);
+}
+
+static void
+dl_stroke_text(fz_context *ctx, fz_device *dev, const fz_text *text, const fz_stroke_state *stroke, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int cs = colorspace_ref(ctx, wri, colorspace);
+	define_text_fonts(ctx, wri, text);
+	fz_write_byte(ctx, wri->out, DL_STROKE_TEXT);
+	write_text(ctx, wri, text);
+	write_stroke(ctx, wri, stroke);
+	write_matrix(ctx, wri->out, ctm);
+	write_color(ctx, wri, cs, colorspace, color, alpha, color_params);
+}
+
+static void
+dl_clip_text(fz_context *ctx, fz_device *dev, const fz_text *text, fz_matrix ctm, fz_rect scissor)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	define_text_fonts(ctx, wri, text);
+	fz_write_byte(ctx, wri->out, DL_CLIP_TEXT);
+	write_text(ctx, wri, text);
+	write_matrix(ctx, wri->out, ctm);
+	write_rect(ctx, wri->out, scissor);
+}
+
+static void
+dl_clip_stroke_text(fz_context *ctx, fz_device *dev, const fz_text *text, const fz_stroke_state *stroke, fz_matrix ctm, fz_rect scissor)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	define_text_fonts(ctx, wri, text);
+	fz_write_byte(ctx, wri->out, DL_CLIP_STROKE_TEXT);
+	write_text(ctx, wri, text);
+	write_stroke(ctx, wri, stroke);
+	write_matrix(ctx, wri->out, ctm);
+	write_rect(ctx, wri->out, scissor);
+}
+
+static void
+dl_ignore_text(fz_context *ctx, fz_device *dev, const fz_text *text, fz_matrix ctm)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	define_text_fonts(ctx, wri, text);
+	fz_write_byte(ctx, wri->out, DL_IGNORE_TEXT);
+	write_text(ctx, wri, text);
+	write_matrix(ctx, wri->out, ctm);
+}
+
+static void
+dl_fill_shade(fz_context *ctx, fz_device *dev, fz_shade *shade, fz_matrix ctm, float alpha, fz_color_params color_params)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int ref = shade_ref(ctx, wri, shade);
+	fz_write_byte(ctx, wri->out, DL_FILL_SHADE);
+	write_ref(ctx, wri, wri->out, DL_SHADE, ref);
+	write_matrix(ctx, wri->out, ctm);
+	fz_write_float_le(ctx, wri->out, alpha);
+	fz_write_byte(ctx, wri->out, dl_pack_color_params(color_params));
+}
+
+static void
+dl_fill_image(fz_context *ctx, fz_device *dev, fz_image *image, fz_matrix ctm, float alpha, fz_color_params color_params)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int ref = image_ref(ctx, wri, image);
+	fz_write_byte(ctx, wri->out, DL_FILL_IMAGE);
+	write_ref(ctx, wri, wri->out, DL_IMAGE, ref);
+	write_matrix(ctx, wri->out, ctm);
+	fz_write_float_le(ctx, wri->out, alpha);
+	fz_write_byte(ctx, wri->out, dl_pack_color_params(color_params));
+}
+
+static void
+dl_fill_image_mask(fz_context *ctx, fz_device *dev, fz_image *image, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int ref = image_ref(ctx, wri, image);
+	int cs = colorspace_ref(ctx, wri, colorspace);
+	fz_write_byte(ctx, wri->out, DL_FILL_IMAGE_MASK);
+	write_ref(ctx, wri, wri->out, DL_IMAGE, ref);
+	write_matrix(ctx, wri->out, ctm);
+	write_color(ctx, wri, cs, colorspace, color, alpha, color_params);
+}
+
+static void
+dl_clip_image_mask(fz_context *ctx, fz_device *dev, fz_image *image, fz_matrix ctm, fz_rect scissor)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int ref = image_ref(ctx, wri, image);
+	fz_write_byte(ctx, wri->out, DL_CLIP_IMAGE_MASK);
+	write_ref(ctx, wri, wri->out, DL_IMAGE, ref);
+	write_matrix(ctx, wri->out, ctm);
+	write_rect(ctx, wri->out, scissor);
+}
+
+static void
+dl_pop_clip(fz_context *ctx, fz_device *dev)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_POP_CLIP);
+}
+
+static int
+dl_begin_mask_id(fz_context *ctx, fz_device *dev, fz_rect area, int luminosity, fz_colorspace *colorspace, const float *bc, fz_color_params color_params, fz_matrix ctm, int id)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int cs = colorspace_ref(ctx, wri, colorspace);
+	fz_write_byte(ctx, wri->out, DL_BEGIN_MASK);
+	write_rect(ctx, wri->out, area);
+	fz_write_byte(ctx, wri->out, luminosity);
+	write_ref(ctx, wri, wri->out, DL_COLORSPACE, cs);
+	fz_write_byte(ctx, wri->out, bc != NULL);
+	if (bc)
+		write_floats(ctx, wri->out, bc, colorspace ? fz_colorspace_n(ctx, colorspace) : 0);
+	fz_write_byte(ctx, wri->out, dl_pack_color_params(color_params));
+	write_matrix(ctx, wri->out, ctm);
+	write_int(ctx, wri->out, id);
+	return 0;
+}
+
+static void
+dl_end_mask(fz_context *ctx, fz_device *dev)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_END_MASK);
+}
+
+static void
+dl_begin_group(fz_context *ctx, fz_device *dev, fz_rect area, fz_colorspace *colorspace, int isolated, int knockout, int blendmode, float alpha)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int cs = colorspace_ref(ctx, wri, colorspace);
+	fz_write_byte(ctx, wri->out, DL_BEGIN_GROUP);
+	write_rect(ctx, wri->out, area);
+	write_ref(ctx, wri, wri->out, DL_COLORSPACE, cs);
+	fz_write_byte(ctx, wri->out, isolated | (knockout << 1));
+	write_uint(ctx, wri->out, blendmode);
+	fz_write_float_le(ctx, wri->out, alpha);
+}
+
+static void
+dl_end_group(fz_context *ctx, fz_device *dev)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_END_GROUP);
+}
+
+static int
+dl_begin_tile(fz_context *ctx, fz_device *dev, fz_rect area, fz_rect view, float xstep, float ystep, fz_matrix ctm, int id)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_BEGIN_TILE);
+	write_rect(ctx, wri->out, area);
+	write_rect(ctx, wri->out, view);
+	fz_write_float_le(ctx, wri->out, xstep);
+	fz_write_float_le(ctx, wri->out, ystep);
+	write_matrix(ctx, wri->out, ctm);
+	write_int(ctx, wri->out, id);
+	return 0;
+}
+
+static void
+dl_end_tile(fz_context *ctx, fz_device *dev)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_END_TILE);
+}
+
+static void
+dl_render_flags(fz_context *ctx, fz_device *dev, int set, int clear)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_RENDER_FLAGS);
+	write_int(ctx, wri->out, set);
+	write_int(ctx, wri->out, clear);
+}
+
+static void
+dl_set_default_colorspaces(fz_context *ctx, fz_device *dev, fz_default_colorspaces *default_cs)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int gray = colorspace_ref(ctx, wri, fz_default_gray(ctx, default_cs));
+	int rgb = colorspace_ref(ctx, wri, fz_default_rgb(ctx, default_cs));
+	int cmyk = colorspace_ref(ctx, wri, fz_default_cmyk(ctx, default_cs));
+	int oi = colorspace_ref(ctx, wri, fz_default_output_intent(ctx, default_cs));
+	fz_write_byte(ctx, wri->out, DL_DEFAULT_COLORSPACES);
+	write_ref(ctx, wri, wri->out, DL_COLORSPACE, gray);
+	write_ref(ctx, wri, wri->out, DL_COLORSPACE, rgb);
+	write_ref(ctx, wri, wri->out, DL_COLORSPACE, cmyk);
+	write_ref(ctx, wri, wri->out, DL_COLORSPACE, oi);
+}
+
+static void
+dl_begin_layer(fz_context *ctx, fz_device *dev, const char *layer_name)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_BEGIN_LAYER);
+	write_string(ctx, wri->out, layer_name);
+}
+
+static void
+dl_end_layer(fz_context *ctx, fz_device *dev)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	fz_write_byte(ctx, wri->out, DL_END_LAYER);
+}
+
+static void
+dl_drop_writer(fz_context *ctx, fz_device *dev)
+{
+	fz_dl_writer *wri = (fz_dl_writer *)dev;
+	int i;
+	for (i = 0; i < DL_KINDS; i++)
+		fz_free(ctx, wri->table[i].items);
+}
+
+void
+fz_write_display_list(fz_context *ctx, fz_output *out, fz_display_list *list, const char *blob_dir)
+{
+	fz_dl_writer *wri = fz_new_derived_device(ctx, fz_dl_writer);
+	fz_cookie cookie = { 0 };
+
+	wri->super.fill_path = dl_fill_path;
+	wri->super.stroke_path = dl_stroke_path;
+	wri->super.clip_path = dl_clip_path;
+	wri->super.clip_stroke_path = dl_clip_stroke_path;
+
+	wri->super.fill_text = dl_fill_text;
+	wri->super.stroke_text = dl_stroke_text;
+	wri->super.clip_text = dl_clip_text;
+	wri->super.clip_stroke_text = dl_clip_stroke_text;
+	wri->super.ignore_text = dl_ignore_text;
+
+	wri->super.fill_shade = dl_fill_shade;
+	wri->super.fill_image = dl_fill_image;
+	wri->super.fill_image_mask = dl_fill_image_mask;
+	wri->super.clip_image_mask = dl_clip_image_mask;
+
+	wri->super.pop_clip = dl_pop_clip;
+
+	wri->super.begin_mask_id = dl_begin_mask_id;
+	wri->super.end_mask = dl_end_mask;
+	wri->super.begin_group = dl_begin_group;
+	wri->super.end_group = dl_end_group;
+
+	wri->super.begin_tile = dl_begin_tile;
+	wri->super.end_tile = dl_end_tile;
+
+	wri->super.render_flags = dl_render_flags;
+	wri->super.set_default_colorspaces = dl_set_default_colorspaces;
+
+	wri->super.begin_layer = dl_begin_layer;
+	wri->super.end_layer = dl_end_layer;
+
+	wri->super.drop_device = dl_drop_writer;
+
+	wri->out = out;
+	wri->blob_dir = blob_dir;
+
+	fz_try(ctx)
+	{
+		fz_write_data(ctx, out, DL_MAGIC, 4);
+		write_uint(ctx, out, DL_VERSION);
+		write_rect(ctx, out, fz_bound_display_list(ctx, list));
+		/* Errors in device calls are swallowed by the list; the cookie counts them. */
+		fz_run_display_list(ctx, list, &wri->super, fz_identity, fz_infinite_rect, &cookie);
+		if (cookie.errors)
+			fz_throw(ctx, FZ_ERROR_GENERIC, "cannot serialize display list");
+		fz_write_byte(ctx, out, DL_END);
+		fz_close_device(ctx, &wri->super);
+	}
+	fz_always(ctx)
+		fz_drop_device(ctx, &wri->super);
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+}
+
+/* Reading */
+
+typedef struct
+{
+	int refs;
+	int kind;
+	unsigned char digest[16];
+} dl_resource_key;
+
+typedef struct
+{
+	fz_storable storable;
+	int kind;
+	void *obj;
+} dl_resource_record;
+
+typedef struct
+{
+	fz_stream *stm;
+	const char *blob_dir;
+	int len[DL_KINDS];
+	int cap[DL_KINDS];
+	void **obj[DL_KINDS];
+	/* Scratch objects of the call being read. */
+	fz_path *path;
+	fz_text *text;
+	fz_stroke_state *stroke;
+	fz_default_colorspaces *default_cs;
+	/* Mask ids are only unique within a session; map them to new ones. */
+	int nids, maxids;
+	int *ids;
+} dl_reader;
+
+static void *
+keep_resource(fz_context *ctx, int kind, void *obj)
+{
+	switch (kind)
+	{
+	case DL_COLORSPACE: return fz_keep_colorspace(ctx, obj);
+	case DL_FONT: return fz_keep_font(ctx, obj);
+	case DL_IMAGE: return fz_keep_image(ctx, obj);
+	default: return fz_keep_shade(ctx, obj);
+	}
+}
+
+static void
+drop_resource(fz_context *ctx, int kind, void *obj)
+{
+	switch (kind)
+	{
+	case DL_COLORSPACE: fz_drop_colorspace(ctx, obj); break;
+	case DL_FONT: fz_drop_font(ctx, obj); break;
+	case DL_IMAGE: fz_drop_image(ctx, obj); break;
+	default: fz_drop_shade(ctx, obj); break;
+	}
+}
+
+static int
+dl_make_hash_resource_key(fz_context *ctx, fz_store_hash *hash, void *key_)
+{
+	dl_resource_key *key = key_;
+	hash->u.pir.ptr = NULL;
+	hash->u.pir.i = key->kind;
+	memcpy(&hash->u.pir.r, key->digest, sizeof(hash->u.pir.r));
+	return 1;
+}
+
+static void *
+dl_keep_resource_key(fz_context *ctx, void *key_)
+{
+	dl_resource_key *key = key_;
+	return fz_keep_imp(ctx, key, &key->refs);
+}
+
+static void
+dl_drop_resource_key(fz_context *ctx, void *key_)
+{
+	dl_resource_key *key = key_;
+	if (fz_drop_imp(ctx, key, &key->refs))
+		fz_free(ctx, key);
+}
+
+static int
+dl_cmp_resource_key(fz_context *ctx, void *k0_, void *k1_)
+{
+	dl_resource_key *k0 = k0_;
+	dl_resource_key *k1 = k1_;
+	return k0->kind != k1->kind || memcmp(k0->digest, k1->digest, 16);
+}
+
+static void
+dl_format_resource_key(fz_context *ctx, char *s, size_t n, void *key_)
+{
+	static const char *kinds[] = { "colorspace", "font", "image", "shade" };
+	dl_resource_key *key = key_;
+	fz_snprintf(s, n, "(display list %s %02x%02x%02x%02x)", kinds[key->kind],
+		key->digest[0], key->digest[1], key->digest[2], key->digest[3]);
+}
+
+static const fz_store_type dl_resource_store_type =
+{
+	"fz_display_list_resource",
+	dl_make_hash_resource_key,
+	dl_keep_resource_key,
+	dl_drop_resource_key,
+	dl_cmp_resource_key,
+	dl_format_resource_key,
+	NULL
+};
+
+static void
+dl_drop_resource_record_imp(fz_context *ctx, fz_storable *storable)
+{
+	dl_resource_record *rec = (dl_resource_record *)storable;
+	drop_resource(ctx, rec->kind, rec->obj);
+	fz_free(ctx, rec);
+}
+
+static void
+corrupt(fz_context *ctx)
+{
+	fz_throw(ctx, FZ_ERROR_GENERIC, "corrupt display list");
+}
+
+static unsigned int
+read_uint(fz_context *ctx, dl_reader *rd)
+{
+	unsigned int v = 0;
+	int shift, c;
+
+	for (shift = 0; shift < 35; shift += 7)
+	{
+		c = fz_read_byte(ctx, rd->stm);
+		if (c == EOF)
+			corrupt(ctx);
+		v |= (unsigned int)(c & 0x7f) << shift;
+		if (c < 0x80)
+			return v;
+	}
+	corrupt(ctx);
+	return 0;
+}
+
+/* Read an unsigned number that is at most max. */
+static int
+read_count(fz_context *ctx, dl_reader *rd, int max)
+{
+	unsigned int v = read_uint(ctx, rd);
+	if (v > (unsigned int)max)
+		corrupt(ctx);
+	return (int)v;
+}
+
+static int
+read_int(fz_context *ctx, dl_reader *rd)
+{
+	unsigned int v = read_uint(ctx, rd);
+	return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static int
+read_byte(fz_context *ctx, dl_reader *rd)
+{
+	int c = fz_read_byte(ctx, rd->stm);
+	if (c == EOF)
+		corrupt(ctx);
+	return c;
+}
+
+static float
+read_float(fz_context *ctx, dl_reader *rd)
+{
+	return fz_read_float_le(ctx, rd->stm);
+}
+
+static void
+read_floats(fz_context *ctx, dl_reader *rd, float *v, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		v[i] = fz_read_float_le(ctx, rd->stm);
+}
+
+static void
+read_data(fz_context *ctx, dl_reader *rd, void *data, size_t len)
+{
+	if (fz_read(ctx, rd->stm, data, len) != len)
+		corrupt(ctx);
+}
+
+static fz_rect
+read_rect(fz_context *ctx, dl_reader *rd)
+{
+	fz_rect r;
+	r.x0 = read_float(ctx, rd);
+	r.y0 = read_float(ctx, rd);
+	r.x1 = read_float(ctx, rd);
+	r.y1 = read_float(ctx, rd);
+	return r;
+}
+
+static fz_matrix
+read_matrix(fz_context *ctx, dl_reader *rd)
+{
+	fz_matrix m;
+	m.a = read_float(ctx, rd);
+	m.b = read_float(ctx, rd);
+	m.c = read_float(ctx, rd);
+	m.d = read_float(ctx, rd);
+	m.e = read_float(ctx, rd);
+	m.f = read_float(ctx, rd);
+	return m;
+}
+
+static char *
+read_string(fz_context *ctx, dl_reader *rd)
+{
+	int len = read_count(ctx, rd, 0xffff);
+	char *s = fz_malloc(ctx, len + 1);
+	fz_try(ctx)
+		read_data(ctx, rd, s, len);
+	fz_catch(ctx)
+	{
+		fz_free(ctx, s);
+		fz_rethrow(ctx);
+	}
+	s[len] = 0;
+	return s;
+}
+
+static fz_buffer *
+read_blob(fz_context *ctx, dl_reader *rd)
+{
+	unsigned char digest[16], check[16];
+	char path[PATH_MAX];
+	fz_buffer *buf;
+	int where = read_byte(ctx, rd);
+	size_t len = read_uint(ctx, rd);
+
+	if (where == DL_BLOB_INLINE)
+	{
+		buf = fz_new_buffer(ctx, len);
+		fz_try(ctx)
+		{
+			read_data(ctx, rd, buf->data, len);
+			buf->len = len;
+		}
+		fz_catch(ctx)
+		{
+			fz_drop_buffer(ctx, buf);
+			fz_rethrow(ctx);
+		}
+		return buf;
+	}
+
+	if (where != DL_BLOB_FILE || !rd->blob_dir)
+		corrupt(ctx);
+	read_data(ctx, rd, digest, 16);
+	dl_blob_path(path, sizeof path, rd->blob_dir, digest);
+	buf = fz_read_file(ctx, path);
+	dl_md5(buf->data, buf->len, check);
+	if (buf->len != len || memcmp(digest, check, 16))
+	{
+		/* Remove it, so that the next list written saves it again. */
+		fz_drop_buffer(ctx, buf);
+#ifdef _WIN32
+		fz_remove_utf8(path);
+#else
+		remove(path);
+#endif
+		corrupt(ctx);
+	}
+	return buf;
+}
+
+static void *
+read_ref(fz_context *ctx, dl_reader *rd, int kind)
+{
+	int ref = read_count(ctx, rd, rd->len[kind]);
+	return ref ? rd->obj[kind][ref - 1] : NULL;
+}
+
+static void *
+read_required_ref(fz_context *ctx, dl_reader *rd, int kind)
+{
+	void *obj = read_ref(ctx, rd, kind);
+	if (!obj)
+		corrupt(ctx);
+	return obj;
+}
+
+static fz_colorspace *
+read_colorspace_def(fz_context *ctx, dl_reader *rd)
+{
+	fz_colorspace *base, *cs = NULL;
+	unsigned char *lookup = NULL;
+	fz_buffer *buf = NULL;
+	char *name = NULL;
+	int type, flags, high;
+
+	fz_var(lookup);
+	fz_var(buf);
+	fz_var(name);
+
+	switch (read_byte(ctx, rd))
+	{
+	case DL_CS_GRAY: return fz_keep_colorspace(ctx, fz_device_gray(ctx));
+	case DL_CS_RGB: return fz_keep_colorspace(ctx, fz_device_rgb(ctx));
+	case DL_CS_BGR: return fz_keep_colorspace(ctx, fz_device_bgr(ctx));
+	case DL_CS_CMYK: return fz_keep_colorspace(ctx, fz_device_cmyk(ctx));
+	case DL_CS_LAB: return fz_keep_colorspace(ctx, fz_device_lab(ctx));
+	case DL_CS_INDEXED:
+		base = read_required_ref(ctx, rd, DL_COLORSPACE);
+		high = read_count(ctx, rd, 255);
+		fz_try(ctx)
+		{
+			size_t len = (high + 1) * (size_t)fz_colorspace_n(ctx, base);
+			lookup = fz_malloc(ctx, len);
+			read_data(ctx, rd, lookup, len);
+			cs = fz_new_indexed_colorspace(ctx, base, high, lookup);
+		}
+		fz_catch(ctx)
+		{
+			fz_free(ctx, lookup);
+			fz_rethrow(ctx);
+		}
+		return cs;
+	case DL_CS_ICC:
+		type = read_uint(ctx, rd);
+		flags = read_uint(ctx, rd);
+		fz_try(ctx)
+		{
+			name = read_string(ctx, rd);
+			buf = read_blob(ctx, rd);
+			cs = fz_new_icc_colorspace(ctx, type, flags, name, buf);
+		}
+		fz_always(ctx)
+		{
+			fz_free(ctx, name);
+			fz_drop_buffer(ctx, buf);
+		}
+		fz_catch(ctx)
+			fz_rethrow(ctx);
+		return cs;
+	}
+	corrupt(ctx);
+	return NULL;
+}
+
+static fz_font *
+read_font_def(fz_context *ctx, dl_reader *rd)
+{
+	fz_font *font = NULL;
+	fz_buffer *buf = NULL;
+	short *width_table = NULL;
+	char *name;
+	int index, flags, use_glyph_bbox, width_count, width_default, i;
+	fz_rect bbox;
+
+	fz_var(font);
+	fz_var(buf);
+	fz_var(width_table);
+
+	name = read_string(ctx, rd);
+	fz_try(ctx)
+	{
+		index = read_uint(ctx, rd);
+		flags = read_uint(ctx, rd);
+		use_glyph_bbox = read_uint(ctx, rd);
+		bbox = read_rect(ctx, rd);
+		width_count = read_count(ctx, rd, 0xffff);
+		width_default = read_int(ctx, rd);
+		if (width_count)
+		{
+			width_table = fz_malloc_array(ctx, width_count, short);
+			for (i = 0; i < width_count; i++)
+				width_table[i] = read_int(ctx, rd);
+		}
+		buf = read_blob(ctx, rd);
+		font = fz_new_font_from_buffer(ctx, name, buf, index, use_glyph_bbox);
+		font->width_table = width_table;
+		font->width_count = width_count;
+		font->width_default = width_default;
+		width_table = NULL;
+		font->bbox = bbox;
+		font->flags.is_mono = flags & 1;
+		font->flags.is_serif = (flags >> 1) & 1;
+		font->flags.is_bold = (flags >> 2) & 1;
+		font->flags.is_italic = (flags >> 3) & 1;
+		font->flags.ft_substitute = (flags >> 4) & 1;
+		font->flags.ft_stretch = (flags >> 5) & 1;
+		font->flags.fake_bold = (flags >> 6) & 1;
+		font->flags.fake_italic = (flags >> 7) & 1;
+		font->flags.has_opentype = (flags >> 8) & 1;
+		font->flags.invalid_bbox = (flags >> 9) & 1;
+		font->flags.cjk = (flags >> 10) & 1;
+		font->flags.cjk_lang = (flags >> 11) & 3;
+	}
+	fz_always(ctx)
+	{
+		fz_free(ctx, name);
+		fz_free(ctx, width_table);
+		fz_drop_buffer(ctx, buf);
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_font(ctx, font);
+		fz_rethrow(ctx);
+	}
+	return font;
+}
+
+static fz_compressed_buffer *
+read_compressed_buffer(fz_context *ctx, dl_reader *rd)
+{
+	fz_compressed_buffer *cbuf = fz_malloc_struct(ctx, fz_compressed_buffer);
+	fz_compression_params *params = &cbuf->params;
+	fz_buffer *globals = NULL;
+
+	fz_var(globals);
+
+	fz_try(ctx)
+	{
+		params->type = read_uint(ctx, rd);
+		switch (params->type)
+		{
+		case FZ_IMAGE_JPEG:
+			params->u.jpeg.color_transform = read_int(ctx, rd);
+			break;
+		case FZ_IMAGE_JPX:
+			params->u.jpx.smask_in_data = read_int(ctx, rd);
+			break;
+		case FZ_IMAGE_JBIG2:
+			params->u.jbig2.embedded = read_int(ctx, rd);
+			if (read_uint(ctx, rd))
+			{
+				globals = read_blob(ctx, rd);
+				params->u.jbig2.globals = fz_load_jbig2_globals(ctx, globals);
+			}
+			break;
+		case FZ_IMAGE_FAX:
+			params->u.fax.columns = read_int(ctx, rd);
+			params->u.fax.rows = read_int(ctx, rd);
+			params->u.fax.k = read_int(ctx, rd);
+			params->u.fax.end_of_line = read_int(ctx, rd);
+			params->u.fax.encoded_byte_align = read_int(ctx, rd);
+			params->u.fax.end_of_block = read_int(ctx, rd);
+			params->u.fax.black_is_1 = read_int(ctx, rd);
+			params->u.fax.damaged_rows_before_error = read_int(ctx, rd);
+			break;
+		case FZ_IMAGE_FLATE:
+			params->u.flate.columns = read_int(ctx, rd);
+			params->u.flate.colors = read_int(ctx, rd);
+			params->u.flate.predictor = read_int(ctx, rd);
+			params->u.flate.bpc = read_int(ctx, rd);
+			break;
+		case FZ_IMAGE_LZW:
+			params->u.lzw.columns = read_int(ctx, rd);
+			params->u.lzw.colors = read_int(ctx, rd);
+			params->u.lzw.predictor = read_int(ctx, rd);
+			params->u.lzw.bpc = read_int(ctx, rd);
+			params->u.lzw.early_change = read_int(ctx, rd);
+			break;
+		}
+		cbuf->buffer = read_blob(ctx, rd);
+	}
+	fz_always(ctx)
+		fz_drop_buffer(ctx, globals);
+	fz_catch(ctx)
+	{
+		fz_drop_compressed_buffer(ctx, cbuf);
+		fz_rethrow(ctx);
+	}
+	return cbuf;
+}
+
+static fz_pixmap *
+read_pixmap(fz_context *ctx, dl_reader *rd, int xres, int yres)
+{
+	fz_colorspace *cs = read_ref(ctx, rd, DL_COLORSPACE);
+	int w = read_count(ctx, rd, 1 << 24);
+	int h = read_count(ctx, rd, 1 << 24);
+	int n = read_count(ctx, rd, FZ_MAX_COLORS + 1);
+	int alpha = read_count(ctx, rd, 1);
+	fz_pixmap *pix = NULL;
+	fz_buffer *buf = NULL;
+	fz_stream *stm = NULL;
+	int y;
+
+	fz_var(pix);
+	fz_var(buf);
+	fz_var(stm);
+
+	fz_try(ctx)
+	{
+		pix = fz_new_pixmap(ctx, cs, w, h, NULL, alpha);
+		if (pix->n != n)
+			corrupt(ctx);
+		pix->xres = xres;
+		pix->yres = yres;
+		buf = read_blob(ctx, rd);
+		stm = fz_open_flated(ctx, fz_open_buffer(ctx, buf), 15);
+		for (y = 0; y < h; y++)
+			if (fz_read(ctx, stm, pix->samples + y * (size_t)pix->stride, (size_t)w * n) != (size_t)w * n)
+				corrupt(ctx);
+	}
+	fz_always(ctx)
+	{
+		fz_drop_stream(ctx, stm);
+		fz_drop_buffer(ctx, buf);
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_pixmap(ctx, pix);
+		fz_rethrow(ctx);
+	}
+	return pix;
+}
+
+static fz_image *
+read_image_def(fz_context *ctx, dl_reader *rd)
+{
+	fz_compressed_buffer *cbuf = NULL;
+	fz_pixmap *pix = NULL;
+	fz_image *image = NULL;
+	fz_colorspace *cs;
+	fz_image *mask;
+	int w, h, n, bpc, xres, yres, flags, orientation, i;
+	float decode[FZ_MAX_COLORS * 2];
+	int colorkey[FZ_MAX_COLORS * 2];
+
+	fz_var(cbuf);
+	fz_var(pix);
+
+	w = read_count(ctx, rd, 1 << 24);
+	h = read_count(ctx, rd, 1 << 24);
+	n = read_count(ctx, rd, FZ_MAX_COLORS);
+	bpc = read_count(ctx, rd, 32);
+	cs = read_ref(ctx, rd, DL_COLORSPACE);
+	mask = read_ref(ctx, rd, DL_IMAGE);
+	xres = read_uint(ctx, rd);
+	yres = read_uint(ctx, rd);
+	flags = read_uint(ctx, rd);
+	orientation = read_count(ctx, rd, 8);
+	if (flags & 8)
+		read_floats(ctx, rd, decode, 2 * n);
+	if (flags & 4)
+		for (i = 0; i < 2 * n; i++)
+			colorkey[i] = read_int(ctx, rd);
+
+	fz_try(ctx)
+	{
+		switch (read_byte(ctx, rd))
+		{
+		case DL_IMAGE_COMPRESSED:
+			cbuf = read_compressed_buffer(ctx, rd);
+			image = fz_new_image_from_compressed_buffer(ctx, w, h, bpc, cs, xres, yres,
+				(flags >> 1) & 1, flags & 1, (flags & 8) ? decode : NULL, (flags & 4) ? colorkey : NULL, cbuf, mask);
+			cbuf = NULL;
+			image->invert_cmyk_jpeg = (flags >> 4) & 1;
+			break;
+		case DL_IMAGE_PIXMAP:
+			pix = read_pixmap(ctx, rd, xres, yres);
+			image = fz_new_image_from_pixmap(ctx, pix, mask);
+			image->interpolate = (flags >> 1) & 1;
+			break;
+		default:
+			corrupt(ctx);
+		}
+		image->orientation = orientation;
+	}
+	fz_always(ctx)
+	{
+		fz_drop_compressed_buffer(ctx, cbuf);
+		fz_drop_pixmap(ctx, pix);
+	}
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+	return image;
+}
+
+static fz_shade *
+read_shade_def(fz_context *ctx, dl_reader *rd)
+{
+	fz_shade *shade = fz_malloc_struct(ctx, fz_shade);
+	int n, i;
+
+	FZ_INIT_STORABLE(shade, 1, fz_drop_shade_imp);
+	fz_try(ctx)
+	{
+		shade->colorspace = fz_keep_colorspace(ctx, read_required_ref(ctx, rd, DL_COLORSPACE));
+		n = fz_colorspace_n(ctx, shade->colorspace);
+		shade->type = read_uint(ctx, rd);
+		if (shade->type < FZ_FUNCTION_BASED || shade->type > FZ_MESH_TYPE7)
+		{
+			shade->type = 0;
+			corrupt(ctx);
+		}
+		shade->bbox = read_rect(ctx, rd);
+		shade->matrix = read_matrix(ctx, rd);
+		shade->use_background = read_count(ctx, rd, 1);
+		if (shade->use_background)
+			read_floats(ctx, rd, shade->background, n);
+		shade->use_function = read_count(ctx, rd, 1);
+		if (shade->use_function)
+			for (i = 0; i < 256; i++)
+				read_floats(ctx, rd, shade->function[i], n + 1);
+
+		switch (shade->type)
+		{
+		case FZ_FUNCTION_BASED:
+			shade->u.f.matrix = read_matrix(ctx, rd);
+			shade->u.f.xdivs = read_count(ctx, rd, 1024);
+			shade->u.f.ydivs = read_count(ctx, rd, 1024);
+			read_floats(ctx, rd, &shade->u.f.domain[0][0], 4);
+			shade->u.f.fn_vals = fz_malloc_array(ctx, (shade->u.f.xdivs + 1) * (shade->u.f.ydivs + 1) * n, float);
+			read_floats(ctx, rd, shade->u.f.fn_vals, (shade->u.f.xdivs + 1) * (shade->u.f.ydivs + 1) * n);
+			break;
+		case FZ_LINEAR:
+		case FZ_RADIAL:
+			shade->u.l_or_r.extend[0] = read_uint(ctx, rd);
+			shade->u.l_or_r.extend[1] = read_uint(ctx, rd);
+			read_floats(ctx, rd, &shade->u.l_or_r.coords[0][0], 6);
+			break;
+		default:
+			shade->u.m.vprow = read_int(ctx, rd);
+			shade->u.m.bpflag = read_int(ctx, rd);
+			shade->u.m.bpcoord = read_int(ctx, rd);
+			shade->u.m.bpcomp = read_int(ctx, rd);
+			shade->u.m.x0 = read_float(ctx, rd);
+			shade->u.m.x1 = read_float(ctx, rd);
+			shade->u.m.y0 = read_float(ctx, rd);
+			shade->u.m.y1 = read_float(ctx, rd);
+			read_floats(ctx, rd, shade->u.m.c0, n);
+			read_floats(ctx, rd, shade->u.m.c1, n);
+			if (read_uint(ctx, rd))
+				shade->buffer = read_compressed_buffer(ctx, rd);
+			break;
+		}
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_shade(ctx, shade);
+		fz_rethrow(ctx);
+	}
+	return shade;
+}
+
+static size_t
+resource_size(fz_context *ctx, int kind, void *obj)
+{
+	switch (kind)
+	{
+	case DL_FONT:
+		return sizeof(fz_font) + ((fz_font *)obj)->buffer->len;
+	case DL_IMAGE:
+		return fz_image_size(ctx, obj);
+	case DL_SHADE:
+		return sizeof(fz_shade) + (((fz_shade *)obj)->buffer ? fz_compressed_buffer_size(((fz_shade *)obj)->buffer) : 0);
+	default:
+		return sizeof(fz_colorspace);
+	}
+}
+
+/*
+	Read a definition, or take the object it defines from the store
+	if that was read before.
+*/
+static void
+read_define(fz_context *ctx, dl_reader *rd)
+{
+	dl_resource_record *rec = NULL;
+	dl_resource_record *found;
+	dl_resource_key *key = NULL;
+	void *obj = NULL;
+	int kind = read_count(ctx, rd, DL_KINDS - 1);
+	unsigned char digest[16];
+	size_t len;
+	int64_t end;
+
+	read_data(ctx, rd, digest, 16);
+	len = read_uint(ctx, rd);
+
+	if (rd->len[kind] == rd->cap[kind])
+	{
+		int cap = rd->cap[kind] ? rd->cap[kind] * 2 : 16;
+		rd->obj[kind] = fz_realloc_array(ctx, rd->obj[kind], cap, void *);
+		rd->cap[kind] = cap;
+	}
+
+	fz_var(rec);
+	fz_var(key);
+	fz_var(obj);
+
+	fz_try(ctx)
+	{
+		key = fz_malloc_struct(ctx, dl_resource_key);
+		key->refs = 1;
+		key->kind = kind;
+		memcpy(key->digest, digest, 16);
+
+		found = fz_find_item(ctx, dl_drop_resource_record_imp, key, &dl_resource_store_type);
+		if (found)
+		{
+			obj = keep_resource(ctx, kind, found->obj);
+			fz_drop_storable(ctx, &found->storable);
+			if (fz_skip(ctx, rd->stm, len) != len)
+				corrupt(ctx);
+		}
+		else
+		{
+			end = fz_tell(ctx, rd->stm) + len;
+			switch (kind)
+			{
+			case DL_COLORSPACE: obj = read_colorspace_def(ctx, rd); break;
+			case DL_FONT: obj = read_font_def(ctx, rd); break;
+			case DL_IMAGE: obj = read_image_def(ctx, rd); break;
+			case DL_SHADE: obj = read_shade_def(ctx, rd); break;
+			}
+			if (fz_tell(ctx, rd->stm) != end)
+				corrupt(ctx);
+
+			rec = fz_malloc_struct(ctx, dl_resource_record);
+			FZ_INIT_STORABLE(rec, 1, dl_drop_resource_record_imp);
+			rec->kind = kind;
+			rec->obj = keep_resource(ctx, kind, obj);
+			found = fz_store_item(ctx, key, rec, resource_size(ctx, kind, obj), &dl_resource_store_type);
+			if (found)
+			{
+				/* Read by another thread meanwhile; share that one. */
+				drop_resource(ctx, kind, obj);
+				obj = keep_resource(ctx, kind, found->obj);
+				fz_drop_storable(ctx, &found->storable);
+			}
+		}
+		rd->obj[kind][rd->len[kind]++] = obj;
+		obj = NULL;
+	}
+	fz_always(ctx)
+	{
+		if (rec)
+			fz_drop_storable(ctx, &rec->storable);
+		dl_drop_resource_key(ctx, key);
+	}
+	fz_catch(ctx)
+	{
+		if (obj)
+			drop_resource(ctx, kind, obj);
+		fz_rethrow(ctx);
+	}
+}
+
+static void
+read_path(fz_context *ctx, dl_reader *rd)
+{
+	float v[6];
+	fz_path *path;
+
+	fz_drop_path(ctx, rd->path);
+	rd->path = NULL;
+	path = rd->path = fz_new_path(ctx);
+	for (;;)
+	{
+		switch (read_byte(ctx, rd))
+		{
+		case DL_MOVETO:
+			read_floats(ctx, rd, v, 2);
+			fz_moveto(ctx, path, v[0], v[1]);
+			break;
+		case DL_LINETO:
+			read_floats(ctx, rd, v, 2);
+			fz_lineto(ctx, path, v[0], v[1]);
+			break;
+		case DL_CURVETO:
+			read_floats(ctx, rd, v, 6);
+			fz_curveto(ctx, path, v[0], v[1], v[2], v[3], v[4], v[5]);
+			break;
+		case DL_CLOSEPATH:
+			fz_closepath(ctx, path);
+			break;
+		case DL_QUADTO:
+			read_floats(ctx, rd, v, 4);
+			fz_quadto(ctx, path, v[0], v[1], v[2], v[3]);
+			break;
+		case DL_CURVETOV:
+			read_floats(ctx, rd, v, 4);
+			fz_curvetov(ctx, path, v[0], v[1], v[2], v[3]);
+			break;
+		case DL_CURVETOY:
+			read_floats(ctx, rd, v, 4);
+			fz_curvetoy(ctx, path, v[0], v[1], v[2], v[3]);
+			break;
+		case DL_RECTTO:
+			read_floats(ctx, rd, v, 4);
+			fz_rectto(ctx, path, v[0], v[1], v[2], v[3]);
+			break;
+		case DL_PATH_END:
+			return;
+		default:
+			corrupt(ctx);
+		}
+	}
+}
+
+static void
+read_stroke(fz_context *ctx, dl_reader *rd)
+{
+	fz_stroke_state *stroke;
+	int dash_len;
+
+	if (!read_byte(ctx, rd))
+	{
+		if (!rd->stroke)
+			corrupt(ctx);
+		return;
+	}
+
+	fz_drop_stroke_state(ctx, rd->stroke);
+	rd->stroke = NULL;
+
+	{
+		fz_linecap start_cap = read_count(ctx, rd, FZ_LINECAP_TRIANGLE);
+		fz_linecap dash_cap = read_count(ctx, rd, FZ_LINECAP_TRIANGLE);
+		fz_linecap end_cap = read_count(ctx, rd, FZ_LINECAP_TRIANGLE);
+		fz_linejoin linejoin = read_count(ctx, rd, FZ_LINEJOIN_MITER_XPS);
+		float linewidth = read_float(ctx, rd);
+		float miterlimit = read_float(ctx, rd);
+		float dash_phase = read_float(ctx, rd);
+
+		dash_len = read_count(ctx, rd, 0xffff);
+		stroke = rd->stroke = fz_new_stroke_state_with_dash_len(ctx, dash_len);
+		stroke->start_cap = start_cap;
+		stroke->dash_cap = dash_cap;
+		stroke->end_cap = end_cap;
+		stroke->linejoin = linejoin;
+		stroke->linewidth = linewidth;
+		stroke->miterlimit = miterlimit;
+		stroke->dash_phase = dash_phase;
+		stroke->dash_len = dash_len;
+		read_floats(ctx, rd, stroke->dash_list, dash_len);
+	}
+}
+
+static void
+read_text(fz_context *ctx, dl_reader *rd)
+{
+	int nspans, len, wmode, bidi_level, markup_dir, language, gid, ucs, i;
+	fz_font *font;
+	fz_matrix trm;
+	fz_text *text;
+
+	fz_drop_text(ctx, rd->text);
+	rd->text = NULL;
+	text = rd->text = fz_new_text(ctx);
+
+	nspans = read_count(ctx, rd, INT_MAX);
+	while (nspans-- > 0)
+	{
+		font = read_required_ref(ctx, rd, DL_FONT);
+		trm.a = read_float(ctx, rd);
+		trm.b = read_float(ctx, rd);
+		trm.c = read_float(ctx, rd);
+		trm.d = read_float(ctx, rd);
+		wmode = read_count(ctx, rd, 1);
+		bidi_level = read_count(ctx, rd, 127);
+		markup_dir = read_count(ctx, rd, 3);
+		language = read_count(ctx, rd, 0x7fff);
+		len = read_count(ctx, rd, INT_MAX);
+		for (i = 0; i < len; i++)
+		{
+			trm.e = read_float(ctx, rd);
+			trm.f = read_float(ctx, rd);
+			gid = read_int(ctx, rd);
+			ucs = read_int(ctx, rd);
+			fz_show_glyph(ctx, text, font, trm, gid, ucs, wmode, bidi_level, markup_dir, language);
+		}
+	}
+}
+
+/* Read a color, returning its colorspace. */
+static fz_colorspace *
+read_color(fz_context *ctx, dl_reader *rd, float *color, float *alpha, fz_color_params *color_params)
+{
+	fz_colorspace *cs = read_ref(ctx, rd, DL_COLORSPACE);
+	read_floats(ctx, rd, color, cs ? fz_colorspace_n(ctx, cs) : 0);
+	*alpha = read_float(ctx, rd);
+	*color_params = dl_unpack_color_params(read_byte(ctx, rd));
+	return cs;
+}
+
+static int
+map_mask_id(fz_context *ctx, dl_reader *rd, int id)
+{
+	int i;
+
+	if (id == 0)
+		return 0;
+	for (i = 0; i < rd->nids; i += 2)
+		if (rd->ids[i] == id)
+			return rd->ids[i + 1];
+	if (rd->nids == rd->maxids)
+	{
+		int maxids = rd->maxids ? rd->maxids * 2 : 16;
+		rd->ids = fz_realloc_array(ctx, rd->ids, maxids, int);
+		rd->maxids = maxids;
+	}
+	rd->ids[rd->nids++] = id;
+	rd->ids[rd->nids++] = fz_new_store_id(ctx);
+	return rd->ids[rd->nids - 1];
+}
+
+static void
+read_calls(fz_context *ctx, dl_reader *rd, fz_device *dev)
+{
+	float color[FZ_MAX_COLORS];
+	fz_color_params color_params;
+	fz_colorspace *cs, *dcs[4];
+	fz_matrix ctm;
+	fz_rect rect, view;
+	float alpha, xstep, ystep;
+	int op, even_odd, flags, luminosity, id;
+	void *obj;
+
+	for (;;)
+	{
+		op = read_byte(ctx, rd);
+		switch (op)
+		{
+		case DL_END:
+			return;
+		case DL_DEFINE:
+			read_define(ctx, rd);
+			break;
+
+		case DL_FILL_PATH:
+			read_path(ctx, rd);
+			even_odd = read_byte(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			cs = read_color(ctx, rd, color, &alpha, &color_params);
+			fz_fill_path(ctx, dev, rd->path, even_odd, ctm, cs, color, alpha, color_params);
+			break;
+		case DL_STROKE_PATH:
+			read_path(ctx, rd);
+			read_stroke(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			cs = read_color(ctx, rd, color, &alpha, &color_params);
+			fz_stroke_path(ctx, dev, rd->path, rd->stroke, ctm, cs, color, alpha, color_params);
+			break;
+		case DL_CLIP_PATH:
+			read_path(ctx, rd);
+			even_odd = read_byte(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			rect = read_rect(ctx, rd);
+			fz_clip_path(ctx, dev, rd->path, even_odd, ctm, rect);
+			break;
+		case DL_CLIP_STROKE_PATH:
+			read_path(ctx, rd);
+			read_stroke(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			rect = read_rect(ctx, rd);
+			fz_clip_stroke_path(ctx, dev, rd->path, rd->stroke, ctm, rect);
+			break;
+
+		case DL_FILL_TEXT:
+			read_text(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			cs = read_color(ctx, rd, color, &alpha, &color_params);
+			fz_fill_text(ctx, dev, rd->text, ctm, cs, color, alpha, color_params);
+			break;
+		case DL_STROKE_TEXT:
+			read_text(ctx, rd);
+			read_stroke(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			cs = read_color(ctx, rd, color, &alpha, &color_params);
+			fz_stroke_text(ctx, dev, rd->text, rd->stroke, ctm, cs, color, alpha, color_params);
+			break;
+		case DL_CLIP_TEXT:
+			read_text(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			rect = read_rect(ctx, rd);
+			fz_clip_text(ctx, dev, rd->text, ctm, rect);
+			break;
+		case DL_CLIP_STROKE_TEXT:
+			read_text(ctx, rd);
+			read_stroke(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			rect = read_rect(ctx, rd);
+			fz_clip_stroke_text(ctx, dev, rd->text, rd->stroke, ctm, rect);
+			break;
+		case DL_IGNORE_TEXT:
+			read_text(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			fz_ignore_text(ctx, dev, rd->text, ctm);
+			break;
+
+		case DL_FILL_SHADE:
+			obj = read_required_ref(ctx, rd, DL_SHADE);
+			ctm = read_matrix(ctx, rd);
+			alpha = read_float(ctx, rd);
+			color_params = dl_unpack_color_params(read_byte(ctx, rd));
+			fz_fill_shade(ctx, dev, obj, ctm, alpha, color_params);
+			break;
+		case DL_FILL_IMAGE:
+			obj = read_required_ref(ctx, rd, DL_IMAGE);
+			ctm = read_matrix(ctx, rd);
+			alpha = read_float(ctx, rd);
+			color_params = dl_unpack_color_params(read_byte(ctx, rd));
+			fz_fill_image(ctx, dev, obj, ctm, alpha, color_params);
+			break;
+		case DL_FILL_IMAGE_MASK:
+			obj = read_required_ref(ctx, rd, DL_IMAGE);
+			ctm = read_matrix(ctx, rd);
+			cs = read_color(ctx, rd, color, &alpha, &color_params);
+			fz_fill_image_mask(ctx, dev, obj, ctm, cs, color, alpha, color_params);
+			break;
+		case DL_CLIP_IMAGE_MASK:
+			obj = read_required_ref(ctx, rd, DL_IMAGE);
+			ctm = read_matrix(ctx, rd);
+			rect = read_rect(ctx, rd);
+			fz_clip_image_mask(ctx, dev, obj, ctm, rect);
+			break;
+
+		case DL_POP_CLIP:
+			fz_pop_clip(ctx, dev);
+			break;
+
+		case DL_BEGIN_MASK:
+			rect = read_rect(ctx, rd);
+			luminosity = read_byte(ctx, rd);
+			cs = read_ref(ctx, rd, DL_COLORSPACE);
+			flags = read_byte(ctx, rd);
+			if (flags)
+				read_floats(ctx, rd, color, cs ? fz_colorspace_n(ctx, cs) : 0);
+			color_params = dl_unpack_color_params(read_byte(ctx, rd));
+			ctm = read_matrix(ctx, rd);
+			id = map_mask_id(ctx, rd, read_int(ctx, rd));
+			(void)fz_begin_mask_id(ctx, dev, rect, luminosity, cs, flags ? color : NULL, color_params, ctm, id);
+			break;
+		case DL_END_MASK:
+			fz_end_mask(ctx, dev);
+			break;
+		case DL_BEGIN_GROUP:
+			rect = read_rect(ctx, rd);
+			cs = read_ref(ctx, rd, DL_COLORSPACE);
+			flags = read_byte(ctx, rd);
+			id = read_uint(ctx, rd);
+			alpha = read_float(ctx, rd);
+			fz_begin_group(ctx, dev, rect, cs, flags & 1, (flags >> 1) & 1, id, alpha);
+			break;
+		case DL_END_GROUP:
+			fz_end_group(ctx, dev);
+			break;
+
+		case DL_BEGIN_TILE:
+			rect = read_rect(ctx, rd);
+			view = read_rect(ctx, rd);
+			xstep = read_float(ctx, rd);
+			ystep = read_float(ctx, rd);
+			ctm = read_matrix(ctx, rd);
+			id = read_int(ctx, rd);
+			(void)fz_begin_tile_id(ctx, dev, rect, view, xstep, ystep, ctm, id);
+			break;
+		case DL_END_TILE:
+			fz_end_tile(ctx, dev);
+			break;
+
+		case DL_RENDER_FLAGS:
+			flags = read_int(ctx, rd);
+			fz_render_flags(ctx, dev, flags, read_int(ctx, rd));
+			break;
+		case DL_DEFAULT_COLORSPACES:
+			fz_drop_default_colorspaces(ctx, rd->default_cs);
+			rd->default_cs = NULL;
+			dcs[0] = read_required_ref(ctx, rd, DL_COLORSPACE);
+			dcs[1] = read_required_ref(ctx, rd, DL_COLORSPACE);
+			dcs[2] = read_required_ref(ctx, rd, DL_COLORSPACE);
+			dcs[3] = read_ref(ctx, rd, DL_COLORSPACE);
+			rd->default_cs = fz_new_default_colorspaces(ctx);
+			/* Setting the output intent changes the defaults too. */
+			if (dcs[3])
+				fz_set_default_output_intent(ctx, rd->default_cs, dcs[3]);
+			fz_set_default_gray(ctx, rd->default_cs, dcs[0]);
+			fz_set_default_rgb(ctx, rd->default_cs, dcs[1]);
+			fz_set_default_cmyk(ctx, rd->default_cs, dcs[2]);
+			fz_set_default_colorspaces(ctx, dev, rd->default_cs);
+			break;
+
+		case DL_BEGIN_LAYER:
+		{
+			char *name = read_string(ctx, rd);
+			fz_try(ctx)
+				fz_begin_layer(ctx, dev, name);
+			fz_always(ctx)
+				fz_free(ctx, name);
+			fz_catch(ctx)
+				fz_rethrow(ctx);
+			break;
+		}
+		case DL_END_LAYER:
+			fz_end_layer(ctx, dev);
+			break;
+
+		default:
+			corrupt(ctx);
+		}
+	}
+}
+
+fz_display_list *
+fz_read_display_list(fz_context *ctx, fz_stream *stm, const char *blob_dir)
+{
+	dl_reader rd = { 0 };
+	fz_display_list *list = NULL;
+	fz_device *dev = NULL;
+	unsigned char magic[4];
+	int i, j;
+
+	fz_var(list);
+	fz_var(dev);
+
+	rd.stm = stm;
+	rd.blob_dir = blob_dir;
+
+	fz_try(ctx)
+	{
+		read_data(ctx, &rd, magic, 4);
+		if (memcmp(magic, DL_MAGIC, 4))
+			fz_throw(ctx, FZ_ERROR_GENERIC, "not a display list");
+		if (read_uint(ctx, &rd) != DL_VERSION)
+			fz_throw(ctx, FZ_ERROR_GENERIC, "unsupported display list version");
+		list = fz_new_display_list(ctx, read_rect(ctx, &rd));
+		dev = fz_new_list_device(ctx, list);
+		read_calls(ctx, &rd, dev);
+		fz_close_device(ctx, dev);
+	}
+	fz_always(ctx)
+	{
+		fz_drop_device(ctx, dev);
+		fz_drop_path(ctx, rd.path);
+		fz_drop_text(ctx, rd.text);
+		fz_drop_stroke_state(ctx, rd.stroke);
+		fz_drop_default_colorspaces(ctx, rd.default_cs);
+		for (i = 0; i < DL_KINDS; i++)
+		{
+			for (j = 0; j < rd.len[i]; j++)
+				drop_resource(ctx, i, rd.obj[i][j]);
+			fz_free(ctx, rd.obj[i]);
+		}
+		fz_free(ctx, rd.ids);
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_display_list(ctx, list);
+		fz_rethrow(ctx);
+	}
+
+	return list;
+}
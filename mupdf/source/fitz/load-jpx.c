@@ -69,6 +69,8 @@ typedef struct
 	fz_colorspace *cs;
 	int xres;
 	int yres;
+	int n;
+	int alpha;
 } fz_jpxd;
 
 typedef struct
@@ -99,7 +101,19 @@ typedef struct
  * threading systems.
  */
 
-static fz_context *opj_secret = NULL;
+/* SumatraPDF: the context is per thread, as openjpeg's worker
+ * threads (see jpx_set_threads) allocate through opj_malloc too.
+ */
+__declspec(thread) static fz_context *opj_secret = NULL;
+
+/* A fz_context may only be used by one thread at a time, so every
+ * worker thread is given a clone of the decoding thread's context the
+ * first time it allocates. These are set up and dropped by the
+ * decoding thread with the opj lock held, so there is only ever one
+ * set of them. */
+static fz_context **opj_workers = NULL;
+static int opj_num_workers = 0;
+static int opj_next_worker = 0;
 
 static void set_opj_context(fz_context *ctx)
 {
@@ -108,7 +122,30 @@ static void set_opj_context(fz_context *ctx)
 
 static fz_context *get_opj_context(void)
 {
-	return opj_secret;
+	fz_context *ctx = opj_secret;
+
+	if (ctx == NULL && opj_num_workers > 0)
+	{
+		fz_lock(opj_workers[0], FZ_LOCK_ALLOC);
+		if (opj_next_worker < opj_num_workers)
+			ctx = opj_workers[opj_next_worker++];
+		fz_unlock(opj_workers[0], FZ_LOCK_ALLOC);
+		opj_secret = ctx;
+	}
+
+	return ctx;
+}
+
+static void jpx_drop_workers(fz_context *ctx)
+{
+	int i;
+
+	for (i = 0; i < opj_num_workers; i++)
+		fz_drop_context(opj_workers[i]);
+	fz_free(ctx, opj_workers);
+	opj_workers = NULL;
+	opj_num_workers = 0;
+	opj_next_worker = 0;
 }
 
 /*
@@ -400,6 +437,12 @@ template_copy_comp(unsigned char *dst0, int w, int h, int stride, const OPJ_INT3
 	}
 }
 
+static inline int32_t
+jpx_ceildivpow2(int32_t a, int b)
+{
+	return (int32_t)(((int64_t)a + (1 << b) - 1) >> b);
+}
+
 static void
 copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx)
 {
@@ -420,8 +463,11 @@ copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx)
 		OPJ_UINT32 cdy = comp->dy;
 		OPJ_UINT32 cw = comp->w;
 		OPJ_UINT32 ch = comp->h;
-		int32_t oy = safe_mul32(ctx, comp->y0, cdy) - jpx->y0;
-		int32_t ox = safe_mul32(ctx, comp->x0, cdx) - jpx->x0;
+		/* When decoding at reduced resolution, the component sizes
+		 * are reduced, but the origins are not. */
+		int factor = comp->factor;
+		int32_t oy = safe_mul32(ctx, jpx_ceildivpow2(comp->y0, factor), cdy) - jpx_ceildivpow2(jpx->y0, factor);
+		int32_t ox = safe_mul32(ctx, jpx_ceildivpow2(comp->x0, factor), cdx) - jpx_ceildivpow2(jpx->x0, factor);
 		unsigned char *dst0 = dst + oy * stride;
 		int prec = comp->prec;
 		int sgnd = comp->sgnd;
@@ -447,8 +493,127 @@ copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx)
 	}
 }
 
+/* Smaller decodes are not worth starting a pool of threads for. */
+#define JPX_THREADS_MIN_SIZE (256 << 10)
+#define JPX_THREADS_MIN_AREA (1024 * 1024)
+
+/*
+	Let openjpeg decode tiles and code-blocks on a pool of worker
+	threads, if asked to and if the decode is large enough. openjpeg
+	keeps the pool in the codec and needs it before reading the
+	header, so it is created for each such decode. The workers each
+	get a cloned context (see get_opj_context); jpx_drop_workers
+	drops them once the codec, and with it the pool, is destroyed.
+*/
+static void
+jpx_set_threads(fz_context *ctx, opj_codec_t *codec, size_t size, const fz_irect *subarea, const int *l2factor)
+{
+	int threads = fz_jpx_threads(ctx);
+	int cpus, i;
+
+	if (threads <= 1 || !opj_has_thread_support())
+		return;
+	if (size < JPX_THREADS_MIN_SIZE)
+		return;
+	if (subarea)
+	{
+		int64_t area = (int64_t)(subarea->x1 - subarea->x0) * (subarea->y1 - subarea->y0);
+		if (l2factor && *l2factor > 0)
+			area >>= 2 * fz_mini(*l2factor, 16);
+		if (area < JPX_THREADS_MIN_AREA)
+			return;
+	}
+	cpus = opj_get_num_cpus();
+	if (threads > cpus)
+		threads = cpus;
+	if (threads <= 1)
+		return;
+
+	fz_try(ctx)
+	{
+		opj_workers = fz_malloc_array(ctx, threads, fz_context *);
+		for (i = 0; i < threads; i++)
+		{
+			/* Contexts without locking cannot be cloned. */
+			fz_context *worker = fz_clone_context(ctx);
+			if (worker == NULL)
+				break;
+			opj_workers[opj_num_workers++] = worker;
+		}
+	}
+	fz_catch(ctx)
+		fz_warn(ctx, "cannot create contexts for JPX decoding threads");
+	if (opj_num_workers < threads)
+	{
+		jpx_drop_workers(ctx);
+		return;
+	}
+
+	if (!opj_codec_set_threads(codec, threads))
+		fz_warn(ctx, "cannot decode JPX with %d threads", threads);
+}
+
+/*
+	Restrict decoding to subarea (in image coordinates), at a
+	resolution reduced by 2^l2factor as far as the codestream allows.
+	On exit, subarea is updated to the area that will actually be
+	decoded, and l2factor to the amount of subsampling left for the
+	caller to do.
+*/
+static void
+jpx_set_decode_region(fz_context *ctx, opj_codec_t *codec, opj_image_t *jpx, fz_irect *subarea, int *l2factor)
+{
+	opj_codestream_info_v2_t *info;
+	int w = jpx->x1 - jpx->x0;
+	int h = jpx->y1 - jpx->y0;
+	int factor = l2factor ? *l2factor : 0;
+	int f;
+	OPJ_UINT32 i;
+
+	/* We can't reduce further than the lowest resolution of any component. */
+	info = opj_get_cstr_info(codec);
+	if (info == NULL || info->m_default_tile_info.tccp_info == NULL)
+		factor = 0;
+	else
+	{
+		for (i = 0; i < info->nbcomps; i++)
+			if (factor >= (int)info->m_default_tile_info.tccp_info[i].numresolutions)
+				factor = (int)info->m_default_tile_info.tccp_info[i].numresolutions - 1;
+	}
+	opj_destroy_cstr_info(&info);
+	if (factor < 0)
+		factor = 0;
+	if (factor > 0 && !opj_set_decoded_resolution_factor(codec, factor))
+	{
+		factor = 0;
+		opj_set_decoded_resolution_factor(codec, 0);
+	}
+	if (l2factor)
+		*l2factor -= factor;
+
+	if (subarea == NULL)
+		return;
+
+	/* Align the area to whole pixels at the reduced resolution. */
+	f = 1 << factor;
+	subarea->x0 &= ~(f - 1);
+	subarea->y0 &= ~(f - 1);
+	subarea->x1 = (subarea->x1 + f - 1) & ~(f - 1);
+	subarea->y1 = (subarea->y1 + f - 1) & ~(f - 1);
+	*subarea = fz_intersect_irect(*subarea, fz_make_irect(0, 0, w, h));
+	if (fz_is_empty_irect(*subarea))
+		*subarea = fz_make_irect(0, 0, w, h);
+	if (subarea->x0 == 0 && subarea->y0 == 0 && subarea->x1 == w && subarea->y1 == h)
+		return;
+
+	if (!opj_set_decode_area(codec, jpx,
+		jpx->x0 + subarea->x0, jpx->y0 + subarea->y0,
+		jpx->x0 + subarea->x1, jpx->y0 + subarea->y1))
+		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to set JPX decode area");
+}
+
 static fz_pixmap *
-jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_t size, fz_colorspace *defcs, int onlymeta)
+jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_t size, fz_colorspace *defcs, fz_irect *subarea, int *l2factor, int onlymeta)
 {
 	fz_pixmap *img = NULL;
 	opj_dparameters_t params;
@@ -485,6 +650,8 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 		opj_destroy_codec(codec);
 		fz_throw(ctx, FZ_ERROR_GENERIC, "j2k decode failed");
 	}
+	if (!onlymeta)
+		jpx_set_threads(ctx, codec, size, subarea, l2factor);
 
 	stream = opj_stream_default_create(OPJ_TRUE);
 	sb.data = data;
@@ -505,6 +672,39 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to read JPX header");
 	}
 
+	/* onlymeta == 2: just the dimensions and components from the header,
+	 * without decoding anything (so without any embedded ICC profile). */
+	if (onlymeta == 2)
+	{
+		state->width = jpx->x1 - jpx->x0;
+		state->height = jpx->y1 - jpx->y0;
+		state->n = state->alpha = 0;
+		for (i = 0; i < jpx->numcomps; ++i)
+		{
+			if (jpx->comps[i].alpha)
+				state->alpha++;
+			else
+				state->n++;
+		}
+		opj_stream_destroy(stream);
+		opj_destroy_codec(codec);
+		opj_image_destroy(jpx);
+		return NULL;
+	}
+
+	if (!onlymeta && (subarea || l2factor))
+	{
+		fz_try(ctx)
+			jpx_set_decode_region(ctx, codec, jpx, subarea, l2factor);
+		fz_catch(ctx)
+		{
+			opj_stream_destroy(stream);
+			opj_destroy_codec(codec);
+			opj_image_destroy(jpx);
+			fz_rethrow(ctx);
+		}
+	}
+
 	if (!opj_decode(codec, stream, jpx))
 	{
 		opj_stream_destroy(stream);
@@ -541,6 +741,12 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 
 	w = state->width = jpx->x1 - jpx->x0;
 	h = state->height = jpx->y1 - jpx->y0;
+	if (jpx->numcomps > 0 && jpx->comps[0].factor > 0)
+	{
+		int factor = jpx->comps[0].factor;
+		w = jpx_ceildivpow2(jpx->x1, factor) - jpx_ceildivpow2(jpx->x0, factor);
+		h = jpx_ceildivpow2(jpx->y1, factor) - jpx_ceildivpow2(jpx->y0, factor);
+	}
 	state->xres = 72; /* openjpeg does not read the JPEG 2000 resc box */
 	state->yres = 72; /* openjpeg does not read the JPEG 2000 resc box */
 
@@ -641,10 +847,35 @@ fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspa
 	fz_try(ctx)
 	{
 		opj_lock(ctx);
-		pix = jpx_read_image(ctx, &state, data, size, defcs, 0);
+		pix = jpx_read_image(ctx, &state, data, size, defcs, NULL, NULL, 0);
 	}
 	fz_always(ctx)
+	{
+		jpx_drop_workers(ctx);
 		opj_unlock(ctx);
+	}
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+
+	return pix;
+}
+
+fz_pixmap *
+fz_load_jpx_subarea(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs, fz_irect *subarea, int *l2factor)
+{
+	fz_jpxd state = { 0 };
+	fz_pixmap *pix = NULL;
+
+	fz_try(ctx)
+	{
+		opj_lock(ctx);
+		pix = jpx_read_image(ctx, &state, data, size, defcs, subarea, l2factor, 0);
+	}
+	fz_always(ctx)
+	{
+		jpx_drop_workers(ctx);
+		opj_unlock(ctx);
+	}
 	fz_catch(ctx)
 		fz_rethrow(ctx);
 
@@ -659,7 +890,7 @@ fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *w
 	fz_try(ctx)
 	{
 		opj_lock(ctx);
-		jpx_read_image(ctx, &state, data, size, NULL, 1);
+		jpx_read_image(ctx, &state, data, size, NULL, NULL, NULL, 1);
 	}
 	fz_always(ctx)
 		opj_unlock(ctx);
@@ -673,6 +904,27 @@ fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *w
 	*yresp = state.yres;
 }
 
+void
+fz_load_jpx_header(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *np, int *alphap)
+{
+	fz_jpxd state = { 0 };
+
+	fz_try(ctx)
+	{
+		opj_lock(ctx);
+		jpx_read_image(ctx, &state, data, size, NULL, NULL, NULL, 2);
+	}
+	fz_always(ctx)
+		opj_unlock(ctx);
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+
+	*wp = state.width;
+	*hp = state.height;
+	*np = state.n;
+	*alphap = state.alpha;
+}
+
 #else /* FZ_ENABLE_JPX */
 
 fz_pixmap *
@@ -681,10 +933,22 @@ fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspa
 	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
 }
 
+fz_pixmap *
+fz_load_jpx_subarea(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs, fz_irect *subarea, int *l2factor)
+{
+	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
+}
+
 void
 fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *xresp, int *yresp, fz_colorspace **cspacep)
 {
 	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
 }
 
+void
+fz_load_jpx_header(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *np, int *alphap)
+{
+	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
+}
+
 #endif
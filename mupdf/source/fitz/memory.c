@@ -22,6 +22,8 @@
 
 #include "mupdf/fitz.h"
 
+#include "context-imp.h"
+
 #include <limits.h>
 #include <string.h>
 #include <stdlib.h>
@@ -54,7 +56,7 @@ do_scavenging_malloc(fz_context *ctx, size_t size)
 			fz_unlock(ctx, FZ_LOCK_ALLOC);
 			return p;
 		}
-	} while (fz_store_scavenge(ctx, size, &phase));
+	} while (fz_scavenge_pixmap_pool(ctx) || fz_store_scavenge(ctx, size, &phase));
 	fz_unlock(ctx, FZ_LOCK_ALLOC);
 
 	return NULL;
@@ -74,7 +76,7 @@ do_scavenging_realloc(fz_context *ctx, void *p, size_t size)
 			fz_unlock(ctx, FZ_LOCK_ALLOC);
 			return q;
 		}
-	} while (fz_store_scavenge(ctx, size, &phase));
+	} while (fz_scavenge_pixmap_pool(ctx) || fz_store_scavenge(ctx, size, &phase));
 	fz_unlock(ctx, FZ_LOCK_ALLOC);
 
 	return NULL;
@@ -174,6 +176,245 @@ fz_strdup(fz_context *ctx, const char *s)
 	return ns;
 }
 
+/*
+ * Run arenas.
+ *
+ * Small blocks are carved out of 64K chunks and recycled through
+ * per-size free lists; larger ones are allocated separately. Every
+ * live block holds a reference to its arena, as does the run that
+ * opened it, so the chunks can be freed in bulk once the run has
+ * ended and the last block allocated from them has been freed.
+ *
+ * Every block starts with a header naming its arena. Outside of a
+ * run, blocks come from the heap with a NULL arena, so that callers
+ * can tell the two apart. Anything that keeps an object for longer
+ * than the run (display lists, and through them the store) must copy
+ * arena blocks to the heap, or a single kept block would pin all the
+ * chunks of its run.
+ */
+
+#define ARENA_HEADER 16
+#define ARENA_CHUNK_SIZE (64 << 10)
+#define ARENA_SMALL_CLASSES 16 /* 16 byte steps up to 256 bytes */
+#define ARENA_CLASSES (ARENA_SMALL_CLASSES + 5) /* powers of two up to 8K */
+#define ARENA_BIG ARENA_CLASSES
+
+typedef struct arena_chunk
+{
+	struct arena_chunk *next;
+} arena_chunk;
+
+typedef struct
+{
+	fz_arena *arena;
+	int cls;
+} arena_header;
+
+struct fz_arena
+{
+	int refs;
+	int nest;
+	arena_chunk *chunks;
+	unsigned char *pos, *end;
+	void *free[ARENA_CLASSES];
+};
+
+static int
+arena_class(size_t size)
+{
+	int cls;
+	size_t sz;
+
+	if (size <= 16 * ARENA_SMALL_CLASSES)
+		return size == 0 ? 0 : (int)((size - 1) >> 4);
+	for (cls = ARENA_SMALL_CLASSES, sz = 512; sz < size && cls < ARENA_BIG; cls++)
+		sz <<= 1;
+	return cls;
+}
+
+static size_t
+arena_class_size(int cls)
+{
+	if (cls < ARENA_SMALL_CLASSES)
+		return (size_t)(cls + 1) << 4;
+	return (size_t)512 << (cls - ARENA_SMALL_CLASSES);
+}
+
+static void
+arena_release(fz_context *ctx, fz_arena *arena)
+{
+	arena_chunk *chunk = arena->chunks;
+	while (chunk)
+	{
+		arena_chunk *next = chunk->next;
+		fz_free(ctx, chunk);
+		chunk = next;
+	}
+	fz_free(ctx, arena);
+}
+
+static void *
+arena_alloc(fz_context *ctx, fz_arena *arena, size_t size)
+{
+	int cls = arena_class(size);
+	size_t need;
+	arena_header *h;
+
+	if (!arena || cls == ARENA_BIG)
+	{
+		if (size > SIZE_MAX - ARENA_HEADER)
+			fz_throw(ctx, FZ_ERROR_MEMORY, "malloc of %zu bytes failed", size);
+		h = fz_malloc(ctx, ARENA_HEADER + size);
+		h->arena = arena;
+		h->cls = ARENA_BIG;
+		if (arena)
+		{
+			fz_lock(ctx, FZ_LOCK_ALLOC);
+			arena->refs++;
+			fz_unlock(ctx, FZ_LOCK_ALLOC);
+		}
+		return (unsigned char *)h + ARENA_HEADER;
+	}
+
+	need = ARENA_HEADER + arena_class_size(cls);
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	if (arena->free[cls])
+	{
+		h = arena->free[cls];
+		arena->free[cls] = *(void **)((unsigned char *)h + ARENA_HEADER);
+	}
+	else
+	{
+		if ((size_t)(arena->end - arena->pos) < need)
+		{
+			arena_chunk *chunk;
+			fz_unlock(ctx, FZ_LOCK_ALLOC);
+			chunk = fz_malloc(ctx, ARENA_CHUNK_SIZE);
+			fz_lock(ctx, FZ_LOCK_ALLOC);
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+			arena->pos = (unsigned char *)chunk + ARENA_HEADER;
+			arena->end = (unsigned char *)chunk + ARENA_CHUNK_SIZE;
+		}
+		h = (arena_header *)arena->pos;
+		arena->pos += need;
+	}
+	h->arena = arena;
+	h->cls = cls;
+	arena->refs++;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	return (unsigned char *)h + ARENA_HEADER;
+}
+
+void *
+fz_arena_malloc(fz_context *ctx, size_t size)
+{
+	return arena_alloc(ctx, ctx->arena, size);
+}
+
+void *
+fz_arena_realloc(fz_context *ctx, void *owner, void *p, size_t size)
+{
+	arena_header *h;
+	size_t cap;
+	void *np;
+
+	if (!p)
+	{
+		if (!owner)
+			return arena_alloc(ctx, NULL, size);
+		h = (arena_header *)((unsigned char *)owner - ARENA_HEADER);
+		return arena_alloc(ctx, h->arena, size);
+	}
+
+	h = (arena_header *)((unsigned char *)p - ARENA_HEADER);
+	if (h->cls == ARENA_BIG)
+	{
+		if (size > SIZE_MAX - ARENA_HEADER)
+			fz_throw(ctx, FZ_ERROR_MEMORY, "realloc of %zu bytes failed", size);
+		h = fz_realloc(ctx, h, ARENA_HEADER + size);
+		return (unsigned char *)h + ARENA_HEADER;
+	}
+
+	cap = arena_class_size(h->cls);
+	if (size <= cap)
+		return p;
+	np = arena_alloc(ctx, h->arena, size);
+	memcpy(np, p, cap);
+	fz_arena_free(ctx, p);
+	return np;
+}
+
+void
+fz_arena_free(fz_context *ctx, void *p)
+{
+	arena_header *h;
+	fz_arena *arena;
+	int dead;
+
+	if (!p)
+		return;
+
+	h = (arena_header *)((unsigned char *)p - ARENA_HEADER);
+	arena = h->arena;
+	if (h->cls == ARENA_BIG)
+	{
+		fz_free(ctx, h);
+		if (!arena)
+			return;
+		fz_lock(ctx, FZ_LOCK_ALLOC);
+	}
+	else
+	{
+		fz_lock(ctx, FZ_LOCK_ALLOC);
+		*(void **)p = arena->free[h->cls];
+		arena->free[h->cls] = h;
+	}
+	dead = (--arena->refs == 0);
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	if (dead)
+		arena_release(ctx, arena);
+}
+
+int
+fz_is_arena_block(const void *p)
+{
+	return p && ((const arena_header *)((const unsigned char *)p - ARENA_HEADER))->arena != NULL;
+}
+
+void
+fz_begin_run_arena(fz_context *ctx)
+{
+	if (ctx->arena)
+		ctx->arena->nest++;
+	else if (ctx->tuning->run_arena)
+	{
+		ctx->arena = fz_malloc_struct(ctx, fz_arena);
+		ctx->arena->refs = 1;
+		ctx->arena->nest = 1;
+	}
+}
+
+void
+fz_end_run_arena(fz_context *ctx)
+{
+	fz_arena *arena = ctx->arena;
+	int dead;
+
+	if (!arena || --arena->nest > 0)
+		return;
+
+	ctx->arena = NULL;
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	dead = (--arena->refs == 0);
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	if (dead)
+		arena_release(ctx, arena);
+}
+
 static void *
 fz_malloc_default(void *opaque, size_t size)
 {
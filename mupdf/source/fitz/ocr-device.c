@@ -22,6 +22,8 @@
 
 #include "mupdf/fitz.h"
 
+#include "context-imp.h"
+
 #include <assert.h>
 #include <string.h>
 
@@ -522,22 +524,24 @@ typedef struct
 	int current;
 } fz_rewrite_device;
 
+/* Spans of a text are allocated alongside it, in its arena if it has one. */
 static fz_text_span *
-fz_clone_text_span(fz_context *ctx, const fz_text_span *span)
+fz_clone_text_span(fz_context *ctx, fz_text *text, const fz_text_span *span)
 {
 	fz_text_span *cspan;
 
 	if (span == NULL)
 		return NULL;
 
-	cspan = fz_malloc_struct(ctx, fz_text_span);
+	cspan = fz_arena_realloc(ctx, text, NULL, sizeof(*cspan));
 	*cspan = *span;
 	cspan->cap = cspan->len;
-	cspan->items = fz_malloc_no_throw(ctx, sizeof(*cspan->items) * cspan->len);
-	if (cspan->items == NULL)
+	fz_try(ctx)
+		cspan->items = fz_arena_realloc(ctx, text, NULL, sizeof(*cspan->items) * cspan->len);
+	fz_catch(ctx)
 	{
-		fz_free(ctx, cspan);
-		fz_throw(ctx, FZ_ERROR_MEMORY, "Failed to malloc while cloning text span");
+		fz_arena_free(ctx, cspan);
+		fz_rethrow(ctx);
 	}
 	memcpy(cspan->items, span->items, sizeof(*cspan->items) * cspan->len);
 	fz_keep_font(ctx, cspan->font);
@@ -641,9 +645,9 @@ rewrite_char(fz_context *ctx, fz_rewrite_device *dev, fz_matrix ctm, fz_text_ite
 }
 
 static fz_text_span *
-rewrite_span(fz_context *ctx, fz_rewrite_device *dev, fz_matrix ctm, const fz_text_span *span)
+rewrite_span(fz_context *ctx, fz_rewrite_device *dev, fz_matrix ctm, fz_text *rtext, const fz_text_span *span)
 {
-	fz_text_span *rspan = fz_clone_text_span(ctx, span);
+	fz_text_span *rspan = fz_clone_text_span(ctx, rtext, span);
 	int wmode = span->wmode;
 	int i;
 	fz_point dir;
@@ -686,7 +690,7 @@ rewrite_text(fz_context *ctx, fz_rewrite_device *dev, fz_matrix ctm, const fz_te
 	{
 		while (span)
 		{
-			*dspan = rewrite_span(ctx, dev, ctm, span);
+			*dspan = rewrite_span(ctx, dev, ctm, rtext, span);
 			rtext->tail = *dspan;
 			dspan = &(*dspan)->next;
 			span = span->next;
@@ -843,12 +847,12 @@ rewrite_pop_clip(fz_context *ctx, fz_device *dev)
 	fz_pop_clip(ctx, rewrite->target);
 }
 
-static void
-rewrite_begin_mask(fz_context *ctx, fz_device *dev, fz_rect area, int luminosity, fz_colorspace *cs, const float *bc, fz_color_params params)
+static int
+rewrite_begin_mask_id(fz_context *ctx, fz_device *dev, fz_rect area, int luminosity, fz_colorspace *cs, const float *bc, fz_color_params params, fz_matrix ctm, int id)
 {
 	fz_rewrite_device *rewrite = (fz_rewrite_device *)dev;
 
-	fz_begin_mask(ctx, rewrite->target, area, luminosity, cs, bc, params);
+	return fz_begin_mask_id(ctx, rewrite->target, area, luminosity, cs, bc, params, ctm, id);
 }
 
 static void
@@ -1010,7 +1014,7 @@ new_rewrite_device(fz_context *ctx, fz_device *target, word_record **words, int
 
 	rewrite->super.pop_clip = rewrite_pop_clip;
 
-	rewrite->super.begin_mask = rewrite_begin_mask;
+	rewrite->super.begin_mask_id = rewrite_begin_mask_id;
 	rewrite->super.end_mask = rewrite_end_mask;
 	rewrite->super.begin_group = rewrite_begin_group;
 	rewrite->super.end_group = rewrite_end_group;
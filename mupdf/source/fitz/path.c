@@ -22,6 +22,8 @@
 
 #include "mupdf/fitz.h"
 
+#include "context-imp.h"
+
 #include <string.h>
 #include <assert.h>
 
@@ -64,6 +66,7 @@ struct fz_path
 {
 	int8_t refs;
 	uint8_t packed;
+	uint8_t arena;
 	int cmd_len, cmd_cap;
 	unsigned char *cmds;
 	int coord_len, coord_cap;
@@ -102,12 +105,25 @@ enum
 
 #define LAST_CMD(path) ((path)->cmd_len > 0 ? (path)->cmds[(path)->cmd_len-1] : 0)
 
+/* Unpacked paths made during a run may live in its arena, along with their cmds and coords. */
+#define path_realloc_array(ctx, path, old, count, type) \
+	((path)->arena ? \
+		(type *)fz_arena_realloc(ctx, path, old, (size_t)(count) * sizeof(type)) : \
+		fz_realloc_array(ctx, old, count, type))
+
 fz_path *
 fz_new_path(fz_context *ctx)
 {
 	fz_path *path;
 
-	path = fz_malloc_struct(ctx, fz_path);
+	if (ctx->arena)
+	{
+		path = fz_arena_malloc(ctx, sizeof(*path));
+		memset(path, 0, sizeof(*path));
+		path->arena = 1;
+	}
+	else
+		path = fz_malloc_struct(ctx, fz_path);
 	path->refs = 1;
 	path->packed = FZ_PATH_UNPACKED;
 	path->current.x = 0;
@@ -145,6 +161,13 @@ fz_drop_path(fz_context *ctx, const fz_path *pathc)
 
 	if (fz_drop_imp8(ctx, path, &path->refs))
 	{
+		if (path->packed == FZ_PATH_UNPACKED && path->arena)
+		{
+			fz_arena_free(ctx, path->cmds);
+			fz_arena_free(ctx, path->coords);
+			fz_arena_free(ctx, path);
+			return;
+		}
 		if (path->packed != FZ_PATH_PACKED_FLAT)
 		{
 			fz_free(ctx, path->cmds);
@@ -216,6 +239,7 @@ fz_pack_path(fz_context *ctx, uint8_t *pack_, size_t max, const fz_path *path)
 		{
 			pack->refs = 1;
 			pack->packed = FZ_PATH_PACKED_OPEN;
+			pack->arena = 0;
 			pack->current.x = 0;
 			pack->current.y = 0;
 			pack->begin.x = 0;
@@ -268,7 +292,7 @@ push_cmd(fz_context *ctx, fz_path *path, int cmd)
 	if (path->cmd_len + 1 >= path->cmd_cap)
 	{
 		int new_cmd_cap = fz_maxi(16, path->cmd_cap * 2);
-		path->cmds = fz_realloc_array(ctx, path->cmds, new_cmd_cap, unsigned char);
+		path->cmds = path_realloc_array(ctx, path, path->cmds, new_cmd_cap, unsigned char);
 		path->cmd_cap = new_cmd_cap;
 	}
 
@@ -281,7 +305,7 @@ push_coord(fz_context *ctx, fz_path *path, float x, float y)
 	if (path->coord_len + 2 >= path->coord_cap)
 	{
 		int new_coord_cap = fz_maxi(32, path->coord_cap * 2);
-		path->coords = fz_realloc_array(ctx, path->coords, new_coord_cap, float);
+		path->coords = path_realloc_array(ctx, path, path->coords, new_coord_cap, float);
 		path->coord_cap = new_coord_cap;
 	}
 
@@ -298,7 +322,7 @@ push_ord(fz_context *ctx, fz_path *path, float xy, int isx)
 	if (path->coord_len + 1 >= path->coord_cap)
 	{
 		int new_coord_cap = fz_maxi(32, path->coord_cap * 2);
-		path->coords = fz_realloc_array(ctx, path->coords, new_coord_cap, float);
+		path->coords = path_realloc_array(ctx, path, path->coords, new_coord_cap, float);
 		path->coord_cap = new_coord_cap;
 	}
 
@@ -1222,12 +1246,12 @@ fz_transform_path(fz_context *ctx, fz_path *path, fz_matrix ctm)
 		}
 		if (path->cmd_len + extra_cmd < path->cmd_cap)
 		{
-			path->cmds = fz_realloc_array(ctx, path->cmds, path->cmd_len + extra_cmd, unsigned char);
+			path->cmds = path_realloc_array(ctx, path, path->cmds, path->cmd_len + extra_cmd, unsigned char);
 			path->cmd_cap = path->cmd_len + extra_cmd;
 		}
 		if (path->coord_len + extra_coord < path->coord_cap)
 		{
-			path->coords = fz_realloc_array(ctx, path->coords, path->coord_len + extra_coord, float);
+			path->coords = path_realloc_array(ctx, path, path->coords, path->coord_len + extra_coord, float);
 			path->coord_cap = path->coord_len + extra_coord;
 		}
 		memmove(path->cmds + extra_cmd, path->cmds, path->cmd_len * sizeof(unsigned char));
@@ -1367,12 +1391,12 @@ void fz_trim_path(fz_context *ctx, fz_path *path)
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Can't trim a packed path");
 	if (path->cmd_cap > path->cmd_len)
 	{
-		path->cmds = fz_realloc_array(ctx, path->cmds, path->cmd_len, unsigned char);
+		path->cmds = path_realloc_array(ctx, path, path->cmds, path->cmd_len, unsigned char);
 		path->cmd_cap = path->cmd_len;
 	}
 	if (path->coord_cap > path->coord_len)
 	{
-		path->coords = fz_realloc_array(ctx, path->coords, path->coord_len, float);
+		path->coords = path_realloc_array(ctx, path, path->coords, path->coord_len, float);
 		path->coord_cap = path->coord_len;
 	}
 }
@@ -1385,6 +1409,15 @@ const fz_stroke_state fz_default_stroke_state = {
 	0, 0, { 0 }
 };
 
+static size_t
+stroke_state_size(const fz_stroke_state *stroke)
+{
+	int extra = stroke->dash_len - nelem(stroke->dash_list);
+	if (extra < 0)
+		extra = 0;
+	return sizeof(*stroke) + sizeof(stroke->dash_list[0]) * extra;
+}
+
 fz_stroke_state *
 fz_keep_stroke_state(fz_context *ctx, const fz_stroke_state *strokec)
 {
@@ -1406,7 +1439,28 @@ fz_drop_stroke_state(fz_context *ctx, const fz_stroke_state *strokec)
 	fz_stroke_state *stroke = (fz_stroke_state *)strokec; /* Explicit cast away of const */
 
 	if (fz_drop_imp(ctx, stroke, &stroke->refs))
-		fz_free(ctx, stroke);
+		fz_arena_free(ctx, stroke);
+}
+
+fz_stroke_state *
+fz_keep_stroke_state_off_arena(fz_context *ctx, const fz_stroke_state *strokec)
+{
+	fz_stroke_state *stroke = (fz_stroke_state *)strokec; /* Explicit cast away of const */
+	fz_stroke_state *clone;
+	size_t size;
+
+	if (!stroke)
+		return NULL;
+
+	/* Stroke states on the stack have no block header to look at. */
+	if (stroke->refs != -2 && !fz_is_arena_block(stroke))
+		return fz_keep_imp(ctx, stroke, &stroke->refs);
+
+	size = stroke_state_size(stroke);
+	clone = fz_arena_realloc(ctx, NULL, NULL, size);
+	memcpy(clone, stroke, size);
+	clone->refs = 1;
+	return clone;
 }
 
 fz_stroke_state *
@@ -1418,7 +1472,7 @@ fz_new_stroke_state_with_dash_len(fz_context *ctx, int len)
 	if (len < 0)
 		len = 0;
 
-	state = Memento_label(fz_malloc(ctx, sizeof(*state) + sizeof(state->dash_list[0]) * len), "fz_stroke_state");
+	state = fz_arena_malloc(ctx, sizeof(*state) + sizeof(state->dash_list[0]) * len);
 	state->refs = 1;
 	state->start_cap = FZ_LINECAP_BUTT;
 	state->dash_cap = FZ_LINECAP_BUTT;
@@ -1471,12 +1525,12 @@ fz_unshare_stroke_state_with_dash_len(fz_context *ctx, fz_stroke_state *shared,
 		return shared;
 
 	unsize = sizeof(*unshared) + sizeof(unshared->dash_list[0]) * len;
-	unshared = Memento_label(fz_malloc(ctx, unsize), "fz_stroke_state");
+	unshared = fz_arena_malloc(ctx, unsize);
 	memcpy(unshared, shared, (shsize > unsize ? unsize : shsize));
 	unshared->refs = 1;
 
 	if (fz_drop_imp(ctx, shared, &shared->refs))
-		fz_free(ctx, shared);
+		fz_arena_free(ctx, shared);
 	return unshared;
 }
 
@@ -23,6 +23,7 @@
 #include "mupdf/fitz.h"
 
 #include "color-imp.h"
+#include "context-imp.h"
 #include "pixmap-imp.h"
 
 #include <assert.h>
@@ -43,6 +44,300 @@ fz_drop_pixmap(fz_context *ctx, fz_pixmap *pix)
 	fz_drop_storable(ctx, &pix->storable);
 }
 
+/*
+	Pooled sample buffers are allocated with a header in front of
+	them that records their size class. While a buffer sits in the
+	pool, the header also links it into the list of free buffers of
+	its class (newest first) and into the list of all pooled buffers
+	from the oldest to the newest, from which buffers are evicted.
+	The pool structures are protected by the alloc lock, but memory
+	is only ever allocated or freed with the lock released (or, when
+	scavenging, directly through the allocator).
+*/
+
+/* Smaller buffers are cheap enough to get from malloc. */
+#define POOL_MIN_SIZE (64 << 10)
+/* Four classes per power of two, up to 2^47 bytes. */
+#define POOL_CLASSES (48 * 4)
+
+typedef struct pool_block
+{
+	struct pool_block *prev, *next;
+	struct pool_block *older, *newer;
+	int cls;
+} pool_block;
+
+#define POOL_HEADER ((sizeof(pool_block) + 15) & ~(size_t)15)
+
+struct fz_pixmap_pool
+{
+	int refs;
+	size_t max;
+	size_t size;
+	int count;
+	int hits, misses, returned, discarded, evicted;
+	pool_block *oldest, *newest;
+	pool_block *free[POOL_CLASSES];
+};
+
+static size_t
+pool_class_size(int cls)
+{
+	int k = cls >> 2;
+	return ((size_t)1 << k) + (size_t)(cls & 3) * ((size_t)1 << k >> 2);
+}
+
+/* Returns the smallest class holding size bytes, or -1 if there is none. */
+static int
+pool_class(size_t size)
+{
+	int k = 0;
+	int cls;
+
+	while (k < 48 && ((size_t)2 << k) <= size)
+		k++;
+	if (k >= 48)
+		return -1;
+	for (cls = k * 4; cls < POOL_CLASSES; cls++)
+		if (pool_class_size(cls) >= size)
+			return cls;
+	return -1;
+}
+
+static void
+pool_unlink(fz_pixmap_pool *pool, pool_block *b)
+{
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		pool->free[b->cls] = b->next;
+	if (b->next)
+		b->next->prev = b->prev;
+
+	if (b->older)
+		b->older->newer = b->newer;
+	else
+		pool->oldest = b->newer;
+	if (b->newer)
+		b->newer->older = b->older;
+	else
+		pool->newest = b->older;
+
+	pool->size -= POOL_HEADER + pool_class_size(b->cls);
+	pool->count--;
+}
+
+/* Unlink the oldest buffers until size more bytes fit, and return
+ * them chained through next for freeing once the lock is released. */
+static pool_block *
+pool_evict(fz_pixmap_pool *pool, size_t size)
+{
+	pool_block *evicted = NULL;
+
+	while (pool->oldest && pool->size + size > pool->max)
+	{
+		pool_block *b = pool->oldest;
+		pool_unlink(pool, b);
+		pool->evicted++;
+		b->next = evicted;
+		evicted = b;
+	}
+	return evicted;
+}
+
+static void
+pool_free_list(fz_context *ctx, pool_block *b)
+{
+	while (b)
+	{
+		pool_block *next = b->next;
+		fz_free(ctx, b);
+		b = next;
+	}
+}
+
+void
+fz_new_pixmap_pool_context(fz_context *ctx)
+{
+	ctx->pixmap_pool = fz_malloc_struct(ctx, fz_pixmap_pool);
+	ctx->pixmap_pool->refs = 1;
+}
+
+fz_pixmap_pool *
+fz_keep_pixmap_pool_context(fz_context *ctx)
+{
+	if (!ctx->pixmap_pool)
+		return NULL;
+	return fz_keep_imp(ctx, ctx->pixmap_pool, &ctx->pixmap_pool->refs);
+}
+
+void
+fz_drop_pixmap_pool_context(fz_context *ctx)
+{
+	if (!ctx->pixmap_pool)
+		return;
+	if (fz_drop_imp(ctx, ctx->pixmap_pool, &ctx->pixmap_pool->refs))
+	{
+		ctx->pixmap_pool->max = 0;
+		pool_free_list(ctx, pool_evict(ctx->pixmap_pool, 0));
+		fz_free(ctx, ctx->pixmap_pool);
+	}
+	ctx->pixmap_pool = NULL;
+}
+
+int
+fz_scavenge_pixmap_pool(fz_context *ctx)
+{
+	fz_pixmap_pool *pool = ctx->pixmap_pool;
+	pool_block *b;
+	size_t max;
+
+	if (!pool || !pool->oldest)
+		return 0;
+	max = pool->max;
+	pool->max = 0;
+	b = pool_evict(pool, 0);
+	pool->max = max;
+	while (b)
+	{
+		pool_block *next = b->next;
+		ctx->alloc.free(ctx->alloc.user, b);
+		b = next;
+	}
+	return 1;
+}
+
+void
+fz_set_pixmap_pool_size(fz_context *ctx, size_t max)
+{
+	fz_pixmap_pool *pool = ctx->pixmap_pool;
+	pool_block *evicted;
+
+	if (!pool)
+		return;
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	pool->max = max;
+	evicted = pool_evict(pool, 0);
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	pool_free_list(ctx, evicted);
+}
+
+void
+fz_empty_pixmap_pool(fz_context *ctx)
+{
+	fz_pixmap_pool *pool = ctx->pixmap_pool;
+	pool_block *evicted;
+	size_t max;
+
+	if (!pool)
+		return;
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	max = pool->max;
+	pool->max = 0;
+	evicted = pool_evict(pool, 0);
+	pool->max = max;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	pool_free_list(ctx, evicted);
+}
+
+void
+fz_get_pixmap_pool_stats(fz_context *ctx, fz_pixmap_pool_stats *stats)
+{
+	fz_pixmap_pool *pool = ctx->pixmap_pool;
+
+	memset(stats, 0, sizeof *stats);
+	if (!pool)
+		return;
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	stats->max = pool->max;
+	stats->count = pool->count;
+	stats->size = pool->size;
+	stats->hits = pool->hits;
+	stats->misses = pool->misses;
+	stats->returned = pool->returned;
+	stats->discarded = pool->discarded;
+	stats->evicted = pool->evicted;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+}
+
+/* Returns NULL if buffers of this size aren't pooled. */
+static unsigned char *
+pool_alloc_samples(fz_context *ctx, size_t size)
+{
+	fz_pixmap_pool *pool = ctx->pixmap_pool;
+	pool_block *b;
+	int cls;
+
+	if (!pool || size < POOL_MIN_SIZE)
+		return NULL;
+	cls = pool_class(size);
+	if (cls < 0)
+		return NULL;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	if (POOL_HEADER + pool_class_size(cls) > pool->max)
+	{
+		fz_unlock(ctx, FZ_LOCK_ALLOC);
+		return NULL;
+	}
+	b = pool->free[cls];
+	if (b)
+	{
+		pool_unlink(pool, b);
+		pool->hits++;
+	}
+	else
+		pool->misses++;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	if (!b)
+	{
+		b = Memento_label(fz_malloc(ctx, POOL_HEADER + pool_class_size(cls)), "pixmap_data");
+		b->cls = cls;
+	}
+	return (unsigned char *)b + POOL_HEADER;
+}
+
+static void
+pool_free_samples(fz_context *ctx, unsigned char *samples)
+{
+	fz_pixmap_pool *pool = ctx->pixmap_pool;
+	pool_block *b = (pool_block *)(void *)(samples - POOL_HEADER);
+	size_t size = POOL_HEADER + pool_class_size(b->cls);
+	pool_block *evicted;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	if (size > pool->max)
+	{
+		pool->discarded++;
+		fz_unlock(ctx, FZ_LOCK_ALLOC);
+		fz_free(ctx, b);
+		return;
+	}
+	evicted = pool_evict(pool, size);
+
+	b->prev = NULL;
+	b->next = pool->free[b->cls];
+	if (b->next)
+		b->next->prev = b;
+	pool->free[b->cls] = b;
+
+	b->newer = NULL;
+	b->older = pool->newest;
+	if (b->older)
+		b->older->newer = b;
+	else
+		pool->oldest = b;
+	pool->newest = b;
+
+	pool->size += size;
+	pool->count++;
+	pool->returned++;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	pool_free_list(ctx, evicted);
+}
+
 void
 fz_drop_pixmap_imp(fz_context *ctx, fz_storable *pix_)
 {
@@ -50,7 +345,9 @@ fz_drop_pixmap_imp(fz_context *ctx, fz_storable *pix_)
 
 	fz_drop_colorspace(ctx, pix->colorspace);
 	fz_drop_separations(ctx, pix->seps);
-	if (pix->flags & FZ_PIXMAP_FLAG_FREE_SAMPLES)
+	if (pix->flags & FZ_PIXMAP_FLAG_POOLED_SAMPLES)
+		pool_free_samples(ctx, pix->samples);
+	else if (pix->flags & FZ_PIXMAP_FLAG_FREE_SAMPLES)
 		fz_free(ctx, pix->samples);
 	fz_drop_pixmap(ctx, pix->underlying);
 	fz_free(ctx, pix);
@@ -106,7 +403,11 @@ fz_new_pixmap_with_data(fz_context *ctx, fz_colorspace *colorspace, int w, int h
 		{
 			if ((size_t)pix->stride > SIZE_MAX / (size_t)pix->h)
 				fz_throw(ctx, FZ_ERROR_GENERIC, "Overly large image");
-			pix->samples = Memento_label(fz_malloc(ctx, pix->h * pix->stride), "pixmap_data");
+			pix->samples = pool_alloc_samples(ctx, pix->h * pix->stride);
+			if (pix->samples)
+				pix->flags |= FZ_PIXMAP_FLAG_POOLED_SAMPLES;
+			else
+				pix->samples = Memento_label(fz_malloc(ctx, pix->h * pix->stride), "pixmap_data");
 		}
 		fz_catch(ctx)
 		{
@@ -190,7 +491,7 @@ fz_pixmap *fz_new_pixmap_from_pixmap(fz_context *ctx, fz_pixmap *pixmap, const f
 	subpix->underlying = fz_keep_pixmap(ctx, pixmap);
 	subpix->colorspace = fz_keep_colorspace(ctx, pixmap->colorspace);
 	subpix->seps = fz_keep_separations(ctx, pixmap->seps);
-	subpix->flags &= ~FZ_PIXMAP_FLAG_FREE_SAMPLES;
+	subpix->flags &= ~(FZ_PIXMAP_FLAG_FREE_SAMPLES | FZ_PIXMAP_FLAG_POOLED_SAMPLES);
 
 	return subpix;
 }
@@ -1556,7 +1857,9 @@ fz_subsample_pixmap(fz_context *ctx, fz_pixmap *tile, int factor)
 	/* Redundant test? We only ever make pixmaps smaller! */
 	if (tile->h > INT_MAX / (tile->w * tile->n))
 		fz_throw(ctx, FZ_ERROR_MEMORY, "pixmap too large");
-	tile->samples = fz_realloc(ctx, tile->samples, (size_t)tile->h * tile->w * tile->n);
+	/* A pooled buffer keeps its size until it goes back to the pool. */
+	if (!(tile->flags & FZ_PIXMAP_FLAG_POOLED_SAMPLES))
+		tile->samples = fz_realloc(ctx, tile->samples, (size_t)tile->h * tile->w * tile->n);
 }
 
 void
@@ -0,0 +1,621 @@
+// Copyright (C) 2004-2022 Artifex Software, Inc.
+//
+// This file is part of MuPDF.
+//
+// MuPDF is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// MuPDF is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with MuPDF. If not, see <https://www.gnu.org/licenses/agpl-3.0.en.html>
+//
+// Alternative licensing terms are available from the licensor.
+// For commercial licensing, see <https://www.artifex.com/> or contact
+// Artifex Software, Inc., 1305 Grant Avenue - Suite 200, Novato,
+// CA 94945, U.S.A., +1(415)492-9861, for further information.
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "mupdf/fitz.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+enum
+{
+	PROFILE_FILL_PATH,
+	PROFILE_STROKE_PATH,
+	PROFILE_CLIP,
+	PROFILE_TEXT,
+	PROFILE_IMAGE,
+	PROFILE_SHADE,
+	PROFILE_GROUP,
+	PROFILE_MASK,
+	PROFILE_TILE,
+	PROFILE_CLASSES
+};
+
+static const char *profile_class_names[PROFILE_CLASSES] =
+{
+	"fill_path",
+	"stroke_path",
+	"clip",
+	"text",
+	"image",
+	"shade",
+	"group",
+	"mask",
+	"tile",
+};
+
+typedef struct
+{
+	int count;
+	double time;
+	double decode;
+	double pixels;
+} profile_stat;
+
+typedef struct
+{
+	int num;
+	char *name;
+	int count;
+	double time;
+	profile_stat ops[PROFILE_CLASSES];
+} profile_xobject;
+
+typedef struct
+{
+	int xobj;
+	double start;
+} profile_frame;
+
+typedef struct
+{
+	fz_device super;
+	fz_device *target;
+	double start, end;
+	profile_stat ops[PROFILE_CLASSES];
+
+	/* All XObjects run on the page, and a hash from their object number to their index. */
+	int xobj_len, xobj_cap;
+	profile_xobject *xobj;
+	fz_hash_table *xobj_index;
+
+	/* The XObjects being run, innermost last. */
+	int frame_len, frame_cap;
+	profile_frame *frame;
+
+	/* The class of each clip pop_clip will end; ended masks become clips. */
+	int clip_len, clip_cap;
+	unsigned char *clip;
+} fz_profile_device;
+
+static double
+profile_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static void
+profile_add(profile_stat *stat, int count, double time, double decode, double pixels)
+{
+	stat->count += count;
+	stat->time += time;
+	stat->decode += decode;
+	stat->pixels += pixels;
+}
+
+/* Account for an operation that started at t0; area is its device space bbox. */
+static void
+profile_record(fz_context *ctx, fz_profile_device *dev, int cls, double t0, int count, double decode, fz_rect area)
+{
+	double time = profile_now() - t0;
+	double pixels = 0;
+
+	area = fz_intersect_rect(area, fz_device_current_scissor(ctx, &dev->super));
+	if (!fz_is_empty_rect(area) && !fz_is_infinite_rect(area))
+		pixels = (double)(area.x1 - area.x0) * (area.y1 - area.y0);
+
+	profile_add(&dev->ops[cls], count, time, decode, pixels);
+	if (dev->frame_len > 0)
+		profile_add(&dev->xobj[dev->frame[dev->frame_len - 1].xobj].ops[cls], count, time, decode, pixels);
+}
+
+static void
+profile_push_clip(fz_context *ctx, fz_profile_device *dev, int cls)
+{
+	if (dev->clip_len == dev->clip_cap)
+	{
+		int new_cap = fz_maxi(16, dev->clip_cap * 2);
+		dev->clip = fz_realloc_array(ctx, dev->clip, new_cap, unsigned char);
+		dev->clip_cap = new_cap;
+	}
+	dev->clip[dev->clip_len++] = cls;
+}
+
+/*
+	Decode the image the way the draw device will ask for it, so that
+	the decoding time can be told apart from the painting time; the
+	draw device then finds the decoded image in the store.
+*/
+static double
+profile_decode(fz_context *ctx, fz_profile_device *dev, fz_image *image, fz_matrix ctm)
+{
+	fz_rect area = fz_transform_rect(fz_unit_rect, ctm);
+	fz_pixmap *pix = NULL;
+	double t0;
+
+	if (fz_is_empty_rect(fz_intersect_rect(area, fz_device_current_scissor(ctx, &dev->super))))
+		return 0;
+
+	t0 = profile_now();
+	ctm = fz_gridfit_matrix(0, ctm);
+	fz_try(ctx)
+		pix = fz_get_pixmap_from_image(ctx, image, NULL, &ctm, NULL, NULL);
+	fz_catch(ctx)
+	{
+		/* Leave it to the target device to report. */
+		fz_rethrow_if(ctx, FZ_ERROR_ABORT);
+	}
+	fz_drop_pixmap(ctx, pix);
+	return profile_now() - t0;
+}
+
+static void
+fz_profile_fill_path(fz_context *ctx, fz_device *dev_, const fz_path *path, int even_odd, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_fill_path(ctx, dev->target, path, even_odd, ctm, colorspace, color, alpha, color_params);
+	profile_record(ctx, dev, PROFILE_FILL_PATH, t0, 1, 0, fz_bound_path(ctx, path, NULL, ctm));
+}
+
+static void
+fz_profile_stroke_path(fz_context *ctx, fz_device *dev_, const fz_path *path, const fz_stroke_state *stroke, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_stroke_path(ctx, dev->target, path, stroke, ctm, colorspace, color, alpha, color_params);
+	profile_record(ctx, dev, PROFILE_STROKE_PATH, t0, 1, 0, fz_bound_path(ctx, path, stroke, ctm));
+}
+
+static void
+fz_profile_clip_path(fz_context *ctx, fz_device *dev_, const fz_path *path, int even_odd, fz_matrix ctm, fz_rect scissor)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	profile_push_clip(ctx, dev, PROFILE_CLIP);
+	if (dev->target)
+		fz_clip_path(ctx, dev->target, path, even_odd, ctm, scissor);
+	profile_record(ctx, dev, PROFILE_CLIP, t0, 1, 0, fz_bound_path(ctx, path, NULL, ctm));
+}
+
+static void
+fz_profile_clip_stroke_path(fz_context *ctx, fz_device *dev_, const fz_path *path, const fz_stroke_state *stroke, fz_matrix ctm, fz_rect scissor)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	profile_push_clip(ctx, dev, PROFILE_CLIP);
+	if (dev->target)
+		fz_clip_stroke_path(ctx, dev->target, path, stroke, ctm, scissor);
+	profile_record(ctx, dev, PROFILE_CLIP, t0, 1, 0, fz_bound_path(ctx, path, stroke, ctm));
+}
+
+static void
+fz_profile_fill_text(fz_context *ctx, fz_device *dev_, const fz_text *text, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_fill_text(ctx, dev->target, text, ctm, colorspace, color, alpha, color_params);
+	profile_record(ctx, dev, PROFILE_TEXT, t0, 1, 0, fz_bound_text(ctx, text, NULL, ctm));
+}
+
+static void
+fz_profile_stroke_text(fz_context *ctx, fz_device *dev_, const fz_text *text, const fz_stroke_state *stroke, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_stroke_text(ctx, dev->target, text, stroke, ctm, colorspace, color, alpha, color_params);
+	profile_record(ctx, dev, PROFILE_TEXT, t0, 1, 0, fz_bound_text(ctx, text, stroke, ctm));
+}
+
+static void
+fz_profile_clip_text(fz_context *ctx, fz_device *dev_, const fz_text *text, fz_matrix ctm, fz_rect scissor)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	profile_push_clip(ctx, dev, PROFILE_CLIP);
+	if (dev->target)
+		fz_clip_text(ctx, dev->target, text, ctm, scissor);
+	profile_record(ctx, dev, PROFILE_CLIP, t0, 1, 0, fz_bound_text(ctx, text, NULL, ctm));
+}
+
+static void
+fz_profile_clip_stroke_text(fz_context *ctx, fz_device *dev_, const fz_text *text, const fz_stroke_state *stroke, fz_matrix ctm, fz_rect scissor)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	profile_push_clip(ctx, dev, PROFILE_CLIP);
+	if (dev->target)
+		fz_clip_stroke_text(ctx, dev->target, text, stroke, ctm, scissor);
+	profile_record(ctx, dev, PROFILE_CLIP, t0, 1, 0, fz_bound_text(ctx, text, stroke, ctm));
+}
+
+static void
+fz_profile_ignore_text(fz_context *ctx, fz_device *dev_, const fz_text *text, fz_matrix ctm)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_ignore_text(ctx, dev->target, text, ctm);
+	profile_record(ctx, dev, PROFILE_TEXT, t0, 1, 0, fz_empty_rect);
+}
+
+static void
+fz_profile_fill_shade(fz_context *ctx, fz_device *dev_, fz_shade *shade, fz_matrix ctm, float alpha, fz_color_params color_params)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_fill_shade(ctx, dev->target, shade, ctm, alpha, color_params);
+	profile_record(ctx, dev, PROFILE_SHADE, t0, 1, 0, fz_bound_shade(ctx, shade, ctm));
+}
+
+static void
+fz_profile_fill_image(fz_context *ctx, fz_device *dev_, fz_image *image, fz_matrix ctm, float alpha, fz_color_params color_params)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double decode = profile_decode(ctx, dev, image, ctm);
+	double t0 = profile_now();
+	if (dev->target)
+		fz_fill_image(ctx, dev->target, image, ctm, alpha, color_params);
+	profile_record(ctx, dev, PROFILE_IMAGE, t0, 1, decode, fz_transform_rect(fz_unit_rect, ctm));
+}
+
+static void
+fz_profile_fill_image_mask(fz_context *ctx, fz_device *dev_, fz_image *image, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double decode = profile_decode(ctx, dev, image, ctm);
+	double t0 = profile_now();
+	if (dev->target)
+		fz_fill_image_mask(ctx, dev->target, image, ctm, colorspace, color, alpha, color_params);
+	profile_record(ctx, dev, PROFILE_IMAGE, t0, 1, decode, fz_transform_rect(fz_unit_rect, ctm));
+}
+
+static void
+fz_profile_clip_image_mask(fz_context *ctx, fz_device *dev_, fz_image *image, fz_matrix ctm, fz_rect scissor)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double decode = profile_decode(ctx, dev, image, ctm);
+	double t0 = profile_now();
+	profile_push_clip(ctx, dev, PROFILE_CLIP);
+	if (dev->target)
+		fz_clip_image_mask(ctx, dev->target, image, ctm, scissor);
+	profile_record(ctx, dev, PROFILE_CLIP, t0, 1, decode, fz_transform_rect(fz_unit_rect, ctm));
+}
+
+static void
+fz_profile_pop_clip(fz_context *ctx, fz_device *dev_)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	int cls = dev->clip_len > 0 ? dev->clip[--dev->clip_len] : PROFILE_CLIP;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_pop_clip(ctx, dev->target);
+	profile_record(ctx, dev, cls, t0, 0, 0, fz_empty_rect);
+}
+
+static int
+fz_profile_begin_mask_id(fz_context *ctx, fz_device *dev_, fz_rect area, int luminosity, fz_colorspace *colorspace, const float *bc, fz_color_params color_params, fz_matrix ctm, int id)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	int cached = 0;
+	if (dev->target)
+		cached = fz_begin_mask_id(ctx, dev->target, area, luminosity, colorspace, bc, color_params, ctm, id);
+	profile_record(ctx, dev, PROFILE_MASK, t0, 1, 0, area);
+	return cached;
+}
+
+static void
+fz_profile_end_mask(fz_context *ctx, fz_device *dev_)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	profile_push_clip(ctx, dev, PROFILE_MASK);
+	if (dev->target)
+		fz_end_mask(ctx, dev->target);
+	profile_record(ctx, dev, PROFILE_MASK, t0, 0, 0, fz_empty_rect);
+}
+
+static void
+fz_profile_begin_group(fz_context *ctx, fz_device *dev_, fz_rect area, fz_colorspace *cs, int isolated, int knockout, int blendmode, float alpha)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_begin_group(ctx, dev->target, area, cs, isolated, knockout, blendmode, alpha);
+	profile_record(ctx, dev, PROFILE_GROUP, t0, 1, 0, area);
+}
+
+static void
+fz_profile_end_group(fz_context *ctx, fz_device *dev_)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_end_group(ctx, dev->target);
+	profile_record(ctx, dev, PROFILE_GROUP, t0, 0, 0, fz_empty_rect);
+}
+
+static int
+fz_profile_begin_tile(fz_context *ctx, fz_device *dev_, fz_rect area, fz_rect view, float xstep, float ystep, fz_matrix ctm, int id)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	int cached = 0;
+	if (dev->target)
+		cached = fz_begin_tile_id(ctx, dev->target, area, view, xstep, ystep, ctm, id);
+	profile_record(ctx, dev, PROFILE_TILE, t0, 1, 0, fz_transform_rect(area, ctm));
+	return cached;
+}
+
+static void
+fz_profile_end_tile(fz_context *ctx, fz_device *dev_)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double t0 = profile_now();
+	if (dev->target)
+		fz_end_tile(ctx, dev->target);
+	profile_record(ctx, dev, PROFILE_TILE, t0, 0, 0, fz_empty_rect);
+}
+
+static void
+fz_profile_render_flags(fz_context *ctx, fz_device *dev_, int set, int clear)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	if (dev->target)
+		fz_render_flags(ctx, dev->target, set, clear);
+}
+
+static void
+fz_profile_set_default_colorspaces(fz_context *ctx, fz_device *dev_, fz_default_colorspaces *default_cs)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	if (dev->target)
+		fz_set_default_colorspaces(ctx, dev->target, default_cs);
+}
+
+static void
+fz_profile_begin_layer(fz_context *ctx, fz_device *dev_, const char *layer_name)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	if (dev->target)
+		fz_begin_layer(ctx, dev->target, layer_name);
+}
+
+static void
+fz_profile_end_layer(fz_context *ctx, fz_device *dev_)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	if (dev->target)
+		fz_end_layer(ctx, dev->target);
+}
+
+static void
+fz_profile_close_device(fz_context *ctx, fz_device *dev_)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	dev->end = profile_now();
+}
+
+static void
+fz_profile_drop_device(fz_context *ctx, fz_device *dev_)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	int i;
+
+	for (i = 0; i < dev->xobj_len; i++)
+		fz_free(ctx, dev->xobj[i].name);
+	fz_free(ctx, dev->xobj);
+	fz_drop_hash_table(ctx, dev->xobj_index);
+	fz_free(ctx, dev->frame);
+	fz_free(ctx, dev->clip);
+}
+
+fz_device *
+fz_new_profile_device(fz_context *ctx, fz_device *target)
+{
+	fz_profile_device *dev = fz_new_derived_device(ctx, fz_profile_device);
+
+	dev->super.close_device = fz_profile_close_device;
+	dev->super.drop_device = fz_profile_drop_device;
+
+	dev->super.fill_path = fz_profile_fill_path;
+	dev->super.stroke_path = fz_profile_stroke_path;
+	dev->super.clip_path = fz_profile_clip_path;
+	dev->super.clip_stroke_path = fz_profile_clip_stroke_path;
+
+	dev->super.fill_text = fz_profile_fill_text;
+	dev->super.stroke_text = fz_profile_stroke_text;
+	dev->super.clip_text = fz_profile_clip_text;
+	dev->super.clip_stroke_text = fz_profile_clip_stroke_text;
+	dev->super.ignore_text = fz_profile_ignore_text;
+
+	dev->super.fill_shade = fz_profile_fill_shade;
+	dev->super.fill_image = fz_profile_fill_image;
+	dev->super.fill_image_mask = fz_profile_fill_image_mask;
+	dev->super.clip_image_mask = fz_profile_clip_image_mask;
+
+	dev->super.pop_clip = fz_profile_pop_clip;
+
+	dev->super.begin_mask_id = fz_profile_begin_mask_id;
+	dev->super.end_mask = fz_profile_end_mask;
+	dev->super.begin_group = fz_profile_begin_group;
+	dev->super.end_group = fz_profile_end_group;
+
+	dev->super.begin_tile = fz_profile_begin_tile;
+	dev->super.end_tile = fz_profile_end_tile;
+
+	dev->super.begin_layer = fz_profile_begin_layer;
+	dev->super.end_layer = fz_profile_end_layer;
+
+	dev->super.render_flags = fz_profile_render_flags;
+	dev->super.set_default_colorspaces = fz_profile_set_default_colorspaces;
+
+	fz_try(ctx)
+		dev->xobj_index = fz_new_hash_table(ctx, 64, sizeof(int), -1, NULL);
+	fz_catch(ctx)
+	{
+		fz_drop_device(ctx, &dev->super);
+		fz_rethrow(ctx);
+	}
+
+	if (target)
+		dev->super.hints = target->hints;
+	dev->target = target;
+	dev->start = dev->end = profile_now();
+
+	return (fz_device*)dev;
+}
+
+void
+fz_profile_begin_xobject(fz_context *ctx, fz_device *dev_, int num, const char *name)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	int idx;
+
+	if (dev_->drop_device != fz_profile_drop_device)
+		return;
+
+	idx = (int)(intptr_t)fz_hash_find(ctx, dev->xobj_index, &num) - 1;
+	if (idx < 0)
+	{
+		if (dev->xobj_len == dev->xobj_cap)
+		{
+			int new_cap = fz_maxi(16, dev->xobj_cap * 2);
+			dev->xobj = fz_realloc_array(ctx, dev->xobj, new_cap, profile_xobject);
+			dev->xobj_cap = new_cap;
+		}
+		idx = dev->xobj_len;
+		memset(&dev->xobj[idx], 0, sizeof(dev->xobj[idx]));
+		dev->xobj[idx].num = num;
+		dev->xobj[idx].name = name ? fz_strdup(ctx, name) : NULL;
+		dev->xobj_len++;
+		fz_hash_insert(ctx, dev->xobj_index, &num, (void *)(intptr_t)(idx + 1));
+	}
+
+	if (dev->frame_len == dev->frame_cap)
+	{
+		int new_cap = fz_maxi(16, dev->frame_cap * 2);
+		dev->frame = fz_realloc_array(ctx, dev->frame, new_cap, profile_frame);
+		dev->frame_cap = new_cap;
+	}
+	dev->frame[dev->frame_len].xobj = idx;
+	dev->frame[dev->frame_len].start = profile_now();
+	dev->frame_len++;
+	dev->xobj[idx].count++;
+}
+
+void
+fz_profile_end_xobject(fz_context *ctx, fz_device *dev_)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	profile_frame *frame;
+	int i;
+
+	if (dev_->drop_device != fz_profile_drop_device || dev->frame_len == 0)
+		return;
+
+	frame = &dev->frame[--dev->frame_len];
+	/* Time spent in an XObject that is run from within itself is only counted once. */
+	for (i = 0; i < dev->frame_len; i++)
+		if (dev->frame[i].xobj == frame->xobj)
+			return;
+	dev->xobj[frame->xobj].time += profile_now() - frame->start;
+}
+
+static void
+profile_write_ops(fz_context *ctx, fz_output *out, const profile_stat *ops)
+{
+	int i, n = 0;
+
+	fz_write_string(ctx, out, "{");
+	for (i = 0; i < PROFILE_CLASSES; i++)
+	{
+		if (ops[i].count == 0 && ops[i].time == 0)
+			continue;
+		fz_write_printf(ctx, out, "%s\"%s\":{\"count\":%d,\"ms\":%.3f", n++ ? "," : "",
+			profile_class_names[i], ops[i].count, ops[i].time * 1000);
+		if (ops[i].decode > 0)
+			fz_write_printf(ctx, out, ",\"decode_ms\":%.3f", ops[i].decode * 1000);
+		fz_write_printf(ctx, out, ",\"pixels\":%.0f}", ops[i].pixels);
+	}
+	fz_write_string(ctx, out, "}");
+}
+
+void
+fz_write_profile_json(fz_context *ctx, fz_device *dev_, fz_output *out)
+{
+	fz_profile_device *dev = (fz_profile_device *)dev_;
+	double ops_time = 0;
+	int i;
+
+	if (dev_->drop_device != fz_profile_drop_device)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "not a profile device");
+
+	for (i = 0; i < PROFILE_CLASSES; i++)
+		ops_time += dev->ops[i].time + dev->ops[i].decode;
+
+	fz_write_printf(ctx, out, "{\"ms\":%.3f,\"interpret_ms\":%.3f,\"ops\":",
+		(dev->end - dev->start) * 1000,
+		fz_max(0, dev->end - dev->start - ops_time) * 1000);
+	profile_write_ops(ctx, out, dev->ops);
+	fz_write_string(ctx, out, ",\"xobjects\":[");
+	for (i = 0; i < dev->xobj_len; i++)
+	{
+		profile_xobject *x = &dev->xobj[i];
+		fz_write_printf(ctx, out, "%s{\"num\":%d", i ? "," : "", x->num);
+		if (x->name)
+			fz_write_printf(ctx, out, ",\"name\":%q", x->name);
+		fz_write_printf(ctx, out, ",\"count\":%d,\"ms\":%.3f,\"ops\":", x->count, x->time * 1000);
+		profile_write_ops(ctx, out, x->ops);
+		fz_write_string(ctx, out, "}");
+	}
+	fz_write_string(ctx, out, "]}");
+}
@@ -36,8 +36,18 @@ typedef struct fz_item
 	struct fz_item *prev;
 	fz_store *store;
 	const fz_store_type *type;
+	float cost;
+	int hits;
+	unsigned int stamp;
 } fz_item;
 
+/* The number of different store types we keep statistics for. */
+#define FZ_STORE_MAX_STATS 32
+
+/* The number of evicted items we remember, to spot them being
+ * recreated. */
+#define FZ_STORE_EVICTED_HISTORY 1024
+
 /* Every entry in fz_store is protected by the alloc lock */
 struct fz_store
 {
@@ -59,6 +69,35 @@ struct fz_store
 	int defer_reap_count;
 	int needs_reaping;
 	int scavenging;
+
+	/* Optional eviction policy. If score is NULL, we evict in LRU
+	 * order. clock is bumped every time an item is touched, so that
+	 * policies can tell how long ago an item was last used. */
+	fz_store_score_fn *score;
+	void *score_arg;
+	unsigned int clock;
+
+	/* Bumped whenever an item is unlinked from the list, so that a
+	 * scan made with the lock dropped can tell whether the items it
+	 * saw are still there. */
+	unsigned int removals;
+
+	/* Per type statistics. */
+	int num_stats;
+	const fz_store_type *stats_type[FZ_STORE_MAX_STATS];
+	fz_store_type_stats stats[FZ_STORE_MAX_STATS];
+
+	/* The hashes of the most recently evicted items, both in a hash
+	 * table (for lookup) and in a ring (so we know which to forget).
+	 * The table is created at twice the size of the ring, so never
+	 * needs to be resized (and hence can never throw). */
+	fz_hash_table *evicted;
+	fz_store_hash evicted_ring[FZ_STORE_EVICTED_HISTORY];
+	int evicted_pos;
+	int evicted_len;
+
+	/* The last id given out by fz_new_store_id. */
+	int last_id;
 };
 
 void
@@ -69,9 +108,11 @@ fz_new_store_context(fz_context *ctx, size_t max)
 	fz_try(ctx)
 	{
 		store->hash = fz_new_hash_table(ctx, 4096, sizeof(fz_store_hash), FZ_LOCK_ALLOC, NULL);
+		store->evicted = fz_new_hash_table(ctx, FZ_STORE_EVICTED_HISTORY * 2, sizeof(fz_store_hash), FZ_LOCK_ALLOC, NULL);
 	}
 	fz_catch(ctx)
 	{
+		fz_drop_hash_table(ctx, store->hash);
 		fz_free(ctx, store);
 		fz_rethrow(ctx);
 	}
@@ -133,6 +174,7 @@ do_reap(fz_context *ctx)
 
 		/* We have to drop it */
 		store->size -= item->size;
+		store->removals++;
 
 		/* Unlink from the linked list */
 		if (item->next)
@@ -272,6 +314,245 @@ void fz_drop_key_storable_key(fz_context *ctx, const fz_key_storable *sc)
 		s->storable.drop(ctx, &s->storable);
 }
 
+/*
+	Entered with FZ_LOCK_ALLOC held. May return NULL if we are
+	already tracking too many types.
+*/
+static fz_store_type_stats *
+type_stats(fz_store *store, const fz_store_type *type)
+{
+	int i;
+
+	for (i = 0; i < store->num_stats; i++)
+		if (store->stats_type[i] == type)
+			return &store->stats[i];
+	if (store->num_stats == FZ_STORE_MAX_STATS)
+		return NULL;
+	store->stats_type[i] = type;
+	store->stats[i].name = type->name;
+	store->num_stats++;
+	return &store->stats[i];
+}
+
+/*
+	Entered with FZ_LOCK_ALLOC held. Called for items that are
+	being evicted to make space (as opposed to being removed or
+	reaped because they can never be found again).
+*/
+static void
+note_evicted(fz_context *ctx, fz_store *store, fz_item *item)
+{
+	fz_store_type_stats *stats = type_stats(store, item->type);
+	fz_store_hash hash = { NULL };
+	fz_store_hash *slot;
+
+	if (stats)
+		stats->evicted++;
+
+	if (item->type->make_hash_key == NULL)
+		return;
+	hash.drop = item->val->drop;
+	if (!item->type->make_hash_key(ctx, &hash, item->key))
+		return;
+	if (fz_hash_find(ctx, store->evicted, &hash))
+		return;
+
+	/* Forget the oldest eviction if the ring is full. */
+	slot = &store->evicted_ring[store->evicted_pos];
+	if (store->evicted_len == FZ_STORE_EVICTED_HISTORY)
+	{
+		if (fz_hash_find(ctx, store->evicted, slot))
+			fz_hash_remove(ctx, store->evicted, slot);
+	}
+	else
+		store->evicted_len++;
+	*slot = hash;
+	store->evicted_pos = (store->evicted_pos + 1) % FZ_STORE_EVICTED_HISTORY;
+
+	/* Never resizes (see fz_new_store_context), so cannot throw. */
+	fz_hash_insert(ctx, store->evicted, slot, (void *)item->type);
+}
+
+/*
+	Entered with FZ_LOCK_ALLOC held. Returns the evictable item
+	with the lowest score according to the eviction policy. Only
+	used when scavenging, where we cannot allocate or drop the lock.
+*/
+static fz_item *
+lowest_score(fz_context *ctx, fz_store *store)
+{
+	fz_item *item, *best = NULL;
+	float best_score = 0;
+
+	for (item = store->tail; item; item = item->prev)
+	{
+		fz_store_item_info info;
+		float score;
+
+		if (item->val->refs != 1)
+			continue;
+
+		info.type = item->type;
+		info.size = item->size;
+		info.cost = item->cost > 0 ? item->cost : (float)item->size;
+		info.hits = item->hits;
+		info.age = store->clock - item->stamp;
+		score = store->score(ctx, store->score_arg, &info);
+		if (best == NULL || score < best_score)
+		{
+			best = item;
+			best_score = score;
+		}
+	}
+
+	return best;
+}
+
+typedef struct
+{
+	fz_item *item;
+	fz_store_item_info info;
+	float score;
+} fz_store_candidate;
+
+/* Lower scores first; on ties, the older item first, as in lowest_score. */
+static int
+candidate_before(const fz_store_candidate *a, const fz_store_candidate *b)
+{
+	if (a->score != b->score)
+		return a->score < b->score;
+	return a->info.age > b->info.age;
+}
+
+static void
+sift_candidate(fz_store_candidate *cand, int n, int i)
+{
+	for (;;)
+	{
+		int best = i;
+		int l = 2 * i + 1;
+		int r = l + 1;
+		fz_store_candidate t;
+
+		if (l < n && candidate_before(&cand[l], &cand[best]))
+			best = l;
+		if (r < n && candidate_before(&cand[r], &cand[best]))
+			best = r;
+		if (best == i)
+			return;
+		t = cand[i];
+		cand[i] = cand[best];
+		cand[best] = t;
+		i = best;
+	}
+}
+
+/*
+	Entered with FZ_LOCK_ALLOC held. Scores every evictable item once,
+	calling the policy with the lock dropped, and returns them as a
+	heap with the lowest score on top. Returns NULL if we could not
+	allocate the candidates, or if the store kept losing items while
+	we were scoring them; the caller should then evict in LRU order.
+	The lock is held again on return.
+*/
+static fz_store_candidate *
+score_candidates(fz_context *ctx, fz_store *store, int *count)
+{
+	fz_store_candidate *cand = NULL;
+	fz_store_score_fn *score = store->score;
+	void *score_arg = store->score_arg;
+	unsigned int removals;
+	fz_item *item;
+	int i, n, tries;
+
+	for (tries = 0; tries < 3; tries++)
+	{
+		n = 0;
+		for (item = store->tail; item; item = item->prev)
+			if (item->val->refs == 1)
+				n++;
+		if (n == 0)
+			break;
+
+		fz_unlock(ctx, FZ_LOCK_ALLOC);
+		fz_free(ctx, cand);
+		cand = fz_malloc_no_throw(ctx, sizeof(*cand) * n);
+		fz_lock(ctx, FZ_LOCK_ALLOC);
+		if (cand == NULL)
+			return NULL;
+
+		/* Items may have come and gone while we were allocating. */
+		i = 0;
+		for (item = store->tail; item && i < n; item = item->prev)
+		{
+			if (item->val->refs != 1)
+				continue;
+			cand[i].item = item;
+			cand[i].info.type = item->type;
+			cand[i].info.size = item->size;
+			cand[i].info.cost = item->cost > 0 ? item->cost : (float)item->size;
+			cand[i].info.hits = item->hits;
+			cand[i].info.age = store->clock - item->stamp;
+			i++;
+		}
+		removals = store->removals;
+
+		fz_unlock(ctx, FZ_LOCK_ALLOC);
+		for (n = 0; n < i; n++)
+			cand[n].score = score(ctx, score_arg, &cand[n].info);
+		fz_lock(ctx, FZ_LOCK_ALLOC);
+
+		/* Our item pointers are only safe if nothing was unlinked. */
+		if (store->removals == removals)
+		{
+			for (n = i / 2 - 1; n >= 0; n--)
+				sift_candidate(cand, i, n);
+			*count = i;
+			return cand;
+		}
+	}
+
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	fz_free(ctx, cand);
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	return NULL;
+}
+
+/* Pop the lowest scoring candidate that is still evictable. */
+static fz_item *
+pop_candidate(fz_store_candidate *cand, int *count)
+{
+	while (*count > 0)
+	{
+		fz_item *item = cand[0].item;
+		cand[0] = cand[--*count];
+		sift_candidate(cand, *count, 0);
+		if (item->val->refs == 1)
+			return item;
+	}
+	return NULL;
+}
+
+float
+fz_store_cost_benefit_score(fz_context *ctx, void *arg, const fz_store_item_info *info)
+{
+	/* Cost to recreate per byte freed, boosted by proven reuse and
+	 * decaying as the item goes unused. */
+	return info->cost * (1 + info->hits) / ((float)info->size + 1) / (1 + info->age / 64.0f);
+}
+
+void
+fz_set_store_eviction_policy(fz_context *ctx, fz_store_score_fn *score, void *arg)
+{
+	if (ctx->store == NULL)
+		return;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	ctx->store->score = score;
+	ctx->store->score_arg = arg;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+}
+
 static void
 evict(fz_context *ctx, fz_item *item)
 {
@@ -279,6 +560,7 @@ evict(fz_context *ctx, fz_item *item)
 	int drop;
 
 	store->size -= item->size;
+	store->removals++;
 	/* Unlink from the linked list */
 	if (item->next)
 		item->next->prev = item->prev;
@@ -319,6 +601,8 @@ ensure_space(fz_context *ctx, size_t tofree)
 	size_t count;
 	fz_store *store = ctx->store;
 	fz_item *to_be_freed = NULL;
+	fz_store_candidate *cand = NULL;
+	int ncand = 0;
 
 	fz_assert_lock_held(ctx, FZ_LOCK_ALLOC);
 
@@ -341,15 +625,30 @@ ensure_space(fz_context *ctx, size_t tofree)
 		return 0;
 	}
 
-	/* Now move all the items to be freed onto 'to_be_freed' */
+	/* Now move all the items to be freed onto 'to_be_freed'. Without
+	 * an eviction policy, we take them in LRU order. With one, we
+	 * score the evictable items once and take the lowest first. */
+	if (store->score)
+		cand = score_candidates(ctx, store, &ncand);
 	count = 0;
-	for (item = store->tail; item; item = prev)
+	prev = store->tail;
+	while (count < tofree)
 	{
+		if (cand)
+			item = pop_candidate(cand, &ncand);
+		else
+		{
+			item = prev;
+			while (item && item->val->refs != 1)
+				item = item->prev;
+		}
+		if (item == NULL)
+			break;
 		prev = item->prev;
-		if (item->val->refs != 1)
-			continue;
 
+		note_evicted(ctx, store, item);
 		store->size -= item->size;
+		store->removals++;
 
 		/* Unlink from the linked list */
 		if (item->next)
@@ -375,8 +674,13 @@ ensure_space(fz_context *ctx, size_t tofree)
 		to_be_freed = item;
 
 		count += item->size;
-		if (count >= tofree)
-			break;
+	}
+
+	if (cand)
+	{
+		fz_unlock(ctx, FZ_LOCK_ALLOC);
+		fz_free(ctx, cand);
+		fz_lock(ctx, FZ_LOCK_ALLOC);
 	}
 
 	/* Now we can safely drop the lock and free our pending items. These
@@ -411,6 +715,8 @@ ensure_space(fz_context *ctx, size_t tofree)
 static void
 touch(fz_store *store, fz_item *item)
 {
+	item->stamp = ++store->clock;
+
 	if (item->next != item)
 	{
 		/* Already in the list - unlink it */
@@ -434,9 +740,16 @@ touch(fz_store *store, fz_item *item)
 }
 
 void *
-fz_store_item(fz_context *ctx, void *key, void *val_, size_t itemsize, const fz_store_type *type)
+fz_store_item(fz_context *ctx, void *key, void *val, size_t itemsize, const fz_store_type *type)
+{
+	return fz_store_item_with_cost(ctx, key, val, itemsize, 0, type);
+}
+
+void *
+fz_store_item_with_cost(fz_context *ctx, void *key, void *val_, size_t itemsize, float cost, const fz_store_type *type)
 {
 	fz_item *item = NULL;
+	fz_store_type_stats *stats;
 	size_t size;
 	fz_storable *val = (fz_storable *)val_;
 	fz_store *store = ctx->store;
@@ -474,6 +787,7 @@ fz_store_item(fz_context *ctx, void *key, void *val_, size_t itemsize, const fz_
 	item->next = item;
 	item->prev = item;
 	item->type = type;
+	item->cost = cost;
 
 	/* If we can index it fast, put it into the hash table. This serves
 	 * to check whether we have one there already. */
@@ -513,6 +827,17 @@ fz_store_item(fz_context *ctx, void *key, void *val_, size_t itemsize, const fz_
 		}
 	}
 
+	stats = type_stats(store, type);
+	if (stats)
+		stats->stored++;
+	if (use_hash && fz_hash_find(ctx, store->evicted, &hash))
+	{
+		/* We evicted this one earlier, and have had to make it again. */
+		fz_hash_remove(ctx, store->evicted, &hash);
+		if (stats)
+			stats->recreated++;
+	}
+
 	/* Now bump the ref */
 	if (val->refs > 0)
 	{
@@ -615,6 +940,12 @@ fz_find_item(fz_context *ctx, fz_store_drop_fn *drop, void *key, const fz_store_
 		 * linked list does not get whipped out again due to the
 		 * store being full. */
 		touch(store, item);
+		item->hits++;
+		{
+			fz_store_type_stats *stats = type_stats(store, type);
+			if (stats)
+				stats->hits++;
+		}
 		/* And bump the refcount before returning */
 		if (item->val->refs > 0)
 		{
@@ -666,6 +997,7 @@ fz_remove_item(fz_context *ctx, fz_store_drop_fn *drop, void *key, const fz_stor
 		 * such items by setting item->next == item. */
 		if (item->next != item)
 		{
+			store->removals++;
 			if (item->next)
 				item->next->prev = item->prev;
 			else
@@ -720,11 +1052,85 @@ fz_drop_store_context(fz_context *ctx)
 	{
 		fz_empty_store(ctx);
 		fz_drop_hash_table(ctx, ctx->store->hash);
+		fz_drop_hash_table(ctx, ctx->store->evicted);
 		fz_free(ctx, ctx->store);
 		ctx->store = NULL;
 	}
 }
 
+static void
+fill_stats_locked(fz_store *store, fz_store_type_stats *stats, int max)
+{
+	fz_item *item;
+	int i;
+
+	for (i = 0; i < store->num_stats && i < max; i++)
+	{
+		stats[i] = store->stats[i];
+		stats[i].count = 0;
+		stats[i].size = 0;
+	}
+	for (item = store->head; item; item = item->next)
+	{
+		for (i = 0; i < store->num_stats && i < max; i++)
+		{
+			if (store->stats_type[i] == item->type)
+			{
+				stats[i].count++;
+				stats[i].size += item->size;
+				break;
+			}
+		}
+	}
+}
+
+int
+fz_new_store_id(fz_context *ctx)
+{
+	int id;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	if (ctx->store->last_id == INT_MAX)
+		ctx->store->last_id = 0;
+	id = ++ctx->store->last_id;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	return id;
+}
+
+int
+fz_store_stats(fz_context *ctx, fz_store_type_stats *stats, int max)
+{
+	int n;
+
+	if (ctx->store == NULL)
+		return 0;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	fill_stats_locked(ctx->store, stats, max);
+	n = ctx->store->num_stats;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	return n;
+}
+
+void
+fz_debug_store_stats(fz_context *ctx, fz_output *out)
+{
+	fz_store_type_stats stats[FZ_STORE_MAX_STATS];
+	int i, n;
+
+	n = fz_store_stats(ctx, stats, FZ_STORE_MAX_STATS);
+	if (n > FZ_STORE_MAX_STATS)
+		n = FZ_STORE_MAX_STATS;
+	fz_write_printf(ctx, out, "STORE\t-- resource store statistics --\n");
+	for (i = 0; i < n; i++)
+		fz_write_printf(ctx, out, "STORE\t%s: stored=%d hits=%d evicted=%d recreated=%d count=%d size=%zu\n",
+			stats[i].name, stats[i].stored, stats[i].hits, stats[i].evicted, stats[i].recreated,
+			stats[i].count, stats[i].size);
+	fz_write_printf(ctx, out, "STORE\t-- end --\n");
+}
+
 static void
 fz_debug_store_item(fz_context *ctx, void *state, void *key_, int keylen, void *item_)
 {
@@ -830,16 +1236,23 @@ scavenge(fz_context *ctx, size_t tofree)
 		size_t suffix_size = 0;
 		fz_item *largest = NULL;
 
-		for (item = store->tail; item; item = item->prev)
+		/* With an eviction policy, we simply go for the lowest scoring
+		 * item instead. */
+		if (store->score)
+			largest = lowest_score(ctx, store);
+		else
 		{
-			if (item->val->refs == 1)
+			for (item = store->tail; item; item = item->prev)
 			{
-				/* This one is evictable */
-				suffix_size += item->size;
-				if (largest == NULL || item->size > largest->size)
-					largest = item;
-				if (suffix_size >= tofree - freed)
-					break;
+				if (item->val->refs == 1)
+				{
+					/* This one is evictable */
+					suffix_size += item->size;
+					if (largest == NULL || item->size > largest->size)
+						largest = item;
+					if (suffix_size >= tofree - freed)
+						break;
+				}
 			}
 		}
 
@@ -852,6 +1265,7 @@ scavenge(fz_context *ctx, size_t tofree)
 			FZ_LOG_DUMP_STORE(ctx, "Before scavenge:\n");
 		}
 		freed += largest->size;
+		note_evicted(ctx, store, largest);
 		evict(ctx, largest); /* Drops then retakes lock */
 	}
 	while (freed < tofree);
@@ -1028,6 +1442,7 @@ void fz_filter_store(fz_context *ctx, fz_store_filter_fn *fn, void *arg, const f
 
 		/* We have to drop it */
 		store->size -= item->size;
+		store->removals++;
 
 		/* Unlink from the linked list */
 		if (item->next)
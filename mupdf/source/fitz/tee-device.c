@@ -0,0 +1,358 @@
+// Copyright (C) 2004-2022 Artifex Software, Inc.
+//
+// This file is part of MuPDF.
+//
+// MuPDF is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// MuPDF is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with MuPDF. If not, see <https://www.gnu.org/licenses/agpl-3.0.en.html>
+//
+// Alternative licensing terms are available from the licensor.
+// For commercial licensing, see <https://www.artifex.com/> or contact
+// Artifex Software, Inc., 1305 Grant Avenue - Suite 200, Novato,
+// CA 94945, U.S.A., +1(415)492-9861, for further information.
+
+#include "mupdf/fitz.h"
+
+/*
+ * A target that has a tile or a mask cached (see fz_begin_tile_id and
+ * fz_begin_mask_id) doesn't want its contents, which the other target
+ * may still need. The tee then skips that target until the end of the
+ * tile resp. the mask, counting the containers opened in between.
+ */
+
+typedef struct
+{
+	fz_device super;
+	fz_device *target[2];
+	int skip[2];
+} fz_tee_device;
+
+#define FOR_EACH_TARGET(dev, i) \
+	for (i = 0; i < 2; i++) \
+		if (!dev->skip[i])
+
+static void
+tee_open(fz_tee_device *dev)
+{
+	int i;
+	for (i = 0; i < 2; i++)
+		if (dev->skip[i])
+			dev->skip[i]++;
+}
+
+/* Returns whether target i gets the call closing a container. */
+static int
+tee_close(fz_tee_device *dev, int i)
+{
+	if (!dev->skip[i])
+		return 1;
+	return --dev->skip[i] == 0;
+}
+
+static void
+fz_tee_fill_path(fz_context *ctx, fz_device *dev_, const fz_path *path, int even_odd, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_fill_path(ctx, dev->target[i], path, even_odd, ctm, colorspace, color, alpha, color_params);
+}
+
+static void
+fz_tee_stroke_path(fz_context *ctx, fz_device *dev_, const fz_path *path, const fz_stroke_state *stroke, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_stroke_path(ctx, dev->target[i], path, stroke, ctm, colorspace, color, alpha, color_params);
+}
+
+static void
+fz_tee_clip_path(fz_context *ctx, fz_device *dev_, const fz_path *path, int even_odd, fz_matrix ctm, fz_rect scissor)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_clip_path(ctx, dev->target[i], path, even_odd, ctm, scissor);
+	tee_open(dev);
+}
+
+static void
+fz_tee_clip_stroke_path(fz_context *ctx, fz_device *dev_, const fz_path *path, const fz_stroke_state *stroke, fz_matrix ctm, fz_rect scissor)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_clip_stroke_path(ctx, dev->target[i], path, stroke, ctm, scissor);
+	tee_open(dev);
+}
+
+static void
+fz_tee_fill_text(fz_context *ctx, fz_device *dev_, const fz_text *text, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_fill_text(ctx, dev->target[i], text, ctm, colorspace, color, alpha, color_params);
+}
+
+static void
+fz_tee_stroke_text(fz_context *ctx, fz_device *dev_, const fz_text *text, const fz_stroke_state *stroke, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_stroke_text(ctx, dev->target[i], text, stroke, ctm, colorspace, color, alpha, color_params);
+}
+
+static void
+fz_tee_clip_text(fz_context *ctx, fz_device *dev_, const fz_text *text, fz_matrix ctm, fz_rect scissor)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_clip_text(ctx, dev->target[i], text, ctm, scissor);
+	tee_open(dev);
+}
+
+static void
+fz_tee_clip_stroke_text(fz_context *ctx, fz_device *dev_, const fz_text *text, const fz_stroke_state *stroke, fz_matrix ctm, fz_rect scissor)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_clip_stroke_text(ctx, dev->target[i], text, stroke, ctm, scissor);
+	tee_open(dev);
+}
+
+static void
+fz_tee_ignore_text(fz_context *ctx, fz_device *dev_, const fz_text *text, fz_matrix ctm)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_ignore_text(ctx, dev->target[i], text, ctm);
+}
+
+static void
+fz_tee_fill_shade(fz_context *ctx, fz_device *dev_, fz_shade *shade, fz_matrix ctm, float alpha, fz_color_params color_params)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_fill_shade(ctx, dev->target[i], shade, ctm, alpha, color_params);
+}
+
+static void
+fz_tee_fill_image(fz_context *ctx, fz_device *dev_, fz_image *image, fz_matrix ctm, float alpha, fz_color_params color_params)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_fill_image(ctx, dev->target[i], image, ctm, alpha, color_params);
+}
+
+static void
+fz_tee_fill_image_mask(fz_context *ctx, fz_device *dev_, fz_image *image, fz_matrix ctm,
+	fz_colorspace *colorspace, const float *color, float alpha, fz_color_params color_params)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_fill_image_mask(ctx, dev->target[i], image, ctm, colorspace, color, alpha, color_params);
+}
+
+static void
+fz_tee_clip_image_mask(fz_context *ctx, fz_device *dev_, fz_image *image, fz_matrix ctm, fz_rect scissor)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_clip_image_mask(ctx, dev->target[i], image, ctm, scissor);
+	tee_open(dev);
+}
+
+static void
+fz_tee_pop_clip(fz_context *ctx, fz_device *dev_)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	for (i = 0; i < 2; i++)
+		if (tee_close(dev, i))
+			fz_pop_clip(ctx, dev->target[i]);
+}
+
+static int
+fz_tee_begin_mask_id(fz_context *ctx, fz_device *dev_, fz_rect area, int luminosity, fz_colorspace *colorspace, const float *bc, fz_color_params color_params, fz_matrix ctm, int id)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int cached[2] = { 0, 0 };
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		cached[i] = fz_begin_mask_id(ctx, dev->target[i], area, luminosity, colorspace, bc, color_params, ctm, id);
+	tee_open(dev);
+	if (cached[0] && cached[1])
+		return 1;
+	/* the mask's contents go to the other target only */
+	for (i = 0; i < 2; i++)
+		if (cached[i])
+			dev->skip[i] = 1;
+	return 0;
+}
+
+static void
+fz_tee_end_mask(fz_context *ctx, fz_device *dev_)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	/* the mask becomes a clip, which is popped later on */
+	for (i = 0; i < 2; i++)
+	{
+		if (dev->skip[i] == 1)
+			dev->skip[i] = 0;
+		if (!dev->skip[i])
+			fz_end_mask(ctx, dev->target[i]);
+	}
+}
+
+static void
+fz_tee_begin_group(fz_context *ctx, fz_device *dev_, fz_rect area, fz_colorspace *cs, int isolated, int knockout, int blendmode, float alpha)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_begin_group(ctx, dev->target[i], area, cs, isolated, knockout, blendmode, alpha);
+	tee_open(dev);
+}
+
+static void
+fz_tee_end_group(fz_context *ctx, fz_device *dev_)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	for (i = 0; i < 2; i++)
+		if (tee_close(dev, i))
+			fz_end_group(ctx, dev->target[i]);
+}
+
+static int
+fz_tee_begin_tile(fz_context *ctx, fz_device *dev_, fz_rect area, fz_rect view, float xstep, float ystep, fz_matrix ctm, int id)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int cached[2] = { 0, 0 };
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		cached[i] = fz_begin_tile_id(ctx, dev->target[i], area, view, xstep, ystep, ctm, id);
+	tee_open(dev);
+	if (cached[0] && cached[1])
+		return 1;
+	/* the tile's contents go to the other target only, the end of
+	 * the tile to both */
+	for (i = 0; i < 2; i++)
+		if (cached[i])
+			dev->skip[i] = 1;
+	return 0;
+}
+
+static void
+fz_tee_end_tile(fz_context *ctx, fz_device *dev_)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	for (i = 0; i < 2; i++)
+		if (tee_close(dev, i))
+			fz_end_tile(ctx, dev->target[i]);
+}
+
+static void
+fz_tee_render_flags(fz_context *ctx, fz_device *dev_, int set, int clear)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_render_flags(ctx, dev->target[i], set, clear);
+}
+
+static void
+fz_tee_set_default_colorspaces(fz_context *ctx, fz_device *dev_, fz_default_colorspaces *default_cs)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_set_default_colorspaces(ctx, dev->target[i], default_cs);
+}
+
+static void
+fz_tee_begin_layer(fz_context *ctx, fz_device *dev_, const char *layer_name)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_begin_layer(ctx, dev->target[i], layer_name);
+}
+
+static void
+fz_tee_end_layer(fz_context *ctx, fz_device *dev_)
+{
+	fz_tee_device *dev = (fz_tee_device *)dev_;
+	int i;
+	FOR_EACH_TARGET(dev, i)
+		fz_end_layer(ctx, dev->target[i]);
+}
+
+fz_device *
+fz_new_tee_device(fz_context *ctx, fz_device *first, fz_device *second)
+{
+	fz_tee_device *dev = fz_new_derived_device(ctx, fz_tee_device);
+
+	dev->super.fill_path = fz_tee_fill_path;
+	dev->super.stroke_path = fz_tee_stroke_path;
+	dev->super.clip_path = fz_tee_clip_path;
+	dev->super.clip_stroke_path = fz_tee_clip_stroke_path;
+
+	dev->super.fill_text = fz_tee_fill_text;
+	dev->super.stroke_text = fz_tee_stroke_text;
+	dev->super.clip_text = fz_tee_clip_text;
+	dev->super.clip_stroke_text = fz_tee_clip_stroke_text;
+	dev->super.ignore_text = fz_tee_ignore_text;
+
+	dev->super.fill_shade = fz_tee_fill_shade;
+	dev->super.fill_image = fz_tee_fill_image;
+	dev->super.fill_image_mask = fz_tee_fill_image_mask;
+	dev->super.clip_image_mask = fz_tee_clip_image_mask;
+
+	dev->super.pop_clip = fz_tee_pop_clip;
+
+	dev->super.begin_mask_id = fz_tee_begin_mask_id;
+	dev->super.end_mask = fz_tee_end_mask;
+	dev->super.begin_group = fz_tee_begin_group;
+	dev->super.end_group = fz_tee_end_group;
+
+	dev->super.begin_tile = fz_tee_begin_tile;
+	dev->super.end_tile = fz_tee_end_tile;
+
+	dev->super.begin_layer = fz_tee_begin_layer;
+	dev->super.end_layer = fz_tee_end_layer;
+
+	dev->super.render_flags = fz_tee_render_flags;
+	dev->super.set_default_colorspaces = fz_tee_set_default_colorspaces;
+
+	dev->super.hints = first->hints | second->hints;
+	dev->target[0] = first;
+	dev->target[1] = second;
+
+	return (fz_device*)dev;
+}
@@ -457,13 +457,15 @@ fz_test_pop_clip(fz_context *ctx, fz_device *dev_)
 		fz_pop_clip(ctx, dev->passthrough);
 }
 
-static void
-fz_test_begin_mask(fz_context *ctx, fz_device *dev_, fz_rect rect, int luminosity, fz_colorspace *cs, const float *bc, fz_color_params color_params)
+static int
+fz_test_begin_mask_id(fz_context *ctx, fz_device *dev_, fz_rect rect, int luminosity, fz_colorspace *cs, const float *bc, fz_color_params color_params, fz_matrix ctm, int id)
 {
 	fz_test_device *dev = (fz_test_device*)dev_;
 
 	if (dev->passthrough)
-		fz_begin_mask(ctx, dev->passthrough, rect, luminosity, cs, bc, color_params);
+		return fz_begin_mask_id(ctx, dev->passthrough, rect, luminosity, cs, bc, color_params, ctm, id);
+	else
+		return 0;
 }
 
 static void
@@ -535,7 +537,7 @@ fz_new_test_device(fz_context *ctx, int *is_color, float threshold, int options,
 		dev->super.ignore_text = fz_test_ignore_text;
 		dev->super.clip_image_mask = fz_test_clip_image_mask;
 		dev->super.pop_clip = fz_test_pop_clip;
-		dev->super.begin_mask = fz_test_begin_mask;
+		dev->super.begin_mask_id = fz_test_begin_mask_id;
 		dev->super.end_mask = fz_test_end_mask;
 		dev->super.begin_group = fz_test_begin_group;
 		dev->super.end_group = fz_test_end_group;
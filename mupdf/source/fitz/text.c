@@ -22,12 +22,15 @@
 
 #include "mupdf/fitz.h"
 
+#include "context-imp.h"
+
 #include <string.h>
 
 fz_text *
 fz_new_text(fz_context *ctx)
 {
-	fz_text *text = fz_malloc_struct(ctx, fz_text);
+	fz_text *text = fz_arena_malloc(ctx, sizeof(*text));
+	memset(text, 0, sizeof(*text));
 	text->refs = 1;
 	return text;
 }
@@ -52,18 +55,60 @@ fz_drop_text(fz_context *ctx, const fz_text *textc)
 		{
 			fz_text_span *next = span->next;
 			fz_drop_font(ctx, span->font);
-			fz_free(ctx, span->items);
-			fz_free(ctx, span);
+			fz_arena_free(ctx, span->items);
+			fz_arena_free(ctx, span);
 			span = next;
 		}
-		fz_free(ctx, text);
+		fz_arena_free(ctx, text);
+	}
+}
+
+fz_text *
+fz_keep_text_off_arena(fz_context *ctx, const fz_text *textc)
+{
+	fz_text *text = (fz_text *)textc; /* Explicit cast away of const */
+	fz_text *clone;
+	fz_text_span *span, *cspan;
+
+	if (!fz_is_arena_block(text))
+		return fz_keep_text(ctx, text);
+
+	clone = fz_arena_realloc(ctx, NULL, NULL, sizeof(*clone));
+	memset(clone, 0, sizeof(*clone));
+	clone->refs = 1;
+
+	fz_try(ctx)
+	{
+		for (span = text->head; span; span = span->next)
+		{
+			cspan = fz_arena_realloc(ctx, clone, NULL, sizeof(*cspan));
+			*cspan = *span;
+			cspan->items = NULL;
+			cspan->next = NULL;
+			cspan->cap = cspan->len;
+			fz_keep_font(ctx, cspan->font);
+			if (clone->tail)
+				clone->tail = clone->tail->next = cspan;
+			else
+				clone->head = clone->tail = cspan;
+			cspan->items = fz_arena_realloc(ctx, clone, NULL, (size_t)cspan->len * sizeof(fz_text_item));
+			memcpy(cspan->items, span->items, (size_t)cspan->len * sizeof(fz_text_item));
+		}
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_text(ctx, clone);
+		fz_rethrow(ctx);
 	}
+
+	return clone;
 }
 
 static fz_text_span *
-fz_new_text_span(fz_context *ctx, fz_font *font, int wmode, int bidi_level, fz_bidi_direction markup_dir, fz_text_language language, fz_matrix trm)
+fz_new_text_span(fz_context *ctx, fz_text *text, fz_font *font, int wmode, int bidi_level, fz_bidi_direction markup_dir, fz_text_language language, fz_matrix trm)
 {
-	fz_text_span *span = fz_malloc_struct(ctx, fz_text_span);
+	fz_text_span *span = fz_arena_realloc(ctx, text, NULL, sizeof(*span));
+	memset(span, 0, sizeof(*span));
 	span->font = fz_keep_font(ctx, font);
 	span->wmode = wmode;
 	span->bidi_level = bidi_level;
@@ -80,7 +125,7 @@ fz_add_text_span(fz_context *ctx, fz_text *text, fz_font *font, int wmode, int b
 {
 	if (!text->tail)
 	{
-		text->head = text->tail = fz_new_text_span(ctx, font, wmode, bidi_level, markup_dir, language, trm);
+		text->head = text->tail = fz_new_text_span(ctx, text, font, wmode, bidi_level, markup_dir, language, trm);
 	}
 	else if (text->tail->font != font ||
 		text->tail->wmode != wmode ||
@@ -92,20 +137,20 @@ fz_add_text_span(fz_context *ctx, fz_text *text, fz_font *font, int wmode, int b
 		text->tail->trm.c != trm.c ||
 		text->tail->trm.d != trm.d)
 	{
-		text->tail = text->tail->next = fz_new_text_span(ctx, font, wmode, bidi_level, markup_dir, language, trm);
+		text->tail = text->tail->next = fz_new_text_span(ctx, text, font, wmode, bidi_level, markup_dir, language, trm);
 	}
 	return text->tail;
 }
 
 static void
-fz_grow_text_span(fz_context *ctx, fz_text_span *span, int n)
+fz_grow_text_span(fz_context *ctx, fz_text *text, fz_text_span *span, int n)
 {
 	int new_cap = span->cap;
 	if (span->len + n < new_cap)
 		return;
 	while (span->len + n > new_cap)
 		new_cap = new_cap + 36;
-	span->items = fz_realloc_array(ctx, span->items, new_cap, fz_text_item);
+	span->items = fz_arena_realloc(ctx, text, span->items, (size_t)new_cap * sizeof(fz_text_item));
 	span->cap = new_cap;
 }
 
@@ -119,7 +164,7 @@ fz_show_glyph(fz_context *ctx, fz_text *text, fz_font *font, fz_matrix trm, int
 
 	span = fz_add_text_span(ctx, text, font, wmode, bidi_level, markup_dir, lang, trm);
 
-	fz_grow_text_span(ctx, span, 1);
+	fz_grow_text_span(ctx, text, span, 1);
 
 	span->items[span->len].ucs = ucs;
 	span->items[span->len].gid = gid;
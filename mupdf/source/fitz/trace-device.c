@@ -467,8 +467,8 @@ fz_trace_pop_clip(fz_context *ctx, fz_device *dev_)
 	fz_write_printf(ctx, out, "<pop_clip/>\n");
 }
 
-static void
-fz_trace_begin_mask(fz_context *ctx, fz_device *dev_, fz_rect bbox, int luminosity, fz_colorspace *colorspace, const float *color, fz_color_params color_params)
+static int
+fz_trace_begin_mask_id(fz_context *ctx, fz_device *dev_, fz_rect bbox, int luminosity, fz_colorspace *colorspace, const float *color, fz_color_params color_params, fz_matrix ctm, int id)
 {
 	fz_trace_device *dev = (fz_trace_device*)dev_;
 	fz_output *out = dev->out;
@@ -476,9 +476,15 @@ fz_trace_begin_mask(fz_context *ctx, fz_device *dev_, fz_rect bbox, int luminosi
 	fz_write_printf(ctx, out, "<clip_mask bbox=\"%g %g %g %g\" s=\"%s\"",
 		bbox.x0, bbox.y0, bbox.x1, bbox.y1,
 		luminosity ? "luminosity" : "alpha");
+	if (id)
+	{
+		fz_write_printf(ctx, out, " id=\"%d\"", id);
+		fz_trace_matrix(ctx, out, ctm);
+	}
 	fz_trace_color_params(ctx, out, color_params);
 	fz_write_printf(ctx, out, ">\n");
 	dev->depth++;
+	return 0;
 }
 
 static void
@@ -602,7 +608,7 @@ fz_device *fz_new_trace_device(fz_context *ctx, fz_output *out)
 
 	dev->super.pop_clip = fz_trace_pop_clip;
 
-	dev->super.begin_mask = fz_trace_begin_mask;
+	dev->super.begin_mask_id = fz_trace_begin_mask_id;
 	dev->super.end_mask = fz_trace_end_mask;
 	dev->super.begin_group = fz_trace_begin_group;
 	dev->super.end_group = fz_trace_end_group;
@@ -35,6 +35,9 @@
 
 enum { T, R, B, L };
 
+/* Runs of up to this many glyphs are kept in the shaping cache. */
+#define MAX_CACHED_GLYPHS 64
+
 typedef struct string_walker
 {
 	fz_context *ctx;
@@ -53,6 +56,8 @@ typedef struct string_walker
 	hb_glyph_info_t *glyph_info;
 	unsigned int glyph_count;
 	int scale;
+	/* Shaping cache value: scale, glyph count, infos, positions */
+	uint32_t shaped[2 + MAX_CACHED_GLYPHS * (sizeof(hb_glyph_info_t) + sizeof(hb_glyph_position_t)) / sizeof(uint32_t)];
 } string_walker;
 
 static int quick_ligature_mov(fz_context *ctx, string_walker *walker, unsigned int i, unsigned int n, int unicode)
@@ -128,6 +133,40 @@ static const hb_feature_t small_caps_feature[1] = {
 	{ HB_TAG('s','m','c','p'), 1, 0, -1 }
 };
 
+static int shape_params(string_walker *walker)
+{
+	return (walker->rtl ? 1 : 0) | (walker->small_caps ? 2 : 0) | ((walker->script & 0xff) << 2) | (walker->language << 10);
+}
+
+static int find_shaped_run(fz_context *ctx, string_walker *walker)
+{
+	size_t size = fz_find_shaped_text(ctx, walker->font, shape_params(walker),
+		walker->start, walker->end - walker->start, walker->shaped, sizeof walker->shaped);
+	if (size < 2 * sizeof(uint32_t) || size > sizeof walker->shaped)
+		return 0;
+	walker->scale = walker->shaped[0];
+	walker->glyph_count = walker->shaped[1];
+	walker->glyph_info = (hb_glyph_info_t *)(walker->shaped + 2);
+	walker->glyph_pos = (hb_glyph_position_t *)(walker->glyph_info + walker->glyph_count);
+	return 1;
+}
+
+static void store_shaped_run(fz_context *ctx, string_walker *walker)
+{
+	unsigned int n = walker->glyph_count;
+	hb_glyph_info_t *info = (hb_glyph_info_t *)(walker->shaped + 2);
+	hb_glyph_position_t *pos = (hb_glyph_position_t *)(info + n);
+	if (n > MAX_CACHED_GLYPHS || fz_shape_caching(ctx) == 0)
+		return;
+	walker->shaped[0] = walker->scale;
+	walker->shaped[1] = n;
+	memcpy(info, walker->glyph_info, n * sizeof *info);
+	memcpy(pos, walker->glyph_pos, n * sizeof *pos);
+	fz_store_shaped_text(ctx, walker->font, shape_params(walker),
+		walker->start, walker->end - walker->start,
+		walker->shaped, 2 * sizeof(uint32_t) + n * (sizeof *info + sizeof *pos));
+}
+
 static int walk_string(string_walker *walker)
 {
 	fz_context *ctx = walker->ctx;
@@ -165,6 +204,11 @@ static int walk_string(string_walker *walker)
 	if (walker->script <= 3 && !walker->rtl && !fz_font_flags(walker->font)->has_opentype)
 		quickshape = 1;
 
+	/* Shaping is done at the font's units per em, so the result can be
+	 * reused when the same text is laid out again at any size. */
+	if (find_shaped_run(ctx, walker))
+		return 1;
+
 	fz_hb_lock(ctx);
 	fz_try(ctx)
 	{
@@ -238,6 +282,8 @@ static int walk_string(string_walker *walker)
 		}
 	}
 
+	store_shaped_run(ctx, walker);
+
 	return 1;
 }
 
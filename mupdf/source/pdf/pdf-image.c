@@ -239,6 +239,75 @@ pdf_is_jpx_image(fz_context *ctx, pdf_obj *dict)
 	return 0;
 }
 
+/*
+	If the colorspace is given by the dictionary and the codestream
+	agrees with it, we can keep the image compressed and let the
+	decoder pick out just the area and resolution needed for each
+	render. Returns NULL if the image has to be decoded up front.
+*/
+static fz_image *
+pdf_load_jpx_compressed(fz_context *ctx, pdf_document *doc, pdf_obj *dict, fz_buffer *buf, fz_colorspace *colorspace)
+{
+	fz_compressed_buffer *cbuf = NULL;
+	fz_image *mask = NULL;
+	fz_image *img = NULL;
+	float decode[FZ_MAX_COLORS * 2];
+	float *decodep = NULL;
+	unsigned char *data;
+	size_t len;
+	int w, h, n, alpha, i;
+	pdf_obj *obj;
+
+	if (colorspace == NULL || fz_colorspace_is_indexed(ctx, colorspace))
+		return NULL;
+	if (pdf_dict_get_int(ctx, dict, PDF_NAME(SMaskInData)))
+		return NULL;
+
+	len = fz_buffer_storage(ctx, buf, &data);
+	fz_try(ctx)
+		fz_load_jpx_header(ctx, data, len, &w, &h, &n, &alpha);
+	fz_catch(ctx)
+		return NULL;
+	if (w <= 0 || h <= 0 || alpha != 0 || n != fz_colorspace_n(ctx, colorspace))
+		return NULL;
+
+	fz_var(cbuf);
+	fz_var(mask);
+
+	fz_try(ctx)
+	{
+		obj = pdf_dict_geta(ctx, dict, PDF_NAME(SMask), PDF_NAME(Mask));
+		if (pdf_is_dict(ctx, obj))
+			mask = pdf_load_image_imp(ctx, doc, NULL, obj, NULL, 1);
+
+		obj = pdf_dict_geta(ctx, dict, PDF_NAME(Decode), PDF_NAME(D));
+		if (obj)
+		{
+			for (i = 0; i < n * 2; i++)
+				decode[i] = pdf_array_get_real(ctx, obj, i);
+			decodep = decode;
+		}
+
+		cbuf = fz_malloc_struct(ctx, fz_compressed_buffer);
+		cbuf->params.type = FZ_IMAGE_JPX;
+		cbuf->buffer = fz_keep_buffer(ctx, buf);
+
+		img = fz_new_image_from_compressed_buffer(ctx, w, h, 8, colorspace, 96, 96,
+			pdf_to_bool(ctx, pdf_dict_geta(ctx, dict, PDF_NAME(Interpolate), PDF_NAME(I))),
+			0, decodep, NULL, cbuf, mask);
+		cbuf = NULL;
+	}
+	fz_always(ctx)
+		fz_drop_image(ctx, mask);
+	fz_catch(ctx)
+	{
+		fz_drop_compressed_buffer(ctx, cbuf);
+		fz_rethrow(ctx);
+	}
+
+	return img;
+}
+
 static fz_image *
 pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 {
@@ -266,6 +335,11 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 		if (obj)
 			colorspace = pdf_load_colorspace(ctx, obj);
 
+		if (!forcemask)
+			img = pdf_load_jpx_compressed(ctx, doc, dict, buf, colorspace);
+		if (img)
+			break;
+
 		len = fz_buffer_storage(ctx, buf, &data);
 		pix = fz_load_jpx(ctx, data, len, colorspace);
 
@@ -67,6 +67,70 @@ static inline int lex_byte(fz_context *ctx, fz_stream *stm)
 #define lex_byte(C,S) fz_read_byte(C,S)
 #endif
 
+/*
+	The fast paths below scan the stream buffer (f->rp to f->wp) directly,
+	and only fall back to lex_byte when the buffer runs dry. When dumping
+	the lexer stream we pretend the buffer is always empty so every byte
+	goes through lex_byte.
+*/
+#ifdef DUMP_LEXER_STREAM
+#define lex_buffer_end(F) ((F)->rp)
+#else
+#define lex_buffer_end(F) ((F)->wp)
+#endif
+
+enum
+{
+	LEX_WHITE = 1,
+	LEX_DELIM = 2,
+	LEX_DIGIT = 4,
+	LEX_NAME = 8, /* copied verbatim into names and keywords */
+	LEX_STRING = 16, /* copied verbatim into literal strings */
+};
+
+static const unsigned char lex_class[256] = {
+	17, 24, 24, 24, 24, 24, 24, 24, 24, 17, 17, 24, 17, 17, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	17, 24, 24, 16, 24, 18, 24, 24, 2, 2, 24, 24, 24, 24, 24, 18,
+	28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 24, 24, 18, 24, 18, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 18, 8, 18, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 18, 24, 18, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+};
+
+#define LEX_ONES 0x0101010101010101ull
+#define LEX_HIGHS 0x8080808080808080ull
+
+static inline uint64_t lex_load8(const unsigned char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+/* Non-zero if any of the 8 bytes in v equals b. */
+static inline uint64_t lex_has_byte(uint64_t v, unsigned char b)
+{
+	uint64_t x = v ^ (LEX_ONES * b);
+	return (x - LEX_ONES) & ~x & LEX_HIGHS;
+}
+
+/* Non-zero if all of the 8 bytes in v are ASCII digits. */
+static inline int lex_all_digits(uint64_t v)
+{
+	return (v & 0xF0F0F0F0F0F0F0F0ull) == 0x3030303030303030ull &&
+		((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) == 0x3030303030303030ull;
+}
+
 static inline int iswhite(int ch)
 {
 	return
@@ -95,20 +159,53 @@ static void
 lex_white(fz_context *ctx, fz_stream *f)
 {
 	int c;
-	do {
+	while (1)
+	{
+		unsigned char *p = f->rp;
+		unsigned char *e = lex_buffer_end(f);
+		while (p < e && (lex_class[*p] & LEX_WHITE))
+			p++;
+		f->rp = p;
+		if (p < e)
+			return;
 		c = lex_byte(ctx, f);
-	} while ((c <= 32) && (iswhite(c)));
-	if (c != EOF)
-		fz_unread_byte(ctx, f);
+		if (c == EOF)
+			return;
+		if (!iswhite(c))
+		{
+			fz_unread_byte(ctx, f);
+			return;
+		}
+	}
 }
 
 static void
 lex_comment(fz_context *ctx, fz_stream *f)
 {
 	int c;
-	do {
+	while (1)
+	{
+		unsigned char *p = f->rp;
+		unsigned char *e = lex_buffer_end(f);
+		while (e - p >= 8)
+		{
+			uint64_t v = lex_load8(p);
+			if (lex_has_byte(v, '\012') || lex_has_byte(v, '\015'))
+				break;
+			p += 8;
+		}
+		while (p < e && *p != '\012' && *p != '\015')
+			p++;
+		if (p < e)
+		{
+			f->rp = p + 1;
+			return;
+		}
+		f->rp = p;
 		c = lex_byte(ctx, f);
-	} while ((c != '\012') && (c != '\015') && (c != EOF));
+		if ((c == '\012') || (c == '\015') || (c == EOF))
+			return;
+	}
 }
 
 /* Fast(ish) but inaccurate strtof, with Adobe overflow handling. */
@@ -195,6 +292,51 @@ lex_number(fz_context *ctx, fz_stream *f, pdf_lexbuf *buf, int c)
 
 	*s++ = c;
 
+	/* Fast path: a well formed number whose characters and terminator
+	 * are all in the buffer is scanned in place, and integers are
+	 * converted as they are copied. Anything else (repeated signs or
+	 * points, numbers straddling a buffer refill) takes the slow path. */
+	{
+		unsigned char *p = f->rp;
+		unsigned char *pe = lex_buffer_end(f);
+		int i = (c >= '0' && c <= '9') ? c - '0' : 0;
+		if (pe - p > e - s)
+			pe = p + (e - s);
+		while (p < pe && (lex_class[*p] & LEX_DIGIT))
+		{
+			/* We deliberately ignore overflow here, as fast_atoi does. */
+			i = i * 10 + (*p - '0');
+			*s++ = *p++;
+		}
+		if (!isreal && p < pe && *p == '.')
+		{
+			isreal = s;
+			*s++ = *p++;
+		}
+		if (isreal)
+		{
+			while (p < pe && (lex_class[*p] & LEX_DIGIT))
+				*s++ = *p++;
+		}
+		if (p < pe && (lex_class[*p] & (LEX_WHITE | LEX_DELIM)))
+		{
+			f->rp = p;
+			*s = '\0';
+			if (!isreal)
+			{
+				buf->i = neg ? -i : i;
+				return PDF_TOK_INT;
+			}
+			if (isreal - buf->scratch >= 10)
+				buf->f = acrobat_compatible_atof(buf->scratch);
+			else
+				buf->f = fz_atof(buf->scratch);
+			return PDF_TOK_REAL;
+		}
+		s = buf->scratch + 1;
+		isreal = (c == '.' ? buf->scratch : NULL);
+	}
+
 	c = lex_byte(ctx, f);
 
 	/* skip extra '-' signs at start of number */
@@ -237,6 +379,24 @@ lex_number(fz_context *ctx, fz_stream *f, pdf_lexbuf *buf, int c)
 			*s++ = c;
 			break;
 		}
+
+		/* Copy any following run of digits straight from the buffer. */
+		{
+			unsigned char *p = f->rp;
+			unsigned char *pe = lex_buffer_end(f);
+			if (pe - p > e - s)
+				pe = p + (e - s);
+			while (pe - p >= 8 && lex_all_digits(lex_load8(p)))
+			{
+				memcpy(s, p, 8);
+				s += 8;
+				p += 8;
+			}
+			while (p < pe && (lex_class[*p] & LEX_DIGIT))
+				*s++ = *p++;
+			f->rp = p;
+		}
+
 		c = lex_byte(ctx, f);
 	}
 
@@ -289,6 +449,29 @@ lex_name(fz_context *ctx, fz_stream *f, pdf_lexbuf *lb)
 				s = NULL;
 			}
 		}
+
+		/* Copy (or skip, once truncated) a run of plain name characters
+		 * straight from the buffer. */
+		{
+			unsigned char *p = f->rp;
+			unsigned char *pe = lex_buffer_end(f);
+			if (s)
+			{
+				if (pe - p > e - s)
+					pe = p + (e - s);
+				while (p < pe && (lex_class[*p] & LEX_NAME))
+					*s++ = *p++;
+			}
+			else
+			{
+				while (p < pe && (lex_class[*p] & LEX_NAME))
+					p++;
+			}
+			f->rp = p;
+			if (s == e)
+				continue;
+		}
+
 		c = lex_byte(ctx, f);
 		switch (c)
 		{
@@ -360,6 +543,30 @@ lex_string(fz_context *ctx, fz_stream *f, pdf_lexbuf *lb)
 			s += pdf_lexbuf_grow(ctx, lb);
 			e = lb->scratch + lb->size;
 		}
+
+		/* Copy a run of characters that need no escaping or
+		 * balancing straight from the buffer. */
+		{
+			unsigned char *p = f->rp;
+			unsigned char *pe = lex_buffer_end(f);
+			if (pe - p > e - s)
+				pe = p + (e - s);
+			while (pe - p >= 8)
+			{
+				uint64_t v = lex_load8(p);
+				if (lex_has_byte(v, '(') || lex_has_byte(v, ')') || lex_has_byte(v, '\\'))
+					break;
+				memcpy(s, p, 8);
+				s += 8;
+				p += 8;
+			}
+			while (p < pe && (lex_class[*p] & LEX_STRING))
+				*s++ = *p++;
+			f->rp = p;
+			if (s == e)
+				continue;
+		}
+
 		c = lex_byte(ctx, f);
 		switch (c)
 		{
@@ -109,6 +109,8 @@ typedef struct
 	int len;
 	int cap;
 	struct keyval *items;
+	int hash_cap;
+	int *hash;
 } pdf_obj_dict;
 
 typedef struct
@@ -1693,6 +1695,8 @@ pdf_new_dict(fz_context *ctx, pdf_document *doc, int initialcap)
 
 	obj->len = 0;
 	obj->cap = initialcap > 1 ? initialcap : 10;
+	obj->hash_cap = 0;
+	obj->hash = NULL;
 
 	fz_try(ctx)
 	{
@@ -1799,12 +1803,144 @@ pdf_dict_put_val_null(fz_context *ctx, pdf_obj *obj, int idx)
 	DICT(obj)->items[idx].v = PDF_NULL;
 }
 
+/*
+	Large dictionaries (font and XObject resources with thousands of
+	entries, Dests, ...) get a hash index of their keys the first time
+	a value is looked up in them. The index is an open addressed table
+	with linear probing, holding 1 + the index of each entry in items
+	(0 for an empty slot). Once built it is kept up to date as entries
+	are added and removed, and thrown away when the dict is sorted.
+	Failing to allocate it is not an error; lookups then fall back to
+	searching items.
+*/
+#define PDF_DICT_HASH_MIN 64
+
+static const char *
+pdf_dict_key_name(pdf_obj *key)
+{
+	if (key < PDF_LIMIT)
+		return PDF_NAME_LIST[(intptr_t)key];
+	if (key->kind == PDF_NAME)
+		return NAME(key)->n;
+	return "";
+}
+
+static unsigned int
+pdf_dict_hash_name(const char *s)
+{
+	unsigned int h = 2166136261u;
+	while (*s)
+	{
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void
+pdf_dict_drop_hash(fz_context *ctx, pdf_obj *obj)
+{
+	fz_free(ctx, DICT(obj)->hash);
+	DICT(obj)->hash = NULL;
+	DICT(obj)->hash_cap = 0;
+}
+
+static void
+pdf_dict_hash_insert(pdf_obj *obj, int i)
+{
+	int mask = DICT(obj)->hash_cap - 1;
+	int h = pdf_dict_hash_name(pdf_dict_key_name(DICT(obj)->items[i].k)) & mask;
+	while (DICT(obj)->hash[h])
+		h = (h + 1) & mask;
+	DICT(obj)->hash[h] = i + 1;
+}
+
+/* Returns the slot holding entry i. */
+static int
+pdf_dict_hash_slot(pdf_obj *obj, int i)
+{
+	int mask = DICT(obj)->hash_cap - 1;
+	int h = pdf_dict_hash_name(pdf_dict_key_name(DICT(obj)->items[i].k)) & mask;
+	while (DICT(obj)->hash[h] != i + 1)
+		h = (h + 1) & mask;
+	return h;
+}
+
+/* Remove entry i from the index, moving later entries of the probe
+ * sequence back so that no lookup stops short at the emptied slot. */
+static void
+pdf_dict_hash_remove(pdf_obj *obj, int i)
+{
+	int *hash = DICT(obj)->hash;
+	int mask = DICT(obj)->hash_cap - 1;
+	int hole = pdf_dict_hash_slot(obj, i);
+	int h = hole;
+
+	for (;;)
+	{
+		int home;
+		hash[hole] = 0;
+		do
+		{
+			h = (h + 1) & mask;
+			if (!hash[h])
+				return;
+			home = pdf_dict_hash_name(pdf_dict_key_name(DICT(obj)->items[hash[h] - 1].k)) & mask;
+		}
+		while (((h - home) & mask) < ((h - hole) & mask));
+		hash[hole] = hash[h];
+		hole = h;
+	}
+}
+
+/* (Re)build the index with room for the dict to grow to its capacity. */
+static void
+pdf_dict_build_hash(fz_context *ctx, pdf_obj *obj)
+{
+	int cap = 16;
+	int i;
+
+	while (cap < DICT(obj)->cap * 2)
+		cap <<= 1;
+	fz_free(ctx, DICT(obj)->hash);
+	DICT(obj)->hash = fz_calloc_no_throw(ctx, cap, sizeof(int));
+	DICT(obj)->hash_cap = DICT(obj)->hash ? cap : 0;
+	if (!DICT(obj)->hash)
+		return;
+	for (i = 0; i < DICT(obj)->len; i++)
+		pdf_dict_hash_insert(obj, i);
+}
+
+static int
+pdf_dict_hash_find(pdf_obj *obj, const char *key)
+{
+	int mask = DICT(obj)->hash_cap - 1;
+	int h = pdf_dict_hash_name(key) & mask;
+	int i;
+	while ((i = DICT(obj)->hash[h]) != 0)
+	{
+		if (!strcmp(pdf_dict_key_name(DICT(obj)->items[i - 1].k), key))
+			return i - 1;
+		h = (h + 1) & mask;
+	}
+	return -1;
+}
+
 /* Returns 0 <= i < len for key found. Returns -1-len < i <= -1 for key
  * not found, but with insertion point -1-i. */
 static int
 pdf_dict_finds(fz_context *ctx, pdf_obj *obj, const char *key)
 {
 	int len = DICT(obj)->len;
+	if (DICT(obj)->hash)
+	{
+		int i = pdf_dict_hash_find(obj, key);
+		if (i >= 0)
+			return i;
+		/* A sorted dict still needs the insertion point. */
+		if (!(obj->flags & PDF_FLAGS_SORTED))
+			return -1 - len;
+	}
 	if ((obj->flags & PDF_FLAGS_SORTED) && len > 0)
 	{
 		int l = 0;
@@ -1844,13 +1980,17 @@ static int
 pdf_dict_find(fz_context *ctx, pdf_obj *obj, pdf_obj *key)
 {
 	int len = DICT(obj)->len;
+	if (DICT(obj)->hash)
+		return pdf_dict_finds(ctx, obj, PDF_NAME_LIST[(intptr_t)key]);
 	if ((obj->flags & PDF_FLAGS_SORTED) && len > 0)
 	{
 		int l = 0;
 		int r = len - 1;
 		pdf_obj *k = DICT(obj)->items[r].k;
 
-		if (k == key || (k >= PDF_LIMIT && strcmp(NAME(k)->n, PDF_NAME_LIST[(intptr_t)key]) < 0))
+		if (k == key)
+			return r;
+		if (k >= PDF_LIMIT && strcmp(NAME(k)->n, PDF_NAME_LIST[(intptr_t)key]) < 0)
 		{
 			return -1 - (r+1);
 		}
@@ -1904,6 +2044,9 @@ pdf_dict_gets(fz_context *ctx, pdf_obj *obj, const char *key)
 	if (!key)
 		return NULL;
 
+	if (!DICT(obj)->hash && DICT(obj)->len >= PDF_DICT_HASH_MIN)
+		pdf_dict_build_hash(ctx, obj);
+
 	i = pdf_dict_finds(ctx, obj, key);
 	if (i >= 0)
 		return DICT(obj)->items[i].v;
@@ -1971,6 +2114,9 @@ pdf_dict_get(fz_context *ctx, pdf_obj *obj, pdf_obj *key)
 	if (!OBJ_IS_NAME(key))
 		return NULL;
 
+	if (!DICT(obj)->hash && DICT(obj)->len >= PDF_DICT_HASH_MIN)
+		pdf_dict_build_hash(ctx, obj);
+
 	if (key < PDF_LIMIT)
 		i = pdf_dict_find(ctx, obj, key);
 	else
@@ -2043,13 +2189,30 @@ pdf_dict_get_put(fz_context *ctx, pdf_obj *obj, pdf_obj *key, pdf_obj *val, pdf_
 
 		i = -1-i;
 		if ((obj->flags & PDF_FLAGS_SORTED) && DICT(obj)->len > 0)
+		{
 			memmove(&DICT(obj)->items[i + 1],
 					&DICT(obj)->items[i],
 					(DICT(obj)->len - i) * sizeof(struct keyval));
+			if (DICT(obj)->hash && i < DICT(obj)->len)
+			{
+				int h;
+				for (h = 0; h < DICT(obj)->hash_cap; h++)
+					if (DICT(obj)->hash[h] > i)
+						DICT(obj)->hash[h]++;
+			}
+		}
 
 		DICT(obj)->items[i].k = pdf_keep_obj(ctx, key);
 		DICT(obj)->items[i].v = pdf_keep_obj(ctx, val);
 		DICT(obj)->len ++;
+
+		if (DICT(obj)->hash)
+		{
+			if (DICT(obj)->len * 2 > DICT(obj)->hash_cap)
+				pdf_dict_build_hash(ctx, obj);
+			else
+				pdf_dict_hash_insert(obj, i);
+		}
 	}
 }
 
@@ -2287,10 +2450,17 @@ pdf_dict_dels(fz_context *ctx, pdf_obj *obj, const char *key)
 	i = pdf_dict_finds(ctx, obj, key);
 	if (i >= 0)
 	{
+		int last = DICT(obj)->len-1;
+		if (DICT(obj)->hash)
+		{
+			pdf_dict_hash_remove(obj, i);
+			if (i != last)
+				DICT(obj)->hash[pdf_dict_hash_slot(obj, last)] = i + 1;
+		}
 		pdf_drop_obj(ctx, DICT(obj)->items[i].k);
 		pdf_drop_obj(ctx, DICT(obj)->items[i].v);
 		obj->flags &= ~PDF_FLAGS_SORTED;
-		DICT(obj)->items[i] = DICT(obj)->items[DICT(obj)->len-1];
+		DICT(obj)->items[i] = DICT(obj)->items[last];
 		DICT(obj)->len --;
 	}
 }
@@ -2317,6 +2487,7 @@ pdf_sort_dict(fz_context *ctx, pdf_obj *obj)
 	{
 		qsort(DICT(obj)->items, DICT(obj)->len, sizeof(struct keyval), keyvalcmp);
 		obj->flags |= PDF_FLAGS_SORTED;
+		pdf_dict_drop_hash(ctx, obj);
 	}
 }
 
@@ -2601,6 +2772,7 @@ pdf_drop_dict(fz_context *ctx, pdf_obj *obj)
 		pdf_drop_obj(ctx, DICT(obj)->items[i].v);
 	}
 
+	fz_free(ctx, DICT(obj)->hash);
 	fz_free(ctx, DICT(obj)->items);
 	fz_free(ctx, obj);
 }
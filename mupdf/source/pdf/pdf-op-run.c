@@ -35,6 +35,7 @@
 typedef struct pdf_run_processor pdf_run_processor;
 
 static void pdf_run_xobject(fz_context *ctx, pdf_run_processor *proc, pdf_obj *xobj, pdf_obj *page_resources, fz_matrix transform, int is_smask);
+static int pdf_softmask_id(fz_context *ctx, pdf_run_processor *pr, pdf_obj *softmask, pdf_obj *page_resources);
 
 enum
 {
@@ -130,6 +131,7 @@ begin_softmask(fz_context *ctx, pdf_run_processor *pr, softmask_save *save)
 	fz_matrix mask_matrix;
 	fz_colorspace *mask_colorspace;
 	int saved_blendmode;
+	int id;
 
 	save->softmask = softmask;
 	if (softmask == NULL)
@@ -143,13 +145,8 @@ begin_softmask(fz_context *ctx, pdf_run_processor *pr, softmask_save *save)
 
 	pdf_tos_save(ctx, &pr->tos, tos_save);
 
-	if (gstate->luminosity)
-		mask_bbox = fz_infinite_rect;
-	else
-	{
-		mask_bbox = fz_transform_rect(mask_bbox, mask_matrix);
-		mask_bbox = fz_transform_rect(mask_bbox, gstate->softmask_ctm);
-	}
+	mask_bbox = fz_transform_rect(mask_bbox, mask_matrix);
+	mask_bbox = fz_transform_rect(mask_bbox, gstate->softmask_ctm);
 	gstate->softmask = NULL;
 	gstate->softmask_resources = NULL;
 	gstate->ctm = gstate->softmask_ctm;
@@ -162,9 +159,21 @@ begin_softmask(fz_context *ctx, pdf_run_processor *pr, softmask_save *save)
 
 	fz_try(ctx)
 	{
-		fz_begin_mask(ctx, pr->dev, mask_bbox, gstate->luminosity, mask_colorspace, gstate->softmask_bc, gstate->fill.color_params);
+		/* Outside its bbox, a luminosity mask takes the luminosity
+		 * of the backdrop. Unless that is black (as it usually is),
+		 * the mask covers everything. */
+		if (gstate->luminosity)
+		{
+			float gray;
+			fz_convert_color(ctx, mask_colorspace, gstate->softmask_bc, fz_device_gray(ctx), &gray, NULL, gstate->fill.color_params);
+			if (gray * 255 >= 1)
+				mask_bbox = fz_infinite_rect;
+		}
+
 		gstate->blendmode = 0;
-		pdf_run_xobject(ctx, pr, softmask, save->page_resources, fz_identity, 1);
+		id = pdf_softmask_id(ctx, pr, softmask, save->page_resources);
+		if (!fz_begin_mask_id(ctx, pr->dev, mask_bbox, gstate->luminosity, mask_colorspace, gstate->softmask_bc, gstate->fill.color_params, gstate->ctm, id))
+			pdf_run_xobject(ctx, pr, softmask, save->page_resources, fz_identity, 1);
 		gstate = pr->gstate + pr->gtop;
 		gstate->blendmode = saved_blendmode;
 		fz_end_mask(ctx, pr->dev);
@@ -372,6 +381,486 @@ pdf_grestore(fz_context *ctx, pdf_run_processor *pr)
 	}
 }
 
+/*
+ * Cache of interpreted content streams.
+ *
+ * Form XObjects and pattern cells are often run many times with the
+ * same inherited graphics state (a logo on every page, a pattern cell
+ * repeated over an area). Their contents are recorded once into a
+ * display list in their own coordinate space, which is kept in the
+ * store and replayed with the current transform on later runs.
+ *
+ * The key holds the contents stream and the parts of the graphics
+ * state the contents can inherit, as well as the page resources that
+ * forms and soft masks without resources of their own run with. States we cannot capture (inherited
+ * patterns and shadings, soft masks, optional content, edited
+ * documents) are not cached at all.
+ *
+ * The same keys give soft masks their ids (see fz_begin_mask_id), so
+ * that the draw device can cache the rendered masks.
+ */
+
+typedef struct
+{
+	int refs;
+	pdf_obj *contents;
+	/* Digest of the inherited state. The objects it refers to by
+	 * pointer are kept, so their addresses cannot be reused. */
+	unsigned char digest[16];
+	fz_default_colorspaces *default_cs;
+	fz_colorspace *fill_cs;
+	fz_colorspace *stroke_cs;
+	pdf_font_desc *font;
+	/* Page resources used by contents without any of their own. */
+	pdf_obj *resources;
+} pdf_contents_key;
+
+typedef struct
+{
+	fz_storable storable;
+	fz_display_list *list;
+} pdf_contents_record;
+
+typedef struct
+{
+	fz_storable storable;
+	int id;
+} pdf_mask_id_record;
+
+typedef struct
+{
+	pdf_contents_key *key;
+	fz_device *dev;
+	fz_display_list *list;
+	int gtop;
+	int gparent;
+	fz_matrix ctm;
+	fz_matrix gparent_ctm;
+	int errors;
+} pdf_contents_recording;
+
+static void
+pdf_digest_material(fz_context *ctx, fz_md5 *md5, const pdf_material *mat)
+{
+	int n = mat->colorspace ? fz_colorspace_n(ctx, mat->colorspace) : 0;
+
+	fz_md5_update(md5, (const unsigned char *)&mat->kind, sizeof(mat->kind));
+	fz_md5_update(md5, (const unsigned char *)&mat->colorspace, sizeof(mat->colorspace));
+	fz_md5_update(md5, (const unsigned char *)&mat->color_params, sizeof(mat->color_params));
+	fz_md5_update(md5, (const unsigned char *)&mat->alpha, sizeof(mat->alpha));
+	fz_md5_update(md5, (const unsigned char *)mat->v, n * sizeof(float));
+}
+
+static void
+pdf_digest_gstate(fz_context *ctx, pdf_run_processor *pr, const pdf_gstate *gs, unsigned char digest[16])
+{
+	const fz_stroke_state *st = gs->stroke_state;
+	const pdf_text_state *text = &gs->text;
+	fz_colorspace *cs[4];
+	fz_md5 md5;
+
+	/* Each run gets its own default colorspaces structure, so digest
+	 * the colorspaces in it rather than its address. */
+	cs[0] = fz_default_gray(ctx, pr->default_cs);
+	cs[1] = fz_default_rgb(ctx, pr->default_cs);
+	cs[2] = fz_default_cmyk(ctx, pr->default_cs);
+	cs[3] = fz_default_output_intent(ctx, pr->default_cs);
+
+	fz_md5_init(&md5);
+	fz_md5_update(&md5, (const unsigned char *)cs, sizeof(cs));
+	pdf_digest_material(ctx, &md5, &gs->fill);
+	pdf_digest_material(ctx, &md5, &gs->stroke);
+	fz_md5_update(&md5, (const unsigned char *)&gs->blendmode, sizeof(gs->blendmode));
+
+	fz_md5_update(&md5, (const unsigned char *)&st->start_cap, sizeof(st->start_cap));
+	fz_md5_update(&md5, (const unsigned char *)&st->dash_cap, sizeof(st->dash_cap));
+	fz_md5_update(&md5, (const unsigned char *)&st->end_cap, sizeof(st->end_cap));
+	fz_md5_update(&md5, (const unsigned char *)&st->linejoin, sizeof(st->linejoin));
+	fz_md5_update(&md5, (const unsigned char *)&st->linewidth, sizeof(st->linewidth));
+	fz_md5_update(&md5, (const unsigned char *)&st->miterlimit, sizeof(st->miterlimit));
+	fz_md5_update(&md5, (const unsigned char *)&st->dash_phase, sizeof(st->dash_phase));
+	fz_md5_update(&md5, (const unsigned char *)&st->dash_len, sizeof(st->dash_len));
+	fz_md5_update(&md5, (const unsigned char *)st->dash_list, st->dash_len * sizeof(float));
+
+	fz_md5_update(&md5, (const unsigned char *)&text->char_space, sizeof(text->char_space));
+	fz_md5_update(&md5, (const unsigned char *)&text->word_space, sizeof(text->word_space));
+	fz_md5_update(&md5, (const unsigned char *)&text->scale, sizeof(text->scale));
+	fz_md5_update(&md5, (const unsigned char *)&text->leading, sizeof(text->leading));
+	fz_md5_update(&md5, (const unsigned char *)&text->font, sizeof(text->font));
+	fz_md5_update(&md5, (const unsigned char *)&text->size, sizeof(text->size));
+	fz_md5_update(&md5, (const unsigned char *)&text->render, sizeof(text->render));
+	fz_md5_update(&md5, (const unsigned char *)&text->rise, sizeof(text->rise));
+	fz_md5_final(&md5, digest);
+}
+
+static int
+pdf_make_hash_contents_key(fz_context *ctx, fz_store_hash *hash, void *key_)
+{
+	pdf_contents_key *key = key_;
+
+	/* The store tells items apart by their hash alone, so it must
+	 * carry the state digest as well as the object. */
+	hash->u.pir.ptr = pdf_get_indirect_document(ctx, key->contents);
+	hash->u.pir.i = pdf_to_num(ctx, key->contents);
+	memcpy(&hash->u.pir.r, key->digest, sizeof(hash->u.pir.r));
+	return 1;
+}
+
+static void *
+pdf_keep_contents_key(fz_context *ctx, void *key_)
+{
+	pdf_contents_key *key = key_;
+	return fz_keep_imp(ctx, key, &key->refs);
+}
+
+static void
+pdf_drop_contents_key(fz_context *ctx, void *key_)
+{
+	pdf_contents_key *key = key_;
+	if (fz_drop_imp(ctx, key, &key->refs))
+	{
+		pdf_drop_obj(ctx, key->contents);
+		fz_drop_default_colorspaces(ctx, key->default_cs);
+		fz_drop_colorspace(ctx, key->fill_cs);
+		fz_drop_colorspace(ctx, key->stroke_cs);
+		pdf_drop_font(ctx, key->font);
+		pdf_drop_obj(ctx, key->resources);
+		fz_free(ctx, key);
+	}
+}
+
+static int
+pdf_cmp_contents_key(fz_context *ctx, void *k0_, void *k1_)
+{
+	pdf_contents_key *k0 = k0_;
+	pdf_contents_key *k1 = k1_;
+
+	if (pdf_get_indirect_document(ctx, k0->contents) != pdf_get_indirect_document(ctx, k1->contents))
+		return 1;
+	if (pdf_objcmp(ctx, k0->contents, k1->contents))
+		return 1;
+	return memcmp(k0->digest, k1->digest, sizeof(k0->digest));
+}
+
+static void
+pdf_format_contents_key(fz_context *ctx, char *s, size_t n, void *key_)
+{
+	pdf_contents_key *key = key_;
+	fz_snprintf(s, n, "(contents %d 0 R)", pdf_to_num(ctx, key->contents));
+}
+
+static const fz_store_type pdf_contents_store_type =
+{
+	"pdf_contents_list",
+	pdf_make_hash_contents_key,
+	pdf_keep_contents_key,
+	pdf_drop_contents_key,
+	pdf_cmp_contents_key,
+	pdf_format_contents_key,
+	NULL
+};
+
+static void
+pdf_drop_contents_record_imp(fz_context *ctx, fz_storable *storable)
+{
+	pdf_contents_record *rec = (pdf_contents_record *)storable;
+	fz_drop_display_list(ctx, rec->list);
+	fz_free(ctx, rec);
+}
+
+static int
+pdf_filter_contents_lists(fz_context *ctx, void *doc, void *key_)
+{
+	pdf_contents_key *key = key_;
+	return pdf_get_indirect_document(ctx, key->contents) == doc;
+}
+
+static const fz_store_type pdf_mask_id_store_type =
+{
+	"pdf_mask_id",
+	pdf_make_hash_contents_key,
+	pdf_keep_contents_key,
+	pdf_drop_contents_key,
+	pdf_cmp_contents_key,
+	pdf_format_contents_key,
+	NULL
+};
+
+static void
+pdf_drop_mask_id_record_imp(fz_context *ctx, fz_storable *storable)
+{
+	fz_free(ctx, storable);
+}
+
+void
+pdf_drop_contents_lists(fz_context *ctx, pdf_document *doc)
+{
+	fz_filter_store(ctx, pdf_filter_contents_lists, doc, &pdf_contents_store_type);
+	fz_filter_store(ctx, pdf_filter_contents_lists, doc, &pdf_mask_id_store_type);
+}
+
+static int
+pdf_can_cache_state(fz_context *ctx, pdf_run_processor *pr, pdf_obj *contents)
+{
+	pdf_gstate *gstate = pr->gstate + pr->gtop;
+	pdf_document *doc;
+
+	if (!pdf_is_indirect(ctx, contents))
+		return 0;
+
+	/* Type 3 glyphs are recorded with device flags tracking which
+	 * parts of the state they use; leave those alone. */
+	if (pr->dev->flags)
+		return 0;
+
+	/* Patterns, shadings and soft masks inherited from outside are
+	 * positioned in device space; that does not survive replaying
+	 * the list under a different transform. */
+	if (gstate->fill.kind == PDF_MAT_PATTERN || gstate->fill.kind == PDF_MAT_SHADE ||
+		gstate->stroke.kind == PDF_MAT_PATTERN || gstate->stroke.kind == PDF_MAT_SHADE ||
+		gstate->softmask)
+		return 0;
+
+	/* Optional content can be toggled, and edited objects change under
+	 * the same object number. */
+	doc = pdf_get_indirect_document(ctx, contents);
+	if (!doc || doc->num_incremental_sections > 0 || doc->local_xref_nesting > 0 || pdf_count_layers(ctx, doc) > 0)
+		return 0;
+
+	return 1;
+}
+
+static int
+pdf_can_cache_contents(fz_context *ctx, pdf_run_processor *pr, pdf_obj *contents)
+{
+	return fz_content_caching(ctx) && pdf_can_cache_state(ctx, pr, contents);
+}
+
+static pdf_contents_key *
+pdf_new_contents_key(fz_context *ctx, pdf_run_processor *pr, pdf_obj *contents, pdf_obj *page_resources)
+{
+	pdf_gstate *gstate = pr->gstate + pr->gtop;
+	pdf_contents_key *key;
+
+	if (pdf_dict_get(ctx, contents, PDF_NAME(Resources)))
+		page_resources = NULL;
+
+	key = fz_malloc_struct(ctx, pdf_contents_key);
+	key->refs = 1;
+	key->contents = pdf_keep_obj(ctx, contents);
+	pdf_digest_gstate(ctx, pr, gstate, key->digest);
+	key->default_cs = fz_keep_default_colorspaces(ctx, pr->default_cs);
+	key->fill_cs = fz_keep_colorspace(ctx, gstate->fill.colorspace);
+	key->stroke_cs = fz_keep_colorspace(ctx, gstate->stroke.colorspace);
+	key->font = pdf_keep_font(ctx, gstate->text.font);
+	if (page_resources)
+	{
+		fz_md5 md5;
+
+		key->resources = pdf_keep_obj(ctx, page_resources);
+		fz_md5_init(&md5);
+		fz_md5_update(&md5, key->digest, sizeof(key->digest));
+		fz_md5_update(&md5, (const unsigned char *)&key->resources, sizeof(key->resources));
+		fz_md5_final(&md5, key->digest);
+	}
+	return key;
+}
+
+/*
+	Replay the cached list for contents, or start recording the
+	contents into a new list. Returns 1 if the contents were replayed
+	and must not be run; otherwise the contents must be run, followed
+	by pdf_end_cached_contents (or pdf_abort_cached_contents if that
+	throws).
+
+	The contents are recorded with an identity transform. The parent
+	gstate (which patterns set inside the contents are relative to)
+	must have the same transform as the current one, unless the
+	contents use no patterns.
+*/
+static int
+pdf_begin_cached_contents(fz_context *ctx, pdf_run_processor *pr, pdf_obj *contents, pdf_obj *page_resources, pdf_contents_recording *rec)
+{
+	pdf_gstate *gstate = pr->gstate + pr->gtop;
+	pdf_contents_record *found;
+	pdf_contents_key *key;
+
+	memset(rec, 0, sizeof(*rec));
+
+	if (!pdf_can_cache_contents(ctx, pr, contents))
+		return 0;
+
+	key = pdf_new_contents_key(ctx, pr, contents, page_resources);
+
+	found = fz_find_item(ctx, pdf_drop_contents_record_imp, key, &pdf_contents_store_type);
+	if (found)
+	{
+		pdf_drop_contents_key(ctx, key);
+		fz_try(ctx)
+			fz_run_display_list(ctx, found->list, pr->dev, gstate->ctm, fz_infinite_rect, NULL);
+		fz_always(ctx)
+			fz_drop_storable(ctx, &found->storable);
+		fz_catch(ctx)
+			fz_rethrow(ctx);
+		return 1;
+	}
+
+	fz_try(ctx)
+	{
+		rec->list = fz_new_display_list(ctx, fz_infinite_rect);
+		rec->dev = fz_new_list_device(ctx, rec->list);
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_display_list(ctx, rec->list);
+		pdf_drop_contents_key(ctx, key);
+		rec->list = NULL;
+		return 0;
+	}
+
+	rec->key = key;
+	rec->errors = pr->cookie ? pr->cookie->errors : 0;
+	rec->gtop = pr->gtop;
+	rec->gparent = pr->gparent;
+	rec->ctm = gstate->ctm;
+	rec->gparent_ctm = pr->gstate[pr->gparent].ctm;
+	gstate->ctm = fz_identity;
+	pr->gstate[pr->gparent].ctm = fz_identity;
+
+	/* swap in the recording device */
+	{
+		fz_device *dev = pr->dev;
+		pr->dev = rec->dev;
+		rec->dev = dev;
+	}
+
+	return 0;
+}
+
+static void
+pdf_restore_cached_contents(fz_context *ctx, pdf_run_processor *pr, pdf_contents_recording *rec)
+{
+	fz_device *list_dev = pr->dev;
+
+	pr->dev = rec->dev;
+	rec->dev = list_dev;
+	pr->gstate[rec->gtop].ctm = rec->ctm;
+	pr->gstate[rec->gparent].ctm = rec->gparent_ctm;
+}
+
+static void
+pdf_abort_cached_contents(fz_context *ctx, pdf_run_processor *pr, pdf_contents_recording *rec)
+{
+	if (!rec->key)
+		return;
+	pdf_restore_cached_contents(ctx, pr, rec);
+	fz_drop_device(ctx, rec->dev);
+	fz_drop_display_list(ctx, rec->list);
+	pdf_drop_contents_key(ctx, rec->key);
+	rec->key = NULL;
+}
+
+static void
+pdf_end_cached_contents(fz_context *ctx, pdf_run_processor *pr, pdf_contents_recording *rec)
+{
+	pdf_contents_record *record = NULL;
+	size_t size;
+
+	if (!rec->key)
+		return;
+
+	pdf_restore_cached_contents(ctx, pr, rec);
+
+	fz_var(record);
+
+	fz_try(ctx)
+	{
+		fz_close_device(ctx, rec->dev);
+
+		/* Don't keep lists that missed parts of the contents. */
+		if (!pr->cookie || (pr->cookie->errors == rec->errors && !pr->cookie->incomplete && !pr->cookie->abort))
+		{
+			record = fz_malloc_struct(ctx, pdf_contents_record);
+			FZ_INIT_STORABLE(record, 1, pdf_drop_contents_record_imp);
+			record->list = fz_keep_display_list(ctx, rec->list);
+			size = sizeof(*record) + fz_display_list_size(ctx, rec->list);
+			/* Interpreting the contents costs roughly in proportion
+			 * to the size of what they produce. */
+			fz_drop_storable(ctx, fz_store_item_with_cost(ctx, rec->key, record, size, 4.0f * size, &pdf_contents_store_type));
+		}
+
+		fz_run_display_list(ctx, rec->list, pr->dev, rec->ctm, fz_infinite_rect, NULL);
+	}
+	fz_always(ctx)
+	{
+		if (record)
+			fz_drop_storable(ctx, &record->storable);
+		fz_drop_device(ctx, rec->dev);
+		fz_drop_display_list(ctx, rec->list);
+		pdf_drop_contents_key(ctx, rec->key);
+		rec->key = NULL;
+	}
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+}
+
+/*
+	Return the id for drawing softmask with the current graphics
+	state, or 0 if it cannot be cached. The same mask run with the
+	same inherited state gets the same id for as long as the store
+	remembers it.
+*/
+static int
+pdf_softmask_id(fz_context *ctx, pdf_run_processor *pr, pdf_obj *softmask, pdf_obj *page_resources)
+{
+	pdf_mask_id_record *record = NULL;
+	pdf_mask_id_record *found;
+	pdf_contents_key *key = NULL;
+	int id = 0;
+
+	if (!fz_mask_caching(ctx) || !pdf_can_cache_state(ctx, pr, softmask))
+		return 0;
+
+	fz_var(record);
+	fz_var(key);
+	fz_var(id);
+
+	fz_try(ctx)
+	{
+		key = pdf_new_contents_key(ctx, pr, softmask, page_resources);
+
+		found = fz_find_item(ctx, pdf_drop_mask_id_record_imp, key, &pdf_mask_id_store_type);
+		if (!found)
+		{
+			record = fz_malloc_struct(ctx, pdf_mask_id_record);
+			FZ_INIT_STORABLE(record, 1, pdf_drop_mask_id_record_imp);
+			record->id = fz_new_store_id(ctx);
+			found = fz_store_item(ctx, key, record, sizeof(*record), &pdf_mask_id_store_type);
+		}
+		if (found)
+		{
+			id = found->id;
+			fz_drop_storable(ctx, &found->storable);
+		}
+		else
+			id = record->id;
+	}
+	fz_always(ctx)
+	{
+		if (record)
+			fz_drop_storable(ctx, &record->storable);
+		if (key)
+			pdf_drop_contents_key(ctx, key);
+	}
+	fz_catch(ctx)
+	{
+		fz_rethrow_if(ctx, FZ_ERROR_ABORT);
+		id = 0;
+	}
+
+	return id;
+}
+
 static pdf_gstate *
 pdf_show_pattern(fz_context *ctx, pdf_run_processor *pr, pdf_pattern *pat, int pat_gstate_num, fz_rect area, int what)
 {
@@ -473,6 +962,11 @@ pdf_show_pattern(fz_context *ctx, pdf_run_processor *pr, pdf_pattern *pat, int p
 	else
 	{
 		int x, y;
+		/* Cells are recorded relative to themselves, while patterns
+		 * used inside them are relative to the pattern space. Only
+		 * cache cells that don't use patterns. */
+		int cache_cells = !pdf_dict_get(ctx, pat->resources, PDF_NAME(Pattern));
+		pdf_contents_recording recording = { NULL };
 
 		/* When calculating the number of tiles required, we adjust by
 		 * a small amount to allow for rounding errors. By choosing
@@ -501,9 +995,20 @@ pdf_show_pattern(fz_context *ctx, pdf_run_processor *pr, pdf_pattern *pat, int p
 				 * it each time round the loop. */
 				gstate = pr->gstate + pr->gtop;
 				gstate->ctm = fz_pre_translate(ptm, x * pat->xstep, y * pat->ystep);
-				pdf_gsave(ctx, pr);
-				pdf_process_contents(ctx, (pdf_processor*)pr, pat->document, pat->resources, pat->contents, NULL);
-				pdf_grestore(ctx, pr);
+				if (cache_cells && pdf_begin_cached_contents(ctx, pr, pat->contents, NULL, &recording))
+					continue;
+				fz_try(ctx)
+				{
+					pdf_gsave(ctx, pr);
+					pdf_process_contents(ctx, (pdf_processor*)pr, pat->document, pat->resources, pat->contents, NULL);
+					pdf_grestore(ctx, pr);
+					pdf_end_cached_contents(ctx, pr, &recording);
+				}
+				fz_catch(ctx)
+				{
+					pdf_abort_cached_contents(ctx, pr, &recording);
+					fz_rethrow(ctx);
+				}
 			}
 		}
 	}
@@ -1202,6 +1707,7 @@ pdf_run_xobject(fz_context *ctx, pdf_run_processor *proc, pdf_obj *xobj, pdf_obj
 	fz_colorspace *cs = NULL;
 	fz_default_colorspaces *save_default_cs = NULL;
 	fz_default_colorspaces *xobj_default_cs = NULL;
+	pdf_contents_recording recording = { NULL };
 
 	/* Avoid infinite recursion */
 	pdf_cycle_list *cycle_up = proc->cycle;
@@ -1258,57 +1764,70 @@ pdf_run_xobject(fz_context *ctx, pdf_run_processor *proc, pdf_obj *xobj, pdf_obj
 			gstate->fill.alpha = 1;
 		}
 
-		pdf_gsave(ctx, pr); /* Save here so the clippath doesn't persist */
-
-		/* clip to the bounds */
-		fz_moveto(ctx, pr->path, xobj_bbox.x0, xobj_bbox.y0);
-		fz_lineto(ctx, pr->path, xobj_bbox.x1, xobj_bbox.y0);
-		fz_lineto(ctx, pr->path, xobj_bbox.x1, xobj_bbox.y1);
-		fz_lineto(ctx, pr->path, xobj_bbox.x0, xobj_bbox.y1);
-		fz_closepath(ctx, pr->path);
-		pr->clip = 1;
-		pdf_show_path(ctx, pr, 0, 0, 0, 0);
-
-		/* run contents */
+		if (!pdf_begin_cached_contents(ctx, pr, xobj, page_resources, &recording))
+		{
+			fz_try(ctx)
+			{
+				pdf_gsave(ctx, pr); /* Save here so the clippath doesn't persist */
+
+				/* clip to the bounds */
+				fz_moveto(ctx, pr->path, xobj_bbox.x0, xobj_bbox.y0);
+				fz_lineto(ctx, pr->path, xobj_bbox.x1, xobj_bbox.y0);
+				fz_lineto(ctx, pr->path, xobj_bbox.x1, xobj_bbox.y1);
+				fz_lineto(ctx, pr->path, xobj_bbox.x0, xobj_bbox.y1);
+				fz_closepath(ctx, pr->path);
+				pr->clip = 1;
+				pdf_show_path(ctx, pr, 0, 0, 0, 0);
+
+				/* run contents */
+
+				resources = pdf_xobject_resources(ctx, xobj);
+				if (!resources)
+					resources = page_resources;
+
+				fz_try(ctx)
+					xobj_default_cs = pdf_update_default_colorspaces(ctx, pr->default_cs, resources);
+				fz_catch(ctx)
+				{
+					if (fz_caught(ctx) != FZ_ERROR_TRYLATER)
+						fz_rethrow(ctx);
+					if (pr->cookie)
+						pr->cookie->incomplete = 1;
+				}
+				if (xobj_default_cs != save_default_cs)
+				{
+					fz_set_default_colorspaces(ctx, pr->dev, xobj_default_cs);
+					pr->default_cs = xobj_default_cs;
+				}
 
-		resources = pdf_xobject_resources(ctx, xobj);
-		if (!resources)
-			resources = page_resources;
+				doc = pdf_get_bound_document(ctx, xobj);
 
-		fz_try(ctx)
-			xobj_default_cs = pdf_update_default_colorspaces(ctx, pr->default_cs, resources);
-		fz_catch(ctx)
-		{
-			if (fz_caught(ctx) != FZ_ERROR_TRYLATER)
-				fz_rethrow(ctx);
-			if (pr->cookie)
-				pr->cookie->incomplete = 1;
-		}
-		if (xobj_default_cs != save_default_cs)
-		{
-			fz_set_default_colorspaces(ctx, pr->dev, xobj_default_cs);
-			pr->default_cs = xobj_default_cs;
-		}
+				oldbot = pr->gbot;
+				pr->gbot = pr->gtop;
 
-		doc = pdf_get_bound_document(ctx, xobj);
+				pdf_process_contents(ctx, (pdf_processor*)pr, doc, resources, xobj, pr->cookie);
 
-		oldbot = pr->gbot;
-		pr->gbot = pr->gtop;
+				/* Undo any gstate mismatches due to the pdf_process_contents call */
+				if (oldbot != -1)
+				{
+					while (pr->gtop > pr->gbot)
+					{
+						pdf_grestore(ctx, pr);
+					}
+					pr->gbot = oldbot;
+				}
 
-		pdf_process_contents(ctx, (pdf_processor*)pr, doc, resources, xobj, pr->cookie);
+				pdf_grestore(ctx, pr); /* Remove the state we pushed for the clippath */
 
-		/* Undo any gstate mismatches due to the pdf_process_contents call */
-		if (oldbot != -1)
-		{
-			while (pr->gtop > pr->gbot)
+				pdf_end_cached_contents(ctx, pr, &recording);
+			}
+			fz_catch(ctx)
 			{
-				pdf_grestore(ctx, pr);
+				pdf_abort_cached_contents(ctx, pr, &recording);
+				fz_rethrow(ctx);
 			}
-			pr->gbot = oldbot;
 		}
 
-		pdf_grestore(ctx, pr); /* Remove the state we pushed for the clippath */
-
 		/* wrap up transparency stacks */
 		if (transparency)
 		{
@@ -1958,7 +2477,15 @@ static void pdf_run_Do_image(fz_context *ctx, pdf_processor *proc, const char *n
 
 static void pdf_run_Do_form(fz_context *ctx, pdf_processor *proc, const char *name, pdf_obj *xobj, pdf_obj *page_resources)
 {
-	pdf_run_xobject(ctx, (pdf_run_processor*)proc, xobj, page_resources, fz_identity, 0);
+	pdf_run_processor *pr = (pdf_run_processor *)proc;
+
+	fz_profile_begin_xobject(ctx, pr->dev, pdf_to_num(ctx, xobj), name);
+	fz_try(ctx)
+		pdf_run_xobject(ctx, pr, xobj, page_resources, fz_identity, 0);
+	fz_always(ctx)
+		fz_profile_end_xobject(ctx, pr->dev);
+	fz_catch(ctx)
+		fz_rethrow(ctx);
 }
 
 /* marked content */
@@ -49,10 +49,48 @@ static void add_root(fz_context *ctx, pdf_obj *obj, pdf_obj ***roots, int *num_r
 	(*roots)[(*num_roots)++] = pdf_keep_obj(ctx, obj);
 }
 
-int
-pdf_repair_obj(fz_context *ctx, pdf_document *doc, pdf_lexbuf *buf, int64_t *stmofsp, int *stmlenp, pdf_obj **encrypt, pdf_obj **id, pdf_obj **page, int64_t *tmpofs, pdf_obj **root)
+/* Objects nested deeper than this are left to the serial scan, which
+ * runs further down the exception stack than the chunk scans do. */
+#define REPAIR_MAX_NESTING 32
+
+/* The depth to which arrays and dictionaries nest in obj. */
+static int
+repair_nesting(fz_context *ctx, pdf_obj *obj)
+{
+	int i, n, d, depth = 0;
+
+	if (pdf_is_indirect(ctx, obj))
+		return 0;
+	if (pdf_is_dict(ctx, obj))
+	{
+		n = pdf_dict_len(ctx, obj);
+		for (i = 0; i < n; i++)
+		{
+			d = repair_nesting(ctx, pdf_dict_get_val(ctx, obj, i));
+			if (d > depth)
+				depth = d;
+		}
+		return depth + 1;
+	}
+	if (pdf_is_array(ctx, obj))
+	{
+		n = pdf_array_len(ctx, obj);
+		for (i = 0; i < n; i++)
+		{
+			d = repair_nesting(ctx, pdf_array_get(ctx, obj, i));
+			if (d > depth)
+				depth = d;
+		}
+		return depth + 1;
+	}
+	return 0;
+}
+
+/* A chunk scan (worker) runs without a document and throws instead of
+ * making do with a broken dictionary, leaving it to the serial scan. */
+static int
+repair_obj(fz_context *ctx, pdf_document *doc, fz_stream *file, pdf_lexbuf *buf, int64_t *stmofsp, int *stmlenp, pdf_obj **encrypt, pdf_obj **id, pdf_obj **page, int64_t *tmpofs, pdf_obj **root, int worker)
 {
-	fz_stream *file = doc->file;
 	pdf_token tok;
 	int stm_len;
 
@@ -84,12 +122,18 @@ pdf_repair_obj(fz_context *ctx, pdf_document *doc, pdf_lexbuf *buf, int64_t *stm
 		{
 			fz_rethrow_if(ctx, FZ_ERROR_TRYLATER);
 			/* Don't let a broken object at EOF overwrite a good one */
-			if (file->eof)
+			if (file->eof || worker)
 				fz_rethrow(ctx);
 			/* Silently swallow the error */
 			dict = pdf_new_dict(ctx, NULL, 2);
 		}
 
+		if (worker && repair_nesting(ctx, dict) > REPAIR_MAX_NESTING)
+		{
+			pdf_drop_obj(ctx, dict);
+			fz_throw(ctx, FZ_ERROR_GENERIC, "object nested too deeply");
+		}
+
 		/* We must be careful not to try to resolve any indirections
 		 * here. We have just read dict, so we know it to be a non
 		 * indirected dictionary. Before we look at any values that
@@ -130,7 +174,7 @@ pdf_repair_obj(fz_context *ctx, pdf_document *doc, pdf_lexbuf *buf, int64_t *stm
 		if (!pdf_is_indirect(ctx, obj) && pdf_is_int(ctx, obj))
 			stm_len = pdf_to_int(ctx, obj);
 
-		if (doc->file_reading_linearly && page)
+		if (page && doc->file_reading_linearly)
 		{
 			obj = pdf_dict_get(ctx, dict, PDF_NAME(Type));
 			if (!pdf_is_indirect(ctx, obj) && pdf_name_eq(ctx, obj, PDF_NAME(Page)))
@@ -218,6 +262,12 @@ atobjend:
 	return tok;
 }
 
+int
+pdf_repair_obj(fz_context *ctx, pdf_document *doc, pdf_lexbuf *buf, int64_t *stmofsp, int *stmlenp, pdf_obj **encrypt, pdf_obj **id, pdf_obj **page, int64_t *tmpofs, pdf_obj **root)
+{
+	return repair_obj(ctx, doc, doc->file, buf, stmofsp, stmlenp, encrypt, id, page, tmpofs, root, 0);
+}
+
 static void
 pdf_repair_obj_stm(fz_context *ctx, pdf_document *doc, int stm_num)
 {
@@ -312,6 +362,481 @@ static int is_white(int c)
 	return c == '\x00' || c == '\x09' || c == '\x0a' || c == '\x0c' || c == '\x0d' || c == '\x20';
 }
 
+/*
+	Files of REPAIR_PARALLEL_MIN bytes and more are scanned in chunks of
+	REPAIR_CHUNK_SIZE bytes, a batch of them at a time, on the threads
+	set with fz_tune_parallel.
+
+	Every chunk scan starts after the first 'endobj' in its chunk, with
+	its own clone of the context and its own stream onto the chunk's
+	bytes (plus some of the next chunk's). It runs the loop of the serial
+	scan, recording the scan's state at the top of each iteration, and
+	what it found since the previous one.
+
+	The serial scan then still runs through the file, but whenever it
+	reaches a state that a chunk scan recorded too, it takes on what the
+	chunk scan found from there on, and jumps to where it stopped. The
+	result is the same as that of the serial scan on its own, objects,
+	trailer and warnings alike.
+
+	Chunk scans stop at anything needing the document (trailers and
+	xref streams) or making do with broken data, and at anything that
+	reads beyond their bytes, or more than REPAIR_CHUNK_OVERLAP bytes in
+	one go, leaving it to the serial scan.
+*/
+
+#define REPAIR_PARALLEL_MIN (32 << 20)
+#define REPAIR_CHUNK_SIZE (4 << 20)
+#define REPAIR_CHUNK_OVERLAP (256 << 10)
+#define REPAIR_BATCH_CHUNKS 16
+
+typedef struct
+{
+	int64_t ofs;
+	int num, gen;
+	int64_t numofs, genofs;
+	/* what was found before this point */
+	int listlen;
+	int warnlen;
+	/* whether the serial scan must take the next step itself */
+	int stop;
+} repair_point;
+
+typedef struct
+{
+	fz_context *ctx;
+	unsigned char *data;
+	size_t len;
+	int64_t start, end;
+	int file_end;
+	int64_t limit;
+	int overrun;
+
+	repair_point *points;
+	int len_points, cap_points;
+	struct entry *list;
+	int listlen, listcap;
+	char **warnings;
+	int warnlen, warncap;
+} repair_chunk;
+
+typedef struct
+{
+	int64_t file_size;
+	int64_t start;
+	int count;
+	unsigned char *data;
+	repair_chunk chunk[REPAIR_BATCH_CHUNKS];
+} repair_scan;
+
+/* Hand out the chunk's bytes up to the limit. */
+static int
+next_repair_window(fz_context *ctx, fz_stream *stm, size_t max)
+{
+	repair_chunk *ch = stm->state;
+	int64_t end = ch->start + (int64_t)ch->len;
+
+	if (ch->overrun)
+		return EOF;
+	if (stm->pos >= fz_mini64(end, ch->limit))
+	{
+		if (stm->pos < end || !ch->file_end)
+			ch->overrun = 1;
+		return EOF;
+	}
+	stm->rp = ch->data + (stm->pos - ch->start);
+	stm->wp = ch->data + (fz_mini64(end, ch->limit) - ch->start);
+	stm->pos = fz_mini64(end, ch->limit);
+	return *stm->rp++;
+}
+
+static void
+seek_repair_window(fz_context *ctx, fz_stream *stm, int64_t offset, int whence)
+{
+	repair_chunk *ch = stm->state;
+	int64_t end = ch->start + (int64_t)ch->len;
+
+	if (whence == 1)
+		offset += stm->pos - (stm->wp - stm->rp);
+	else if (whence == 2)
+		offset += end;
+
+	/* Once the scan has left the window, all it sees is its end. */
+	if (ch->overrun || offset < ch->start || offset > end || (whence == 2 && !ch->file_end))
+	{
+		ch->overrun = 1;
+		stm->rp = stm->wp;
+		return;
+	}
+	stm->rp = stm->wp = ch->data + (offset - ch->start);
+	stm->pos = offset;
+	ch->limit = offset + REPAIR_CHUNK_OVERLAP;
+}
+
+/* A stream onto the bytes of the chunk, at their offsets in the file. */
+static fz_stream *
+repair_open_window(fz_context *ctx, repair_chunk *ch)
+{
+	fz_stream *stm = fz_new_stream(ctx, ch, next_repair_window, NULL);
+	stm->seek = seek_repair_window;
+	stm->rp = stm->wp = ch->data;
+	stm->pos = ch->start;
+	ch->limit = ch->start + REPAIR_CHUNK_OVERLAP;
+	return stm;
+}
+
+static void
+repair_chunk_warning(void *user, const char *message)
+{
+	repair_chunk *ch = user;
+	fz_context *ctx = ch->ctx;
+	int i, n = 1;
+
+	/* Record repeated warnings one by one, for the serial scan to
+	 * count them up again. */
+	if (ctx->warn.count > 1)
+	{
+		n = ctx->warn.count - 1;
+		message = ctx->warn.message;
+	}
+	for (i = 0; i < n; i++)
+	{
+		if (ch->warnlen == ch->warncap)
+		{
+			int new_cap = ch->warncap ? ch->warncap * 2 : 16;
+			ch->warnings = fz_realloc_array(ctx, ch->warnings, new_cap, char *);
+			ch->warncap = new_cap;
+		}
+		ch->warnings[ch->warnlen++] = fz_strdup(ctx, message);
+	}
+}
+
+static void
+repair_add_point(fz_context *ctx, repair_chunk *ch, int64_t ofs, int num, int gen, int64_t numofs, int64_t genofs)
+{
+	repair_point *pt;
+
+	fz_flush_warnings(ctx);
+	if (ch->len_points == ch->cap_points)
+	{
+		int new_cap = ch->cap_points ? ch->cap_points * 2 : 1024;
+		ch->points = fz_realloc_array(ctx, ch->points, new_cap, repair_point);
+		ch->cap_points = new_cap;
+	}
+	pt = &ch->points[ch->len_points++];
+	pt->ofs = ofs;
+	pt->num = num;
+	pt->gen = gen;
+	pt->numofs = numofs;
+	pt->genofs = genofs;
+	pt->listlen = ch->listlen;
+	pt->warnlen = ch->warnlen;
+	pt->stop = 0;
+}
+
+/* Leave the step from the last point on to the serial scan. */
+static void
+repair_stop(repair_chunk *ch)
+{
+	if (ch->len_points > 0)
+		ch->points[ch->len_points - 1].stop = 1;
+}
+
+/* The loop of pdf_repair_xref, marking the steps it leaves to the serial scan. */
+static void
+repair_scan_chunk(fz_context *ctx, repair_chunk *ch)
+{
+	fz_stream *file = NULL;
+	pdf_lexbuf_large lexbuf;
+	pdf_lexbuf *buf = &lexbuf.base;
+	pdf_token tok;
+	int num = 0;
+	int gen = 0;
+	int64_t tmpofs, stm_ofs, numofs = 0, genofs = 0;
+	int stm_len;
+	int c;
+
+	fz_var(file);
+
+	pdf_lexbuf_init(ctx, buf, PDF_LEXBUF_LARGE);
+
+	fz_try(ctx)
+	{
+		file = repair_open_window(ctx, ch);
+
+		/* Rather than lex through whatever the chunk starts in the
+		 * middle of, start after the first 'endobj', where the serial
+		 * scan is likely to be too. */
+		if (ch->start > 0)
+		{
+			unsigned char *p = fz_memmem(ch->data, ch->len, "endobj", 6);
+			if (!p)
+				break;
+			fz_seek(ctx, file, ch->start + (p - ch->data), 0);
+		}
+
+		while (1)
+		{
+			tmpofs = fz_tell(ctx, file);
+			if (ch->overrun)
+				break;
+			repair_add_point(ctx, ch, tmpofs, num, gen, numofs, genofs);
+			if (tmpofs >= ch->end)
+				break;
+			ch->limit = tmpofs + REPAIR_CHUNK_OVERLAP;
+
+			fz_try(ctx)
+				tok = pdf_lex_no_string(ctx, file, buf);
+			fz_catch(ctx)
+			{
+				fz_warn(ctx, "skipping ahead to next token");
+				do
+					c = fz_read_byte(ctx, file);
+				while (c != EOF && !is_white(c));
+				if (c == EOF)
+					tok = PDF_TOK_EOF;
+				else
+					continue;
+			}
+
+		have_next_token:
+
+			if (tok == PDF_TOK_INT)
+			{
+				if (buf->i < 0)
+				{
+					num = 0;
+					gen = 0;
+					continue;
+				}
+				numofs = genofs;
+				num = gen;
+				genofs = tmpofs;
+				gen = buf->i;
+			}
+
+			else if (tok == PDF_TOK_OBJ)
+			{
+				pdf_obj *encrypt = NULL, *id = NULL, *root = NULL;
+				int found;
+
+				stm_len = 0;
+				stm_ofs = 0;
+				fz_try(ctx)
+					tok = repair_obj(ctx, NULL, file, buf, &stm_ofs, &stm_len, &encrypt, &id, NULL, &tmpofs, &root, 1);
+				fz_catch(ctx)
+				{
+					repair_stop(ch);
+					continue;
+				}
+				found = encrypt || id || root;
+				pdf_drop_obj(ctx, encrypt);
+				pdf_drop_obj(ctx, id);
+				pdf_drop_obj(ctx, root);
+				/* an xref stream's trailer is left to the serial scan */
+				if (found)
+					repair_stop(ch);
+
+				if (num <= 0 || num > PDF_MAX_OBJECT_NUMBER)
+				{
+					fz_warn(ctx, "ignoring object with invalid object number (%d %d R)", num, gen);
+					goto have_next_token;
+				}
+
+				gen = fz_clampi(gen, 0, 65535);
+
+				if (ch->listlen == ch->listcap)
+				{
+					int new_cap = ch->listcap ? ch->listcap * 2 : 1024;
+					ch->list = fz_realloc_array(ctx, ch->list, new_cap, struct entry);
+					ch->listcap = new_cap;
+				}
+
+				ch->list[ch->listlen].num = num;
+				ch->list[ch->listlen].gen = gen;
+				ch->list[ch->listlen].ofs = numofs;
+				ch->list[ch->listlen].stm_ofs = stm_ofs;
+				ch->list[ch->listlen].stm_len = stm_len;
+				ch->listlen++;
+
+				goto have_next_token;
+			}
+
+			/* and so is a trailer */
+			else if (tok == PDF_TOK_OPEN_DICT)
+			{
+				repair_stop(ch);
+				fz_try(ctx)
+					pdf_drop_obj(ctx, pdf_parse_dict(ctx, NULL, file, buf));
+				fz_catch(ctx)
+					continue;
+			}
+
+			else if (tok == PDF_TOK_EOF)
+			{
+				break;
+			}
+
+			else
+			{
+				num = 0;
+				gen = 0;
+			}
+		}
+	}
+	fz_always(ctx)
+	{
+		fz_drop_stream(ctx, file);
+		pdf_lexbuf_fin(ctx, buf);
+	}
+	fz_catch(ctx)
+	{
+		/* Whatever went wrong is left to the serial scan. */
+	}
+}
+
+static void
+repair_chunk_task(void *arg, int i)
+{
+	repair_chunk *ch = &((repair_chunk *)arg)[i];
+	if (ch->ctx)
+		repair_scan_chunk(ch->ctx, ch);
+}
+
+static void
+repair_drop_chunks(fz_context *ctx, repair_scan *scan)
+{
+	int i, k;
+
+	for (i = 0; i < scan->count; i++)
+	{
+		repair_chunk *ch = &scan->chunk[i];
+		if (ch->ctx)
+		{
+			/* dropping the context flushes its warnings */
+			fz_set_warning_callback(ch->ctx, NULL, NULL);
+			fz_drop_context(ch->ctx);
+		}
+		for (k = 0; k < ch->warnlen; k++)
+			fz_free(ctx, ch->warnings[k]);
+		fz_free(ctx, ch->warnings);
+		fz_free(ctx, ch->list);
+		fz_free(ctx, ch->points);
+		memset(ch, 0, sizeof *ch);
+	}
+	fz_free(ctx, scan->data);
+	scan->data = NULL;
+	scan->count = 0;
+}
+
+/* Read the batch of chunks starting with the one at ofs, and scan them. */
+static void
+repair_scan_batch(fz_context *ctx, pdf_document *doc, repair_scan *scan, int64_t ofs)
+{
+	int64_t end;
+	size_t len;
+
+	repair_drop_chunks(ctx, scan);
+
+	scan->start = ofs - ofs % REPAIR_CHUNK_SIZE;
+	end = fz_mini64(scan->file_size, scan->start + (int64_t)REPAIR_BATCH_CHUNKS * REPAIR_CHUNK_SIZE + REPAIR_CHUNK_OVERLAP);
+	scan->data = fz_malloc(ctx, (size_t)(end - scan->start));
+	fz_seek(ctx, doc->file, scan->start, 0);
+	len = fz_read(ctx, doc->file, scan->data, (size_t)(end - scan->start));
+	if (scan->start + (int64_t)len < end)
+		scan->file_size = end = scan->start + (int64_t)len;
+
+	while (scan->count < REPAIR_BATCH_CHUNKS)
+	{
+		repair_chunk *ch = &scan->chunk[scan->count];
+		ch->start = scan->start + (int64_t)scan->count * REPAIR_CHUNK_SIZE;
+		if (ch->start >= end)
+			break;
+		ch->end = ch->start + REPAIR_CHUNK_SIZE;
+		ch->data = scan->data + (ch->start - scan->start);
+		ch->len = (size_t)fz_mini64(end - ch->start, REPAIR_CHUNK_SIZE + REPAIR_CHUNK_OVERLAP);
+		ch->file_end = ch->start + (int64_t)ch->len == scan->file_size;
+		scan->count++;
+		ch->ctx = fz_clone_context(ctx);
+		if (ch->ctx)
+		{
+			fz_set_warning_callback(ch->ctx, repair_chunk_warning, ch);
+			fz_set_error_callback(ch->ctx, NULL, NULL);
+		}
+	}
+
+	fz_run_parallel(ctx, scan->count, repair_chunk_task, scan->chunk);
+}
+
+/*
+	If a chunk scan went through the state at of the serial scan, add
+	what it found from there on to list, and return the state it
+	reached before stopping. Otherwise, return NULL.
+*/
+static const repair_point *
+repair_adopt(fz_context *ctx, pdf_document *doc, repair_scan *scan, const repair_point *at, struct entry **list, int *listlen, int *listcap, int *maxnum)
+{
+	repair_chunk *ch;
+	const repair_point *pt, *last;
+	int lo, hi, mid, i;
+
+	if (at->ofs < scan->start || at->ofs >= scan->start + (int64_t)scan->count * REPAIR_CHUNK_SIZE)
+	{
+		/* Scan serially once there is too little left. */
+		if (scan->file_size - at->ofs < 2 * REPAIR_CHUNK_SIZE)
+			return NULL;
+		fz_try(ctx)
+			repair_scan_batch(ctx, doc, scan, at->ofs);
+		fz_catch(ctx)
+		{
+			fz_rethrow_if(ctx, FZ_ERROR_TRYLATER);
+			repair_drop_chunks(ctx, scan);
+			scan->file_size = 0;
+		}
+		fz_seek(ctx, doc->file, at->ofs, 0);
+		if (scan->count == 0)
+			return NULL;
+	}
+
+	ch = &scan->chunk[(at->ofs - scan->start) / REPAIR_CHUNK_SIZE];
+	lo = 0;
+	hi = ch->len_points;
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (ch->points[mid].ofs < at->ofs)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo >= ch->len_points)
+		return NULL;
+	pt = &ch->points[lo];
+	if (pt->ofs != at->ofs || pt->num != at->num || pt->gen != at->gen || pt->numofs != at->numofs || pt->genofs != at->genofs)
+		return NULL;
+	for (last = pt; !last->stop && last < &ch->points[ch->len_points - 1]; last++)
+		;
+	if (last == pt)
+		return NULL;
+
+	if (*listlen + (last->listlen - pt->listlen) >= *listcap)
+	{
+		while (*listlen + (last->listlen - pt->listlen) >= *listcap)
+			*listcap = (*listcap * 3) / 2;
+		*list = fz_realloc_array(ctx, *list, *listcap, struct entry);
+	}
+	for (i = pt->listlen; i < last->listlen; i++)
+	{
+		(*list)[(*listlen)++] = ch->list[i];
+		if (ch->list[i].num > *maxnum)
+			*maxnum = ch->list[i].num;
+	}
+	for (i = pt->warnlen; i < last->warnlen; i++)
+		fz_warn(ctx, "%s", ch->warnings[i]);
+
+	return last;
+}
+
 void
 pdf_repair_xref(fz_context *ctx, pdf_document *doc)
 {
@@ -340,6 +865,7 @@ pdf_repair_xref(fz_context *ctx, pdf_document *doc)
 	pdf_lexbuf *buf = &doc->lexbuf.base;
 	int num_roots = 0;
 	int max_roots = 0;
+	repair_scan *scan = NULL;
 
 	fz_var(encrypt);
 	fz_var(id);
@@ -349,6 +875,7 @@ pdf_repair_xref(fz_context *ctx, pdf_document *doc)
 	fz_var(info);
 	fz_var(list);
 	fz_var(obj);
+	fz_var(scan);
 
 	fz_warn(ctx, "repairing PDF document");
 
@@ -391,12 +918,39 @@ pdf_repair_xref(fz_context *ctx, pdf_document *doc)
 			c = fz_read_byte(ctx, doc->file);
 		fz_unread_byte(ctx, doc->file);
 
+		if (fz_has_parallel(ctx) && doc->file->seek && !doc->file->progressive)
+		{
+			tmpofs = fz_tell(ctx, doc->file);
+			fz_seek(ctx, doc->file, 0, 2);
+			if (fz_tell(ctx, doc->file) >= REPAIR_PARALLEL_MIN)
+			{
+				scan = fz_malloc_struct(ctx, repair_scan);
+				scan->file_size = fz_tell(ctx, doc->file);
+			}
+			fz_seek(ctx, doc->file, tmpofs, 0);
+		}
+
 		while (1)
 		{
 			tmpofs = fz_tell(ctx, doc->file);
 			if (tmpofs < 0)
 				fz_throw(ctx, FZ_ERROR_GENERIC, "cannot tell in file");
 
+			if (scan)
+			{
+				repair_point at = { tmpofs, num, gen, numofs, genofs, 0, 0 };
+				const repair_point *to = repair_adopt(ctx, doc, scan, &at, &list, &listlen, &listcap, &maxnum);
+				if (to)
+				{
+					num = to->num;
+					gen = to->gen;
+					numofs = to->numofs;
+					genofs = to->genofs;
+					fz_seek(ctx, doc->file, to->ofs, 0);
+					continue;
+				}
+			}
+
 			fz_try(ctx)
 				tok = pdf_lex_no_string(ctx, doc->file, buf);
 			fz_catch(ctx)
@@ -696,6 +1250,9 @@ pdf_repair_xref(fz_context *ctx, pdf_document *doc)
 			pdf_drop_obj(ctx, roots[i]);
 		fz_free(ctx, roots);
 		fz_free(ctx, list);
+		if (scan)
+			repair_drop_chunks(ctx, scan);
+		fz_free(ctx, scan);
 		doc->repair_in_progress = 0;
 	}
 	fz_catch(ctx)
@@ -180,6 +180,7 @@ void pdf_run_page_contents_with_usage(fz_context *ctx, pdf_page *page, fz_device
 	if (nocache)
 		pdf_mark_xref(ctx, doc);
 
+	fz_begin_run_arena(ctx);
 	fz_try(ctx)
 	{
 		pdf_run_page_contents_with_usage_imp(ctx, doc, page, dev, ctm, usage, cookie);
@@ -188,6 +189,7 @@ void pdf_run_page_contents_with_usage(fz_context *ctx, pdf_page *page, fz_device
 	{
 		if (nocache)
 			pdf_clear_xref_to_mark(ctx, doc);
+		fz_end_run_arena(ctx);
 	}
 	fz_catch(ctx)
 	{
@@ -209,6 +211,8 @@ void pdf_run_annot(fz_context *ctx, pdf_annot *annot, fz_device *dev, fz_matrix
 	nocache = !!(dev->hints & FZ_NO_CACHE);
 	if (nocache)
 		pdf_mark_xref(ctx, doc);
+
+	fz_begin_run_arena(ctx);
 	fz_try(ctx)
 	{
 		pdf_run_annot_with_usage(ctx, doc, page, annot, dev, ctm, "View", cookie);
@@ -217,6 +221,7 @@ void pdf_run_annot(fz_context *ctx, pdf_annot *annot, fz_device *dev, fz_matrix
 	{
 		if (nocache)
 			pdf_clear_xref_to_mark(ctx, doc);
+		fz_end_run_arena(ctx);
 	}
 	fz_catch(ctx)
 	{
@@ -287,6 +292,7 @@ void pdf_run_page_annots_with_usage(fz_context *ctx, pdf_page *page, fz_device *
 	if (nocache)
 		pdf_mark_xref(ctx, doc);
 
+	fz_begin_run_arena(ctx);
 	fz_try(ctx)
 	{
 		pdf_run_page_annots_with_usage_imp(ctx, doc, page, dev, ctm, usage, cookie);
@@ -295,6 +301,7 @@ void pdf_run_page_annots_with_usage(fz_context *ctx, pdf_page *page, fz_device *
 	{
 		if (nocache)
 			pdf_clear_xref_to_mark(ctx, doc);
+		fz_end_run_arena(ctx);
 	}
 	fz_catch(ctx)
 	{
@@ -316,6 +323,7 @@ void pdf_run_page_widgets_with_usage(fz_context *ctx, pdf_page *page, fz_device
 	if (nocache)
 		pdf_mark_xref(ctx, doc);
 
+	fz_begin_run_arena(ctx);
 	fz_try(ctx)
 	{
 		pdf_run_page_widgets_with_usage_imp(ctx, doc, page, dev, ctm, usage, cookie);
@@ -324,6 +332,7 @@ void pdf_run_page_widgets_with_usage(fz_context *ctx, pdf_page *page, fz_device
 	{
 		if (nocache)
 			pdf_clear_xref_to_mark(ctx, doc);
+		fz_end_run_arena(ctx);
 	}
 	fz_catch(ctx)
 	{
@@ -344,6 +353,8 @@ pdf_run_page_with_usage(fz_context *ctx, pdf_page *page, fz_device *dev, fz_matr
 
 	if (nocache)
 		pdf_mark_xref(ctx, doc);
+
+	fz_begin_run_arena(ctx);
 	fz_try(ctx)
 	{
 		pdf_run_page_contents_with_usage_imp(ctx, doc, page, dev, ctm, usage, cookie);
@@ -354,6 +365,7 @@ pdf_run_page_with_usage(fz_context *ctx, pdf_page *page, fz_device *dev, fz_matr
 	{
 		if (nocache)
 			pdf_clear_xref_to_mark(ctx, doc);
+		fz_end_run_arena(ctx);
 	}
 	fz_catch(ctx)
 	{
@@ -94,6 +94,17 @@ pdf_store_item(fz_context *ctx, pdf_obj *key, void *val, size_t itemsize)
 		fz_warn(ctx, "unexpectedly replacing entry in PDF store");
 }
 
+void
+pdf_store_item_with_cost(fz_context *ctx, pdf_obj *key, void *val, size_t itemsize, float cost)
+{
+	void *existing;
+
+	assert(pdf_is_name(ctx, key) || pdf_is_array(ctx, key) || pdf_is_dict(ctx, key) || pdf_is_indirect(ctx, key));
+	existing = fz_store_item_with_cost(ctx, key, val, itemsize, cost, &pdf_obj_store_type);
+	if (existing)
+		fz_warn(ctx, "unexpectedly replacing entry in PDF store");
+}
+
 void *
 pdf_find_item(fz_context *ctx, fz_store_drop_fn *drop, pdf_obj *key)
 {
@@ -120,6 +131,7 @@ void
 pdf_empty_store(fz_context *ctx, pdf_document *doc)
 {
 	fz_filter_store(ctx, pdf_filter_store, doc, &pdf_obj_store_type);
+	pdf_drop_contents_lists(ctx, doc);
 }
 
 static int
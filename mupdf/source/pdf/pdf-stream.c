@@ -87,6 +87,7 @@ pdf_load_jbig2_globals(fz_context *ctx, pdf_obj *dict)
 {
 	fz_jbig2_globals *globals;
 	fz_buffer *buf = NULL;
+	size_t size;
 
 	fz_var(buf);
 
@@ -100,7 +101,12 @@ pdf_load_jbig2_globals(fz_context *ctx, pdf_obj *dict)
 	{
 		buf = pdf_load_stream(ctx, dict);
 		globals = fz_load_jbig2_globals(ctx, buf);
-		pdf_store_item(ctx, dict, globals, fz_buffer_storage(ctx, buf, NULL));
+		/* The globals are shared by every page of a scanned book, and
+		 * hold the decoded symbol bitmaps (1 bit per pixel). Account
+		 * for their real size, and cost them per decoded pixel like
+		 * JBIG2 images so the store keeps them over page images. */
+		size = fz_jbig2_globals_size(ctx, globals);
+		pdf_store_item_with_cost(ctx, dict, globals, size, 24.0f * 8 * size);
 	}
 	fz_always(ctx)
 	{
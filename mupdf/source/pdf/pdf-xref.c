@@ -1877,31 +1877,124 @@ pdf_keep_document(fz_context *ctx, pdf_document *doc)
 
 /*
  * compressed object streams
+ *
+ * An object stream is decompressed and its header parsed once, into an
+ * index of the objects it contains that is kept in the store. Objects
+ * are then parsed on demand from their slice of the decoded data, so
+ * resolving scattered objects does not decompress and tokenize the
+ * whole stream again, nor parse objects nobody asked for.
  */
 
-static pdf_xref_entry *
-pdf_load_obj_stm(fz_context *ctx, pdf_document *doc, int num, pdf_lexbuf *buf, int target)
+typedef struct
 {
-	fz_stream *stm = NULL;
-	pdf_obj *objstm = NULL;
-	int *numbuf = NULL;
-	int64_t *ofsbuf = NULL;
+	int num;
+	int idx;
+} pdf_obj_stm_slot;
 
-	pdf_obj *obj;
+typedef struct
+{
+	fz_storable storable;
+	fz_buffer *data;
 	int64_t first;
 	int count;
-	int i;
+	int64_t *ofs; /* in stream order */
+	pdf_obj_stm_slot *slots; /* sorted by object number, then stream order */
+	int repair_attempted;
+} pdf_obj_stm;
+
+static void
+pdf_drop_obj_stm_imp(fz_context *ctx, fz_storable *os_)
+{
+	pdf_obj_stm *os = (pdf_obj_stm *)os_;
+
+	fz_drop_buffer(ctx, os->data);
+	fz_free(ctx, os->ofs);
+	fz_free(ctx, os->slots);
+	fz_free(ctx, os);
+}
+
+static int
+cmp_obj_stm_slot(const void *a_, const void *b_)
+{
+	const pdf_obj_stm_slot *a = a_;
+	const pdf_obj_stm_slot *b = b_;
+
+	if (a->num != b->num)
+		return a->num < b->num ? -1 : 1;
+	return a->idx - b->idx;
+}
+
+/* Find the first definition of object num in the stream, or -1. */
+static int
+pdf_find_obj_stm_slot(pdf_obj_stm *os, int num)
+{
+	int l = 0;
+	int r = os->count;
+
+	while (l < r)
+	{
+		int m = l + (r - l) / 2;
+		if (os->slots[m].num < num)
+			l = m + 1;
+		else
+			r = m;
+	}
+	if (l < os->count && os->slots[l].num == num)
+		return os->slots[l].idx;
+	return -1;
+}
+
+static fz_stream *
+pdf_open_obj_stm_slice(fz_context *ctx, pdf_obj_stm *os, int i)
+{
+	size_t len = os->data->len;
+	int64_t start = os->first + os->ofs[i];
+	uint64_t length;
+
+	if (i+1 < os->count)
+		length = os->ofs[i+1] - os->ofs[i];
+	else
+		length = UINT64_MAX;
+
+	if (start < 0 || (uint64_t)start > len)
+		start = len;
+	if (length > len - start)
+		length = len - start;
+
+	return fz_open_memory(ctx, os->data->data + start, length);
+}
+
+static pdf_obj_stm *
+pdf_load_obj_stm_index(fz_context *ctx, pdf_document *doc, int num, pdf_lexbuf *buf)
+{
+	fz_stream *stm = NULL;
+	pdf_obj *objstm = NULL;
+	pdf_obj *key;
+	pdf_obj_stm *os;
+	int count, found, truncated, xref_len, i;
 	pdf_token tok;
-	pdf_xref_entry *ret_entry = NULL;
-	int xref_len;
-	int found;
-	fz_stream *sub = NULL;
+	size_t size;
+
+	key = pdf_new_indirect(ctx, doc, num, 0);
+
+	os = pdf_find_item(ctx, pdf_drop_obj_stm_imp, key);
+	if (os && os->repair_attempted == doc->repair_attempted)
+	{
+		pdf_drop_obj(ctx, key);
+		return os;
+	}
+	if (os)
+	{
+		/* The xref has been repaired since we indexed this stream,
+		 * so the object number may now refer to another object. */
+		pdf_remove_item(ctx, pdf_drop_obj_stm_imp, key);
+		fz_drop_storable(ctx, &os->storable);
+		os = NULL;
+	}
 
-	fz_var(numbuf);
-	fz_var(ofsbuf);
 	fz_var(objstm);
 	fz_var(stm);
-	fz_var(sub);
+	fz_var(os);
 
 	fz_try(ctx)
 	{
@@ -1913,6 +2006,7 @@ pdf_load_obj_stm(fz_context *ctx, pdf_document *doc, int num, pdf_lexbuf *buf, i
 	fz_catch(ctx)
 	{
 		pdf_drop_obj(ctx, objstm);
+		pdf_drop_obj(ctx, key);
 		fz_rethrow(ctx);
 	}
 
@@ -1920,96 +2014,115 @@ pdf_load_obj_stm(fz_context *ctx, pdf_document *doc, int num, pdf_lexbuf *buf, i
 	{
 		(void)pdf_mark_obj(ctx, objstm);
 
+		os = fz_malloc_struct(ctx, pdf_obj_stm);
+		FZ_INIT_STORABLE(os, 1, pdf_drop_obj_stm_imp);
+		os->repair_attempted = doc->repair_attempted;
+
 		count = pdf_dict_get_int(ctx, objstm, PDF_NAME(N));
-		first = pdf_dict_get_int(ctx, objstm, PDF_NAME(First));
+		os->first = pdf_dict_get_int(ctx, objstm, PDF_NAME(First));
 
-		validate_object_number_range(ctx, first, count, "object stream");
+		validate_object_number_range(ctx, os->first, count, "object stream");
 
-		numbuf = fz_calloc(ctx, count, sizeof(*numbuf));
-		ofsbuf = fz_calloc(ctx, count, sizeof(*ofsbuf));
+		os->ofs = fz_malloc_array(ctx, count, int64_t);
+		os->slots = fz_malloc_array(ctx, count, pdf_obj_stm_slot);
+
+		stm = pdf_open_stream_number(ctx, doc, num);
+		os->data = fz_read_best(ctx, stm, 0, &truncated);
+		if (truncated)
+			fz_warn(ctx, "truncated object stream (%d 0 R)", num);
+		fz_drop_stream(ctx, stm);
+		stm = NULL;
 
 		xref_len = pdf_xref_len(ctx, doc);
 
 		found = 0;
 
-		stm = pdf_open_stream_number(ctx, doc, num);
+		stm = fz_open_buffer(ctx, os->data);
 		for (i = 0; i < count; i++)
 		{
+			int onum;
+
 			tok = pdf_lex(ctx, stm, buf);
 			if (tok != PDF_TOK_INT)
 				fz_throw(ctx, FZ_ERROR_GENERIC, "corrupt object stream (%d 0 R)", num);
-			numbuf[found] = buf->i;
+			onum = buf->i;
 
 			tok = pdf_lex(ctx, stm, buf);
 			if (tok != PDF_TOK_INT)
 				fz_throw(ctx, FZ_ERROR_GENERIC, "corrupt object stream (%d 0 R)", num);
-			ofsbuf[found] = buf->i;
 
-			if (numbuf[found] <= 0 || numbuf[found] >= xref_len)
+			if (onum <= 0 || onum >= xref_len)
 				fz_warn(ctx, "object stream object out of range, skipping");
 			else
+			{
+				os->ofs[found] = buf->i;
+				os->slots[found].num = onum;
+				os->slots[found].idx = found;
 				found++;
+			}
 		}
+		os->count = found;
+		qsort(os->slots, found, sizeof(*os->slots), cmp_obj_stm_slot);
 
-		for (i = 0; i < found; i++)
-		{
-			pdf_xref_entry *entry;
-			uint64_t length;
-			int64_t offset;
-
-			offset = first + ofsbuf[i];
-			if (i+1 < found)
-				length = ofsbuf[i+1] - ofsbuf[i];
-			else
-				length = UINT64_MAX;
+		size = sizeof(*os) + os->data->len + found * (sizeof(*os->ofs) + sizeof(*os->slots));
+		pdf_store_item_with_cost(ctx, key, os, size, 2.0f * os->data->len);
+	}
+	fz_always(ctx)
+	{
+		fz_drop_stream(ctx, stm);
+		pdf_unmark_obj(ctx, objstm);
+		pdf_drop_obj(ctx, objstm);
+		pdf_drop_obj(ctx, key);
+	}
+	fz_catch(ctx)
+	{
+		if (os)
+			fz_drop_storable(ctx, &os->storable);
+		fz_rethrow(ctx);
+	}
 
-			sub = fz_open_null_filter(ctx, stm, length, offset);
+	return os;
+}
 
-			obj = pdf_parse_stm_obj(ctx, doc, sub, buf);
-			fz_drop_stream(ctx, sub);
-			sub = NULL;
+static pdf_xref_entry *
+pdf_load_obj_stm(fz_context *ctx, pdf_document *doc, int num, pdf_lexbuf *buf, int target)
+{
+	pdf_obj_stm *os = pdf_load_obj_stm_index(ctx, doc, num, buf);
+	pdf_xref_entry *ret_entry = NULL;
+	fz_stream *sub = NULL;
+	int i;
 
-			entry = pdf_get_xref_entry_no_null(ctx, doc, numbuf[i]);
+	fz_var(sub);
 
-			pdf_set_obj_parent(ctx, obj, numbuf[i]);
+	fz_try(ctx)
+	{
+		i = pdf_find_obj_stm_slot(os, target);
+		if (i >= 0)
+		{
+			pdf_xref_entry *entry = pdf_get_xref_entry_no_null(ctx, doc, target);
 
 			if (entry->type == 'o' && entry->ofs == num)
 			{
-				/* If we already have an entry for this object,
-				 * we'd like to drop it and use the new one -
-				 * but this means that anyone currently holding
-				 * a pointer to the old one will be left with a
-				 * stale pointer. Instead, we drop the new one
-				 * and trust that the old one is correct. */
-				if (entry->obj)
-				{
-					if (pdf_objcmp(ctx, entry->obj, obj))
-						fz_warn(ctx, "Encountered new definition for object %d - keeping the original one", numbuf[i]);
-					pdf_drop_obj(ctx, obj);
-				}
-				else
+				if (!entry->obj)
 				{
+					pdf_obj *obj;
+
+					sub = pdf_open_obj_stm_slice(ctx, os, i);
+					obj = pdf_parse_stm_obj(ctx, doc, sub, buf);
+					pdf_set_obj_parent(ctx, obj, target);
+
 					entry->obj = obj;
 					fz_drop_buffer(ctx, entry->stm_buf);
 					entry->stm_buf = NULL;
 				}
-				if (numbuf[i] == target)
-					ret_entry = entry;
-			}
-			else
-			{
-				pdf_drop_obj(ctx, obj);
+				ret_entry = entry;
 			}
 		}
 	}
 	fz_always(ctx)
 	{
-		fz_drop_stream(ctx, stm);
 		fz_drop_stream(ctx, sub);
-		fz_free(ctx, ofsbuf);
-		fz_free(ctx, numbuf);
-		pdf_unmark_obj(ctx, objstm);
-		pdf_drop_obj(ctx, objstm);
+		fz_drop_storable(ctx, &os->storable);
 	}
 	fz_catch(ctx)
 	{
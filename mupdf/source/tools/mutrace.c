@@ -40,6 +40,9 @@ static int usage(void)
 		"\n"
 		"\t-d\tuse display list\n"
 		"\n"
+		"\t-P\tprofile rendering instead of tracing, and write JSON\n"
+		"\t-r -\tresolution in dpi for profiling (default: 72)\n"
+		"\n"
 		"\tpages\tcomma separated list of page numbers and ranges\n"
 		);
 	return 1;
@@ -52,6 +55,9 @@ static char *layout_css = NULL;
 static int layout_use_doc_css = 1;
 
 static int use_display_list = 0;
+static int profile = 0;
+static float resolution = 72;
+static int first_page = 1;
 
 static void runpage(fz_context *ctx, fz_document *doc, int number)
 {
@@ -60,32 +66,61 @@ static void runpage(fz_context *ctx, fz_document *doc, int number)
 	fz_device *dev = NULL;
 	fz_rect mediabox;
 
+	fz_device *draw = NULL;
+	fz_pixmap *pix = NULL;
+	fz_matrix ctm = fz_identity;
+
 	fz_var(page);
 	fz_var(list);
 	fz_var(dev);
+	fz_var(draw);
+	fz_var(pix);
 	fz_try(ctx)
 	{
 		page = fz_load_page(ctx, doc, number - 1);
 		mediabox = fz_bound_page(ctx, page);
-		printf("<page number=\"%d\" mediabox=\"%g %g %g %g\">\n",
-				number, mediabox.x0, mediabox.y0, mediabox.x1, mediabox.y1);
-		dev = fz_new_trace_device(ctx, fz_stdout(ctx));
+		if (profile)
+		{
+			ctm = fz_scale(resolution / 72, resolution / 72);
+			pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), fz_round_rect(fz_transform_rect(mediabox, ctm)), NULL, 0);
+			fz_clear_pixmap_with_value(ctx, pix, 255);
+			draw = fz_new_draw_device(ctx, fz_identity, pix);
+			dev = fz_new_profile_device(ctx, draw);
+		}
+		else
+		{
+			printf("<page number=\"%d\" mediabox=\"%g %g %g %g\">\n",
+					number, mediabox.x0, mediabox.y0, mediabox.x1, mediabox.y1);
+			dev = fz_new_trace_device(ctx, fz_stdout(ctx));
+		}
 		if (use_display_list)
 		{
 			list = fz_new_display_list_from_page(ctx, page);
-			fz_run_display_list(ctx, list, dev, fz_identity, fz_infinite_rect, NULL);
+			fz_run_display_list(ctx, list, dev, ctm, fz_infinite_rect, NULL);
 		}
 		else
 		{
-			fz_run_page(ctx, page, dev, fz_identity, NULL);
+			fz_run_page(ctx, page, dev, ctm, NULL);
 		}
-		printf("</page>\n");
+		fz_close_device(ctx, dev);
+		if (profile)
+		{
+			fz_close_device(ctx, draw);
+			printf("%s{\"page\":%d,\"profile\":", first_page ? "" : ",\n", number);
+			fz_write_profile_json(ctx, dev, fz_stdout(ctx));
+			printf("}");
+			first_page = 0;
+		}
+		else
+			printf("</page>\n");
 	}
 	fz_always(ctx)
 	{
 		fz_drop_display_list(ctx, list);
 		fz_drop_page(ctx, page);
 		fz_drop_device(ctx, dev);
+		fz_drop_device(ctx, draw);
+		fz_drop_pixmap(ctx, pix);
 	}
 	fz_catch(ctx)
 		fz_rethrow(ctx);
@@ -113,7 +148,7 @@ int mutrace_main(int argc, char **argv)
 	char *password = "";
 	int i, c, count;
 
-	while ((c = fz_getopt(argc, argv, "p:W:H:S:U:Xd")) != -1)
+	while ((c = fz_getopt(argc, argv, "p:W:H:S:U:XdPr:")) != -1)
 	{
 		switch (c)
 		{
@@ -127,6 +162,9 @@ int mutrace_main(int argc, char **argv)
 		case 'X': layout_use_doc_css = 0; break;
 
 		case 'd': use_display_list = 1; break;
+
+		case 'P': profile = 1; break;
+		case 'r': resolution = fz_atof(fz_optarg); break;
 		}
 	}
 
@@ -168,13 +206,22 @@ int mutrace_main(int argc, char **argv)
 				if (!fz_authenticate_password(ctx, doc, password))
 					fz_throw(ctx, FZ_ERROR_GENERIC, "cannot authenticate password: %s", argv[i]);
 			fz_layout_document(ctx, doc, layout_w, layout_h, layout_em);
-			printf("<document filename=\"%s\">\n", argv[i]);
+			if (profile)
+			{
+				fz_write_printf(ctx, fz_stdout(ctx), "{\"filename\":%q,\"pages\":[\n", argv[i]);
+				first_page = 1;
+			}
+			else
+				printf("<document filename=\"%s\">\n", argv[i]);
 			count = fz_count_pages(ctx, doc);
 			if (i+1 < argc && fz_is_page_range(ctx, argv[i+1]))
 				runrange(ctx, doc, count, argv[++i]);
 			else
 				runrange(ctx, doc, count, "1-N");
-			printf("</document>\n");
+			if (profile)
+				printf("\n]}\n");
+			else
+				printf("</document>\n");
 			fz_drop_document(ctx, doc);
 			doc = NULL;
 		}
@@ -538,6 +538,7 @@ function sumatrapdf_files()
     "TableOfContents.*",
     "Tabs.*",
     "Tester.*",
+    "TextRegex.*",
     "TextSearch.*",
     "TextSelection.*",
     "Theme.*",
@@ -779,6 +780,7 @@ function mupdf_files()
     "jmemcust.c",
     "link.c",
     "list-device.c",
+    "list-serialize.c",
     "load-bmp.c",
     "load-gif.c",
     "load-jbig2.c",
@@ -810,6 +812,7 @@ function mupdf_files()
     "pixmap.c",
     "pool.c",
     "printf.c",
+    "profile-device.c",
     "random.c",
     "separation.c",
     "shade.c",
@@ -822,6 +825,7 @@ function mupdf_files()
     "string.c",
     "strtof.c",
     "svg-device.c",
+    "tee-device.c",
     "test-device.c",
     "text.c",
     "time.c",
@@ -1000,11 +1004,14 @@ function test_util_files()
     "BaseUtil.*",
     "BitManip.*",
     "ByteOrderDecoder.*",
+    "ByteReader.*",
+    "ByteWriter.*",
     "CmdLineArgsIter.*",
     "ColorUtil.*",
     "CryptoUtil.*",
     "CssParser.*",
     "Dict.*",
+    "DirIter.*",
     "Dpi.*",
     "FileUtil.*",
     "GeomUtil.*",
@@ -1022,10 +1029,12 @@ function test_util_files()
     "SquareTreeParser.*",
     "TrivialHtmlParser.*",
     "TempAllocator.*",
+    "ThreadUtil.*",
     "UtAssert.*",
     "Vec.*",
     "WinUtil.*",
     "WinDynCalls.*",
+    "ZipUtil.*",
     "tests/*"
   })
   files_in_dir("src", {
@@ -1033,10 +1042,15 @@ function test_util_files()
     --"StressTesting.*",
     "AppUtil.*",
     "DisplayMode.*",
+    "EngineBase.*",
     "Flags.*",
+    "MupdfUnitTests.cpp",
     "SumatraConfig.*",
     "SettingsStructs.*",
     "SumatraUnitTests.cpp",
+    "TextRegex.*",
+    "TextSearch.*",
+    "TextSelection.*",
     "tools/test_util.cpp"
   })
 end
@@ -1046,6 +1060,9 @@ function engine_dump_files()
     "EngineDump.cpp",
     "SumatraConfig.*",
     "FzImgReader.*",
+    "TextRegex.*",
+    "TextSearch.*",
+    "TextSelection.*",
     "mui/Mui.*",
     "mui/TextRender.*"
   })
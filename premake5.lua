@@ -356,7 +356,7 @@ workspace "SumatraPDF"
     -- and we can't provide our own in a different directory because
     -- msvc will include the one in ext/openjpeg/src/lib/openjp2 first
     -- because #include "opj_config_private.h" searches current directory first
-    defines { "_CRT_SECURE_NO_WARNINGS", "USE_JPIP", "OPJ_STATIC", "OPJ_EXPORTS" }
+    defines { "_CRT_SECURE_NO_WARNINGS", "USE_JPIP", "OPJ_STATIC", "OPJ_EXPORTS", "MUTEX_win32" }
     openjpeg_files()
 
     -- freetype
@@ -464,7 +464,7 @@ workspace "SumatraPDF"
     -- and we can't provide our own in a different directory because
     -- msvc will include the one in ext/openjpeg/src/lib/openjp2 first
     -- because #include "opj_config_private.h" searches current directory first
-    defines { "_CRT_SECURE_NO_WARNINGS", "USE_JPIP", "OPJ_STATIC", "OPJ_EXPORTS" }
+    defines { "_CRT_SECURE_NO_WARNINGS", "USE_JPIP", "OPJ_STATIC", "OPJ_EXPORTS", "MUTEX_win32" }
     openjpeg_files()
 
     project "freetype"
@@ -707,9 +707,11 @@ workspace "SumatraPDF"
     language "C++"
     cppdialect "C++latest"
     regconf()
-    disablewarnings { "4838" }
-    includedirs { "src" }
+    disablewarnings { "4100", "4244", "4267", "4457", "4706", "4838" }
+    zlib_ng_defines()
+    includedirs { "src", "ext/zlib-ng", "ext/unarr", "mupdf/include" }
     test_util_files()
+    links { "mupdf", "zlib-ng", "libdjvu", "libwebp", "unarrlib" }
     links { "gdiplus", "comctl32", "shlwapi", "Version" }
 
   project "logview"
@@ -61,6 +61,9 @@ bool EngineMupdfSupportsAnnotations(EngineBase*);
 bool EngineMupdfSaveUpdated(EngineBase* engine, std::string_view path,
                             std::function<void(std::string_view)> showErrorFunc);
 Annotation* EngineMupdfGetAnnotationAtPos(EngineBase*, int pageNo, PointF pos, AnnotationType* allowedAnnots);
+bool EngineMupdfIsEncrypted(EngineBase*);
+void EngineMupdfSetPageCacheDir(EngineBase*, const char* dir);
+bool EngineMupdfProfilePage(EngineBase*, int pageNo, float zoom, str::Str& json);
 
 /* EnginePs.cpp */
 
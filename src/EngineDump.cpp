@@ -17,6 +17,8 @@
 #include "EngineBase.h"
 #include "EngineAll.h"
 #include "PdfCreator.h"
+#include "TextSelection.h"
+#include "TextSearch.h"
 
 void _uploadDebugReportIfFunc(__unused bool cond, __unused const char* condStr) {
     // no-op implementation to satisfy SubmitBugReport()
@@ -462,6 +464,151 @@ bool RenderDocument(EngineBase* engine, const WCHAR* renderPath, float zoom = 1.
     return success;
 }
 
+// prints, as JSON, where the time goes when rendering each page
+static bool ProfileDocument(EngineBase* engine, float zoom) {
+    str::Str json;
+    json.Append("{\"pages\":[\n");
+    bool success = true;
+    bool first = true;
+    for (int pageNo = 1; pageNo <= engine->PageCount(); pageNo++) {
+        str::Str profile;
+        if (!EngineMupdfProfilePage(engine, pageNo, zoom, profile)) {
+            ErrOut("Error: Failed to profile page %d for %s!", pageNo, engine->FileName());
+            success = false;
+            continue;
+        }
+        json.AppendFmt("%s{\"page\":%d,\"profile\":%s}", first ? "" : ",\n", pageNo, profile.Get());
+        first = false;
+    }
+    json.Append("\n]}\n");
+    Out1(json.Get());
+    return success;
+}
+
+struct SearchOptions {
+    bool matchCase = false;
+    bool wholeWords = false;
+    bool regex = false;
+    bool loose = false;
+};
+
+static void AppendJsonString(str::Str& json, const WCHAR* s) {
+    char* utf8 = ToUtf8Temp(s);
+    json.AppendChar('"');
+    for (const char* c = utf8; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            json.AppendChar('\\');
+            json.AppendChar(*c);
+        } else if ((u8)*c < 0x20) {
+            json.AppendFmt("\\u%04x", (u8)*c);
+        } else {
+            json.AppendChar(*c);
+        }
+    }
+    json.AppendChar('"');
+}
+
+// reads the queries for -search from a UTF-8 file, one per line
+static bool ReadQueries(const WCHAR* path, WStrVec& queries) {
+    AutoFree data = file::ReadFile(path);
+    if (!data.data) {
+        return false;
+    }
+    WCHAR* text = ToWstrTemp(data.AsView());
+    if (text[0] == 0xFEFF) {
+        text++;
+    }
+    WStrVec lines;
+    lines.Split(text, L"\n");
+    for (WCHAR* line : lines) {
+        if (str::EndsWith(line, L"\r")) {
+            line[str::Len(line) - 1] = '\0';
+        }
+        if (!str::IsEmpty(line)) {
+            queries.Append(str::Dup(line));
+        }
+    }
+    return true;
+}
+
+// prints, as JSON, the hits of all queries with the page and the rects (in
+// page coordinates at zoom 1) each covers. the queries are all searched for
+// in a single pass over the document, while its pages are extracted ahead
+// on worker threads
+static bool SearchDocument(EngineBase* engine, const WStrVec& queries, const SearchOptions& opts) {
+    // how many pages ahead of the searches to extract (the text of more pages
+    // could be evicted from the cache before it's searched)
+    constexpr int kPrefetchPages = 64;
+
+    int nPages = engine->PageCount();
+    DocumentTextCache textCache(engine);
+    Vec<TextSearch*> searches;
+    Vec<SearchHits*> hits;
+    for (size_t k = 0; k < queries.size(); k++) {
+        auto search = new TextSearch(engine, &textCache);
+        search->SetSensitive(opts.matchCase);
+        search->SetWholeWords(opts.wholeWords);
+        search->SetRegex(opts.regex);
+        search->SetFolding(opts.loose);
+        searches.Append(search);
+        hits.Append(new SearchHits());
+    }
+
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        Vec<int> pageNos;
+        for (int n = pageNo + 1; n <= nPages && n <= pageNo + kPrefetchPages; n++) {
+            pageNos.Append(n);
+        }
+        textCache.PrefetchPages(pageNos);
+        // waits for the worker already extracting the page
+        textCache.GetTextForPage(pageNo);
+        // then extends the hits of all queries for as long as there's extracted text
+        for (size_t k = 0; k < queries.size(); k++) {
+            if (hits.at(k)->nextPage <= pageNo) {
+                searches.at(k)->FindAll(queries.at(k), hits.at(k), true);
+            }
+        }
+    }
+    textCache.PrefetchPages(Vec<int>());
+
+    str::Str json;
+    json.Append("{\"file\":");
+    AppendJsonString(json, engine->FileName());
+    json.AppendFmt(",\"pages\":%d,\"queries\":[", nPages);
+    bool success = true;
+    for (size_t k = 0; k < queries.size(); k++) {
+        TextSearch* search = searches.at(k);
+        SearchHits* res = hits.at(k);
+        // in case the text of a page has been evicted before all searches got to it
+        search->FindAll(queries.at(k), res);
+        if (!search->IsPatternValid()) {
+            ErrOut("Error: Invalid regular expression '%s'!", queries.at(k));
+            success = false;
+        }
+        json.Append(k > 0 ? ",\n" : "\n");
+        json.Append("{\"query\":");
+        AppendJsonString(json, queries.at(k));
+        json.AppendFmt(",\"valid\":%s,\"hits\":[", search->IsPatternValid() ? "true" : "false");
+        for (int h = 0; h < res->hits.isize(); h++) {
+            SearchHit& hit = res->hits.at(h);
+            json.AppendFmt("%s{\"page\":%d,\"glyph\":%d,\"endPage\":%d,\"endGlyph\":%d,\"rects\":[",
+                           h > 0 ? "," : "", hit.startPage, hit.startGlyph, hit.endPage, hit.endGlyph);
+            for (int r = hit.firstRect; r < hit.firstRect + hit.nRects; r++) {
+                Rect rc = res->rects.at(r);
+                json.AppendFmt("%s{\"page\":%d,\"rect\":[%d,%d,%d,%d]}", r > hit.firstRect ? "," : "",
+                               res->rectPages.at(r), rc.x, rc.y, rc.dx, rc.dy);
+            }
+            json.Append("]}");
+        }
+        json.Append("]}");
+        delete search;
+        delete res;
+    }
+    json.Append("\n]}\n");
+    Out1(json.Get());
+    return success;
+}
+
 class PasswordHolder : public PasswordUI {
     const WCHAR* password;
 
@@ -483,8 +630,10 @@ int main(__unused int argc, __unused char** argv) {
 
     if (nArgs < 2) {
     Usage:
-        ErrOut("%s [-pwd <password>][-quick][-render <path-%%d.tga>] <filename>",
-               path::GetBaseNameTemp(argList.args[0]));
+        ErrOut("%s [-pwd <password>][-quick][-render <path-%%d.tga>][-profile] <filename>\n"
+               "%s [-pwd <password>] -search <query> [-search <query>...][-searchfile <path>]\n"
+               "\t[-matchcase][-wholewords][-regex][-loose] <filename>",
+               path::GetBaseNameTemp(argList.args[0]), path::GetBaseNameTemp(argList.args[0]));
         return 2;
     }
 
@@ -494,6 +643,9 @@ int main(__unused int argc, __unused char** argv) {
     WCHAR* renderPath = nullptr;
     float renderZoom = 1.f;
     bool loadOnly = false, silent = false;
+    bool profile = false;
+    WStrVec queries;
+    SearchOptions searchOpts;
 
     for (int i = 1; i < nArgs; i++) {
         if (str::Eq(argList.at(i), L"-pwd") && i + 1 < nArgs && !password) {
@@ -508,6 +660,27 @@ int main(__unused int argc, __unused char** argv) {
                 i++;
             }
             renderPath = argList.at(++i);
+        } else if (str::Eq(argList.at(i), L"-profile")) {
+            // prints per page JSON instead of the XML dump; uses the
+            // -render zoom, if given
+            profile = true;
+        } else if (str::Eq(argList.at(i), L"-search") && i + 1 < nArgs) {
+            // prints JSON with the hits of all queries instead of the XML dump
+            queries.Append(str::Dup(argList.at(++i)));
+        } else if (str::Eq(argList.at(i), L"-searchfile") && i + 1 < nArgs) {
+            const WCHAR* path = argList.at(++i);
+            if (!ReadQueries(path, queries)) {
+                ErrOut("Error: Couldn't read the queries from %s!", path);
+                return 1;
+            }
+        } else if (str::Eq(argList.at(i), L"-matchcase")) {
+            searchOpts.matchCase = true;
+        } else if (str::Eq(argList.at(i), L"-wholewords")) {
+            searchOpts.wholeWords = true;
+        } else if (str::Eq(argList.at(i), L"-regex")) {
+            searchOpts.regex = true;
+        } else if (str::Eq(argList.at(i), L"-loose")) {
+            searchOpts.loose = true;
         } else if (str::Eq(argList.at(i), L"-loadonly")) {
             // -loadonly and -silent are only meant for profiling
             loadOnly = true;
@@ -551,7 +724,16 @@ int main(__unused int argc, __unused char** argv) {
         ErrOut("Error: Couldn't create an engine for %s!", path::GetBaseNameTemp(filePath));
         return 1;
     }
-    if (!loadOnly) {
+    int exitCode = 0;
+    if (queries.size() > 0) {
+        if (!SearchDocument(engine, queries, searchOpts)) {
+            exitCode = 1;
+        }
+    } else if (profile) {
+        if (!ProfileDocument(engine, renderZoom)) {
+            exitCode = 1;
+        }
+    } else if (!loadOnly) {
         DumpData(engine, fullDump);
     }
     if (renderPath) {
@@ -559,5 +741,5 @@ int main(__unused int argc, __unused char** argv) {
     }
     delete engine;
 
-    return 0;
+    return exitCode;
 }
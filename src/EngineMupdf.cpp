@@ -1488,6 +1488,64 @@ static void fz_print_cb(void* user, const char* msg) {
     }
 }
 
+struct FitzParallelJob {
+    void (*task)(void* taskArg, int i) = nullptr;
+    void* taskArg = nullptr;
+    int count = 0;
+    LONG next = -1;
+    // workers (including the calling thread) that haven't finished yet
+    LONG pending = 1;
+    HANDLE done = nullptr;
+};
+
+static void FitzParallelWorker(FitzParallelJob* job) {
+    for (;;) {
+        int i = (int)InterlockedIncrement(&job->next);
+        if (i >= job->count) {
+            return;
+        }
+        job->task(job->taskArg, i);
+    }
+}
+
+static void CALLBACK FitzParallelCallback(PTP_CALLBACK_INSTANCE, void* data) {
+    FitzParallelJob* job = (FitzParallelJob*)data;
+    FitzParallelWorker(job);
+    if (InterlockedDecrement(&job->pending) == 0) {
+        SetEvent(job->done);
+    }
+}
+
+// runs tasks for mupdf (e.g. scanning a damaged file during repair) on up to
+// one thread per core, with the calling thread taking its share of the work.
+// the other workers come from the process thread pool, so that running a
+// batch doesn't cost creating and tearing down threads
+static void FitzRunParallel(void* arg, int count, void (*task)(void* taskArg, int i), void* taskArg) {
+    int nWorkers = std::min((int)(intptr_t)arg, count) - 1;
+    FitzParallelJob job;
+    job.task = task;
+    job.taskArg = taskArg;
+    job.count = count;
+
+    if (nWorkers > 0) {
+        job.done = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    }
+    for (int i = 0; job.done && i < nWorkers; i++) {
+        InterlockedIncrement(&job.pending);
+        if (!TrySubmitThreadpoolCallback(FitzParallelCallback, &job, nullptr)) {
+            InterlockedDecrement(&job.pending);
+            break;
+        }
+    }
+    FitzParallelWorker(&job);
+    if (InterlockedDecrement(&job.pending) != 0) {
+        WaitForSingleObject(job.done, INFINITE);
+    }
+    if (job.done) {
+        CloseHandle(job.done);
+    }
+}
+
 static void InstallFitzErrorCallbacks(fz_context* ctx) {
     fz_set_warning_callback(ctx, fz_print_cb, nullptr);
     fz_set_error_callback(ctx, fz_print_cb, nullptr);
@@ -1509,6 +1567,29 @@ EngineMupdf::EngineMupdf() {
     fz_locks_ctx.unlock = fz_unlock_context_cs;
     ctx = fz_new_context(nullptr, &fz_locks_ctx, FZ_STORE_DEFAULT);
     InstallFitzErrorCallbacks(ctx);
+    // prefer evicting cheap-to-decode images over e.g. big JPX/JBIG2 scans
+    // that would be expensive to decode again on scroll-back
+    fz_set_store_eviction_policy(ctx, fz_store_cost_benefit_score, nullptr);
+    // JPEG 2000 scans are slow to decode; let openjpeg use all cores
+    SYSTEM_INFO si{};
+    GetSystemInfo(&si);
+    fz_tune_jpx_threads(ctx, (int)si.dwNumberOfProcessors);
+    // logos and headers repeated as forms on every page are interpreted once
+    fz_tune_content_caching(ctx, 1);
+    // soft masks shared by many objects (and by all tiles of a page)
+    // are rendered once and reused from the store
+    fz_tune_mask_caching(ctx, 1);
+    // repairing large damaged files scans them for objects on all cores
+    fz_tune_parallel(ctx, FitzRunParallel, (void*)(intptr_t)si.dwNumberOfProcessors);
+    // tiles, transparency groups and soft masks of the same sizes are
+    // allocated over and over while scrolling; reuse their buffers
+    fz_set_pixmap_pool_size(ctx, 32 * 1024 * 1024);
+    // CAD drawings make and drop tens of thousands of paths per page;
+    // take them from a per-run arena instead of the heap
+    fz_tune_run_arena(ctx, 1);
+    // changing the font size of an EPUB lays it out again; reuse the
+    // shaping of words already seen instead of running HarfBuzz again
+    fz_tune_shape_caching(ctx, 8 * 1024 * 1024);
 
     pdf_install_load_system_font_funcs(ctx);
     fz_register_document_handlers(ctx);
@@ -1531,6 +1612,7 @@ EngineMupdf::~EngineMupdf() {
         if (pi->page) {
             fz_drop_page(ctx, pi->page);
         }
+        fz_drop_display_list(ctx, pi->cachedList);
     }
 
     fz_drop_outline(ctx, outline);
@@ -1553,6 +1635,7 @@ EngineMupdf::~EngineMupdf() {
     DeleteVecMembers(pages);
 
     str::Free(defaultExt);
+    str::Free(pageCacheDir);
     for (size_t i = 0; i < dimof(mutexes); i++) {
         LeaveCriticalSection(&mutexes[i]);
         DeleteCriticalSection(&mutexes[i]);
@@ -2716,6 +2799,88 @@ RectF EngineMupdf::Transform(const RectF& rect, int pageNo, float zoom, int rota
     return ToRectF(rect2);
 }
 
+// pages that take less than this to interpret (and draw) are not worth caching
+constexpr double kPageCacheMinInterpretMs = 30;
+
+// the display lists of other pages are read again from the page cache
+constexpr int kMaxCachedPageLists = 8;
+
+static char* PageCacheListPath(const char* pageCacheDir, int pageNo) {
+    return str::Format("%s\\%d.fzdl", pageCacheDir, pageNo);
+}
+
+// must be called within ctxAccess
+fz_display_list* EngineMupdf::LoadCachedPageList(int pageNo) {
+    AutoFreeStr path = PageCacheListPath(pageCacheDir, pageNo);
+    if (!file::Exists(path.Get())) {
+        return nullptr;
+    }
+    fz_display_list* list = nullptr;
+    fz_stream* stm = nullptr;
+
+    fz_var(list);
+    fz_var(stm);
+
+    fz_try(ctx) {
+        stm = fz_open_file(ctx, path);
+        list = fz_read_display_list(ctx, stm, pageCacheDir);
+    }
+    fz_always(ctx) {
+        fz_drop_stream(ctx, stm);
+    }
+    fz_catch(ctx) {
+        logf("LoadCachedPageList: '%s' failed with '%s'\n", path.Get(), fz_caught_message(ctx));
+        file::Delete(path);
+        list = nullptr;
+    }
+    return list;
+}
+
+// must be called within ctxAccess
+bool EngineMupdf::SaveCachedPageList(int pageNo, fz_display_list* list) {
+    AutoFreeStr path = PageCacheListPath(pageCacheDir, pageNo);
+    fz_output* out = nullptr;
+    bool ok = false;
+
+    fz_var(out);
+    fz_var(ok);
+
+    fz_try(ctx) {
+        out = fz_new_output_with_path(ctx, path, 0);
+        fz_write_display_list(ctx, out, list, pageCacheDir);
+        fz_close_output(ctx, out);
+        ok = true;
+    }
+    fz_always(ctx) {
+        fz_drop_output(ctx, out);
+    }
+    fz_catch(ctx) {
+        // e.g. Type 3 fonts can't be serialized
+        logf("SaveCachedPageList: page %d not cached: '%s'\n", pageNo, fz_caught_message(ctx));
+    }
+    if (!ok) {
+        file::Delete(path);
+    }
+    return ok;
+}
+
+// must be called within ctxAccess
+// keeps list as the page's cachedList, dropping the one of the least
+// recently viewed page if there are too many
+void EngineMupdf::KeepCachedPageList(FzPageInfo* pageInfo, fz_display_list* list) {
+    if (!pageInfo->cachedList) {
+        pageInfo->cachedList = fz_keep_display_list(ctx, list);
+    }
+    cachedListPages.Remove(pageInfo);
+    cachedListPages.Append(pageInfo);
+    if (cachedListPages.isize() > kMaxCachedPageLists) {
+        FzPageInfo* pi = cachedListPages[0];
+        cachedListPages.RemoveAt(0);
+        fz_drop_display_list(ctx, pi->cachedList);
+        pi->cachedList = nullptr;
+    }
+}
+
 RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     auto pageNo = args.pageNo;
 
@@ -2769,6 +2934,27 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     pdf_page* pdfpage = nullptr;
     fz_var(pdfpage);
     if (pdfdoc) {
+        // the display list of a page is only cached for viewing an unmodified document
+        bool usePageCache = pageCacheDir && args.target == RenderTarget::View && !modifiedAnnotations;
+        fz_display_list* list = nullptr;
+        fz_device* listDev = nullptr;
+        fz_device* teeDev = nullptr;
+        bool recordList = false;
+        double interpretMs = 0;
+        fz_var(list);
+        fz_var(listDev);
+        fz_var(teeDev);
+        if (usePageCache && pageInfo->cachedList) {
+            list = fz_keep_display_list(ctx, pageInfo->cachedList);
+        } else if (usePageCache && (!pageInfo->pageCacheChecked || pageInfo->inPageCache)) {
+            list = LoadCachedPageList(pageNo);
+            pageInfo->pageCacheChecked = list != nullptr;
+            pageInfo->inPageCache = list != nullptr;
+        }
+        if (list) {
+            KeepCachedPageList(pageInfo, list);
+        }
+        recordList = usePageCache && !list && !pageInfo->pageCacheChecked;
         fz_try(ctx) {
             pdfpage = pdf_page_from_fz_page(ctx, page);
             pix = fz_new_pixmap_with_bbox(ctx, csRgb, ibounds, nullptr, 1);
@@ -2776,20 +2962,47 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
             // TODO: in printing different style. old code use pdf_run_page_with_usage(), with usage ="View"
             // or "Print". "Export" is not used
             dev = fz_new_draw_device(ctx, ctm, pix);
-            pdf_run_page_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+            if (recordList) {
+                // draw the page and record it in a single interpretation
+                list = fz_new_display_list(ctx, fz_bound_page(ctx, page));
+                listDev = fz_new_list_device(ctx, list);
+                teeDev = fz_new_tee_device(ctx, dev, listDev);
+                auto timeStart = TimeGet();
+                pdf_run_page_with_usage(ctx, pdfpage, teeDev, fz_identity, usage, fzcookie);
+                fz_close_device(ctx, teeDev);
+                fz_close_device(ctx, listDev);
+                interpretMs = TimeSinceInMs(timeStart);
+            } else if (list) {
+                fz_run_display_list(ctx, list, dev, fz_identity, pRect, fzcookie);
+            } else {
+                pdf_run_page_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+            }
             bitmap = NewRenderedFzPixmap(ctx, pix);
             fz_close_device(ctx, dev);
         }
         fz_always(ctx) {
+            fz_drop_device(ctx, teeDev);
             if (dev) {
                 fz_drop_device(ctx, dev);
             }
+            fz_drop_device(ctx, listDev);
             fz_drop_pixmap(ctx, pix);
         }
         fz_catch(ctx) {
+            fz_drop_display_list(ctx, list);
             delete bitmap;
             return nullptr;
         }
+        // an aborted or broken interpretation leaves an incomplete list
+        bool listComplete = !fzcookie || (!fzcookie->abort && fzcookie->errors == 0);
+        if (recordList && listComplete) {
+            if (interpretMs >= kPageCacheMinInterpretMs && SaveCachedPageList(pageNo, list)) {
+                pageInfo->inPageCache = true;
+                KeepCachedPageList(pageInfo, list);
+            }
+            pageInfo->pageCacheChecked = true;
+        }
+        fz_drop_display_list(ctx, list);
     } else {
         fz_try(ctx) {
             pix = fz_new_pixmap_with_bbox(ctx, csRgb, ibounds, nullptr, 1);
@@ -3375,6 +3588,127 @@ bool EngineMupdfSaveUpdated(EngineBase* engine, std::string_view path,
             showErrorFunc(mupdfErr);
         }
     }
+    if (ok && epdf->pageCacheDir) {
+        // the cached display lists no longer match the saved file
+        ScopedCritSec scope(epdf->ctxAccess);
+        str::FreePtr(&epdf->pageCacheDir);
+        for (FzPageInfo* pi : epdf->pages) {
+            fz_drop_display_list(ctx, pi->cachedList);
+            pi->cachedList = nullptr;
+        }
+        epdf->cachedListPages.Reset();
+    }
+    return ok;
+}
+
+// nothing derived from the content of an encrypted document should be
+// written to disk (where it would be unencrypted)
+bool EngineMupdfIsEncrypted(EngineBase* engine) {
+    if (engine && engine->IsPasswordProtected()) {
+        return true;
+    }
+    // documents with only an owner password are encrypted as well
+    EngineMupdf* epdf = AsEngineMupdf(engine);
+    return epdf && epdf->pdfdoc && epdf->pdfdoc->crypt;
+}
+
+// the page cache in dir is emptied if it was made for a different version of the file
+void EngineMupdfSetPageCacheDir(EngineBase* engine, const char* dir) {
+    EngineMupdf* epdf = AsEngineMupdf(engine);
+    if (!epdf || !epdf->pdfdoc || EngineMupdfIsEncrypted(engine) || !dir || !engine->FileName()) {
+        return;
+    }
+    char* filePath = ToUtf8Temp(engine->FileName());
+    FILETIME modTime = file::GetModificationTime(filePath);
+    AutoFreeStr stamp = str::Format("%lld %u %u", (long long)file::GetSize(filePath), (uint)modTime.dwHighDateTime,
+                                    (uint)modTime.dwLowDateTime);
+    AutoFreeStr stampPath = path::Join(dir, "stamp.txt", nullptr);
+    AutoFree prevStamp = file::ReadFile(stampPath.Get());
+    if (!str::Eq(prevStamp.Get(), stamp.Get())) {
+        WCHAR* dirW = ToWstrTemp(dir);
+        dir::RemoveAll(dirW);
+        if (!dir::CreateAll(dirW)) {
+            return;
+        }
+        if (!file::WriteFile(stampPath.Get(), str::ToSpan(stamp.Get()))) {
+            return;
+        }
+    }
+
+    ScopedCritSec scope(epdf->ctxAccess);
+    str::ReplaceWithCopy(&epdf->pageCacheDir, dir);
+}
+
+// renders the page like RenderPage() but through a profile device and
+// appends the time and area per operation class (and per XObject) as JSON
+bool EngineMupdfProfilePage(EngineBase* engine, int pageNo, float zoom, str::Str& json) {
+    EngineMupdf* epdf = AsEngineMupdf(engine);
+    if (!epdf) {
+        return false;
+    }
+    FzPageInfo* pageInfo = epdf->GetFzPageInfo(pageNo, false);
+    if (!pageInfo || !pageInfo->page) {
+        return false;
+    }
+    fz_context* ctx = epdf->ctx;
+    fz_page* page = pageInfo->page;
+
+    ScopedCritSec cs(epdf->ctxAccess);
+
+    // the page is run with the view transform (rather than drawn with it)
+    // so that the profile device measures areas in pixels
+    fz_matrix ctm = epdf->viewctm(page, zoom, 0);
+    fz_irect bbox = fz_round_rect(fz_transform_rect(fz_bound_page(ctx, page), ctm));
+
+    fz_pixmap* pix = nullptr;
+    fz_device* draw = nullptr;
+    fz_device* dev = nullptr;
+    fz_buffer* buf = nullptr;
+    fz_output* out = nullptr;
+    bool ok = false;
+    // replaying cached forms, pattern cells and soft masks would be timed
+    // instead of interpreting them
+    int contentCaching = fz_content_caching(ctx);
+    int maskCaching = fz_mask_caching(ctx);
+    fz_tune_content_caching(ctx, 0);
+    fz_tune_mask_caching(ctx, 0);
+
+    fz_var(pix);
+    fz_var(draw);
+    fz_var(dev);
+    fz_var(buf);
+    fz_var(out);
+    fz_var(ok);
+
+    fz_try(ctx) {
+        pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), bbox, nullptr, 1);
+        fz_clear_pixmap_with_value(ctx, pix, 0xff);
+        draw = fz_new_draw_device(ctx, fz_identity, pix);
+        dev = fz_new_profile_device(ctx, draw);
+        fz_run_page(ctx, page, dev, ctm, nullptr);
+        fz_close_device(ctx, dev);
+        fz_close_device(ctx, draw);
+
+        buf = fz_new_buffer(ctx, 1024);
+        out = fz_new_output_with_buffer(ctx, buf);
+        fz_write_profile_json(ctx, dev, out);
+        fz_close_output(ctx, out);
+        json.Append((const char*)buf->data, buf->len);
+        ok = true;
+    }
+    fz_always(ctx) {
+        fz_drop_output(ctx, out);
+        fz_drop_buffer(ctx, buf);
+        fz_drop_device(ctx, dev);
+        fz_drop_device(ctx, draw);
+        fz_drop_pixmap(ctx, pix);
+        fz_tune_content_caching(ctx, contentCaching);
+        fz_tune_mask_caching(ctx, maskCaching);
+    }
+    fz_catch(ctx) {
+        logf("EngineMupdfProfilePage: page %d failed with '%s'\n", pageNo, fz_caught_message(ctx));
+        ok = false;
+    }
     return ok;
 }
 
@@ -37,6 +37,14 @@ struct FzPageInfo {
     bool fullyLoaded = false;
 
     bool commentsNeedRebuilding = true;
+
+    // true once we know if the page's display list is in the page cache
+    bool pageCacheChecked = false;
+    // true if it is
+    bool inPageCache = false;
+    // the display list read from (or written to) the page cache, kept for
+    // the few most recently viewed pages (see EngineMupdf::cachedListPages)
+    fz_display_list* cachedList = nullptr;
 };
 
 class EngineMupdf : public EngineBase {
@@ -101,6 +109,12 @@ class EngineMupdf : public EngineBase {
     // the same annotation, we should be back to 0
     bool modifiedAnnotations = false;
 
+    // directory with display lists of pages that were slow to interpret,
+    // so that re-opening the document can skip interpreting them
+    char* pageCacheDir = nullptr;
+    // pages with a cachedList, the least recently viewed first
+    Vec<FzPageInfo*> cachedListPages;
+
     bool Load(const WCHAR* filePath, PasswordUI* pwdUI = nullptr);
     bool Load(IStream* stream, const char* nameHint, PasswordUI* pwdUI = nullptr);
     // TODO(port): fz_stream can no-longer be re-opened (fz_clone_stream)
@@ -118,6 +132,10 @@ class EngineMupdf : public EngineBase {
 
     ByteSlice LoadStreamFromPDFFile(const WCHAR* filePath);
     void InvalideAnnotationsForPage(int pageNo);
+
+    fz_display_list* LoadCachedPageList(int pageNo);
+    bool SaveCachedPageList(int pageNo, fz_display_list* list);
+    void KeepCachedPageList(FzPageInfo* pageInfo, fz_display_list* list);
 };
 
 EngineMupdf* AsEngineMupdf(EngineBase* engine);
@@ -16,25 +16,34 @@
 #include "FileThumbnails.h"
 
 constexpr const char* kThumbnailsDirName = "sumatrapdfcache";
-constexpr const char* kPngExt = "*.png";
-
-static char* GetThumbnailPathTemp(const char* filePath) {
+constexpr const char* kPngExt = ".png";
+// display lists of pages, in a sub-directory per file
+constexpr const char* kPageCacheDirName = "sumatrapdfcache\\pages";
+// text of the pages and its search index, in a file per file
+constexpr const char* kTextIndexDirName = "sumatrapdfcache\\text";
+constexpr const char* kTextIndexExt = ".idx";
+
+static char* GetFingerprint(const char* filePath) {
     // create a fingerprint of a (normalized) path for the file name
     // I'd have liked to also include the file's last modification time
     // in the fingerprint (much quicker than hashing the entire file's
     // content), but that's too expensive for files on slow drives
     u8 digest[16]{};
-    // TODO: why is this happening? Seen in crash reports e.g. 35043
-    if (!filePath) {
-        return nullptr;
-    }
     if (path::HasVariableDriveLetter(filePath)) {
         // ignore the drive letter, if it might change
         char* tmp = (char*)filePath;
         tmp[0] = '?';
     }
     CalcMD5Digest((u8*)filePath, str::Len(filePath), digest);
-    AutoFree fingerPrint(_MemToHex(&digest));
+    return _MemToHex(&digest);
+}
+
+static char* GetThumbnailPathTemp(const char* filePath) {
+    // TODO: why is this happening? Seen in crash reports e.g. 35043
+    if (!filePath) {
+        return nullptr;
+    }
+    AutoFree fingerPrint(GetFingerprint(filePath));
 
     char* thumbsPath = AppGenDataFilenameTemp(kThumbnailsDirName);
     if (!thumbsPath) {
@@ -47,12 +56,51 @@ static char* GetThumbnailPathTemp(const char* filePath) {
     return res;
 }
 
-// removes thumbnails that don't belong to any frequently used item in file history
-void CleanUpThumbnailCache(const FileHistory& fileHistory) {
-    char* thumbsPath = AppGenDataFilenameTemp(kThumbnailsDirName);
-    AutoFreeStr pattern(path::Join(thumbsPath, kPngExt, nullptr));
+char* GetPageCacheDirTemp(const char* filePath) {
+    if (!filePath) {
+        return nullptr;
+    }
+    AutoFree fingerPrint(GetFingerprint(filePath));
+
+    char* pagesPath = AppGenDataFilenameTemp(kPageCacheDirName);
+    if (!pagesPath) {
+        return nullptr;
+    }
+
+    char* tmp = path::Join(pagesPath, fingerPrint.Get(), nullptr);
+    char* res = str::DupTemp(tmp);
+    str::Free(tmp);
+    return res;
+}
+
+char* GetTextIndexPathTemp(const char* filePath) {
+    if (!filePath) {
+        return nullptr;
+    }
+    AutoFree fingerPrint(GetFingerprint(filePath));
+
+    char* textPath = AppGenDataFilenameTemp(kTextIndexDirName);
+    if (!textPath) {
+        return nullptr;
+    }
 
-    WStrVec files;
+    char* tmp = str::Format(R"(%s\%s.idx)", textPath, fingerPrint.Get());
+    char* res = str::DupTemp(tmp);
+    str::Free(tmp);
+    return res;
+}
+
+// removes the entries of a cache directory that don't belong to any frequently
+// used item in file history. the entries are named after the fingerprint of
+// the file's path followed by ext, or are directories named after it if ext is null
+static void CleanUpCache(const FileHistory& fileHistory, const char* cacheDirName, const char* ext) {
+    char* cachePath = AppGenDataFilenameTemp(cacheDirName);
+    if (!cachePath) {
+        return;
+    }
+    AutoFreeStr pattern(str::Format(R"(%s\*%s)", cachePath, ext ? ext : ""));
+
+    WStrVec names;
     WIN32_FIND_DATA fdata;
 
     WCHAR* pw = ToWstrTemp(pattern);
@@ -61,13 +109,15 @@ void CleanUpThumbnailCache(const FileHistory& fileHistory) {
         return;
     }
     do {
-        if (!(fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
-            files.Append(str::Dup(fdata.cFileName));
+        bool isDir = fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+        bool isDotDir = str::Eq(fdata.cFileName, L".") || str::Eq(fdata.cFileName, L"..");
+        if (ext ? !isDir : (isDir && !isDotDir)) {
+            names.Append(str::Dup(fdata.cFileName));
         }
     } while (FindNextFile(hfind, &fdata));
     FindClose(hfind);
 
-    // remove files that should not be deleted
+    // remove entries that should not be deleted
     Vec<FileState*> list;
     fileHistory.GetFrequencyOrder(list);
     int n = 0;
@@ -75,27 +125,38 @@ void CleanUpThumbnailCache(const FileHistory& fileHistory) {
         if (n++ > kFileHistoryMaxFrequent * 2) {
             break;
         }
-        char* bmpPath = GetThumbnailPathTemp(fs->filePath);
-        if (!bmpPath) {
+        if (!fs->filePath) {
             continue;
         }
-        WCHAR* fileName = ToWstrTemp(path::GetBaseNameTemp(bmpPath));
-        int idx = files.Find(fileName);
+        AutoFree fingerPrint(GetFingerprint(fs->filePath));
+        AutoFreeStr name(str::Format("%s%s", fingerPrint.Get(), ext ? ext : ""));
+        int idx = names.Find(ToWstrTemp(name));
         if (idx < 0) {
             continue;
         }
-        WCHAR* path = files.PopAt(idx);
-        str::Free(path);
+        WCHAR* nameW = names.PopAt(idx);
+        str::Free(nameW);
     }
 
-    for (auto& pathW : files) {
-        char* pathA = ToUtf8Temp(pathW);
-        char* bmpPath = path::Join(thumbsPath, pathA, nullptr);
-        file::Delete(bmpPath);
-        str::Free(bmpPath);
+    for (auto& nameW : names) {
+        char* nameA = ToUtf8Temp(nameW);
+        AutoFreeStr entryPath(path::Join(cachePath, nameA, nullptr));
+        if (ext) {
+            file::Delete(entryPath);
+        } else {
+            dir::RemoveAll(ToWstrTemp(entryPath));
+        }
     }
 }
 
+// removes thumbnails (and cached pages and text) that don't belong to any
+// frequently used item in file history
+void CleanUpThumbnailCache(const FileHistory& fileHistory) {
+    CleanUpCache(fileHistory, kThumbnailsDirName, kPngExt);
+    CleanUpCache(fileHistory, kPageCacheDirName, nullptr);
+    CleanUpCache(fileHistory, kTextIndexDirName, kTextIndexExt);
+}
+
 bool LoadThumbnail(FileState& ds) {
     delete ds.thumbnail;
     ds.thumbnail = nullptr;
@@ -13,3 +13,8 @@ bool HasThumbnail(FileState& ds);
 void SetThumbnail(FileState* ds, RenderedBitmap* bmp);
 void SaveThumbnail(FileState& ds);
 void RemoveThumbnail(FileState& ds);
+
+// directory for caching display lists of pages of filePath
+char* GetPageCacheDirTemp(const char* filePath);
+// file for persisting the text index of filePath (see DocumentTextCache::SetIndexPath)
+char* GetTextIndexPathTemp(const char* filePath);
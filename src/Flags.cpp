@@ -228,6 +228,24 @@ static void ParseScrollValue(Point* scroll, const WCHAR* txt) {
     V(N, "n")                                    \
     V(Render, "render")                          \
     V(ExtractText, "extract-text")               \
+    V(TestJpxThreads, "test-jpx-threads")        \
+    V(BenchPageDecode, "bench-page-decode")      \
+    V(BenchLexer, "bench-lexer")                 \
+    V(TestObjStm, "test-obj-stm")                \
+    V(BenchObjStm, "bench-obj-stm")              \
+    V(BenchDictLookup, "bench-dict-lookup")      \
+    V(BenchRunArena, "bench-run-arena")          \
+    V(TestListSerialize, "test-list-serialize")  \
+    V(BenchListReplay, "bench-list-replay")      \
+    V(BenchShapeCache, "bench-shape-cache")      \
+    V(BenchSearch, "bench-search")               \
+    V(BenchTextScan, "bench-text-scan")          \
+    V(BenchFindAll, "bench-find-all")            \
+    V(BenchHitTest, "bench-hit-test")            \
+    V(BenchTextCache, "bench-text-cache")        \
+    V(BenchRegex, "bench-regex")                 \
+    V(BenchFoldText, "bench-fold-text")          \
+    V(BenchTextIndex, "bench-text-index")        \
     V(Bench, "bench")                            \
     V(Dir, "d")                                  \
     V(InstallDir, "install-dir")                 \
@@ -395,6 +413,74 @@ void ParseFlags(const WCHAR* cmdLine, Flags& i) {
             i.reuseDdeInstance = true;
             continue;
         }
+        if (arg == Arg::BenchPageDecode) {
+            i.benchPageDecode = true;
+            continue;
+        }
+        if (arg == Arg::BenchLexer) {
+            i.benchLexer = true;
+            continue;
+        }
+        if (arg == Arg::TestObjStm) {
+            i.testObjStm = true;
+            continue;
+        }
+        if (arg == Arg::BenchObjStm) {
+            i.benchObjStm = true;
+            continue;
+        }
+        if (arg == Arg::BenchDictLookup) {
+            i.benchDictLookup = true;
+            continue;
+        }
+        if (arg == Arg::BenchRunArena) {
+            i.benchRunArena = true;
+            continue;
+        }
+        if (arg == Arg::TestListSerialize) {
+            i.testListSerialize = true;
+            continue;
+        }
+        if (arg == Arg::BenchListReplay) {
+            i.benchListReplay = true;
+            continue;
+        }
+        if (arg == Arg::BenchShapeCache) {
+            i.benchShapeCache = true;
+            continue;
+        }
+        if (arg == Arg::BenchSearch) {
+            i.benchSearch = true;
+            continue;
+        }
+        if (arg == Arg::BenchTextScan) {
+            i.benchTextScan = true;
+            continue;
+        }
+        if (arg == Arg::BenchFindAll) {
+            i.benchFindAll = true;
+            continue;
+        }
+        if (arg == Arg::BenchHitTest) {
+            i.benchHitTest = true;
+            continue;
+        }
+        if (arg == Arg::BenchTextCache) {
+            i.benchTextCache = true;
+            continue;
+        }
+        if (arg == Arg::BenchRegex) {
+            i.benchRegex = true;
+            continue;
+        }
+        if (arg == Arg::BenchFoldText) {
+            i.benchFoldText = true;
+            continue;
+        }
+        if (arg == Arg::BenchTextIndex) {
+            i.benchTextIndex = true;
+            continue;
+        }
         if (arg == Arg::EscToExit) {
             i.globalPrefArgs.Append(str::Dup(argName));
             continue;
@@ -524,6 +610,10 @@ void ParseFlags(const WCHAR* cmdLine, Flags& i) {
             i.pageNumber = paramInt;
             continue;
         }
+        if (arg == Arg::TestJpxThreads) {
+            i.testJpxThreads = paramInt;
+            continue;
+        }
         if (arg == Arg::Bench) {
             i.pathsToBenchmark.Append(str::Dup(param));
             const WCHAR* s = args.AdditionalParam(1);
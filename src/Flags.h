@@ -57,6 +57,25 @@ struct Flags {
     // related to testing
     bool testRenderPage = false;
     bool testExtractPage = false;
+    // number of threads to compare JPX decoding against single-threaded decoding
+    int testJpxThreads = 0;
+    bool benchPageDecode = false;
+    bool benchLexer = false;
+    bool testObjStm = false;
+    bool benchObjStm = false;
+    bool benchDictLookup = false;
+    bool benchRunArena = false;
+    bool testListSerialize = false;
+    bool benchListReplay = false;
+    bool benchShapeCache = false;
+    bool benchSearch = false;
+    bool benchTextScan = false;
+    bool benchFindAll = false;
+    bool benchHitTest = false;
+    bool benchTextCache = false;
+    bool benchRegex = false;
+    bool benchFoldText = false;
+    bool benchTextIndex = false;
     int testPageNo = 0;
     bool testApp = false;
 
@@ -0,0 +1,481 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+extern "C" {
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+}
+
+#include "utils/BaseUtil.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+// the value of key in dict, found by going through all entries
+static pdf_obj* DictScan(fz_context* ctx, pdf_obj* dict, const char* key) {
+    int n = pdf_dict_len(ctx, dict);
+    for (int i = 0; i < n; i++) {
+        if (str::Eq(pdf_to_name(ctx, pdf_dict_get_key(ctx, dict, i)), key)) {
+            return pdf_dict_get_val(ctx, dict, i);
+        }
+    }
+    return nullptr;
+}
+
+static bool DictIsSorted(fz_context* ctx, pdf_obj* dict) {
+    int n = pdf_dict_len(ctx, dict);
+    for (int i = 1; i < n; i++) {
+        const char* prev = pdf_to_name(ctx, pdf_dict_get_key(ctx, dict, i - 1));
+        if (strcmp(prev, pdf_to_name(ctx, pdf_dict_get_key(ctx, dict, i))) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// keys of dicts with more than PDF_DICT_HASH_MIN entries are looked up in a
+// hash index, which puts and deletes (also into sorted dicts) keep up to date
+static void DictHashTest(fz_context* ctx) {
+    // a mix of standard names (which are looked up as constants) and others
+    const char* names[] = {"Type", "Subtype", "Length", "Font", "XObject", "Resources", "Contents", "Filter", "Width"};
+    constexpr int kKeys = 400;
+    char keys[kKeys][16];
+    for (int i = 0; i < kKeys; i++) {
+        if (i < (int)dimof(names)) {
+            str::BufSet(keys[i], dimof(keys[i]), names[i]);
+        } else {
+            str::BufFmt(keys[i], dimof(keys[i]), "K%d", i);
+        }
+    }
+
+    pdf_obj* dict = pdf_new_dict(ctx, nullptr, 4);
+    srand(1);
+    for (int round = 0; round < 3; round++) {
+        // the second round only inserts into a sorted dict (deleting
+        // an entry leaves the dict unsorted)
+        if (round == 1) {
+            pdf_sort_dict(ctx, dict);
+        }
+        for (int op = 0; op < 4000; op++) {
+            const char* key = keys[rand() % kKeys];
+            int what = round == 1 ? rand() % 4 : rand() % 8;
+            if (what < 4) {
+                pdf_obj* val = pdf_new_int(ctx, op);
+                pdf_dict_puts(ctx, dict, key, val);
+                pdf_drop_obj(ctx, val);
+            } else if (what < 6) {
+                pdf_dict_dels(ctx, dict, key);
+            } else {
+                pdf_obj* name = pdf_new_name(ctx, key);
+                utassert(pdf_dict_get(ctx, dict, name) == DictScan(ctx, dict, key));
+                pdf_drop_obj(ctx, name);
+            }
+            // the index is only built once a lookup needs it
+            utassert(pdf_dict_gets(ctx, dict, key) == DictScan(ctx, dict, key));
+        }
+        utassert(pdf_dict_len(ctx, dict) > 64);
+        for (int i = 0; i < kKeys; i++) {
+            utassert(pdf_dict_gets(ctx, dict, keys[i]) == DictScan(ctx, dict, keys[i]));
+        }
+        if (round == 1) {
+            utassert(DictIsSorted(ctx, dict));
+        }
+    }
+    pdf_drop_obj(ctx, dict);
+
+    // a sorted dict whose last key is a standard name
+    dict = pdf_new_dict(ctx, nullptr, 4);
+    pdf_dict_puts(ctx, dict, "A", PDF_TRUE);
+    pdf_dict_puts(ctx, dict, "Width", PDF_TRUE);
+    pdf_sort_dict(ctx, dict);
+    pdf_dict_puts(ctx, dict, "Width", PDF_FALSE);
+    utassert(pdf_dict_len(ctx, dict) == 2);
+    utassert(pdf_dict_gets(ctx, dict, "Width") == PDF_FALSE);
+    pdf_drop_obj(ctx, dict);
+}
+
+static fz_pixmap_pool_stats PoolStats(fz_context* ctx) {
+    fz_pixmap_pool_stats stats;
+    fz_get_pixmap_pool_stats(ctx, &stats);
+    return stats;
+}
+
+// sample buffers of dropped pixmaps are kept in the pixmap pool for reuse
+static void PixmapPoolTest(fz_context* ctx) {
+    fz_colorspace* gray = fz_device_gray(ctx);
+
+    // the pool is disabled by default
+    fz_pixmap* pix = fz_new_pixmap(ctx, gray, 512, 512, nullptr, 0);
+    fz_drop_pixmap(ctx, pix);
+    fz_pixmap_pool_stats stats = PoolStats(ctx);
+    utassert(stats.max == 0 && stats.count == 0 && stats.returned == 0);
+
+    fz_set_pixmap_pool_size(ctx, 4 << 20);
+    pix = fz_new_pixmap(ctx, gray, 512, 512, nullptr, 0);
+    u8* samples = pix->samples;
+    utassert(PoolStats(ctx).misses == 1);
+    fz_drop_pixmap(ctx, pix);
+    stats = PoolStats(ctx);
+    utassert(stats.returned == 1 && stats.count == 1 && stats.size >= 512 * 512);
+
+    // a pixmap of a slightly different size gets the same buffer
+    pix = fz_new_pixmap(ctx, gray, 500, 520, nullptr, 0);
+    utassert(pix->samples == samples);
+    stats = PoolStats(ctx);
+    utassert(stats.hits == 1 && stats.count == 0 && stats.size == 0);
+    fz_drop_pixmap(ctx, pix);
+
+    // small buffers and the ones pixmaps don't own aren't pooled
+    pix = fz_new_pixmap(ctx, gray, 100, 100, nullptr, 0);
+    fz_drop_pixmap(ctx, pix);
+    u8* data = (u8*)fz_malloc(ctx, 512 * 512);
+    pix = fz_new_pixmap_with_data(ctx, gray, 512, 512, nullptr, 0, 512, data);
+    fz_drop_pixmap(ctx, pix);
+    fz_free(ctx, data);
+    stats = PoolStats(ctx);
+    utassert(stats.hits == 1 && stats.misses == 1 && stats.returned == 2);
+
+    // the least recently returned buffers are evicted to make space
+    fz_pixmap* pixs[8];
+    for (fz_pixmap*& p : pixs) {
+        p = fz_new_pixmap(ctx, gray, 1024, 1024, nullptr, 0);
+    }
+    samples = pixs[7]->samples;
+    for (fz_pixmap* p : pixs) {
+        fz_drop_pixmap(ctx, p);
+    }
+    stats = PoolStats(ctx);
+    utassert(stats.size <= stats.max && stats.count == 3 && stats.evicted == 6);
+    pix = fz_new_pixmap(ctx, gray, 1024, 1024, nullptr, 0);
+    utassert(pix->samples == samples);
+
+    // buffers too large for a shrunk pool are freed when returned
+    fz_set_pixmap_pool_size(ctx, 1 << 20);
+    fz_drop_pixmap(ctx, pix);
+    stats = PoolStats(ctx);
+    utassert(stats.discarded == 1 && stats.count == 0);
+
+    pix = fz_new_pixmap(ctx, gray, 512, 512, nullptr, 0);
+    fz_drop_pixmap(ctx, pix);
+    utassert(PoolStats(ctx).count == 1);
+    fz_empty_pixmap_pool(ctx);
+    stats = PoolStats(ctx);
+    utassert(stats.count == 0 && stats.size == 0);
+    fz_set_pixmap_pool_size(ctx, 0);
+}
+
+// records filled and stroked paths and text into a display list, the way
+// running a page does (i.e. from the run arena, if enabled)
+static fz_display_list* RecordShapes(fz_context* ctx, fz_font* font, float offset) {
+    fz_rect bounds = fz_make_rect(0, 0, 200, 200);
+    fz_display_list* list = fz_new_display_list(ctx, bounds);
+    fz_device* dev = fz_new_list_device(ctx, list);
+    float red[3] = {1, 0, 0};
+    float blue[3] = {0, 0, 1};
+    fz_colorspace* rgb = fz_device_rgb(ctx);
+
+    fz_begin_run_arena(ctx);
+    for (int i = 0; i < 20; i++) {
+        fz_path* path = fz_new_path(ctx);
+        fz_moveto(ctx, path, offset + i * 8, 10);
+        fz_lineto(ctx, path, offset + i * 8 + 6, 60 + i * 4);
+        fz_lineto(ctx, path, offset + i * 3, 90);
+        fz_closepath(ctx, path);
+        fz_fill_path(ctx, dev, path, 0, fz_identity, rgb, red, 1, fz_default_color_params);
+
+        fz_stroke_state* stroke = fz_new_stroke_state_with_dash_len(ctx, 2);
+        stroke->linewidth = 1.0f + (i % 3);
+        stroke->dash_len = 2;
+        stroke->dash_list[0] = 3;
+        stroke->dash_list[1] = 2.0f + (i % 4);
+        fz_stroke_path(ctx, dev, path, stroke, fz_identity, rgb, blue, 1, fz_default_color_params);
+
+        fz_text* text = fz_new_text(ctx);
+        fz_show_string(ctx, text, font, fz_scale(10, -10), "Arena", 0, 0, FZ_BIDI_LTR, FZ_LANG_UNSET);
+        fz_matrix ctm = fz_translate(offset + 10, 110 + i * 4);
+        fz_fill_text(ctx, dev, text, ctm, rgb, red, 1, fz_default_color_params);
+        fz_stroke_text(ctx, dev, text, stroke, fz_pre_translate(ctm, 60, 0), rgb, blue, 1, fz_default_color_params);
+
+        fz_drop_text(ctx, text);
+        fz_drop_stroke_state(ctx, stroke);
+        fz_drop_path(ctx, path);
+    }
+    fz_end_run_arena(ctx);
+
+    fz_close_device(ctx, dev);
+    fz_drop_device(ctx, dev);
+    return list;
+}
+
+static fz_pixmap* RenderList(fz_context* ctx, fz_display_list* list) {
+    fz_pixmap* pix = fz_new_pixmap(ctx, fz_device_rgb(ctx), 200, 200, nullptr, 0);
+    fz_clear_pixmap_with_value(ctx, pix, 0xff);
+    fz_device* dev = fz_new_draw_device(ctx, fz_identity, pix);
+    fz_run_display_list(ctx, list, dev, fz_identity, fz_infinite_rect, nullptr);
+    fz_close_device(ctx, dev);
+    fz_drop_device(ctx, dev);
+    return pix;
+}
+
+// paths, texts and stroke states made while running a page come from an
+// arena, and those kept by a display list must outlive it
+static void RunArenaTest(fz_context* ctx) {
+    fz_font* font = fz_new_base14_font(ctx, "Helvetica");
+
+    fz_display_list* list = RecordShapes(ctx, font, 0);
+    fz_pixmap* expected = RenderList(ctx, list);
+    fz_drop_display_list(ctx, list);
+
+    fz_tune_run_arena(ctx, 1);
+    list = RecordShapes(ctx, font, 0);
+    // the memory of the first arena is likely to be reused by the next one
+    fz_drop_display_list(ctx, RecordShapes(ctx, font, 50));
+    fz_pixmap* pix = RenderList(ctx, list);
+    fz_tune_run_arena(ctx, 0);
+
+    size_t size = (size_t)pix->stride * pix->h;
+    utassert(memcmp(pix->samples, expected->samples, size) == 0);
+    // and something has been drawn at all
+    utassert(memchr(pix->samples, 0, size) != nullptr);
+
+    fz_drop_pixmap(ctx, pix);
+    fz_drop_pixmap(ctx, expected);
+    fz_drop_display_list(ctx, list);
+    fz_drop_font(ctx, font);
+}
+
+static fz_pixmap* RenderHtml(fz_context* ctx, fz_document* doc, float em) {
+    fz_layout_document(ctx, doc, 300, 400, em);
+    fz_page* page = fz_load_page(ctx, doc, 0);
+    fz_pixmap* pix = fz_new_pixmap_from_page(ctx, page, fz_identity, fz_device_rgb(ctx), 0);
+    fz_drop_page(ctx, page);
+    return pix;
+}
+
+static bool PixmapsEqual(fz_pixmap* a, fz_pixmap* b) {
+    return a->w == b->w && a->h == b->h && a->n == b->n &&
+           memcmp(a->samples, b->samples, (size_t)a->stride * a->h) == 0;
+}
+
+// results of shaping runs of text are kept in a cache shared by all fonts
+// with the same data, and reused when laying text out again at any size
+static void ShapeCacheTest(fz_context* ctx) {
+    fz_font* times = fz_new_base14_font(ctx, "Times-Roman");
+    fz_font* helv = fz_new_base14_font(ctx, "Helvetica");
+    char value[1000];
+    char found[sizeof(value)];
+    memset(value, 'v', sizeof(value));
+
+    // disabled by default
+    fz_store_shaped_text(ctx, times, 0, "word", 4, value, sizeof(value));
+    utassert(fz_find_shaped_text(ctx, times, 0, "word", 4, found, sizeof(found)) == 0);
+
+    fz_tune_shape_caching(ctx, 64 * 1024);
+    fz_store_shaped_text(ctx, times, 0, "word", 4, value, sizeof(value));
+    utassert(fz_find_shaped_text(ctx, times, 0, "word", 4, found, sizeof(found)) == sizeof(value));
+    utassert(memcmp(found, value, sizeof(value)) == 0);
+    // the result doesn't fit
+    utassert(fz_find_shaped_text(ctx, times, 0, "word", 4, found, 10) == sizeof(value));
+    // everything else is part of the key
+    utassert(fz_find_shaped_text(ctx, times, 1, "word", 4, found, sizeof(found)) == 0);
+    utassert(fz_find_shaped_text(ctx, times, 0, "word", 3, found, sizeof(found)) == 0);
+    utassert(fz_find_shaped_text(ctx, times, 0, "ward", 4, found, sizeof(found)) == 0);
+    utassert(fz_find_shaped_text(ctx, helv, 0, "word", 4, found, sizeof(found)) == 0);
+
+    // the least recently used results are evicted
+    char text[32];
+    for (int i = 0; i < 200; i++) {
+        str::BufFmt(text, dimof(text), "word%d", i);
+        value[0] = (char)i;
+        fz_store_shaped_text(ctx, times, 0, text, str::Len(text), value, sizeof(value));
+        utassert(fz_find_shaped_text(ctx, times, 0, "word", 4, found, sizeof(found)) == sizeof(value));
+    }
+    fz_shape_cache_stats stats;
+    fz_read_shape_cache_stats(ctx, &stats);
+    utassert(stats.evicted > 0 && stats.size <= stats.max_size && stats.count < 200);
+    utassert(fz_find_shaped_text(ctx, times, 0, "word0", 5, found, sizeof(found)) == 0);
+    utassert(fz_find_shaped_text(ctx, times, 0, "word199", 7, found, sizeof(found)) == sizeof(value));
+    utassert(found[0] == (char)199);
+
+    fz_purge_shape_cache(ctx);
+    fz_read_shape_cache_stats(ctx, &stats);
+    utassert(stats.count == 0 && stats.size == 0);
+    utassert(fz_find_shaped_text(ctx, times, 0, "word", 4, found, sizeof(found)) == 0);
+    fz_drop_font(ctx, helv);
+    fz_drop_font(ctx, times);
+
+    // laying out with cached results gives the same pages
+    const char* html =
+        "<p>The office staff efficiently shuffled the affable waffles. "
+        "The office staff efficiently shuffled the affable waffles.</p>"
+        "<p><i>The office staff</i> <b>efficiently shuffled</b> <tt>the affable waffles.</tt></p>";
+    fz_buffer* buf = fz_new_buffer_from_copied_data(ctx, (const u8*)html, str::Len(html));
+    fz_stream* stm = fz_open_buffer(ctx, buf);
+    fz_document* doc = fz_open_document_with_stream(ctx, "text/html", stm);
+    fz_tune_shape_caching(ctx, 0);
+    fz_pixmap* expected12 = RenderHtml(ctx, doc, 12);
+    fz_pixmap* expected17 = RenderHtml(ctx, doc, 17);
+    fz_tune_shape_caching(ctx, 1024 * 1024);
+    fz_pixmap* pix12 = RenderHtml(ctx, doc, 12);
+    fz_pixmap* pix17 = RenderHtml(ctx, doc, 17);
+    fz_read_shape_cache_stats(ctx, &stats);
+    utassert(stats.hits > 0 && stats.count > 0);
+    utassert(PixmapsEqual(pix12, expected12));
+    utassert(PixmapsEqual(pix17, expected17));
+    utassert(!PixmapsEqual(pix12, pix17));
+    fz_tune_shape_caching(ctx, 0);
+
+    fz_drop_pixmap(ctx, pix17);
+    fz_drop_pixmap(ctx, pix12);
+    fz_drop_pixmap(ctx, expected17);
+    fz_drop_pixmap(ctx, expected12);
+    fz_drop_document(ctx, doc);
+    fz_drop_stream(ctx, stm);
+    fz_drop_buffer(ctx, buf);
+}
+
+// a PDF document made of the given objects, numbered from 1 (the first being the catalog)
+static fz_document* OpenPdfObjects(fz_context* ctx, const char** objs, int nObjs) {
+    fz_buffer* buf = fz_new_buffer(ctx, 1024);
+    int* offsets = AllocArray<int>(nObjs);
+    fz_append_string(ctx, buf, "%PDF-1.4\n");
+    for (int i = 0; i < nObjs; i++) {
+        offsets[i] = (int)buf->len;
+        fz_append_printf(ctx, buf, "%d 0 obj\n%s\nendobj\n", i + 1, objs[i]);
+    }
+    int xref = (int)buf->len;
+    fz_append_printf(ctx, buf, "xref\n0 %d\n0000000000 65535 f \n", nObjs + 1);
+    for (int i = 0; i < nObjs; i++) {
+        fz_append_printf(ctx, buf, "%010d 00000 n \n", offsets[i]);
+    }
+    fz_append_printf(ctx, buf, "trailer\n<< /Size %d /Root 1 0 R >>\nstartxref\n%d\n%%%%EOF\n", nObjs + 1, xref);
+    free(offsets);
+    fz_stream* stm = fz_open_buffer(ctx, buf);
+    fz_document* doc = fz_open_document_with_stream(ctx, "application/pdf", stm);
+    fz_drop_stream(ctx, stm);
+    fz_drop_buffer(ctx, buf);
+    return doc;
+}
+
+// forms without resources of their own run with those of the page, and
+// their cached recordings are only replayed on pages with the same ones
+static void FormResourcesTest(fz_context* ctx) {
+    const char* objs[] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [3 0 R 4 0 R] /Count 2 >>",
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 200 60] /Contents 5 0 R "
+        "/Resources << /Font << /F1 6 0 R >> /XObject << /X 8 0 R >> >> >>",
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 200 60] /Contents 5 0 R "
+        "/Resources << /Font << /F1 7 0 R >> /XObject << /X 8 0 R >> >> >>",
+        "<< /Length 5 >>\nstream\n/X Do\nendstream",
+        "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>",
+        "<< /Type /Font /Subtype /Type1 /BaseFont /Courier >>",
+        "<< /Type /XObject /Subtype /Form /BBox [0 0 200 60] /Length 35 >>\n"
+        "stream\nBT /F1 24 Tf 10 20 Td (Hello) Tj ET\nendstream",
+    };
+    fz_document* doc = OpenPdfObjects(ctx, objs, (int)dimof(objs));
+
+    fz_tune_content_caching(ctx, 0);
+    fz_pixmap* expected1 = fz_new_pixmap_from_page_number(ctx, doc, 0, fz_identity, fz_device_rgb(ctx), 0);
+    fz_pixmap* expected2 = fz_new_pixmap_from_page_number(ctx, doc, 1, fz_identity, fz_device_rgb(ctx), 0);
+    utassert(!PixmapsEqual(expected1, expected2));
+
+    fz_tune_content_caching(ctx, 1);
+    for (int round = 0; round < 2; round++) {
+        fz_pixmap* pix1 = fz_new_pixmap_from_page_number(ctx, doc, 0, fz_identity, fz_device_rgb(ctx), 0);
+        fz_pixmap* pix2 = fz_new_pixmap_from_page_number(ctx, doc, 1, fz_identity, fz_device_rgb(ctx), 0);
+        utassert(PixmapsEqual(pix1, expected1));
+        utassert(PixmapsEqual(pix2, expected2));
+        fz_drop_pixmap(ctx, pix2);
+        fz_drop_pixmap(ctx, pix1);
+    }
+    fz_tune_content_caching(ctx, 0);
+
+    fz_drop_pixmap(ctx, expected2);
+    fz_drop_pixmap(ctx, expected1);
+    fz_drop_document(ctx, doc);
+}
+
+// drawing and recording a page in a single run through a tee device gives
+// the same pixels as drawing it directly, also when only the draw device
+// has the page's soft mask and pattern tile cached
+static void TeeDeviceTest(fz_context* ctx) {
+    const char* objs[] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [3 0 R] /Count 1 >>",
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 200 60] /Contents 4 0 R "
+        "/Resources << /ExtGState << /GS1 << /SMask << /S /Luminosity /G 5 0 R >> >> >> "
+        "/Pattern << /P1 6 0 R >> >> >>",
+        "<< /Length 74 >>\nstream\nq /GS1 gs 0 0 1 rg 0 0 200 60 re f Q /Pattern cs /P1 scn 100 0 100 60 re f\nendstream",
+        "<< /Type /XObject /Subtype /Form /BBox [0 0 200 60] "
+        "/Group << /S /Transparency /CS /DeviceGray >> /Length 21 >>\nstream\n0.5 g 0 0 100 60 re f\nendstream",
+        "<< /PatternType 1 /PaintType 1 /TilingType 1 /BBox [0 0 10 10] /XStep 10 /YStep 10 "
+        "/Resources << >> /Length 21 >>\nstream\n1 0 0 rg 0 0 5 5 re f\nendstream",
+    };
+    fz_document* doc = OpenPdfObjects(ctx, objs, (int)dimof(objs));
+    fz_page* page = fz_load_page(ctx, doc, 0);
+    fz_rect bounds = fz_bound_page(ctx, page);
+
+    fz_tune_content_caching(ctx, 0);
+    fz_tune_mask_caching(ctx, 0);
+    fz_pixmap* expected = fz_new_pixmap_from_page(ctx, page, fz_identity, fz_device_rgb(ctx), 0);
+
+    for (int cached = 0; cached < 2; cached++) {
+        fz_tune_content_caching(ctx, cached);
+        fz_tune_mask_caching(ctx, cached);
+        if (cached) {
+            // fill the caches of the draw device
+            fz_drop_pixmap(ctx, fz_new_pixmap_from_page(ctx, page, fz_identity, fz_device_rgb(ctx), 0));
+        }
+
+        fz_pixmap* pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), fz_round_rect(bounds), nullptr, 0);
+        fz_clear_pixmap_with_value(ctx, pix, 0xFF);
+        fz_display_list* list = fz_new_display_list(ctx, bounds);
+        fz_device* draw = fz_new_draw_device(ctx, fz_identity, pix);
+        fz_device* listDev = fz_new_list_device(ctx, list);
+        fz_device* tee = fz_new_tee_device(ctx, draw, listDev);
+        fz_run_page(ctx, page, tee, fz_identity, nullptr);
+        fz_close_device(ctx, tee);
+        fz_close_device(ctx, listDev);
+        fz_close_device(ctx, draw);
+        fz_drop_device(ctx, tee);
+        fz_drop_device(ctx, listDev);
+        fz_drop_device(ctx, draw);
+        utassert(PixmapsEqual(pix, expected));
+
+        fz_tune_content_caching(ctx, 0);
+        fz_tune_mask_caching(ctx, 0);
+        fz_pixmap* replayed = fz_new_pixmap_from_display_list(ctx, list, fz_identity, fz_device_rgb(ctx), 0);
+        utassert(PixmapsEqual(replayed, expected));
+
+        fz_drop_pixmap(ctx, replayed);
+        fz_drop_display_list(ctx, list);
+        fz_drop_pixmap(ctx, pix);
+    }
+
+    fz_drop_pixmap(ctx, expected);
+    fz_drop_page(ctx, page);
+    fz_drop_document(ctx, doc);
+}
+
+void Mupdf_UnitTests() {
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_DEFAULT);
+    utassert(ctx != nullptr);
+    if (!ctx) {
+        return;
+    }
+    fz_register_document_handlers(ctx);
+    fz_try(ctx) {
+        DictHashTest(ctx);
+        PixmapPoolTest(ctx);
+        RunArenaTest(ctx);
+        ShapeCacheTest(ctx);
+        FormResourcesTest(ctx);
+        TeeDeviceTest(ctx);
+    }
+    fz_catch(ctx) {
+        // none of the tests should throw
+        utassert(str::IsEmpty(fz_caught_message(ctx)));
+    }
+    fz_drop_context(ctx);
+}
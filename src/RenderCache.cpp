@@ -662,7 +662,7 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
         // all rendered pages to allow text selection and
         // searching without any further delays
         if (!req.dm->textCache->HasTextForPage(req.pageNo)) {
-            req.dm->textCache->GetTextForPage(req.pageNo);
+            req.dm->textCache->CacheTextForPage(req.pageNo);
         }
 
         CrashIf(req.abortCookie != nullptr);
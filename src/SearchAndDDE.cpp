@@ -78,8 +78,11 @@ void OnMenuFind(WindowInfo* win) {
         return;
     }
 
-    // copy any selected text to the find bar, if it's still empty
     DisplayModel* dm = win->AsFixed();
+    // give the text index a head start while the user types the search term
+    dm->textCache->StartIndexing();
+
+    // copy any selected text to the find bar, if it's still empty
     if (dm->textSelection->result.len > 0 && Edit_GetTextLength(win->hwndFindBox) == 0) {
         AutoFreeWstr selection(dm->textSelection->ExtractText(L" "));
         str::NormalizeWSInPlace(selection);
@@ -375,6 +378,9 @@ void FindTextOnThread(WindowInfo* win, TextSearchDirection direction, const WCHA
     if (str::IsEmpty(text)) {
         return;
     }
+    if (win->AsFixed()) {
+        win->AsFixed()->textCache->StartIndexing();
+    }
     FindThreadData* ftd = new FindThreadData(win, direction, text, wasModified);
     ftd->ShowUI(showProgress);
     win->findThread = nullptr;
@@ -925,7 +925,16 @@ static Controller* CreateControllerForFile(const WCHAR* path, PasswordUI* pwdUI,
     EngineBase* engine = CreateEngine(path, pwdUI, chmInFixedUI);
 
     if (engine) {
-        ctrl = new DisplayModel(engine, win->cbHandler);
+        DisplayModel* dm = new DisplayModel(engine, win->cbHandler);
+        // pages that are slow to interpret are cached as display lists and the
+        // text index of a previous session makes the first search as fast as
+        // the following ones (but both are only kept for files in the file history
+        // and never for encrypted ones)
+        if (gGlobalPrefs->rememberOpenedFiles && !EngineMupdfIsEncrypted(engine)) {
+            EngineMupdfSetPageCacheDir(engine, GetPageCacheDirTemp(ToUtf8Temp(path)));
+            dm->textCache->SetIndexPath(GetTextIndexPathTemp(ToUtf8Temp(path)));
+        }
+        ctrl = dm;
         CrashIf(!ctrl || !ctrl->AsFixed() || ctrl->AsChm());
         VerifyController(ctrl, path);
         // logf(L"CreateControllerForFile: '%s', %d pages\n", path, engine->PageCount());
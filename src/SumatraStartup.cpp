@@ -1131,6 +1131,114 @@ int APIENTRY WinMain(HINSTANCE hInstance, __unused HINSTANCE hPrevInstance, __un
         ShutdownCommon();
         return 0;
     }
+
+    if (flags.testJpxThreads > 0) {
+        TestJpxThreads(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchPageDecode) {
+        BenchPageDecode(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchLexer) {
+        BenchLexer(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.testObjStm) {
+        TestObjStm(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchObjStm) {
+        BenchObjStm(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchDictLookup) {
+        BenchDictLookup(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchRunArena) {
+        BenchRunArena(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.testListSerialize) {
+        TestListSerialize(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchListReplay) {
+        BenchListReplay(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchShapeCache) {
+        BenchShapeCache(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchSearch) {
+        BenchSearch(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchTextScan) {
+        BenchTextScan(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchFindAll) {
+        BenchFindAll(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchHitTest) {
+        BenchHitTest(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchTextCache) {
+        BenchTextCache(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchRegex) {
+        BenchRegex(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchFoldText) {
+        BenchFoldText(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.benchTextIndex) {
+        BenchTextIndex(flags);
+        ShutdownCommon();
+        return 0;
+    }
 #endif
 
     if (flags.appdataDir) {
@@ -15,6 +15,9 @@
 #include "EngineBase.h"
 #include "GlobalPrefs.h"
 #include "Flags.h"
+#include "TextRegex.h"
+#include "TextSelection.h"
+#include "TextSearch.h"
 
 #include <float.h>
 #include <math.h>
@@ -218,10 +221,566 @@ static void colorTest() {
     utassert(c == c2);
 }
 
+// the pages of a document, for matching a TextRegex without one
+struct TestRegexInput : TextRegexInput {
+    const WCHAR** pages = nullptr;
+    const WCHAR* GetPageText(int pageNo, int* lenOut) override {
+        *lenOut = (int)str::Len(pages[pageNo - 1]);
+        return pages[pageNo - 1];
+    }
+};
+
+// returns the length of the match of pattern at glyph start of page pageNo
+// (-1 for none), on the page the match ends on (endPage if given)
+static int RegexMatchLen(const WCHAR* pattern, TestRegexInput* input, int pageNo, int start, bool ignoreCase = false,
+                         bool wholeWords = false, int* endPage = nullptr) {
+    TextRegex* re = CompileTextRegex(pattern, ignoreCase, wholeWords);
+    utassert(re != nullptr);
+    int page = 0, glyph = 0;
+    bool ok = re->MatchAt(input, pageNo, start, &page, &glyph);
+    delete re;
+    if (endPage) {
+        *endPage = page;
+    }
+    if (!ok) {
+        return -1;
+    }
+    return page == pageNo ? glyph - start : glyph;
+}
+
+static void TextRegexTest() {
+    const WCHAR* pages[] = {L"Foo bar 2022-10", L"baz qux", L"the end", L"more"};
+    TestRegexInput input;
+    input.nPages = (int)dimof(pages);
+    input.pages = pages;
+
+    utassert(RegexMatchLen(L"Fo+", &input, 1, 0) == 3);
+    utassert(RegexMatchLen(L"fo+", &input, 1, 0) == -1);
+    utassert(RegexMatchLen(L"[a-z]+", &input, 1, 4) == 3);
+    utassert(RegexMatchLen(L"\\d{4}", &input, 1, 8) == 4);
+    utassert(RegexMatchLen(L"\\d{4}\\-\\d+", &input, 1, 8) == 7);
+    utassert(RegexMatchLen(L"\\d{5}", &input, 1, 8) == -1);
+    utassert(RegexMatchLen(L"ba(r|z)", &input, 1, 4) == 3);
+    utassert(RegexMatchLen(L"b.*", &input, 1, 4) == 11);
+    utassert(RegexMatchLen(L"b.*?\\d", &input, 1, 4) == 5);
+    utassert(RegexMatchLen(L"bar$", &input, 1, 4) == -1);
+    utassert(RegexMatchLen(L"10$", &input, 1, 13) == 2);
+    utassert(RegexMatchLen(L"^baz", &input, 2, 0) == 3);
+    // a space matches any whitespace, also a page break
+    int endPage = 0;
+    utassert(RegexMatchLen(L"10 baz", &input, 1, 13, false, false, &endPage) == 3);
+    utassert(endPage == 2);
+    utassert(RegexMatchLen(L"qux\\s+the", &input, 2, 4, false, false, &endPage) == 3);
+    utassert(endPage == 3);
+    // but a match can't go on forever
+    utassert(RegexMatchLen(L"Foo[^!]*end", &input, 1, 0, false, false, &endPage) == 7);
+    utassert(endPage == 3);
+    utassert(RegexMatchLen(L"Foo[^!]*more", &input, 1, 0) == -1);
+    // case (the text is lower-cased for matching case-insensitively) and whole words
+    utassert(RegexMatchLen(L"BAZ", &input, 2, 0, true) == 3);
+    utassert(RegexMatchLen(L"[A-C]a[X-Z]", &input, 2, 0, true) == 3);
+    utassert(RegexMatchLen(L"BAZ", &input, 2, 0) == -1);
+    utassert(RegexMatchLen(L"ba", &input, 1, 4, false, true) == -1);
+    utassert(RegexMatchLen(L"ba\\w", &input, 1, 4, false, true) == 3);
+    utassert(RegexMatchLen(L"oo", &input, 1, 1, false, true) == -1);
+    utassert(RegexMatchLen(L"\\bbar\\b", &input, 1, 4) == 3);
+    // '-' also matches the typographic dashes
+    const WCHAR* dashes[] = {L"a\x2013z"};
+    TestRegexInput input2;
+    input2.nPages = (int)dimof(dashes);
+    input2.pages = dashes;
+    utassert(RegexMatchLen(L"a-z", &input2, 1, 0) == 3);
+    utassert(RegexMatchLen(L"a\\u2013z", &input2, 1, 0) == 3);
+    // empty matches don't count
+    utassert(RegexMatchLen(L"x*", &input, 1, 0) == -1);
+
+    TextRegex* re = CompileTextRegex(L"bar\\s+\\d+", false, false);
+    utassert(re && str::Eq(re->prefix, L"bar"));
+    delete re;
+    re = CompileTextRegex(L"(foo|bar)", false, false);
+    utassert(re && !re->prefix);
+    delete re;
+
+    const WCHAR* invalid[] = {L"(foo", L"foo)", L"[a-", L"a{2,1}", L"*a", L"\\q", L"a{1001}"};
+    for (const WCHAR* pattern : invalid) {
+        utassert(!CompileTextRegex(pattern, false, false));
+    }
+}
+
+// a document with the given text on its pages, laid out in lines of 10x10
+// glyphs (line breaks having empty boxes, as the engines report them)
+class TestTextEngine : public EngineBase {
+  public:
+    const WCHAR** pages = nullptr;
+    // the glyph boxes of a page, if given, else its text is laid out in lines
+    const Rect** pageCoords = nullptr;
+    // called before a page is extracted, if set
+    std::function<void(int)> onExtract;
+    // the number of pages extracted, by this engine and its clones
+    LONG nExtracted = 0;
+    LONG* extracted = &nExtracted;
+
+    TestTextEngine(const WCHAR** pages, int nPages) : pages(pages) {
+        pageCount = nPages;
+    }
+    EngineBase* Clone() override {
+        auto clone = new TestTextEngine(pages, pageCount);
+        clone->pageCoords = pageCoords;
+        clone->onExtract = onExtract;
+        clone->extracted = extracted;
+        return clone;
+    }
+    RectF PageMediabox(int) override {
+        return RectF(0, 0, 1000, 1000);
+    }
+    RenderedBitmap* RenderPage(RenderPageArgs&) override {
+        return nullptr;
+    }
+    RectF Transform(const RectF& rect, int, float, int, bool) override {
+        return rect;
+    }
+    ByteSlice GetFileData() override {
+        return {};
+    }
+    bool SaveFileAs(const char*) override {
+        return false;
+    }
+    PageText ExtractPageText(int pageNo) override {
+        InterlockedIncrement(extracted);
+        if (onExtract) {
+            onExtract(pageNo);
+        }
+        PageText res;
+        res.text = str::Dup(pages[pageNo - 1]);
+        res.len = (int)str::Len(res.text);
+        res.coords = AllocArray<Rect>(res.len + 1);
+        if (pageCoords && pageCoords[pageNo - 1]) {
+            memcpy(res.coords, pageCoords[pageNo - 1], res.len * sizeof(Rect));
+            return res;
+        }
+        int x = 0, y = 0;
+        for (int i = 0; i < res.len; i++) {
+            if (res.text[i] == '\n') {
+                x = 0;
+                y++;
+                continue;
+            }
+            res.coords[i] = Rect(10 + 10 * x, 10 + 20 * y, 10, 10);
+            x++;
+        }
+        return res;
+    }
+    bool HasClipOptimizations(int) override {
+        return true;
+    }
+    WCHAR* GetProperty(DocumentProperty) override {
+        return nullptr;
+    }
+    Vec<IPageElement*> GetElements(int) override {
+        return {};
+    }
+    IPageElement* GetElementAtPos(int, PointF) override {
+        return nullptr;
+    }
+    bool BenchLoadPage(int) override {
+        return true;
+    }
+};
+
+static void TextIndexTest() {
+    const WCHAR* pages[] = {L"The quick brown fox", L"jumps over\nthe lazy dog", L"", L"Lorem ipsum"};
+    int nPages = (int)dimof(pages);
+    TestTextEngine engine(pages, nPages);
+    DocumentTextCache textCache(&engine);
+    textCache.maxWorkers = 0;
+    // pages that haven't been indexed yet may contain any word
+    utassert(textCache.MayContainWord(1, L"lorem"));
+
+    textCache.StartIndexing();
+    int nPagesIndexed = 0;
+    i64 memory = 0;
+    for (int i = 0; i < 1000 && nPagesIndexed < nPages; i++) {
+        Sleep(10);
+        textCache.GetIndexProgress(&nPagesIndexed, &memory);
+    }
+    utassert(nPagesIndexed == nPages);
+    utassert(memory > 0);
+
+    // words are compared case-insensitively and ones too short to have a trigram always may match
+    utassert(textCache.MayContainWord(1, L"quick"));
+    utassert(textCache.MayContainWord(1, L"QUICK"));
+    utassert(textCache.MayContainWord(1, L"The quick"));
+    utassert(textCache.MayContainWord(2, L"lazy"));
+    utassert(textCache.MayContainWord(2, L"over"));
+    utassert(textCache.MayContainWord(4, L"Lorem"));
+    utassert(textCache.MayContainWord(3, L"ox"));
+    utassert(!textCache.MayContainWord(1, L"lorem"));
+    utassert(!textCache.MayContainWord(1, L"quiet"));
+    utassert(!textCache.MayContainWord(2, L"fox"));
+    utassert(!textCache.MayContainWord(3, L"fox"));
+    utassert(!textCache.MayContainWord(4, L"quick"));
+
+    // the indexer keeps the text of the pages, but not decoded
+    TextCacheMemory mem;
+    textCache.GetMemoryReport(&mem);
+    utassert(mem.nPagesCached == nPages);
+    utassert(mem.nPagesDecoded == 0);
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        int len = -1;
+        const WCHAR* text = textCache.GetTextForPage(pageNo, &len);
+        utassert(str::Eq(text, pages[pageNo - 1]));
+        utassert(len == (int)str::Len(pages[pageNo - 1]));
+    }
+    utassert(engine.nExtracted == nPages);
+}
+
+// checks that FindAll finds the same hits (and highlights them the same way)
+// as FindFirst and FindNext do one after another
+static void CheckFindAll(TextSearch* search, const WCHAR* text, int nHits) {
+    SearchHits hits;
+    utassert(search->FindAll(text, &hits));
+    utassert(hits.hits.isize() == nHits);
+    TextSel* sel = search->FindFirst(1, text);
+    for (const SearchHit& hit : hits.hits) {
+        utassert(sel != nullptr);
+        if (!sel) {
+            return;
+        }
+        int fromPage, fromGlyph, toPage, toGlyph;
+        search->GetGlyphRange(&fromPage, &fromGlyph, &toPage, &toGlyph);
+        utassert(hit.startPage == fromPage && hit.startGlyph == fromGlyph);
+        utassert(hit.endPage == toPage && hit.endGlyph == toGlyph);
+        utassert(hit.nRects == sel->len);
+        for (int i = 0; i < hit.nRects && i < sel->len; i++) {
+            utassert(hits.rectPages[hit.firstRect + i] == sel->pages[i]);
+            utassert(hits.rects[hit.firstRect + i] == sel->rects[i]);
+        }
+        sel = search->FindNext();
+    }
+    utassert(sel == nullptr);
+}
+
+static void FindAllTest() {
+    const WCHAR* pages[] = {L"foo bar foo", L"nothing here", L"Foo\nfoo-bar", L"bar foo\n", L"bar", L"end foo"};
+    int nPages = (int)dimof(pages);
+    TestTextEngine engine(pages, nPages);
+    DocumentTextCache textCache(&engine);
+    textCache.maxWorkers = 0;
+    TextSearch search(&engine, &textCache);
+
+    SearchHits hits;
+    utassert(search.FindAll(L"foo", &hits));
+    utassert(hits.hits.size() == 6);
+    utassert(hits.nextPage == nPages + 1);
+    const SearchHit& first = hits.hits[0];
+    utassert(first.startPage == 1 && first.startGlyph == 0 && first.endPage == 1 && first.endGlyph == 3);
+    utassert(first.nRects == 1 && hits.rectPages[first.firstRect] == 1);
+    utassert(hits.rects[first.firstRect] == Rect(10, 10, 30, 10));
+    // on the second line of the page, case-insensitively
+    const SearchHit& third = hits.hits[2];
+    utassert(third.startPage == 3 && third.startGlyph == 0 && third.endGlyph == 3);
+    const SearchHit& fourth = hits.hits[3];
+    utassert(fourth.startPage == 3 && fourth.startGlyph == 4 && fourth.endGlyph == 7);
+    utassert(hits.rects[fourth.firstRect] == Rect(10, 30, 30, 10));
+    CheckFindAll(&search, L"foo", 6);
+
+    // a hit across a page break (where the text ends in whitespace) is highlighted on both pages
+    SearchHits crossing;
+    utassert(search.FindAll(L"foo bar", &crossing));
+    utassert(crossing.hits.size() == 2);
+    const SearchHit& last = crossing.hits.Last();
+    utassert(last.startPage == 4 && last.startGlyph == 4 && last.endPage == 5 && last.endGlyph == 3);
+    utassert(last.nRects == 2);
+    utassert(crossing.rectPages[last.firstRect] == 4 && crossing.rectPages[last.firstRect + 1] == 5);
+    CheckFindAll(&search, L"foo bar", 2);
+    // and searching goes on after the hit, where it ends
+    const WCHAR* pages2[] = {L"x la\n", L"la la"};
+    TestTextEngine engine2(pages2, (int)dimof(pages2));
+    DocumentTextCache textCache2(&engine2);
+    textCache2.maxWorkers = 0;
+    TextSearch search2(&engine2, &textCache2);
+    CheckFindAll(&search2, L"la la", 1);
+
+    CheckFindAll(&search, L"bar", 4);
+    CheckFindAll(&search, L"o", 13);
+    CheckFindAll(&search, L"missing", 0);
+    search.SetSensitive(true);
+    CheckFindAll(&search, L"Foo", 1);
+    search.SetSensitive(false);
+    search.SetWholeWords(true);
+    CheckFindAll(&search, L"fo", 0);
+    search.SetWholeWords(false);
+    search.SetRegex(true);
+    CheckFindAll(&search, L"fo+ b", 2);
+    search.SetRegex(false);
+
+    // with onlyExtracted, hits are only found on the pages extracted so far
+    // and can be extended once more pages have been extracted
+    DocumentTextCache textCache3(&engine);
+    textCache3.maxWorkers = 0;
+    TextSearch search3(&engine, &textCache3);
+    SearchHits partial;
+    utassert(!search3.FindAll(L"foo", &partial, true));
+    utassert(partial.hits.size() == 0 && partial.nextPage == 1);
+    for (int pageNo = 1; pageNo <= 3; pageNo++) {
+        textCache3.CacheTextForPage(pageNo);
+    }
+    utassert(!search3.FindAll(L"foo", &partial, true));
+    utassert(partial.hits.size() == 4 && partial.nextPage == 4);
+    for (int pageNo = 4; pageNo <= nPages; pageNo++) {
+        textCache3.CacheTextForPage(pageNo);
+    }
+    utassert(search3.FindAll(L"foo", &partial, true));
+    utassert(partial.hits.size() == hits.hits.size());
+    for (int i = 0; i < partial.hits.isize() && i < hits.hits.isize(); i++) {
+        utassert(memeq(&partial.hits[i], &hits.hits[i], sizeof(SearchHit)));
+    }
+}
+
+// the glyph a linear scan over all glyphs picks: of the glyphs the point
+// is over (if any, else of all glyphs) the first one with the closest center
+static int FindClosestGlyphSlow(const Rect* coords, int len, Point pt) {
+    int best = -1;
+    bool bestIsOver = false;
+    uint bestDist = UINT_MAX;
+    for (int i = 0; i < len; i++) {
+        const Rect& r = coords[i];
+        if (!r.x && !r.dx) {
+            continue;
+        }
+        bool isOver = r.Contains(pt);
+        uint dist = distSq(pt.x - (r.x + r.dx / 2), pt.y - (r.y + r.dy / 2));
+        if ((isOver && !bestIsOver) || (isOver == bestIsOver && dist < bestDist)) {
+            best = i;
+            bestIsOver = isOver;
+            bestDist = dist;
+        }
+    }
+    return best;
+}
+
+static void CheckClosestGlyphs(DocumentTextCache* textCache, int pageNo) {
+    int len;
+    Rect* coords;
+    textCache->GetTextForPage(pageNo, &len, &coords);
+    Vec<Rect> copy;
+    copy.Append(coords, len);
+    // including points outside of all glyphs
+    for (int y = -50; y < 1050; y += 7) {
+        for (int x = -50; x < 1050; x += 7) {
+            int expected = FindClosestGlyphSlow(copy.LendData(), len, Point(x, y));
+            utassert(textCache->FindClosestGlyph(pageNo, Point(x, y)) == expected);
+        }
+    }
+}
+
+static void GlyphHitTest() {
+    // glyph boxes of all kinds: in lines, line breaks, overlapping, repeated,
+    // empty, spanning much of the page and with a negative size
+    const int nGlyphs = 400;
+    WCHAR text[nGlyphs + 1] = {};
+    Rect coords[nGlyphs];
+    u32 seed = 1;
+    auto rnd = [&seed](int n) {
+        seed = seed * 1103515245 + 12345;
+        return (int)((seed >> 16) % n);
+    };
+    int x = 10, y = 10;
+    for (int i = 0; i < nGlyphs; i++) {
+        text[i] = 'a' + rnd(26);
+        int kind = rnd(12);
+        if (kind == 0) {
+            text[i] = '\n';
+            x = 10;
+            y += 20;
+        } else if (kind == 1 && i > 0) {
+            coords[i] = coords[i - 1];
+        } else if (kind == 2) {
+            coords[i] = Rect(rnd(1000), rnd(1000), 0, 0);
+        } else if (kind == 3) {
+            coords[i] = Rect(rnd(1000), rnd(1000), 100 + rnd(800), 50 + rnd(500));
+        } else if (kind == 4) {
+            coords[i] = Rect(rnd(1000), rnd(1000), -1 - rnd(30), rnd(20) - 10);
+        } else if (kind == 5) {
+            coords[i] = Rect(rnd(1000), rnd(1000), 5 + rnd(30), 5 + rnd(30));
+        } else {
+            coords[i] = Rect(x, y, 4 + rnd(8), 10);
+            x += coords[i].dx + rnd(3);
+        }
+    }
+    const WCHAR* pages[] = {text, L"The quick brown fox\njumps over\n\nthe lazy dog", L"\n\n", L"x"};
+    const Rect* pageCoords[] = {coords, nullptr, nullptr, nullptr};
+    TestTextEngine engine(pages, (int)dimof(pages));
+    engine.pageCoords = pageCoords;
+    DocumentTextCache textCache(&engine);
+    textCache.maxWorkers = 0;
+    for (int pageNo = 1; pageNo <= (int)dimof(pages); pageNo++) {
+        CheckClosestGlyphs(&textCache, pageNo);
+    }
+    // no glyph can be hit on a page with only line breaks
+    utassert(textCache.FindClosestGlyph(3, Point(10, 10)) == -1);
+    utassert(textCache.FindClosestGlyph(4, Point(500, 500)) == 0);
+    utassert(textCache.FindClosestGlyph(2, Point(15, 35)) == 20);
+}
+
+// checks that list has exactly the given pages, in this order
+static bool IsLruOrder(const PageLruList& list, const int* pageNos, int n) {
+    int pageNo = list.first;
+    for (int i = 0; i < n; i++) {
+        if (pageNo != pageNos[i] || !list.Contains(pageNo)) {
+            return false;
+        }
+        pageNo = list.links[pageNo - 1].next;
+    }
+    if (pageNo != 0 || list.last != (n > 0 ? pageNos[n - 1] : 0)) {
+        return false;
+    }
+    for (int i = n - 1; i > 0; i--) {
+        if (list.links[pageNos[i] - 1].prev != pageNos[i - 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void PageLruListTest() {
+    PageLink links[5];
+    PageLruList list;
+    list.links = links;
+    utassert(IsLruOrder(list, nullptr, 0) && !list.Contains(1));
+    list.Insert(2);
+    list.Insert(4);
+    list.Insert(1, 4);
+    list.Insert(3, 2);
+    int order1[] = {3, 2, 1, 4};
+    utassert(IsLruOrder(list, order1, 4) && !list.Contains(5));
+    list.MoveToEnd(2);
+    list.MoveToEnd(2);
+    int order2[] = {3, 1, 4, 2};
+    utassert(IsLruOrder(list, order2, 4));
+    list.MoveToEnd(3);
+    int order3[] = {1, 4, 2, 3};
+    utassert(IsLruOrder(list, order3, 4));
+    list.Remove(3);
+    list.Remove(2);
+    int order4[] = {1, 4};
+    utassert(IsLruOrder(list, order4, 2) && !list.Contains(2) && !list.Contains(3));
+    list.Remove(1);
+    list.Remove(4);
+    utassert(IsLruOrder(list, nullptr, 0));
+}
+
+// checks that the text decoded from the cache is the one the engine extracts
+static void CheckDecodedText(TestTextEngine* engine, DocumentTextCache* textCache, int pageNo) {
+    int len;
+    Rect* coords;
+    const WCHAR* text = textCache->GetTextForPage(pageNo, &len, &coords);
+    PageText extracted = engine->ExtractPageText(pageNo);
+    utassert(len == extracted.len && str::Eq(text, extracted.text));
+    utassert(memeq(coords, extracted.coords, len * sizeof(Rect)));
+    FreePageText(&extracted);
+}
+
+static void TextCacheMemoryTest() {
+    PageLruListTest();
+
+    // the compact encoding keeps any glyph boxes as they are
+    const Rect coords[] = {Rect(-20, 5, 7, 9),     Rect(100000, -300, -4, 2), Rect(), Rect(3, 40, 0, 0),
+                           Rect(1, 1, 2000, 3000), Rect(),                    Rect(9, 40, 5, -6)};
+    const WCHAR* boxPages[] = {L"ab\ncd e"};
+    const Rect* boxPageCoords[] = {coords};
+    TestTextEngine boxEngine(boxPages, 1);
+    boxEngine.pageCoords = boxPageCoords;
+    DocumentTextCache boxCache(&boxEngine);
+    boxCache.maxWorkers = 0;
+    boxCache.CacheTextForPage(1);
+    CheckDecodedText(&boxEngine, &boxCache, 1);
+
+    // pages of the same length, so that they take up the same memory
+    const int nPages = 10;
+    WCHAR texts[nPages][32];
+    const WCHAR* pages[nPages];
+    for (int i = 0; i < nPages; i++) {
+        str::BufSet(texts[i], dimof(texts[i]), L"page # of the test\nwith two lines");
+        texts[i][5] = '0' + i;
+        pages[i] = texts[i];
+    }
+    TestTextEngine engine(pages, nPages);
+    DocumentTextCache textCache(&engine);
+    textCache.maxWorkers = 0;
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        textCache.CacheTextForPage(pageNo);
+    }
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        CheckDecodedText(&engine, &textCache, pageNo);
+    }
+    LONG nExtracted = engine.nExtracted;
+    TextCacheMemory mem;
+    textCache.GetMemoryReport(&mem);
+    utassert(mem.nPagesCached == nPages && mem.nPagesDecoded == nPages && mem.nEvicted == 0);
+
+    // the decoded text of the least recently used page goes first
+    textCache.maxMemory = mem.compactSize + mem.decodedSize + mem.indexSize - 1;
+    {
+        ScopedCritSec scope(&textCache.access);
+        textCache.TrimMemory();
+    }
+    textCache.GetMemoryReport(&mem);
+    utassert(mem.nPagesCached == nPages && mem.nPagesDecoded == nPages - 1 && mem.nEvicted == 0);
+    utassert(!textCache.pages[0].text && textCache.pages[0].data);
+    // and it's decoded again (instead of extracted) when needed
+    utassert(str::Eq(textCache.GetTextForPage(1), pages[0]));
+    utassert(engine.nExtracted == nExtracted);
+    utassert(textCache.pages[0].text && !textCache.pages[1].text);
+
+    // only the pages pinned by the last kPinnedPages reads are kept
+    textCache.maxMemory = 0;
+    {
+        ScopedCritSec scope(&textCache.access);
+        textCache.TrimMemory();
+    }
+    textCache.GetMemoryReport(&mem);
+    utassert(mem.nPagesCached == kPinnedPages && mem.nPagesDecoded == kPinnedPages);
+    utassert(mem.nEvicted == nPages - kPinnedPages && mem.nReextracted == 0);
+    // evicted pages are extracted again
+    utassert(str::Eq(textCache.GetTextForPage(3), pages[2]));
+    textCache.GetMemoryReport(&mem);
+    utassert(mem.nReextracted == 1 && engine.nExtracted == nExtracted + 1);
+    utassert(mem.nPagesCached == kPinnedPages && mem.nPagesDecoded == kPinnedPages);
+
+    // the page a search is on stays decoded while a match goes on over
+    // more than kPinnedPages (empty) pages, even without memory to spare
+    const WCHAR* searchPages[] = {L"foo \n", L"", L"", L"", L"", L"", L"bar foo \n", L"", L"", L"", L"", L"", L"baz"};
+    int nSearchPages = (int)dimof(searchPages);
+    TestTextEngine searchEngine(searchPages, nSearchPages);
+    DocumentTextCache searchCache(&searchEngine);
+    searchCache.maxWorkers = 0;
+    searchCache.maxMemory = 0;
+    int nChecked = 0;
+    searchEngine.onExtract = [&](int pageNo) {
+        int searchedPage = pageNo - 1;
+        while (searchedPage > 1 && !*searchPages[searchedPage - 1]) {
+            searchedPage--;
+        }
+        if (pageNo > 1 && !*searchPages[pageNo - 1]) {
+            utassert(searchCache.pages[searchedPage - 1].text != nullptr);
+            nChecked++;
+        }
+    };
+    TextSearch search(&searchEngine, &searchCache);
+    CheckFindAll(&search, L"foo bar", 1);
+    utassert(nChecked >= 2 * kPinnedPages);
+}
+
 void SumatraPDF_UnitTests() {
     colorTest();
     BenchRangeTest();
     ParseCommandLineTest();
     versioncheck_test();
     hexstrTest();
+    TextRegexTest();
+    TextIndexTest();
+    FindAllTest();
+    GlyphHitTest();
+    TextCacheMemoryTest();
 }
@@ -1,9 +1,18 @@
 /* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
    License: GPLv3 */
 
+#pragma warning(disable : 4611) // interaction between '_setjmp' and C++ object destruction is non-portable
+
+extern "C" {
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+}
+
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
+#include "utils/Timer.h"
+#include "utils/FileUtil.h"
 
 #include "wingui/UIModels.h"
 
@@ -11,6 +20,8 @@
 #include "Controller.h"
 #include "EngineBase.h"
 #include "EngineAll.h"
+#include "TextSelection.h"
+#include "TextSearch.h"
 #include "GlobalPrefs.h"
 #include "Flags.h"
 
@@ -100,3 +111,1809 @@ void TestExtractPage(const Flags& ci) {
         delete engine;
     }
 }
+
+static CRITICAL_SECTION gTestFzMutexes[FZ_LOCK_MAX];
+
+static void TestFzLock(void*, int lock) {
+    EnterCriticalSection(&gTestFzMutexes[lock]);
+}
+
+static void TestFzUnlock(void*, int lock) {
+    LeaveCriticalSection(&gTestFzMutexes[lock]);
+}
+
+// fitz context with locks, as mupdf may call back into the
+// context from worker threads (e.g. when decoding JPX)
+static fz_context* NewTestFzContext(const fz_alloc_context* alloc = nullptr) {
+    static fz_locks_context locks = {nullptr, TestFzLock, TestFzUnlock};
+    static bool didInit = false;
+    if (!didInit) {
+        for (auto& cs : gTestFzMutexes) {
+            InitializeCriticalSection(&cs);
+        }
+        didInit = true;
+    }
+    fz_context* ctx = fz_new_context(alloc, &locks, FZ_STORE_DEFAULT);
+    if (ctx) {
+        fz_register_document_handlers(ctx);
+    }
+    return ctx;
+}
+
+static fz_pixmap* RenderPageWithFitz(fz_context* ctx, fz_document* doc, int pageNo, double* timeMs) {
+    fz_pixmap* pix = nullptr;
+    auto t = TimeGet();
+    fz_try(ctx) {
+        pix = fz_new_pixmap_from_page_number(ctx, doc, pageNo, fz_identity, fz_device_rgb(ctx), 0);
+    }
+    fz_catch(ctx) {
+        pix = nullptr;
+    }
+    *timeMs = TimeSinceInMs(t);
+    return pix;
+}
+
+// renders all pages of each file with single-threaded JPX decoding
+// and with decoding on nThreads threads, and verifies that the
+// results are identical
+void TestJpxThreads(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    int nThreads = i.testJpxThreads;
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        fz_document* doc = nullptr;
+        int nPages = 0;
+        fz_try(ctx) {
+            doc = fz_open_document(ctx, fileNameA.Get());
+            nPages = fz_count_pages(ctx, doc);
+        }
+        fz_catch(ctx) {
+            printf("failed to open '%s'\n", fileNameA.Get());
+            continue;
+        }
+        double totalMs1 = 0, totalMsN = 0;
+        int nMismatches = 0;
+        for (int pageNo = 0; pageNo < nPages; pageNo++) {
+            double ms1, msN;
+            // empty the store so that images are decoded again
+            fz_empty_store(ctx);
+            fz_tune_jpx_threads(ctx, 1);
+            fz_pixmap* pix1 = RenderPageWithFitz(ctx, doc, pageNo, &ms1);
+            fz_empty_store(ctx);
+            fz_tune_jpx_threads(ctx, nThreads);
+            fz_pixmap* pixN = RenderPageWithFitz(ctx, doc, pageNo, &msN);
+            totalMs1 += ms1;
+            totalMsN += msN;
+            bool same = pix1 && pixN && pix1->w == pixN->w && pix1->h == pixN->h && pix1->stride == pixN->stride &&
+                        memeq(pix1->samples, pixN->samples, (size_t)pix1->stride * pix1->h);
+            if (!same) {
+                printf("page %d of '%s': output differs with %d threads\n", pageNo + 1, fileNameA.Get(), nThreads);
+                nMismatches++;
+            }
+            fz_drop_pixmap(ctx, pix1);
+            fz_drop_pixmap(ctx, pixN);
+        }
+        printf("'%s': %d pages, %d mismatches, 1 thread: %.2f ms, %d threads: %.2f ms\n", fileNameA.Get(), nPages,
+               nMismatches, totalMs1, nThreads, totalMsN);
+        fz_drop_document(ctx, doc);
+    }
+    fz_drop_context(ctx);
+}
+
+// renders all pages of each file in order, the way they're rendered
+// when flipping through a document, and prints the time for each page.
+// resources shared between pages (like JBIG2 globals) stay in the store
+void BenchPageDecode(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        fz_document* doc = nullptr;
+        int nPages = 0;
+        fz_try(ctx) {
+            doc = fz_open_document(ctx, fileNameA.Get());
+            nPages = fz_count_pages(ctx, doc);
+        }
+        fz_catch(ctx) {
+            printf("failed to open '%s'\n", fileNameA.Get());
+            continue;
+        }
+        printf("'%s':\n", fileNameA.Get());
+        double totalMs = 0, minMs = 0, maxMs = 0;
+        for (int pageNo = 0; pageNo < nPages; pageNo++) {
+            double ms;
+            fz_pixmap* pix = RenderPageWithFitz(ctx, doc, pageNo, &ms);
+            printf("page %d: %.2f ms%s\n", pageNo + 1, ms, pix ? "" : " (failed)");
+            fz_drop_pixmap(ctx, pix);
+            totalMs += ms;
+            minMs = (pageNo == 0 || ms < minMs) ? ms : minMs;
+            maxMs = (ms > maxMs) ? ms : maxMs;
+        }
+        if (nPages > 0) {
+            printf("%d pages, total: %.2f ms, min: %.2f ms, avg: %.2f ms, max: %.2f ms\n", nPages, totalMs, minMs,
+                   totalMs / nPages, maxMs);
+        }
+        fz_store_type_stats stats[32];
+        int nStats = fz_store_stats(ctx, stats, dimof(stats));
+        for (int n = 0; n < nStats && n < (int)dimof(stats); n++) {
+            auto& st = stats[n];
+            printf("store %s: stored: %d, hits: %d, evicted: %d, recreated: %d\n", st.name, st.stored, st.hits,
+                   st.evicted, st.recreated);
+        }
+        fz_drop_document(ctx, doc);
+        fz_empty_store(ctx);
+    }
+    fz_drop_context(ctx);
+}
+
+static int LexAll(fz_context* ctx, fz_buffer* content) {
+    int nTokens = 0;
+    fz_var(nTokens);
+    fz_stream* stm = fz_open_buffer(ctx, content);
+    pdf_lexbuf lb;
+    pdf_lexbuf_init(ctx, &lb, PDF_LEXBUF_SMALL);
+    fz_try(ctx) {
+        while (pdf_lex(ctx, stm, &lb) != PDF_TOK_EOF) {
+            nTokens++;
+        }
+    }
+    fz_always(ctx) {
+        pdf_lexbuf_fin(ctx, &lb);
+        fz_drop_stream(ctx, stm);
+    }
+    fz_catch(ctx) {
+        nTokens = -1;
+    }
+    return nTokens;
+}
+
+// measures pdf_lex throughput over the decompressed content streams
+// of all pages, so that lexer changes can be compared in isolation
+// from parsing, interpretation and rendering
+void BenchLexer(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    const int kRuns = 10;
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        pdf_document* doc = nullptr;
+        Vec<fz_buffer*> contents;
+        size_t nBytes = 0;
+        fz_var(doc);
+        fz_try(ctx) {
+            doc = pdf_open_document(ctx, fileNameA.Get());
+            int nPages = pdf_count_pages(ctx, doc);
+            for (int pageNo = 0; pageNo < nPages; pageNo++) {
+                pdf_obj* pageObj = pdf_lookup_page_obj(ctx, doc, pageNo);
+                pdf_obj* obj = pdf_dict_get(ctx, pageObj, PDF_NAME(Contents));
+                fz_stream* stm = pdf_open_contents_stream(ctx, doc, obj);
+                fz_buffer* buf = nullptr;
+                fz_try(ctx) {
+                    buf = fz_read_all(ctx, stm, 0);
+                }
+                fz_always(ctx) {
+                    fz_drop_stream(ctx, stm);
+                }
+                fz_catch(ctx) {
+                    fz_rethrow(ctx);
+                }
+                contents.Append(buf);
+                nBytes += buf->len;
+            }
+        }
+        fz_catch(ctx) {
+            printf("failed to load content streams of '%s'\n", fileNameA.Get());
+            for (fz_buffer* buf : contents) {
+                fz_drop_buffer(ctx, buf);
+            }
+            pdf_drop_document(ctx, doc);
+            continue;
+        }
+
+        int nTokens = 0;
+        double minMs = 0;
+        for (int run = 0; run < kRuns; run++) {
+            auto t = TimeGet();
+            nTokens = 0;
+            for (fz_buffer* buf : contents) {
+                int n = LexAll(ctx, buf);
+                nTokens += (n > 0) ? n : 0;
+            }
+            double ms = TimeSinceInMs(t);
+            minMs = (run == 0 || ms < minMs) ? ms : minMs;
+        }
+        double mbPerSec = (minMs > 0) ? (double)nBytes / (minMs * 1000.0) : 0;
+        printf("'%s': %d pages, %d bytes, %d tokens, best of %d: %.2f ms, %.1f MB/s\n", fileNameA.Get(),
+               contents.isize(), (int)nBytes, nTokens, kRuns, minMs, mbPerSec);
+
+        for (fz_buffer* buf : contents) {
+            fz_drop_buffer(ctx, buf);
+        }
+        pdf_drop_document(ctx, doc);
+    }
+    fz_drop_context(ctx);
+}
+
+enum class ObjStmDamage {
+    None,
+    TruncatedData,
+    BadHeader,
+    OutOfRangeNum,
+    DuplicateNum,
+    BadOffset,
+};
+
+constexpr int kObjStmCount = 200;
+
+// builds a PDF with objects 3 to 2 + kObjStmCount in a single compressed
+// object stream, each being << /N num >>, damaged in the given way
+static fz_buffer* BuildObjStmPdf(fz_context* ctx, ObjStmDamage damage) {
+    constexpr int objStmNum = 3 + kObjStmCount;
+    constexpr int xrefNum = objStmNum + 1;
+    int64_t ofs[xrefNum + 1]{};
+
+    fz_buffer* data = fz_new_buffer(ctx, 1024);
+    fz_buffer* body = fz_new_buffer(ctx, 1024);
+    for (int i = 0; i < kObjStmCount; i++) {
+        int num = 3 + i;
+        int bodyOfs = (int)body->len;
+        if (damage == ObjStmDamage::OutOfRangeNum && i == 0) {
+            num = 99999;
+        }
+        if (damage == ObjStmDamage::DuplicateNum && i == 1) {
+            num = 3;
+        }
+        if (damage == ObjStmDamage::BadOffset && i == 1) {
+            bodyOfs = 100000;
+        }
+        if (damage == ObjStmDamage::BadHeader && i == 5) {
+            fz_append_printf(ctx, data, "%d x ", num);
+        } else {
+            fz_append_printf(ctx, data, "%d %d ", num, bodyOfs);
+        }
+        fz_append_printf(ctx, body, "<< /N %d /Text (object %d in an object stream) >>\n", 3 + i, 3 + i);
+    }
+    fz_append_byte(ctx, data, '\n');
+    int first = (int)data->len;
+    fz_append_data(ctx, data, body->data, body->len);
+    size_t len = 0;
+    u8* compressed = fz_new_deflated_data_from_buffer(ctx, &len, data, FZ_DEFLATE_DEFAULT);
+    if (damage == ObjStmDamage::TruncatedData) {
+        len /= 2;
+    }
+    fz_drop_buffer(ctx, body);
+    fz_drop_buffer(ctx, data);
+
+    fz_buffer* pdf = fz_new_buffer(ctx, 16 * 1024);
+    fz_append_string(ctx, pdf, "%PDF-1.7\n");
+    ofs[1] = pdf->len;
+    fz_append_string(ctx, pdf, "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+    ofs[2] = pdf->len;
+    fz_append_string(ctx, pdf, "2 0 obj\n<< /Type /Pages /Kids [] /Count 0 >>\nendobj\n");
+    ofs[objStmNum] = pdf->len;
+    fz_append_printf(ctx, pdf, "%d 0 obj\n<< /Type /ObjStm /N %d /First %d /Filter /FlateDecode /Length %d >>\nstream\n",
+                     objStmNum, kObjStmCount, first, (int)len);
+    fz_append_data(ctx, pdf, compressed, len);
+    fz_append_string(ctx, pdf, "\nendstream\nendobj\n");
+    fz_free(ctx, compressed);
+
+    // cross-reference stream with /W [1 4 2]
+    ofs[xrefNum] = pdf->len;
+    fz_append_printf(ctx, pdf, "%d 0 obj\n<< /Type /XRef /Size %d /W [1 4 2] /Root 1 0 R /Length %d >>\nstream\n",
+                     xrefNum, xrefNum + 1, (xrefNum + 1) * 7);
+    for (int num = 0; num <= xrefNum; num++) {
+        bool inObjStm = num >= 3 && num < objStmNum;
+        int type = (num == 0) ? 0 : inObjStm ? 2 : 1;
+        int64_t a = inObjStm ? objStmNum : ofs[num];
+        int b = inObjStm ? num - 3 : (num == 0) ? 65535 : 0;
+        u8 row[7] = {(u8)type, (u8)(a >> 24), (u8)(a >> 16), (u8)(a >> 8), (u8)a, (u8)(b >> 8), (u8)b};
+        fz_append_data(ctx, pdf, row, sizeof(row));
+    }
+    fz_append_printf(ctx, pdf, "\nendstream\nendobj\nstartxref\n%d\n%%%%EOF\n", (int)ofs[xrefNum]);
+    return pdf;
+}
+
+// returns /N of the object, or -1 if it couldn't be loaded
+static int LoadObjStmTestObject(fz_context* ctx, pdf_document* doc, int num) {
+    int n = -1;
+    pdf_obj* obj = nullptr;
+    fz_var(obj);
+    fz_try(ctx) {
+        obj = pdf_load_object(ctx, doc, num);
+        if (pdf_is_dict(ctx, obj)) {
+            n = pdf_dict_get_int(ctx, obj, PDF_NAME(N));
+        }
+    }
+    fz_always(ctx) {
+        pdf_drop_obj(ctx, obj);
+    }
+    fz_catch(ctx) {
+        n = -1;
+    }
+    return n;
+}
+
+static int PdfStoreStat(fz_context* ctx, int fz_store_type_stats::*field) {
+    fz_store_type_stats stats[32];
+    int nStats = fz_store_stats(ctx, stats, dimof(stats));
+    for (int n = 0; n < nStats && n < (int)dimof(stats); n++) {
+        if (str::Eq(stats[n].name, "pdf_obj")) {
+            return stats[n].*field;
+        }
+    }
+    return 0;
+}
+
+// loads every object from a generated object stream, intact and damaged
+// in various ways, and checks that damage is contained to the objects
+// it affects and that the stream is only decoded once
+void TestObjStm(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    struct {
+        ObjStmDamage damage;
+        const char* name;
+    } tests[] = {
+        {ObjStmDamage::None, "intact"},
+        {ObjStmDamage::TruncatedData, "truncated data"},
+        {ObjStmDamage::BadHeader, "corrupt header"},
+        {ObjStmDamage::OutOfRangeNum, "object number out of range"},
+        {ObjStmDamage::DuplicateNum, "duplicate object number"},
+        {ObjStmDamage::BadOffset, "offset past the end"},
+    };
+    int nFailed = 0;
+    for (auto& test : tests) {
+        fz_buffer* pdf = nullptr;
+        fz_stream* stm = nullptr;
+        pdf_document* doc = nullptr;
+        fz_var(pdf);
+        fz_var(stm);
+        fz_var(doc);
+        fz_try(ctx) {
+            pdf = BuildObjStmPdf(ctx, test.damage);
+            stm = fz_open_buffer(ctx, pdf);
+            doc = pdf_open_document_with_stream(ctx, stm);
+        }
+        fz_catch(ctx) {
+            printf("FAIL %s: couldn't open the document\n", test.name);
+            nFailed++;
+            pdf_drop_document(ctx, doc);
+            fz_drop_stream(ctx, stm);
+            fz_drop_buffer(ctx, pdf);
+            continue;
+        }
+
+        int stored = PdfStoreStat(ctx, &fz_store_type_stats::stored);
+        // load back to front so that the index isn't built by the first object
+        int ids[kObjStmCount];
+        int nLoaded = 0;
+        for (int n = kObjStmCount - 1; n >= 0; n--) {
+            ids[n] = LoadObjStmTestObject(ctx, doc, 3 + n);
+            nLoaded += (ids[n] == 3 + n) ? 1 : 0;
+        }
+        stored = PdfStoreStat(ctx, &fz_store_type_stats::stored) - stored;
+
+        bool ok = false;
+        switch (test.damage) {
+            case ObjStmDamage::None:
+                ok = nLoaded == kObjStmCount && stored == 1;
+                break;
+            case ObjStmDamage::TruncatedData:
+                ok = ids[0] == 3 && ids[kObjStmCount - 1] == -1;
+                break;
+            case ObjStmDamage::BadHeader:
+                ok = nLoaded == 0;
+                break;
+            case ObjStmDamage::OutOfRangeNum:
+                ok = nLoaded == kObjStmCount - 1 && ids[0] == -1;
+                break;
+            case ObjStmDamage::DuplicateNum:
+                // the first definition wins
+                ok = nLoaded == kObjStmCount - 1 && ids[0] == 3 && ids[1] == -1;
+                break;
+            case ObjStmDamage::BadOffset:
+                ok = nLoaded == kObjStmCount - 1 && ids[1] == -1;
+                break;
+        }
+        printf("%s %s: %d of %d objects loaded, %d stream indices stored\n", ok ? "ok  " : "FAIL", test.name, nLoaded,
+               kObjStmCount, stored);
+        nFailed += ok ? 0 : 1;
+
+        pdf_drop_document(ctx, doc);
+        fz_drop_stream(ctx, stm);
+        fz_drop_buffer(ctx, pdf);
+    }
+    printf("%d of %d object stream tests failed\n", nFailed, (int)dimof(tests));
+    fz_drop_context(ctx);
+}
+
+// loads all pages and their annotations and then every object in random
+// order, which is how page tree loading and annotation scans resolve
+// objects scattered over many object streams
+void BenchObjStm(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        pdf_document* doc = nullptr;
+        int nPages = 0;
+        int nAnnots = 0;
+        fz_var(doc);
+        auto t = TimeGet();
+        fz_try(ctx) {
+            doc = pdf_open_document(ctx, fileNameA.Get());
+            nPages = pdf_count_pages(ctx, doc);
+            for (int pageNo = 0; pageNo < nPages; pageNo++) {
+                pdf_page* page = pdf_load_page(ctx, doc, pageNo);
+                for (pdf_annot* annot = pdf_first_annot(ctx, page); annot; annot = pdf_next_annot(ctx, annot)) {
+                    nAnnots++;
+                }
+                fz_drop_page(ctx, (fz_page*)page);
+            }
+        }
+        fz_catch(ctx) {
+            printf("failed to load pages of '%s'\n", fileNameA.Get());
+            pdf_drop_document(ctx, doc);
+            continue;
+        }
+        double pagesMs = TimeSinceInMs(t);
+
+        int nObjects = pdf_xref_len(ctx, doc);
+        Vec<int> order;
+        for (int num = 1; num < nObjects; num++) {
+            order.Append(num);
+        }
+        srand(1);
+        for (int n = order.isize() - 1; n > 0; n--) {
+            std::swap(order[n], order[rand() % (n + 1)]);
+        }
+        int nFailed = 0;
+        t = TimeGet();
+        for (int num : order) {
+            pdf_obj* obj = nullptr;
+            fz_var(obj);
+            fz_try(ctx) {
+                obj = pdf_load_object(ctx, doc, num);
+            }
+            fz_catch(ctx) {
+                nFailed++;
+            }
+            pdf_drop_obj(ctx, obj);
+        }
+        double objectsMs = TimeSinceInMs(t);
+
+        printf("'%s': %d pages, %d annotations: %.2f ms; %d objects (%d failed) in random order: %.2f ms\n",
+               fileNameA.Get(), nPages, nAnnots, pagesMs, nObjects - 1, nFailed, objectsMs);
+        printf("store pdf_obj: stored: %d, hits: %d, evicted: %d\n", PdfStoreStat(ctx, &fz_store_type_stats::stored),
+               PdfStoreStat(ctx, &fz_store_type_stats::hits), PdfStoreStat(ctx, &fz_store_type_stats::evicted));
+        pdf_drop_document(ctx, doc);
+        fz_empty_store(ctx);
+    }
+    fz_drop_context(ctx);
+}
+
+constexpr int kDictLookupOps = 20000;
+
+// builds a single page PDF whose /ExtGState resources have nResources
+// entries, with a content stream selecting kDictLookupOps of them at random
+static fz_buffer* BuildDictLookupPdf(fz_context* ctx, int nResources) {
+    int64_t ofs[5]{};
+    fz_buffer* content = fz_new_buffer(ctx, kDictLookupOps * 16);
+    srand(1);
+    for (int n = 0; n < kDictLookupOps; n++) {
+        fz_append_printf(ctx, content, "q /GS%d gs Q\n", rand() % nResources);
+    }
+
+    fz_buffer* pdf = fz_new_buffer(ctx, content->len + nResources * 24 + 1024);
+    fz_append_string(ctx, pdf, "%PDF-1.7\n");
+    ofs[1] = pdf->len;
+    fz_append_string(ctx, pdf, "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+    ofs[2] = pdf->len;
+    fz_append_string(ctx, pdf, "2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n");
+    ofs[3] = pdf->len;
+    fz_append_string(ctx, pdf, "3 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] /Contents 4 0 R\n");
+    fz_append_string(ctx, pdf, "/Resources << /ExtGState <<\n");
+    for (int n = 0; n < nResources; n++) {
+        fz_append_printf(ctx, pdf, "/GS%d << /CA 0.5 >>\n", n);
+    }
+    fz_append_string(ctx, pdf, ">> >> >>\nendobj\n");
+    ofs[4] = pdf->len;
+    fz_append_printf(ctx, pdf, "4 0 obj\n<< /Length %d >>\nstream\n", (int)content->len);
+    fz_append_data(ctx, pdf, content->data, content->len);
+    fz_append_string(ctx, pdf, "\nendstream\nendobj\n");
+    fz_drop_buffer(ctx, content);
+
+    int64_t xref = pdf->len;
+    fz_append_string(ctx, pdf, "xref\n0 5\n0000000000 65535 f \n");
+    for (int num = 1; num <= 4; num++) {
+        fz_append_printf(ctx, pdf, "%010d 00000 n \n", (int)ofs[num]);
+    }
+    fz_append_printf(ctx, pdf, "trailer\n<< /Size 5 /Root 1 0 R >>\nstartxref\n%d\n%%%%EOF\n", (int)xref);
+    return pdf;
+}
+
+// times resource lookups in dictionaries below and above the size at
+// which they get a hash index, both through pdf_run_page and directly
+void BenchDictLookup(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    const int kRuns = 5;
+    int sizes[] = {16, 64, 100, 1000, 10000};
+    for (int nResources : sizes) {
+        fz_buffer* pdf = nullptr;
+        fz_stream* stm = nullptr;
+        pdf_document* doc = nullptr;
+        fz_page* page = nullptr;
+        fz_var(pdf);
+        fz_var(stm);
+        fz_var(doc);
+        fz_var(page);
+        double runMs = 0;
+        double getMs = 0;
+        fz_try(ctx) {
+            pdf = BuildDictLookupPdf(ctx, nResources);
+            stm = fz_open_buffer(ctx, pdf);
+            doc = pdf_open_document_with_stream(ctx, stm);
+            page = fz_load_page(ctx, (fz_document*)doc, 0);
+            for (int run = 0; run < kRuns; run++) {
+                fz_rect bbox = fz_empty_rect;
+                fz_device* dev = fz_new_bbox_device(ctx, &bbox);
+                auto t = TimeGet();
+                fz_try(ctx) {
+                    fz_run_page(ctx, page, dev, fz_identity, nullptr);
+                    fz_close_device(ctx, dev);
+                }
+                fz_always(ctx) {
+                    fz_drop_device(ctx, dev);
+                }
+                fz_catch(ctx) {
+                    fz_rethrow(ctx);
+                }
+                double ms = TimeSinceInMs(t);
+                runMs = (run == 0 || ms < runMs) ? ms : runMs;
+            }
+
+            pdf_obj* extGState = pdf_dict_getl(ctx, pdf_page_from_fz_page(ctx, page)->obj, PDF_NAME(Resources),
+                                               PDF_NAME(ExtGState), nullptr);
+            char key[32];
+            for (int run = 0; run < kRuns; run++) {
+                int nFound = 0;
+                srand(1);
+                auto t = TimeGet();
+                for (int n = 0; n < kDictLookupOps; n++) {
+                    str::BufFmt(key, dimof(key), "GS%d", rand() % nResources);
+                    nFound += pdf_dict_gets(ctx, extGState, key) ? 1 : 0;
+                }
+                double ms = TimeSinceInMs(t);
+                getMs = (run == 0 || ms < getMs) ? ms : getMs;
+                ReportIf(nFound != kDictLookupOps);
+            }
+        }
+        fz_always(ctx) {
+            fz_drop_page(ctx, page);
+            pdf_drop_document(ctx, doc);
+            fz_drop_stream(ctx, stm);
+            fz_drop_buffer(ctx, pdf);
+        }
+        fz_catch(ctx) {
+            printf("%d resources: failed\n", nResources);
+            continue;
+        }
+        printf("%d resources: pdf_run_page %.2f ms, %d pdf_dict_gets %.2f ms (%.0f ns each), best of %d\n",
+               nResources, runMs, kDictLookupOps, getMs, getMs * 1e6 / kDictLookupOps, kRuns);
+    }
+    fz_drop_context(ctx);
+}
+
+static LONG gFzMallocs = 0;
+static LONG gFzReallocs = 0;
+static LONG gFzFrees = 0;
+
+static void* CountingFzMalloc(void*, size_t size) {
+    InterlockedIncrement(&gFzMallocs);
+    return malloc(size);
+}
+
+static void* CountingFzRealloc(void*, void* old, size_t size) {
+    InterlockedIncrement(&gFzReallocs);
+    return realloc(old, size);
+}
+
+static void CountingFzFree(void*, void* p) {
+    if (p) {
+        InterlockedIncrement(&gFzFrees);
+    }
+    free(p);
+}
+
+constexpr int kRunArenaPaths = 30000;
+
+// builds a single page PDF resembling a CAD drawing: tens of thousands
+// of short stroked and filled paths with line width, dash and color
+// changes inside q/Q, and a text label for every 50 paths
+static fz_buffer* BuildRunArenaPdf(fz_context* ctx) {
+    int64_t ofs[5]{};
+    fz_buffer* content = fz_new_buffer(ctx, kRunArenaPaths * 64);
+    srand(1);
+    for (int n = 0; n < kRunArenaPaths; n++) {
+        int x = rand() % 1100 + 50;
+        int y = rand() % 800 + 50;
+        int dx = rand() % 40 - 20;
+        int dy = rand() % 40 - 20;
+        fz_append_printf(ctx, content, "q %g w %s%g %g %g RG ", (rand() % 20) / 10.0f + 0.1f,
+                         n % 7 == 0 ? "[3 2] 0 d " : "", (n % 5) / 5.0f, (n % 3) / 3.0f, (n % 11) / 11.0f);
+        if (n % 4 == 0) {
+            fz_append_printf(ctx, content, "%d %d %d %d re B Q
+", x, y, dx, dy);
+        } else {
+            fz_append_printf(ctx, content, "%d %d m %d %d l %d %d %d %d %d %d c S Q
+", x, y, x + dx, y + dy, x, y + dy,
+                             x - dx, y, x + dx, y - dy);
+        }
+        if (n % 50 == 0) {
+            fz_append_printf(ctx, content, "BT /F1 6 Tf %d %d Td (P%d-%d) Tj ET
+", x, y, n, x * y);
+        }
+    }
+
+    fz_buffer* pdf = fz_new_buffer(ctx, content->len + 1024);
+    fz_append_string(ctx, pdf, "%PDF-1.7\n");
+    ofs[1] = pdf->len;
+    fz_append_string(ctx, pdf, "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+    ofs[2] = pdf->len;
+    fz_append_string(ctx, pdf, "2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n");
+    ofs[3] = pdf->len;
+    fz_append_string(ctx, pdf, "3 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 1200 900] /Contents 4 0 R\n");
+    fz_append_string(ctx, pdf, "/Resources << /Font << /F1 << /Type /Font /Subtype /Type1 /BaseFont /Helvetica >> >> >> >>\nendobj\n");
+    ofs[4] = pdf->len;
+    fz_append_printf(ctx, pdf, "4 0 obj\n<< /Length %d >>\nstream\n", (int)content->len);
+    fz_append_data(ctx, pdf, content->data, content->len);
+    fz_append_string(ctx, pdf, "\nendstream\nendobj\n");
+    fz_drop_buffer(ctx, content);
+
+    int64_t xref = pdf->len;
+    fz_append_string(ctx, pdf, "xref\n0 5\n0000000000 65535 f \n");
+    for (int num = 1; num <= 4; num++) {
+        fz_append_printf(ctx, pdf, "%010d 00000 n \n", (int)ofs[num]);
+    }
+    fz_append_printf(ctx, pdf, "trailer\n<< /Size 5 /Root 1 0 R >>\nstartxref\n%d\n%%%%EOF\n", (int)xref);
+    return pdf;
+}
+
+enum class RunArenaMode { BBox, Draw, ListDraw };
+
+static void RunArenaPage(fz_context* ctx, fz_page* page, RunArenaMode mode) {
+    if (mode == RunArenaMode::BBox) {
+        fz_rect bbox = fz_empty_rect;
+        fz_device* dev = fz_new_bbox_device(ctx, &bbox);
+        fz_try(ctx) {
+            fz_run_page(ctx, page, dev, fz_identity, nullptr);
+            fz_close_device(ctx, dev);
+        }
+        fz_always(ctx) {
+            fz_drop_device(ctx, dev);
+        }
+        fz_catch(ctx) {
+            fz_rethrow(ctx);
+        }
+        return;
+    }
+    fz_display_list* list = nullptr;
+    fz_pixmap* pix = nullptr;
+    fz_var(list);
+    fz_try(ctx) {
+        if (mode == RunArenaMode::ListDraw) {
+            // as EngineMupdf does: the list keeps texts and stroke states
+            // made during the run, and is drawn after the run has ended
+            list = fz_new_display_list_from_page(ctx, page);
+            pix = fz_new_pixmap_from_display_list(ctx, list, fz_identity, fz_device_rgb(ctx), 0);
+        } else {
+            pix = fz_new_pixmap_from_page(ctx, page, fz_identity, fz_device_rgb(ctx), 0);
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_pixmap(ctx, pix);
+        fz_drop_display_list(ctx, list);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+// counts the allocations made and measures the time taken while running
+// a generated CAD-like page (or all pages of the given files) with and
+// without the per-run arena
+void BenchRunArena(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    static fz_alloc_context alloc = {nullptr, CountingFzMalloc, CountingFzRealloc, CountingFzFree};
+    fz_context* ctx = NewTestFzContext(&alloc);
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    const int kRuns = 5;
+    const char* modeNames[] = {"bbox", "draw", "list+draw"};
+    RunArenaMode modes[] = {RunArenaMode::BBox, RunArenaMode::Draw, RunArenaMode::ListDraw};
+    int nFiles = i.fileNames.isize();
+    for (int nFile = -1; nFile < nFiles; nFile++) {
+        auto fileNameA(ToUtf8Temp(nFile < 0 ? L"" : i.fileNames[nFile]));
+        const char* name = nFile < 0 ? "generated CAD page" : fileNameA.Get();
+        fz_buffer* pdf = nullptr;
+        fz_stream* stm = nullptr;
+        fz_document* doc = nullptr;
+        fz_var(pdf);
+        fz_var(stm);
+        fz_var(doc);
+        fz_try(ctx) {
+            if (nFile < 0) {
+                pdf = BuildRunArenaPdf(ctx);
+                stm = fz_open_buffer(ctx, pdf);
+                doc = (fz_document*)pdf_open_document_with_stream(ctx, stm);
+            } else {
+                doc = fz_open_document(ctx, name);
+            }
+            int nPages = fz_count_pages(ctx, doc);
+            for (int m = 0; m < (int)dimof(modes); m++) {
+                for (int arena = 0; arena <= 1; arena++) {
+                    fz_tune_run_arena(ctx, arena);
+                    double bestMs = 0;
+                    LONG mallocs = 0, reallocs = 0, frees = 0;
+                    for (int run = 0; run < kRuns; run++) {
+                        LONG m0 = gFzMallocs, r0 = gFzReallocs, f0 = gFzFrees;
+                        auto t = TimeGet();
+                        for (int pageNo = 0; pageNo < nPages; pageNo++) {
+                            fz_page* page = fz_load_page(ctx, doc, pageNo);
+                            fz_try(ctx) {
+                                RunArenaPage(ctx, page, modes[m]);
+                            }
+                            fz_always(ctx) {
+                                fz_drop_page(ctx, page);
+                            }
+                            fz_catch(ctx) {
+                                fz_rethrow(ctx);
+                            }
+                        }
+                        double ms = TimeSinceInMs(t);
+                        bestMs = (run == 0 || ms < bestMs) ? ms : bestMs;
+                        mallocs = gFzMallocs - m0;
+                        reallocs = gFzReallocs - r0;
+                        frees = gFzFrees - f0;
+                    }
+                    printf("%s, %s, arena %s: %.2f ms (best of %d), %d mallocs, %d reallocs, %d frees\n", name,
+                           modeNames[m], arena ? "on" : "off", bestMs, kRuns, (int)mallocs, (int)reallocs,
+                           (int)frees);
+                }
+            }
+        }
+        fz_always(ctx) {
+            fz_tune_run_arena(ctx, 0);
+            fz_drop_document(ctx, doc);
+            fz_drop_stream(ctx, stm);
+            fz_drop_buffer(ctx, pdf);
+        }
+        fz_catch(ctx) {
+            printf("%s: failed\n", name);
+            continue;
+        }
+    }
+    fz_drop_context(ctx);
+}
+
+// writes list with fz_write_display_list() and reads it back
+static fz_display_list* RoundTripDisplayList(fz_context* ctx, fz_display_list* list, size_t* sizeOut) {
+    fz_display_list* res = nullptr;
+    fz_buffer* buf = nullptr;
+    fz_output* out = nullptr;
+    fz_stream* stm = nullptr;
+    fz_var(buf);
+    fz_var(out);
+    fz_var(stm);
+    fz_try(ctx) {
+        buf = fz_new_buffer(ctx, 64 * 1024);
+        out = fz_new_output_with_buffer(ctx, buf);
+        fz_write_display_list(ctx, out, list, nullptr);
+        fz_close_output(ctx, out);
+        *sizeOut = buf->len;
+        stm = fz_open_buffer(ctx, buf);
+        res = fz_read_display_list(ctx, stm, nullptr);
+    }
+    fz_always(ctx) {
+        fz_drop_stream(ctx, stm);
+        fz_drop_output(ctx, out);
+        fz_drop_buffer(ctx, buf);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+    return res;
+}
+
+// loads each page into a display list, writes it out and reads it back,
+// and verifies that both lists render identically
+void TestListSerialize(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        fz_document* doc = nullptr;
+        int nPages = 0;
+        fz_try(ctx) {
+            doc = fz_open_document(ctx, fileNameA.Get());
+            nPages = fz_count_pages(ctx, doc);
+        }
+        fz_catch(ctx) {
+            printf("failed to open '%s'\n", fileNameA.Get());
+            continue;
+        }
+        int nMismatches = 0, nFailed = 0;
+        size_t totalSize = 0;
+        for (int pageNo = 0; pageNo < nPages; pageNo++) {
+            fz_display_list* list = nullptr;
+            fz_display_list* list2 = nullptr;
+            fz_pixmap* pix1 = nullptr;
+            fz_pixmap* pix2 = nullptr;
+            size_t size = 0;
+            fz_var(list);
+            fz_var(list2);
+            fz_var(pix1);
+            fz_var(pix2);
+            fz_try(ctx) {
+                list = fz_new_display_list_from_page_number(ctx, doc, pageNo);
+                list2 = RoundTripDisplayList(ctx, list, &size);
+                pix1 = fz_new_pixmap_from_display_list(ctx, list, fz_identity, fz_device_rgb(ctx), 0);
+                pix2 = fz_new_pixmap_from_display_list(ctx, list2, fz_identity, fz_device_rgb(ctx), 0);
+                totalSize += size;
+                bool same = pix1->w == pix2->w && pix1->h == pix2->h && pix1->stride == pix2->stride &&
+                            memeq(pix1->samples, pix2->samples, (size_t)pix1->stride * pix1->h);
+                if (!same) {
+                    printf("page %d of '%s': replayed list renders differently\n", pageNo + 1, fileNameA.Get());
+                    nMismatches++;
+                }
+            }
+            fz_always(ctx) {
+                fz_drop_pixmap(ctx, pix1);
+                fz_drop_pixmap(ctx, pix2);
+                fz_drop_display_list(ctx, list);
+                fz_drop_display_list(ctx, list2);
+            }
+            fz_catch(ctx) {
+                printf("page %d of '%s': %s\n", pageNo + 1, fileNameA.Get(), fz_caught_message(ctx));
+                nFailed++;
+            }
+        }
+        printf("'%s': %d pages, %d mismatches, %d not serialized, %d bytes\n", fileNameA.Get(), nPages, nMismatches,
+               nFailed, (int)totalSize);
+        fz_drop_document(ctx, doc);
+    }
+    fz_drop_context(ctx);
+}
+
+// compares the time of interpreting each page into a display list
+// with the time of reading the list back after serializing it,
+// both with an empty store and with the page's resources in the store
+void BenchListReplay(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        fz_document* doc = nullptr;
+        int nPages = 0;
+        fz_try(ctx) {
+            doc = fz_open_document(ctx, fileNameA.Get());
+            nPages = fz_count_pages(ctx, doc);
+        }
+        fz_catch(ctx) {
+            printf("failed to open '%s'\n", fileNameA.Get());
+            continue;
+        }
+        double interpretMs = 0, readColdMs = 0, readWarmMs = 0;
+        size_t totalSize = 0;
+        int nFailed = 0;
+        for (int pageNo = 0; pageNo < nPages; pageNo++) {
+            fz_display_list* list = nullptr;
+            fz_buffer* buf = nullptr;
+            fz_output* out = nullptr;
+            fz_stream* stm = nullptr;
+            fz_var(list);
+            fz_var(buf);
+            fz_var(out);
+            fz_var(stm);
+            fz_try(ctx) {
+                fz_empty_store(ctx);
+                auto t = TimeGet();
+                list = fz_new_display_list_from_page_number(ctx, doc, pageNo);
+                interpretMs += TimeSinceInMs(t);
+
+                buf = fz_new_buffer(ctx, 64 * 1024);
+                out = fz_new_output_with_buffer(ctx, buf);
+                fz_write_display_list(ctx, out, list, nullptr);
+                fz_close_output(ctx, out);
+                totalSize += buf->len;
+                fz_drop_display_list(ctx, list);
+                list = nullptr;
+
+                for (int warm = 0; warm <= 1; warm++) {
+                    if (!warm) {
+                        fz_empty_store(ctx);
+                    }
+                    t = TimeGet();
+                    stm = fz_open_buffer(ctx, buf);
+                    list = fz_read_display_list(ctx, stm, nullptr);
+                    (warm ? readWarmMs : readColdMs) += TimeSinceInMs(t);
+                    fz_drop_stream(ctx, stm);
+                    stm = nullptr;
+                    fz_drop_display_list(ctx, list);
+                    list = nullptr;
+                }
+            }
+            fz_always(ctx) {
+                fz_drop_stream(ctx, stm);
+                fz_drop_output(ctx, out);
+                fz_drop_buffer(ctx, buf);
+                fz_drop_display_list(ctx, list);
+            }
+            fz_catch(ctx) {
+                nFailed++;
+            }
+        }
+        printf("'%s': %d pages (%d not serialized), %d bytes, interpret: %.2f ms, read: %.2f ms, read with resources "
+               "in store: %.2f ms\n",
+               fileNameA.Get(), nPages, nFailed, (int)totalSize, interpretMs, readColdMs, readWarmMs);
+        fz_drop_document(ctx, doc);
+    }
+    fz_drop_context(ctx);
+}
+
+// lays out reflowable documents (EPUB, FB2, HTML) at several font sizes,
+// as when the user changes the font size, without and with the shaping
+// cache, and checks that both give the same pages
+void BenchShapeCache(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    fz_context* ctx = NewTestFzContext();
+    if (!ctx) {
+        printf("failed to create fitz context\n");
+        return;
+    }
+    const float emSizes[] = {9, 11, 13, 15, 11};
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        int nPages[2][dimof(emSizes)]{};
+        u8 digests[2][dimof(emSizes)][16]{};
+        double layoutMs[2]{};
+        for (int cached = 0; cached <= 1; cached++) {
+            fz_tune_shape_caching(ctx, cached ? 8 * 1024 * 1024 : 0);
+            fz_purge_shape_cache(ctx);
+            fz_document* doc = nullptr;
+            fz_pixmap* pix = nullptr;
+            fz_var(doc);
+            fz_var(pix);
+            fz_try(ctx) {
+                doc = fz_open_document(ctx, fileNameA.Get());
+                for (int k = 0; k < (int)dimof(emSizes); k++) {
+                    auto t = TimeGet();
+                    fz_layout_document(ctx, doc, 450, 600, emSizes[k]);
+                    nPages[cached][k] = fz_count_pages(ctx, doc);
+                    layoutMs[cached] += TimeSinceInMs(t);
+                    pix = fz_new_pixmap_from_page_number(ctx, doc, nPages[cached][k] / 2, fz_identity,
+                                                         fz_device_rgb(ctx), 0);
+                    fz_md5_pixmap(ctx, pix, digests[cached][k]);
+                    fz_drop_pixmap(ctx, pix);
+                    pix = nullptr;
+                }
+            }
+            fz_always(ctx) {
+                fz_drop_pixmap(ctx, pix);
+                fz_drop_document(ctx, doc);
+            }
+            fz_catch(ctx) {
+                printf("failed to lay out '%s': %s\n", fileNameA.Get(), fz_caught_message(ctx));
+                break;
+            }
+        }
+        int nMismatches = 0;
+        for (int k = 0; k < (int)dimof(emSizes); k++) {
+            if (nPages[0][k] != nPages[1][k] || !memeq(digests[0][k], digests[1][k], 16)) {
+                printf("'%s' at %g pt: laid out differently with the shaping cache\n", fileNameA.Get(), emSizes[k]);
+                nMismatches++;
+            }
+        }
+        fz_shape_cache_stats stats;
+        fz_read_shape_cache_stats(ctx, &stats);
+        int nLookups = stats.hits + stats.misses;
+        printf("'%s': %d mismatches, layout %.1f ms uncached, %.1f ms cached\n", fileNameA.Get(), nMismatches,
+               layoutMs[0], layoutMs[1]);
+        printf("  shaping cache: %d hits, %d misses (%.1f%% hit rate), %d evicted, %d runs, %d of %d bytes\n",
+               stats.hits, stats.misses, nLookups ? 100.0 * stats.hits / nLookups : 0.0, stats.evicted, stats.count,
+               (int)stats.size, (int)stats.max_size);
+    }
+    fz_drop_context(ctx);
+}
+
+// finds all hits of term and returns their number, and a checksum of their positions
+static int FindAllHits(TextSearch* search, const WCHAR* term, u64* checksum) {
+    int nHits = 0;
+    *checksum = 0;
+    for (auto sel = search->FindFirst(1, term); sel; sel = search->FindNext()) {
+        int fromPage, fromGlyph, toPage, toGlyph;
+        search->GetGlyphRange(&fromPage, &fromGlyph, &toPage, &toGlyph);
+        *checksum = *checksum * 31 + (u64)fromPage * 1000003 + (u64)fromGlyph;
+        nHits++;
+    }
+    return nHits;
+}
+
+// searches documents for the term given with -search (or a few common
+// words), page by page as before, with the text of the following pages
+// extracted in parallel, and again once the background indexer has indexed
+// all pages, and checks that all find the same hits
+void BenchSearch(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    Vec<const WCHAR*> terms;
+    if (i.search) {
+        terms.Append(i.search);
+    } else {
+        terms.Append(L"the");
+        terms.Append(L"information");
+        terms.Append(L"in the");
+        terms.Append(L"xyzzy");
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        auto engine = CreateEngine(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileNameA.Get());
+            continue;
+        }
+        int nPages = engine->PageCount();
+        printf("'%s': %d pages\n", fileNameA.Get(), nPages);
+        Vec<int> nHits;
+        Vec<u64> checksums;
+        const char* modeNames[] = {"page by page", "parallel", "indexed"};
+        for (int mode = 0; mode < (int)dimof(modeNames); mode++) {
+            DocumentTextCache textCache(engine);
+            if (mode == 0) {
+                textCache.maxWorkers = 0;
+            }
+            if (mode == 2) {
+                auto t = TimeGet();
+                textCache.StartIndexing();
+                int nPagesIndexed = 0;
+                i64 memory = 0;
+                while (nPagesIndexed < nPages) {
+                    Sleep(500);
+                    textCache.GetIndexProgress(&nPagesIndexed, &memory);
+                    printf("  indexed %d of %d pages, %d kB\n", nPagesIndexed, nPages, (int)(memory / 1024));
+                }
+                printf("  indexing took %.1f ms (index: %d kB)\n", TimeSinceInMs(t),
+                       (int)(textCache.indexSize / 1024));
+            }
+            for (size_t k = 0; k < terms.size(); k++) {
+                const WCHAR* term = terms.at(k);
+                // the first search extracts the text of the pages it looks at, the second one reuses it
+                for (int pass = 0; pass < 2; pass++) {
+                    TextSearch search(engine, &textCache);
+                    u64 checksum;
+                    auto t = TimeGet();
+                    int n = FindAllHits(&search, term, &checksum);
+                    double dur = TimeSinceInMs(t);
+                    printf("  %s '%s' (%s): %d hits in %.1f ms\n", modeNames[mode], ToUtf8Temp(term).Get(),
+                           pass ? "again" : "first", n, dur);
+                    if (mode == 0 && pass == 0) {
+                        nHits.Append(n);
+                        checksums.Append(checksum);
+                    } else if (n != nHits.at(k) || checksum != checksums.at(k)) {
+                        printf("  mismatch: %d hits expected\n", nHits.at(k));
+                    }
+                }
+            }
+        }
+        delete engine;
+    }
+}
+
+// counts the occurrences of common words in the text of documents, repeated
+// up to 10,000 pages, with StrStrI (as TextSearch used to find the anchor)
+// and with the anchor scan over the lower-cased text
+void BenchTextScan(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    Vec<const WCHAR*> words;
+    if (i.search) {
+        words.Append(i.search);
+    } else {
+        words.Append(L"the");
+        words.Append(L"and");
+        words.Append(L"information");
+        words.Append(L"xyzzy");
+    }
+    const int kCorpusPages = 10000;
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        auto engine = CreateEngine(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileNameA.Get());
+            continue;
+        }
+        int nPages = engine->PageCount();
+        DocumentTextCache textCache(engine);
+        i64 nChars = 0;
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            int len;
+            textCache.GetTextForPage(pageNo, &len);
+            nChars += len;
+        }
+        int nReps = (kCorpusPages + nPages - 1) / nPages;
+        double mb = (double)nChars * nReps * sizeof(WCHAR) / (1024 * 1024);
+        printf("'%s': %d pages repeated %d times, %.1f MB of text\n", fileNameA.Get(), nPages, nReps, mb);
+        for (auto word : words) {
+            AutoFreeWstr lower(str::Dup(word));
+            CharLowerBuffW(lower, (DWORD)str::Len(lower));
+            int n = (int)str::Len(word);
+
+            int nFound1 = 0;
+            auto t = TimeGet();
+            for (int rep = 0; rep < nReps; rep++) {
+                for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+                    const WCHAR* s = textCache.GetTextForPage(pageNo);
+                    while ((s = StrStrI(s, word)) != nullptr) {
+                        nFound1++;
+                        s++;
+                    }
+                }
+            }
+            double dur1 = TimeSinceInMs(t);
+
+            int nFound2 = 0;
+            t = TimeGet();
+            for (int rep = 0; rep < nReps; rep++) {
+                for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+                    int len;
+                    const WCHAR* s;
+                    textCache.GetTextForPage(pageNo, &len, nullptr, &s);
+                    const WCHAR* end = s + len;
+                    while ((s = FindAnchorForward(s, (int)(end - s), lower, n)) != nullptr) {
+                        nFound2++;
+                        s++;
+                    }
+                }
+            }
+            double dur2 = TimeSinceInMs(t);
+
+            printf("  '%s': StrStrI %d in %.1f ms (%.0f MB/s), anchor scan %d in %.1f ms (%.0f MB/s)\n",
+                   ToUtf8Temp(word).Get(), nFound1, dur1, mb / dur1 * 1000, nFound2, dur2, mb / dur2 * 1000);
+        }
+        delete engine;
+    }
+}
+
+// finds all hits of common words (or the term given with -search) once with
+// FindFirst/FindNext and once with FindAll, and again with FindAll extending
+// its hits as the background indexer extracts pages, and checks that all
+// find the same hits with the same rects
+void BenchFindAll(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    Vec<const WCHAR*> terms;
+    if (i.search) {
+        terms.Append(i.search);
+    } else {
+        terms.Append(L"the");
+        terms.Append(L"information");
+        terms.Append(L"in the");
+        terms.Append(L"xyzzy");
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        auto engine = CreateEngine(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileNameA.Get());
+            continue;
+        }
+        printf("'%s': %d pages\n", fileNameA.Get(), engine->PageCount());
+        DocumentTextCache textCache(engine);
+        for (auto term : terms) {
+            auto termA(ToUtf8Temp(term));
+            TextSearch search(engine, &textCache);
+            Vec<int> rectPages;
+            Vec<Rect> rects;
+            Vec<int> glyphs;
+            auto t = TimeGet();
+            for (auto sel = search.FindFirst(1, term); sel; sel = search.FindNext()) {
+                int fromPage, fromGlyph, toPage, toGlyph;
+                search.GetGlyphRange(&fromPage, &fromGlyph, &toPage, &toGlyph);
+                glyphs.Append(fromPage);
+                glyphs.Append(fromGlyph);
+                for (int k = 0; k < sel->len; k++) {
+                    rectPages.Append(sel->pages[k]);
+                    rects.Append(sel->rects[k]);
+                }
+            }
+            double dur1 = TimeSinceInMs(t);
+
+            TextSearch search2(engine, &textCache);
+            SearchHits hits;
+            t = TimeGet();
+            search2.FindAll(term, &hits);
+            double dur2 = TimeSinceInMs(t);
+
+            int nHits = glyphs.isize() / 2;
+            bool same = hits.hits.isize() == nHits && hits.rects.isize() == rects.isize();
+            for (int k = 0; same && k < nHits; k++) {
+                SearchHit& hit = hits.hits.at(k);
+                same = hit.startPage == glyphs.at(2 * k) && hit.startGlyph == glyphs.at(2 * k + 1);
+            }
+            for (int k = 0; same && k < rects.isize(); k++) {
+                same = hits.rectPages.at(k) == rectPages.at(k) && hits.rects.at(k) == rects.at(k);
+            }
+            printf("  '%s': FindFirst/FindNext %d hits in %.1f ms, FindAll %d hits in %.1f ms%s\n", termA.Get(),
+                   nHits, dur1, hits.hits.isize(), dur2, same ? "" : " (mismatch)");
+        }
+
+        // extend the hits while a fresh cache is being indexed
+        DocumentTextCache textCache2(engine);
+        textCache2.StartIndexing();
+        TextSearch search(engine, &textCache2);
+        SearchHits hits;
+        int nSteps = 1;
+        auto t = TimeGet();
+        while (!search.FindAll(terms.at(0), &hits, true)) {
+            Sleep(50);
+            nSteps++;
+        }
+        printf("  '%s' while indexing: %d hits in %d steps, %.1f ms\n", ToUtf8Temp(terms.at(0)).Get(),
+               hits.hits.isize(), nSteps, TimeSinceInMs(t));
+        delete engine;
+    }
+}
+
+// the glyph hit-testing did before DocumentTextCache::FindClosestGlyph,
+// looking at all glyphs of the page
+static int FindClosestGlyphLinear(const Rect* coords, int len, Point pt) {
+    uint maxDist = UINT_MAX;
+    bool overGlyph = false;
+    int result = -1;
+    for (int i = 0; i < len; i++) {
+        const Rect& coord = coords[i];
+        if (!coord.x && !coord.dx) {
+            continue;
+        }
+        if (overGlyph && !coord.Contains(pt)) {
+            continue;
+        }
+        uint dist = distSq(pt.x - coord.x - coord.dx / 2, pt.y - coord.y - coord.dy / 2);
+        if (dist < maxDist) {
+            result = i;
+            maxDist = dist;
+        }
+        if (!overGlyph && coord.Contains(pt)) {
+            overGlyph = true;
+            result = i;
+            maxDist = dist;
+        }
+    }
+    return result;
+}
+
+// hit-tests random points on every page with a linear scan over the page's
+// glyphs and with the glyph grid, and checks that both find the same glyphs
+void BenchHitTest(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    const int kPointsPerPage = 2000;
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        auto engine = CreateEngine(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileNameA.Get());
+            continue;
+        }
+        int nPages = engine->PageCount();
+        DocumentTextCache textCache(engine);
+        Vec<Point> points;
+        i64 nGlyphs = 0;
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            int len;
+            textCache.GetTextForPage(pageNo, &len);
+            nGlyphs += len;
+            Rect mediabox = engine->PageMediabox(pageNo).Round();
+            for (int k = 0; k < kPointsPerPage; k++) {
+                int x = mediabox.x + rand() % std::max(mediabox.dx, 1);
+                int y = mediabox.y + rand() % std::max(mediabox.dy, 1);
+                points.Append(Point(x, y));
+            }
+        }
+        printf("'%s': %d pages, %d glyphs\n", fileNameA.Get(), nPages, (int)nGlyphs);
+
+        Vec<int> glyphs;
+        auto t = TimeGet();
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            int len;
+            Rect* coords;
+            textCache.GetTextForPage(pageNo, &len, &coords);
+            for (int k = 0; k < kPointsPerPage; k++) {
+                glyphs.Append(FindClosestGlyphLinear(coords, len, points.at((pageNo - 1) * kPointsPerPage + k)));
+            }
+        }
+        double dur1 = TimeSinceInMs(t);
+
+        int nMismatches = 0;
+        t = TimeGet();
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            for (int k = 0; k < kPointsPerPage; k++) {
+                int idx = (pageNo - 1) * kPointsPerPage + k;
+                if (textCache.FindClosestGlyph(pageNo, points.at(idx)) != glyphs.at(idx)) {
+                    nMismatches++;
+                }
+            }
+        }
+        double dur2 = TimeSinceInMs(t);
+
+        int nQueries = nPages * kPointsPerPage;
+        printf("  linear: %.1f ms (%.2f us per query), grid: %.1f ms (%.2f us per query, incl. building), "
+               "%d mismatches\n",
+               dur1, dur1 * 1000 / nQueries, dur2, dur2 * 1000 / nQueries, nMismatches);
+        delete engine;
+    }
+}
+
+static void PrintTextCacheMemory(DocumentTextCache* textCache) {
+    TextCacheMemory mem;
+    textCache->GetMemoryReport(&mem);
+    printf("  %d of %d pages cached, %d decoded, text: %d kB + %d kB decoded, index: %d kB, %d evicted, %d extracted "
+           "again\n",
+           mem.nPagesCached, mem.nPages, mem.nPagesDecoded, (int)(mem.compactSize / 1024),
+           (int)(mem.decodedSize / 1024), (int)(mem.indexSize / 1024), mem.nEvicted, mem.nReextracted);
+}
+
+// checks that the text cache returns the text as extracted, and compares the
+// memory it needs and the time a search takes without a memory limit and
+// with a limit of a quarter of the memory needed for the compact text
+void BenchTextCache(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    const WCHAR* term = i.search ? i.search : L"the";
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        auto engine = CreateEngine(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileNameA.Get());
+            continue;
+        }
+        int nPages = engine->PageCount();
+        printf("'%s': %d pages\n", fileNameA.Get(), nPages);
+
+        i64 extractedSize = 0;
+        i64 compactSize = 0;
+        for (int limited = 0; limited < 2; limited++) {
+            DocumentTextCache textCache(engine);
+            textCache.maxWorkers = 0;
+            if (limited) {
+                textCache.maxMemory = compactSize / 4;
+                printf("limited to %d kB:\n", (int)(textCache.maxMemory / 1024));
+            } else {
+                textCache.maxMemory = INT64_MAX;
+                printf("unlimited:\n");
+            }
+
+            auto t = TimeGet();
+            for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+                textCache.CacheTextForPage(pageNo);
+            }
+            printf("  extracting took %.1f ms\n", TimeSinceInMs(t));
+            PrintTextCacheMemory(&textCache);
+
+            int nMismatches = 0;
+            for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+                PageText extracted = engine->ExtractPageText(pageNo);
+                int len;
+                Rect* coords;
+                const WCHAR* text = textCache.GetTextForPage(pageNo, &len, &coords);
+                bool same = len == extracted.len && memeq(text, extracted.text, len * sizeof(WCHAR));
+                for (int k = 0; same && k < len; k++) {
+                    same = coords[k] == extracted.coords[k];
+                }
+                if (!same) {
+                    nMismatches++;
+                }
+                if (!limited) {
+                    extractedSize += (i64)(extracted.len + 1) * sizeof(WCHAR) + extracted.len * sizeof(Rect);
+                }
+                FreePageText(&extracted);
+            }
+            if (!limited) {
+                TextCacheMemory mem;
+                textCache.GetMemoryReport(&mem);
+                compactSize = mem.compactSize;
+                printf("  extracted text: %d kB, compact: %d kB (%.1f%%)\n", (int)(extractedSize / 1024),
+                       (int)(compactSize / 1024), 100.0 * compactSize / std::max(extractedSize, (i64)1));
+            }
+            printf("  %d pages differ from the extracted text\n", nMismatches);
+            PrintTextCacheMemory(&textCache);
+
+            for (int pass = 0; pass < 2; pass++) {
+                TextSearch search(engine, &textCache);
+                u64 checksum;
+                t = TimeGet();
+                int n = FindAllHits(&search, term, &checksum);
+                printf("  search '%s': %d hits in %.1f ms\n", ToUtf8Temp(term).Get(), n, TimeSinceInMs(t));
+            }
+            PrintTextCacheMemory(&textCache);
+        }
+        delete engine;
+    }
+}
+
+// compares FindAll for literal search text in regex and literal mode (which
+// should find the same hits in about the same time) and times a few patterns
+// (or the one given with -search) that only a regex can search for
+void BenchRegex(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    const WCHAR* literals[] = {L"the", L"information", L"in the", L"xyzzy"};
+    Vec<const WCHAR*> patterns;
+    if (i.search) {
+        patterns.Append(i.search);
+    } else {
+        patterns.Append(L"inform\\w+");
+        patterns.Append(L"th(e|is|at)\\b");
+        patterns.Append(L"\\b[a-z]+tion\\b");
+        patterns.Append(L"\\d{4}");
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        auto engine = CreateEngine(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileNameA.Get());
+            continue;
+        }
+        printf("'%s': %d pages\n", fileNameA.Get(), engine->PageCount());
+        DocumentTextCache textCache(engine);
+        // extract all the text up front so that only searching is timed
+        for (int pageNo = 1; pageNo <= engine->PageCount(); pageNo++) {
+            textCache.CacheTextForPage(pageNo);
+        }
+
+        for (auto term : literals) {
+            auto termA(ToUtf8Temp(term));
+            TextSearch search(engine, &textCache);
+            SearchHits hits;
+            auto t = TimeGet();
+            search.FindAll(term, &hits);
+            double dur1 = TimeSinceInMs(t);
+
+            TextSearch search2(engine, &textCache);
+            search2.SetRegex(true);
+            SearchHits hits2;
+            t = TimeGet();
+            search2.FindAll(term, &hits2);
+            double dur2 = TimeSinceInMs(t);
+
+            // a regex doesn't infer anything from a trailing space
+            bool same = hits.hits.isize() == hits2.hits.isize();
+            for (int k = 0; same && k < hits.hits.isize(); k++) {
+                same = hits.hits.at(k).startPage == hits2.hits.at(k).startPage &&
+                       hits.hits.at(k).startGlyph == hits2.hits.at(k).startGlyph;
+            }
+            printf("  '%s': literal %d hits in %.1f ms, regex %d hits in %.1f ms%s\n", termA.Get(),
+                   hits.hits.isize(), dur1, hits2.hits.isize(), dur2, same ? "" : " (mismatch)");
+        }
+
+        for (auto pattern : patterns) {
+            auto patternA(ToUtf8Temp(pattern));
+            for (int wholeWords = 0; wholeWords < 2; wholeWords++) {
+                TextSearch search(engine, &textCache);
+                search.SetRegex(true);
+                search.SetWholeWords(wholeWords != 0);
+                SearchHits hits;
+                auto t = TimeGet();
+                search.FindAll(pattern, &hits);
+                if (!search.IsPatternValid()) {
+                    printf("  '%s': invalid pattern\n", patternA.Get());
+                    break;
+                }
+                printf("  '%s'%s: %d hits in %.1f ms\n", patternA.Get(), wholeWords ? " (whole words)" : "",
+                       hits.hits.isize(), TimeSinceInMs(t));
+            }
+        }
+        delete engine;
+    }
+}
+
+// times folding the text of all pages for a loose search and compares
+// FindAll with and without folding for the term given with -search (or
+// a few words that fold differently)
+void BenchFoldText(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    Vec<const WCHAR*> terms;
+    if (i.search) {
+        terms.Append(i.search);
+    } else {
+        terms.Append(L"the");
+        terms.Append(L"information");
+        terms.Append(L"file");
+        terms.Append(L"cafe");
+    }
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        auto engine = CreateEngine(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileNameA.Get());
+            continue;
+        }
+        int nPages = engine->PageCount();
+        printf("'%s': %d pages\n", fileNameA.Get(), nPages);
+        DocumentTextCache textCache(engine);
+        // decode the text of all pages up front so that only folding is timed
+        textCache.maxMemory = INT64_MAX;
+        i64 nGlyphs = 0;
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            int len;
+            textCache.GetTextForPage(pageNo, &len);
+            nGlyphs += len;
+        }
+        i64 nFolded = 0;
+        auto t = TimeGet();
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            int len;
+            textCache.GetFoldedTextForPage(pageNo, &len);
+            nFolded += len;
+        }
+        double dur = TimeSinceInMs(t);
+        printf("  folded %d glyphs into %d characters in %.1f ms (%.1f Mglyphs/s)\n", (int)nGlyphs, (int)nFolded,
+               dur, dur > 0 ? nGlyphs / dur / 1000 : 0);
+
+        for (auto term : terms) {
+            auto termA(ToUtf8Temp(term));
+            TextSearch search(engine, &textCache);
+            SearchHits hits;
+            t = TimeGet();
+            search.FindAll(term, &hits);
+            double dur1 = TimeSinceInMs(t);
+
+            TextSearch search2(engine, &textCache);
+            search2.SetFolding(true);
+            SearchHits hits2;
+            t = TimeGet();
+            search2.FindAll(term, &hits2);
+            double dur2 = TimeSinceInMs(t);
+
+            // a loose search finds at least the hits of a case-insensitive one
+            int nFound = 0;
+            for (int k = 0, k2 = 0; k < hits.hits.isize() && k2 < hits2.hits.isize(); k2++) {
+                SearchHit& hit = hits.hits.at(k);
+                SearchHit& hit2 = hits2.hits.at(k2);
+                if (hit.startPage == hit2.startPage && hit.startGlyph == hit2.startGlyph &&
+                    hit.endPage == hit2.endPage && hit.endGlyph == hit2.endGlyph) {
+                    nFound++;
+                    k++;
+                }
+            }
+            printf("  '%s': %d hits in %.1f ms, folded %d hits in %.1f ms%s\n", termA.Get(), hits.hits.isize(),
+                   dur1, hits2.hits.isize(), dur2, nFound == hits.hits.isize() ? "" : " (missing hits)");
+        }
+        delete engine;
+    }
+}
+
+// saves the text index of documents as it's persisted between sessions and
+// compares the first search for the term given with -search (or a few common
+// words) in a new session with and without loading the saved index
+void BenchTextIndex(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    Vec<const WCHAR*> terms;
+    if (i.search) {
+        terms.Append(i.search);
+    } else {
+        terms.Append(L"the");
+        terms.Append(L"information");
+        terms.Append(L"xyzzy");
+    }
+    AutoFreeWstr indexPathW(path::GetTempFilePath(L"idx"));
+    char* indexPath = ToUtf8Temp(indexPathW);
+    for (auto fileName : files) {
+        auto fileNameA(ToUtf8Temp(fileName));
+        auto engine = CreateEngine(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileNameA.Get());
+            continue;
+        }
+        int nPages = engine->PageCount();
+        printf("'%s': %d pages\n", fileNameA.Get(), nPages);
+        file::Delete(indexPath);
+        {
+            DocumentTextCache textCache(engine);
+            textCache.SetIndexPath(indexPath);
+            auto t = TimeGet();
+            for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+                textCache.CacheTextForPage(pageNo);
+            }
+            printf("  indexed in %.1f ms\n", TimeSinceInMs(t));
+            t = TimeGet();
+            bool ok = textCache.SaveIndex();
+            printf("  %s the index (%d kB) in %.1f ms\n", ok ? "saved" : "failed to save",
+                   (int)(file::GetSize(indexPath) / 1024), TimeSinceInMs(t));
+        }
+        for (size_t k = 0; k < terms.size(); k++) {
+            const WCHAR* term = terms.at(k);
+            auto termA(ToUtf8Temp(term));
+            // each in a new session, the first one without the saved index
+            u64 checksums[2]{};
+            int nHits[2]{};
+            for (int pass = 0; pass < 2; pass++) {
+                DocumentTextCache textCache(engine);
+                TextSearch search(engine, &textCache);
+                auto t = TimeGet();
+                if (pass == 1) {
+                    // as done by the indexer thread
+                    textCache.SetIndexPath(indexPath);
+                    textCache.LoadIndex();
+                }
+                nHits[pass] = FindAllHits(&search, term, &checksums[pass]);
+                printf("  '%s' (%s): %d hits in %.1f ms\n", termA.Get(), pass ? "saved index" : "no index",
+                       nHits[pass], TimeSinceInMs(t));
+            }
+            if (nHits[0] != nHits[1] || checksums[0] != checksums[1]) {
+                printf("  mismatch: %d hits expected\n", nHits[0]);
+            }
+        }
+        file::Delete(indexPath);
+        delete engine;
+    }
+}
@@ -3,3 +3,21 @@
 
 void TestRenderPage(const Flags& i);
 void TestExtractPage(const Flags& i);
+void TestJpxThreads(const Flags& i);
+void BenchPageDecode(const Flags& i);
+void BenchLexer(const Flags& i);
+void TestObjStm(const Flags& i);
+void BenchObjStm(const Flags& i);
+void BenchDictLookup(const Flags& i);
+void BenchRunArena(const Flags& i);
+void TestListSerialize(const Flags& i);
+void BenchListReplay(const Flags& i);
+void BenchShapeCache(const Flags& i);
+void BenchSearch(const Flags& i);
+void BenchTextScan(const Flags& i);
+void BenchFindAll(const Flags& i);
+void BenchHitTest(const Flags& i);
+void BenchTextCache(const Flags& i);
+void BenchRegex(const Flags& i);
+void BenchFoldText(const Flags& i);
+void BenchTextIndex(const Flags& i);
@@ -0,0 +1,682 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+#include "utils/BaseUtil.h"
+
+#include "TextRegex.h"
+
+constexpr uint kReDigit = 1;
+constexpr uint kReWord = 2;
+constexpr uint kReSpace = 4;
+constexpr uint kReNotDigit = 8;
+constexpr uint kReNotWord = 16;
+constexpr uint kReNotSpace = 32;
+
+// limits protecting against patterns that would compile to huge programs
+constexpr int kMaxRepeat = 1000;
+constexpr int kMaxProgLen = 20000;
+constexpr int kMaxNesting = 100;
+
+enum class ReNodeType { Empty, Char, Any, Class, Assert, Concat, Alt, Repeat };
+
+// the parsed pattern, compiled into the program of a TextRegex
+struct ReNode {
+    ReNodeType type = ReNodeType::Empty;
+    WCHAR c = 0;
+    ReOp op = ReOp::Match; // of an Assert
+    int cls = 0;
+    int left = -1;
+    int right = -1;
+    int min = 0;
+    int max = 0; // -1 for no limit
+    bool greedy = true;
+};
+
+static WCHAR CharToLower(WCHAR c) {
+    CharLowerBuffW(&c, 1);
+    return c;
+}
+
+static bool IsDigit(WCHAR c) {
+    return '0' <= c && c <= '9';
+}
+
+// the same as isWordChar (from TextSelection.cpp, which the unit tests don't link)
+static bool IsWordChar(WCHAR c) {
+    return IsCharAlphaNumeric(c) || c == '_';
+}
+
+// the characters a literal search also matches for '-', '\'' and '"' (cf. TextSearch::MatchEnd)
+static bool IsTypographicVariant(WCHAR c, WCHAR variant) {
+    switch (c) {
+        case '-':
+            return 0x2010 <= variant && variant <= 0x2014;
+        case '\'':
+            return 0x2018 <= variant && variant <= 0x201b;
+        case '"':
+            return 0x201c <= variant && variant <= 0x201f;
+    }
+    return false;
+}
+
+static int HexValue(const WCHAR*& s, int nDigits) {
+    int v = 0;
+    for (int i = 0; i < nDigits; i++, s++) {
+        WCHAR c = *s;
+        int d = IsDigit(c) ? c - '0' : 'a' <= (c | 0x20) && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+        if (d < 0) {
+            return -1;
+        }
+        v = v * 16 + d;
+    }
+    return v;
+}
+
+struct ReParser {
+    const WCHAR* s = nullptr;
+    bool ignoreCase = false;
+    Vec<ReNode> nodes;
+    Vec<ReClass*>* classes = nullptr;
+    int depth = 0;
+    bool failed = false;
+
+    int Add(ReNodeType type, int left = -1, int right = -1) {
+        ReNode n;
+        n.type = type;
+        n.left = left;
+        n.right = right;
+        nodes.Append(n);
+        return nodes.isize() - 1;
+    }
+    int AddChar(WCHAR c) {
+        int n = Add(ReNodeType::Char);
+        nodes[n].c = ignoreCase ? CharToLower(c) : c;
+        return n;
+    }
+    int AddClass(ReClass* cls) {
+        classes->Append(cls);
+        int n = Add(ReNodeType::Class);
+        nodes[n].cls = classes->isize() - 1;
+        return n;
+    }
+    int AddKinds(uint kinds) {
+        auto cls = new ReClass();
+        cls->kinds = kinds;
+        return AddClass(cls);
+    }
+    int AddAssert(ReOp op) {
+        int n = Add(ReNodeType::Assert);
+        nodes[n].op = op;
+        return n;
+    }
+    int AddRepeat(int child, int min, int max, bool greedy) {
+        int n = Add(ReNodeType::Repeat, child);
+        nodes[n].min = min;
+        nodes[n].max = max;
+        nodes[n].greedy = greedy;
+        return n;
+    }
+
+    int Fail() {
+        failed = true;
+        return -1;
+    }
+
+    int ParseAlt();
+    int ParseConcat();
+    int ParseRepeat();
+    int ParseAtom();
+    int ParseEscape();
+    bool ParseClassChar(WCHAR* c, uint* kinds);
+    int ParseClass();
+};
+
+int ReParser::ParseAlt() {
+    if (++depth > kMaxNesting) {
+        return Fail();
+    }
+    int n = ParseConcat();
+    while (!failed && *s == '|') {
+        s++;
+        n = Add(ReNodeType::Alt, n, ParseConcat());
+    }
+    depth--;
+    return n;
+}
+
+int ReParser::ParseConcat() {
+    int n = Add(ReNodeType::Empty);
+    while (!failed && *s && *s != '|' && *s != ')') {
+        n = Add(ReNodeType::Concat, n, ParseRepeat());
+    }
+    return n;
+}
+
+// parses the counts of {m}, {m,} and {m,n}, returns false if there are none
+// (in which case '{' is a literal character)
+static bool ParseCounts(const WCHAR*& s, int* min, int* max) {
+    const WCHAR* c = s + 1;
+    if (!IsDigit(*c)) {
+        return false;
+    }
+    *min = 0;
+    for (; IsDigit(*c); c++) {
+        *min = std::min(*min * 10 + (*c - '0'), kMaxRepeat + 1);
+    }
+    *max = *min;
+    if (*c == ',') {
+        c++;
+        *max = -1;
+        if (IsDigit(*c)) {
+            *max = 0;
+            for (; IsDigit(*c); c++) {
+                *max = std::min(*max * 10 + (*c - '0'), kMaxRepeat + 1);
+            }
+        }
+    }
+    if (*c != '}') {
+        return false;
+    }
+    s = c + 1;
+    return true;
+}
+
+int ReParser::ParseRepeat() {
+    int n = ParseAtom();
+    while (!failed) {
+        int min, max;
+        if (*s == '*' || *s == '+' || *s == '?') {
+            min = *s == '+' ? 1 : 0;
+            max = *s == '?' ? 1 : -1;
+            s++;
+        } else if (*s != '{' || !ParseCounts(s, &min, &max)) {
+            break;
+        }
+        if (min > kMaxRepeat || max > kMaxRepeat || (max != -1 && max < min)) {
+            return Fail();
+        }
+        bool greedy = true;
+        if (*s == '?') {
+            greedy = false;
+            s++;
+        }
+        n = AddRepeat(n, min, max, greedy);
+    }
+    return n;
+}
+
+int ReParser::ParseAtom() {
+    WCHAR c = *s++;
+    switch (c) {
+        case '(': {
+            if (s[0] == '?' && s[1] == ':') {
+                s += 2;
+            }
+            int n = ParseAlt();
+            if (*s != ')') {
+                return Fail();
+            }
+            s++;
+            return n;
+        }
+        case '[':
+            return ParseClass();
+        case '.':
+            return Add(ReNodeType::Any);
+        case '^':
+            return AddAssert(ReOp::LineStart);
+        case '$':
+            return AddAssert(ReOp::LineEnd);
+        case '\\':
+            return ParseEscape();
+        case '*':
+        case '+':
+        case '?':
+            // nothing to repeat
+            return Fail();
+    }
+    if (str::IsWs(c)) {
+        // as in a literal search, any whitespace matches any amount of whitespace
+        while (str::IsWs(*s)) {
+            s++;
+        }
+        return AddRepeat(AddKinds(kReSpace), 1, -1, true);
+    }
+    return AddChar(c);
+}
+
+// parses the character after a backslash (also in a class), returning
+// either a character or the kinds of characters it stands for
+bool ReParser::ParseClassChar(WCHAR* c, uint* kinds) {
+    *kinds = 0;
+    WCHAR e = *s++;
+    switch (e) {
+        case 0:
+            return false;
+        case 'd':
+            *kinds = kReDigit;
+            return true;
+        case 'D':
+            *kinds = kReNotDigit;
+            return true;
+        case 'w':
+            *kinds = kReWord;
+            return true;
+        case 'W':
+            *kinds = kReNotWord;
+            return true;
+        case 's':
+            *kinds = kReSpace;
+            return true;
+        case 'S':
+            *kinds = kReNotSpace;
+            return true;
+        case 'n':
+            *c = '\n';
+            return true;
+        case 'r':
+            *c = '\r';
+            return true;
+        case 't':
+            *c = '\t';
+            return true;
+        case 'x':
+        case 'u': {
+            int v = HexValue(s, e == 'x' ? 2 : 4);
+            *c = (WCHAR)v;
+            return v >= 0;
+        }
+    }
+    // other letters and digits might be given a meaning later on
+    if (e < 0x80 && isalnum(e)) {
+        return false;
+    }
+    *c = e;
+    return true;
+}
+
+int ReParser::ParseEscape() {
+    if (*s == 'b' || *s == 'B') {
+        return AddAssert(*s++ == 'b' ? ReOp::WordBoundary : ReOp::NotWordBoundary);
+    }
+    WCHAR c;
+    uint kinds;
+    if (!ParseClassChar(&c, &kinds)) {
+        return Fail();
+    }
+    return kinds ? AddKinds(kinds) : AddChar(c);
+}
+
+int ReParser::ParseClass() {
+    auto cls = new ReClass();
+    int n = AddClass(cls);
+    if (*s == '^') {
+        cls->negated = true;
+        s++;
+    }
+    // a ']' right at the start is a literal one
+    for (bool first = true; *s && (*s != ']' || first); first = false) {
+        WCHAR lo, hi;
+        uint kinds = 0;
+        if (*s == '\\') {
+            s++;
+            if (!ParseClassChar(&lo, &kinds)) {
+                return Fail();
+            }
+            if (kinds) {
+                cls->kinds |= kinds;
+                continue;
+            }
+        } else {
+            lo = *s++;
+        }
+        hi = lo;
+        if (s[0] == '-' && s[1] && s[1] != ']') {
+            s++;
+            if (*s == '\\') {
+                s++;
+                if (!ParseClassChar(&hi, &kinds) || kinds) {
+                    return Fail();
+                }
+            } else {
+                hi = *s++;
+            }
+            if (hi < lo) {
+                return Fail();
+            }
+        }
+        cls->ranges.Append(lo);
+        cls->ranges.Append(hi);
+        if (ignoreCase && hi - lo < 512) {
+            // the text is lower-cased, so upper-case characters must match their lower-case forms
+            for (int i = lo; i <= hi; i++) {
+                WCHAR l = CharToLower((WCHAR)i);
+                if (l < lo || l > hi) {
+                    cls->ranges.Append(l);
+                    cls->ranges.Append(l);
+                }
+            }
+        }
+    }
+    if (*s != ']') {
+        return Fail();
+    }
+    s++;
+    return n;
+}
+
+struct ReCompiler {
+    Vec<ReNode>& nodes;
+    Vec<ReInst>& prog;
+    bool failed = false;
+
+    int Emit(ReOp op, WCHAR c = 0, int x = 0) {
+        ReInst inst;
+        inst.op = op;
+        inst.c = c;
+        inst.x = x;
+        prog.Append(inst);
+        return prog.isize() - 1;
+    }
+    void Compile(int n);
+};
+
+// returns the parts of a (left-nested) concatenation in order
+static void FlattenConcat(Vec<ReNode>& nodes, int n, Vec<int>& parts) {
+    int first = parts.isize();
+    for (; nodes[n].type == ReNodeType::Concat; n = nodes[n].left) {
+        parts.Append(nodes[n].right);
+    }
+    parts.Append(n);
+    std::reverse(parts.begin() + first, parts.end());
+}
+
+void ReCompiler::Compile(int n) {
+    if (failed || prog.isize() > kMaxProgLen) {
+        failed = true;
+        return;
+    }
+    ReNode node = nodes[n];
+    switch (node.type) {
+        case ReNodeType::Empty:
+            break;
+        case ReNodeType::Char:
+            Emit(ReOp::Char, node.c);
+            break;
+        case ReNodeType::Any:
+            Emit(ReOp::Any);
+            break;
+        case ReNodeType::Class:
+            Emit(ReOp::Class, 0, node.cls);
+            break;
+        case ReNodeType::Assert:
+            Emit(node.op);
+            break;
+        case ReNodeType::Concat: {
+            Vec<int> parts;
+            FlattenConcat(nodes, n, parts);
+            for (int part : parts) {
+                Compile(part);
+            }
+            break;
+        }
+        case ReNodeType::Alt: {
+            int split = Emit(ReOp::Split);
+            prog[split].x = prog.isize();
+            Compile(node.left);
+            int jmp = Emit(ReOp::Jmp);
+            prog[split].y = prog.isize();
+            Compile(node.right);
+            prog[jmp].x = prog.isize();
+            break;
+        }
+        case ReNodeType::Repeat: {
+            for (int i = 0; i < node.min; i++) {
+                Compile(node.left);
+            }
+            Vec<int> splits;
+            if (node.max == -1) {
+                int split = Emit(ReOp::Split);
+                splits.Append(split);
+                Compile(node.left);
+                Emit(ReOp::Jmp, 0, split);
+            } else {
+                for (int i = node.min; i < node.max; i++) {
+                    splits.Append(Emit(ReOp::Split));
+                    Compile(node.left);
+                }
+            }
+            // either continue with (another) repetition or after all of them
+            int end = prog.isize();
+            for (int split : splits) {
+                prog[split].x = node.greedy ? split + 1 : end;
+                prog[split].y = node.greedy ? end : split + 1;
+            }
+            break;
+        }
+    }
+}
+
+// collects the literal characters all matches of node n start with,
+// returns false if they don't make up all of node n
+static bool CollectPrefix(Vec<ReNode>& nodes, int n, str::WStr& prefix) {
+    ReNode& node = nodes[n];
+    switch (node.type) {
+        case ReNodeType::Empty:
+            return true;
+        case ReNodeType::Char:
+            // candidates are found by exact comparison, so no characters with variants
+            if (str::IsWs(node.c) || node.c == '-' || node.c == '\'' || node.c == '"') {
+                return false;
+            }
+            prefix.Append(node.c);
+            return true;
+        case ReNodeType::Concat: {
+            Vec<int> parts;
+            FlattenConcat(nodes, n, parts);
+            for (int part : parts) {
+                if (!CollectPrefix(nodes, part, prefix)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+TextRegex* CompileTextRegex(const WCHAR* pattern, bool ignoreCase, bool wholeWords) {
+    auto re = new TextRegex();
+    ReParser parser;
+    parser.s = pattern;
+    parser.ignoreCase = ignoreCase;
+    parser.classes = &re->classes;
+    int root = parser.ParseAlt();
+    // also fails for an unbalanced ')'
+    if (parser.failed || *parser.s) {
+        delete re;
+        return nullptr;
+    }
+
+    ReCompiler compiler{parser.nodes, re->prog};
+    if (wholeWords) {
+        compiler.Emit(ReOp::NotInWord);
+    }
+    compiler.Compile(root);
+    if (wholeWords) {
+        compiler.Emit(ReOp::NotInWord);
+    }
+    compiler.Emit(ReOp::Match);
+    if (compiler.failed) {
+        delete re;
+        return nullptr;
+    }
+
+    str::WStr prefix;
+    CollectPrefix(parser.nodes, root, prefix);
+    if (prefix.size() > 0) {
+        re->prefix = prefix.StealData();
+    }
+    re->marks.SetSize(re->prog.size());
+    memset(re->marks.LendData(), 0, re->marks.size() * sizeof(u32));
+    return re;
+}
+
+TextRegex::~TextRegex() {
+    str::Free(prefix);
+    DeleteVecMembers(classes);
+}
+
+static bool ClassMatches(const ReClass* cls, WCHAR c) {
+    bool matches = false;
+    for (size_t i = 0; i + 1 < cls->ranges.size() && !matches; i += 2) {
+        matches = cls->ranges[i] <= c && c <= cls->ranges[i + 1];
+    }
+    if (!matches && cls->kinds) {
+        uint k = cls->kinds;
+        matches = ((k & kReDigit) && IsDigit(c)) || ((k & kReNotDigit) && !IsDigit(c)) ||
+                  ((k & kReWord) && IsWordChar(c)) || ((k & kReNotWord) && !IsWordChar(c)) ||
+                  ((k & kReSpace) && str::IsWs(c)) || ((k & kReNotSpace) && !str::IsWs(c));
+    }
+    return matches != cls->negated;
+}
+
+static bool IsLineBreak(WCHAR c) {
+    return c == '\n' || c == '\r';
+}
+
+// reads the text from a glyph of a page on, going on to the following pages
+// (reading a page break as '\n') and ending with 0 at the end of the document
+struct ReReader {
+    TextRegexInput* input = nullptr;
+    int page = 0;
+    int idx = 0;
+    int len = 0;
+    const WCHAR* s = nullptr;
+    int nBreaks = 0;
+
+    WCHAR Peek() const {
+        if (idx < len) {
+            return s[idx];
+        }
+        return page < input->nPages ? '\n' : 0;
+    }
+    void Advance() {
+        if (idx < len) {
+            idx++;
+            return;
+        }
+        page++;
+        idx = 0;
+        s = input->GetPageText(page, &len);
+        nBreaks++;
+    }
+};
+
+// a Pike VM: all the ways the pattern can match are followed at once, one
+// character at a time, ordered by priority, so that the first match found
+// is the one a backtracking matcher would find
+bool TextRegex::MatchAt(TextRegexInput* input, int pageNo, int start, int* endPageOut, int* endGlyphOut) {
+    ReReader r;
+    r.input = input;
+    r.page = pageNo;
+    r.idx = start;
+    r.s = input->GetPageText(pageNo, &r.len);
+    WCHAR prev = start > 0 ? r.s[start - 1] : pageNo > 1 ? '\n' : 0;
+
+    auto nextMark = [this]() {
+        if (++mark == 0) {
+            memset(marks.LendData(), 0, marks.size() * sizeof(u32));
+            mark = 1;
+        }
+    };
+    // adds the threads following pc (without consuming a character) in priority order
+    auto addThreads = [this](Vec<int>& list, int pc, WCHAR prev, WCHAR next) {
+        stack.Reset();
+        stack.Append(pc);
+        while (stack.size() > 0) {
+            pc = stack.Pop();
+            if (marks[pc] == mark) {
+                continue;
+            }
+            marks[pc] = mark;
+            const ReInst& inst = prog[pc];
+            bool pass = true;
+            switch (inst.op) {
+                case ReOp::Jmp:
+                    stack.Append(inst.x);
+                    continue;
+                case ReOp::Split:
+                    stack.Append(inst.y);
+                    stack.Append(inst.x);
+                    continue;
+                case ReOp::WordBoundary:
+                    pass = IsWordChar(prev) != IsWordChar(next);
+                    break;
+                case ReOp::NotWordBoundary:
+                    pass = IsWordChar(prev) == IsWordChar(next);
+                    break;
+                case ReOp::NotInWord:
+                    pass = !IsWordChar(prev) || !IsWordChar(next);
+                    break;
+                case ReOp::LineStart:
+                    pass = !prev || IsLineBreak(prev);
+                    break;
+                case ReOp::LineEnd:
+                    pass = !next || IsLineBreak(next);
+                    break;
+                default:
+                    list.Append(pc);
+                    continue;
+            }
+            if (pass) {
+                stack.Append(pc + 1);
+            }
+        }
+    };
+
+    threads.Reset();
+    nextMark();
+    addThreads(threads, 0, prev, r.Peek());
+    bool found = false;
+    for (int nConsumed = 0; threads.size() > 0; nConsumed++) {
+        WCHAR c = r.Peek();
+        nextThreads.Reset();
+        for (int pc : threads) {
+            const ReInst& inst = prog[pc];
+            if (inst.op == ReOp::Match) {
+                if (nConsumed == 0) {
+                    continue;
+                }
+                // threads of lower priority don't matter anymore
+                found = true;
+                *endPageOut = r.page;
+                *endGlyphOut = r.idx;
+                break;
+            }
+            bool consumes = false;
+            if (inst.op == ReOp::Char) {
+                consumes = c == inst.c || IsTypographicVariant(inst.c, c);
+            } else if (inst.op == ReOp::Any) {
+                consumes = c && !IsLineBreak(c);
+            } else if (inst.op == ReOp::Class) {
+                consumes = c && ClassMatches(classes[inst.x], c);
+            }
+            if (consumes) {
+                nextThreads.Append(pc + 1);
+            }
+        }
+        if (nextThreads.size() == 0 || (r.idx >= r.len && r.nBreaks >= kMaxPageBreaks)) {
+            break;
+        }
+        r.Advance();
+        WCHAR next = r.Peek();
+        threads.Reset();
+        nextMark();
+        for (int pc : nextThreads) {
+            addThreads(threads, pc, c, next);
+        }
+    }
+    return found;
+}
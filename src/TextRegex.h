@@ -0,0 +1,74 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// the text of the pages of a document a TextRegex is matched against
+struct TextRegexInput {
+    int nPages = 0;
+    // the text of a page (lower-cased when matching case-insensitively)
+    virtual const WCHAR* GetPageText(int pageNo, int* lenOut) = 0;
+    virtual ~TextRegexInput() = default;
+};
+
+enum class ReOp : u8 {
+    Char,  // c (or one of its typographic variants)
+    Any,   // any character but a line break
+    Class, // classes[x]
+    Split, // continue at x and, with lower priority, at y
+    Jmp,   // continue at x
+    WordBoundary,
+    NotWordBoundary,
+    NotInWord, // not between two word characters (for whole words)
+    LineStart,
+    LineEnd,
+    Match,
+};
+
+struct ReInst {
+    ReOp op = ReOp::Match;
+    WCHAR c = 0;
+    int x = 0;
+    int y = 0;
+};
+
+struct ReClass {
+    // pairs of the first and last character of a range
+    Vec<WCHAR> ranges;
+    // combination of kReDigit, kReWord, kReSpace and their negations
+    uint kinds = 0;
+    bool negated = false;
+};
+
+// a match can span at most that many page breaks
+constexpr int kMaxPageBreaks = 2;
+
+// a regular expression for searching the text of pages. Supported are
+// literal characters, ., [...] and [^...] classes, \d \w \s (and \D \W \S),
+// \b \B ^ $, groups with | alternatives and the quantifiers * + ? {m,n}
+// (also lazy). As in a literal search, a space matches any whitespace, a
+// page break reads as a line break and '-', '\'' and '"' also match the
+// typographic dashes and quotes. Matching takes time linear in the length
+// of the match (there's no backtracking)
+struct TextRegex {
+    Vec<ReInst> prog;
+    Vec<ReClass*> classes;
+    // literal characters all matches start with, for finding candidates quickly
+    WCHAR* prefix = nullptr;
+
+    // the state while matching
+    Vec<int> threads;
+    Vec<int> nextThreads;
+    Vec<int> stack;
+    Vec<u32> marks;
+    u32 mark = 0;
+
+    ~TextRegex();
+
+    // returns the end of the first non-empty match starting at glyph start of
+    // page pageNo (the one a backtracking matcher would find)
+    bool MatchAt(TextRegexInput* input, int pageNo, int start, int* endPageOut, int* endGlyphOut);
+};
+
+// returns nullptr if the pattern isn't valid. With ignoreCase, the pattern is
+// matched against lower-cased text. With wholeWords, matches can neither start
+// nor end within a word
+TextRegex* CompileTextRegex(const WCHAR* pattern, bool ignoreCase, bool wholeWords);
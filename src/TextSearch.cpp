@@ -12,8 +12,13 @@
 #include "EngineBase.h"
 #include "ProgressUpdateUI.h"
 #include "TextSelection.h"
+#include "TextRegex.h"
 #include "TextSearch.h"
 
+#if IS_INTEL_32 || IS_INTEL_64
+#include <emmintrin.h>
+#endif
+
 #define SkipWhitespace(c) for (; str::IsWs(*(c)); (c)++)
 // ignore spaces between CJK glyphs but not between Latin, Greek, Cyrillic, etc. letters
 // cf. http://code.google.com/p/sumatrapdf/issues/detail?id=959
@@ -34,12 +39,110 @@ TextSearch::~TextSearch() {
     Clear();
 }
 
+void TextSearch::ClearRegex() {
+    delete regex;
+    regex = nullptr;
+    invalidPattern = false;
+}
+
 void TextSearch::Reset() {
+    if (pageTextPage) {
+        textCache->ReleasePage(pageTextPage);
+        pageTextPage = 0;
+    }
     pageText = nullptr;
+    pageTextLower = nullptr;
+    pageTextLen = 0;
     TextSelection::Reset();
 }
 
+// the text searched on a page and its lower-cased version (both the folded text when folding)
+const WCHAR* TextSearch::GetSearchText(int pageNo, int* lenOut, const WCHAR** lowerOut) const {
+    if (folding) {
+        *lowerOut = textCache->GetFoldedTextForPage(pageNo, lenOut);
+        return *lowerOut;
+    }
+    return textCache->GetTextForPage(pageNo, lenOut, nullptr, lowerOut);
+}
+
+void TextSearch::SetPageText(int pageNo) {
+    pageText = GetSearchText(pageNo, &pageTextLen, &pageTextLower);
+    // matches going on over many pages (e.g. empty ones) ask for more pages
+    // than stay pinned while the page is still searched
+    textCache->HoldPage(pageNo);
+    if (pageTextPage) {
+        textCache->ReleasePage(pageTextPage);
+    }
+    pageTextPage = pageNo;
+}
+
+// hits are found at offsets into the searched text, which are the glyphs' indices unless it's folded
+
+int TextSearch::StartGlyph(int pageNo, int offset) const {
+    if (!folding) {
+        return offset;
+    }
+    const int* glyphs;
+    textCache->GetFoldedTextForPage(pageNo, nullptr, &glyphs);
+    return glyphs[offset];
+}
+
+int TextSearch::EndGlyph(int pageNo, int offset) const {
+    if (!folding || offset == 0) {
+        return offset;
+    }
+    const int* glyphs;
+    textCache->GetFoldedTextForPage(pageNo, nullptr, &glyphs);
+    // a hit includes the diacritics following it, and all of a ligature it ends within
+    return std::max(glyphs[offset - 1] + 1, glyphs[offset]);
+}
+
+int TextSearch::GlyphOffset(int pageNo, int glyph) const {
+    if (!folding) {
+        return glyph;
+    }
+    int len;
+    const int* glyphs;
+    textCache->GetFoldedTextForPage(pageNo, &len, &glyphs);
+    return (int)(std::lower_bound(glyphs, glyphs + len, glyph) - glyphs);
+}
+
+// a hit starts with the anchor, so pages already indexed that can't contain it don't
+// have to be searched at all (the index is of the page text, not the folded one)
+bool TextSearch::MayContainAnchor(int pageNo) const {
+    return !anchor || folding || textCache->MayContainWord(pageNo, anchor);
+}
+
+static WCHAR* DupLower(const WCHAR* s) {
+    WCHAR* res = str::Dup(s);
+    CharLowerBuffW(res, (DWORD)str::Len(res));
+    return res;
+}
+
+// extract anchor string (the first word or the first symbol) for faster searching
+static WCHAR* ExtractAnchor(const WCHAR* text) {
+    if (isnoncjkwordchar(*text)) {
+        const WCHAR* end;
+        for (end = text; isnoncjkwordchar(*end); end++) {
+            ;
+        }
+        return str::Dup(text, end - text);
+    }
+    // Adobe Reader also matches certain hard-to-type Unicode
+    // characters when searching for easy-to-type homoglyphs
+    // cf. https://web.archive.org/web/20140201013717/http://forums.fofou.org:80/sumatrapdf/topic?id=2432337&comments=3
+    if (*text == '-' || *text == '\'' || *text == '"') {
+        return nullptr;
+    }
+    return str::Dup(text, 1);
+}
+
 void TextSearch::SetText(const WCHAR* text) {
+    if (useRegex) {
+        SetPattern(text);
+        return;
+    }
+
     // search text starting with a single space enables the 'Match word start'
     // and search text ending in a single space enables the 'Match word end' option
     // (that behavior already "kind of" exists without special treatment, but
@@ -58,24 +161,8 @@ void TextSearch::SetText(const WCHAR* text) {
 
     this->Clear();
     this->lastText = str::Dup(text);
-    this->findText = str::Dup(text);
-
-    // extract anchor string (the first word or the first symbol) for faster searching
-    if (isnoncjkwordchar(*text)) {
-        const WCHAR* end;
-        for (end = text; isnoncjkwordchar(*end); end++) {
-            ;
-        }
-        anchor = str::Dup(text, end - text);
-    }
-    // Adobe Reader also matches certain hard-to-type Unicode
-    // characters when searching for easy-to-type homoglyphs
-    // cf. https://web.archive.org/web/20140201013717/http://forums.fofou.org:80/sumatrapdf/topic?id=2432337&comments=3
-    else if (*text == '-' || *text == '\'' || *text == '"') {
-        anchor = nullptr;
-    } else {
-        anchor = str::Dup(text, 1);
-    }
+    this->findText = folding ? FoldText(text, (int)str::Len(text), nullptr) : str::Dup(text);
+    anchor = ExtractAnchor(findText);
 
     if (str::Len(this->findText) >= INT_MAX) {
         this->findText[(unsigned)INT_MAX - 1] = '\0';
@@ -83,15 +170,125 @@ void TextSearch::SetText(const WCHAR* text) {
     if (str::EndsWith(this->findText, L" ")) {
         this->findText[str::Len(this->findText) - 1] = '\0';
     }
+    this->findTextLower = DupLower(this->findText);
+    if (anchor) {
+        anchorLower = DupLower(anchor);
+    }
+
+    markAllPagesNonSkip(pagesToSkip);
+}
+
+// a pattern without any of these is matched as literal text (which is just as
+// tolerant of whitespace and the typographic variants of '-', '\'' and '"')
+static const WCHAR* kRegexSpecialChars = L"\\.[]()|*+?{}^$";
+
+static bool IsLiteralPattern(const WCHAR* pattern) {
+    if (str::IsWs(*pattern)) {
+        return false;
+    }
+    for (const WCHAR* c = pattern; *c; c++) {
+        if (str::FindChar(kRegexSpecialChars, *c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the pattern matching text literally
+static WCHAR* EscapePattern(const WCHAR* text) {
+    str::WStr res;
+    for (const WCHAR* c = text; *c; c++) {
+        if (str::FindChar(kRegexSpecialChars, *c)) {
+            res.Append('\\');
+        }
+        res.Append(*c);
+    }
+    return res.StealData();
+}
+
+// in regex mode, the search text is used as is (spaces don't imply any options)
+void TextSearch::SetPattern(const WCHAR* pattern) {
+    matchWordStart = false;
+    matchWordEnd = false;
+    if (str::Eq(lastText, pattern)) {
+        return;
+    }
+
+    Clear();
+    lastText = str::Dup(pattern);
+    bool fold = folding && IsLiteralPattern(pattern);
+    findText = fold ? FoldText(pattern, (int)str::Len(pattern), nullptr) : str::Dup(pattern);
+    findTextLower = DupLower(findText);
+    UpdatePattern();
+}
+
+// (re)compiles findText for the current options
+void TextSearch::UpdatePattern() {
+    ClearRegex();
+    str::ReplaceWithCopy(&anchor, nullptr);
+    str::ReplaceWithCopy(&anchorLower, nullptr);
+    if (IsLiteralPattern(lastText)) {
+        // as fast as a literal search
+        anchor = ExtractAnchor(findText);
+    } else {
+        // the folded text is lower-cased
+        regex = CompileTextRegex(findText, !caseSensitive || folding, wholeWords);
+        invalidPattern = !regex;
+        // all hits start with the regex's prefix, so it's an anchor as good as any
+        if (regex && regex->prefix) {
+            anchor = str::Dup(regex->prefix);
+        }
+    }
+    if (anchor) {
+        anchorLower = DupLower(anchor);
+    }
 
     markAllPagesNonSkip(pagesToSkip);
 }
 
+bool TextSearch::HasPattern() const {
+    return !str::IsEmpty(findText) && !invalidPattern;
+}
+
 void TextSearch::SetSensitive(bool sensitive) {
     if (caseSensitive == sensitive) {
         return;
     }
     this->caseSensitive = sensitive;
+    // a regex is compiled for matching either case-sensitively or not
+    if (useRegex && findText) {
+        UpdatePattern();
+    }
+
+    markAllPagesNonSkip(pagesToSkip);
+}
+
+void TextSearch::SetRegex(bool enable) {
+    if (useRegex == enable) {
+        return;
+    }
+    useRegex = enable;
+    // the search text has to be set again (FindFirst, FindAll)
+    Clear();
+}
+
+void TextSearch::SetFolding(bool enable) {
+    if (folding == enable) {
+        return;
+    }
+    folding = enable;
+    // the search text has to be set again (FindFirst, FindAll)
+    Clear();
+}
+
+void TextSearch::SetWholeWords(bool enable) {
+    if (wholeWords == enable) {
+        return;
+    }
+    wholeWords = enable;
+    if (useRegex && findText) {
+        UpdatePattern();
+    }
 
     markAllPagesNonSkip(pagesToSkip);
 }
@@ -102,7 +299,14 @@ void TextSearch::SetDirection(TextSearchDirection direction) {
         return;
     }
     this->forward = forward;
-    if (findText) {
+    if (findText && regex) {
+        // the length of a regex's hit depends on the text it matched
+        if (forward) {
+            findIndex = endPage == findPage ? GlyphOffset(findPage, endGlyph) : pageTextLen;
+        } else {
+            findIndex = startPage == findPage ? GlyphOffset(findPage, startGlyph) : 0;
+        }
+    } else if (findText) {
         int n = (int)str::Len(findText);
         if (forward) {
             findIndex += n;
@@ -117,33 +321,37 @@ void TextSearch::SetLastResult(TextSelection* sel) {
 
     AutoFreeWstr selection(ExtractText(L" "));
     str::NormalizeWSInPlace(selection);
-    SetText(selection);
+    int n;
+    if (useRegex) {
+        AutoFreeWstr pattern(EscapePattern(selection));
+        SetText(pattern);
+        n = (int)str::Len(selection);
+    } else {
+        SetText(selection);
+        n = (int)str::Len(findText);
+    }
 
     searchHitStartAt = findPage = std::min(startPage, endPage);
-    findIndex = (findPage == startPage ? startGlyph : endGlyph) + (int)str::Len(findText);
-    pageText = textCache->GetTextForPage(findPage);
+    findIndex = GlyphOffset(findPage, findPage == startPage ? startGlyph : endGlyph) + n;
+    SetPageText(findPage);
     forward = true;
 }
 
-static WCHAR CharToLower2(WCHAR c) {
-    WCHAR buf[1] = {c};
-    CharLowerBuffW(buf, 1);
-    return buf[0];
-}
+// the text of the document as a TextRegex reads it
+struct TextCacheRegexInput : TextRegexInput {
+    DocumentTextCache* textCache = nullptr;
+    bool lowerCase = false;
+    bool folded = false;
 
-static inline WCHAR CharToLower(WCHAR c) {
-    // fast path that hopefully will be inlined
-    if (c >= 'a' && c <= 'z') {
-        return c;
-    }
-    if (c >= '0' && c <= '9') {
-        return c;
-    }
-    if (c >= 'A' && c <= 'Z') {
-        return c + 32;
+    const WCHAR* GetPageText(int pageNo, int* lenOut) override {
+        if (folded) {
+            return textCache->GetFoldedTextForPage(pageNo, lenOut);
+        }
+        const WCHAR* lower;
+        const WCHAR* text = textCache->GetTextForPage(pageNo, lenOut, nullptr, &lower);
+        return lowerCase ? lower : text;
     }
-    return CharToLower2(c);
-}
+};
 
 // try to match "findText" from "start" with whitespace tolerance
 // (ignore all whitespace except after alphanumeric characters)
@@ -152,9 +360,25 @@ TextSearch::PageAndOffset TextSearch::MatchEnd(const WCHAR* start) const {
     const PageAndOffset notFound = {-1, -1};
     int currentPage = findPage;
     const WCHAR* currentPageText = pageText;
+    const WCHAR* currentPageLower = pageTextLower;
     bool lookingAtWs;
 
-    if (matchWordStart && start > pageText && isWordChar(start[-1]) && isWordChar(start[0])) {
+    if (regex) {
+        TextCacheRegexInput input;
+        input.nPages = nPages;
+        input.textCache = textCache;
+        input.lowerCase = !caseSensitive;
+        input.folded = folding;
+        PageAndOffset res;
+        if (!regex->MatchAt(&input, findPage, (int)(start - pageText), &res.page, &res.offset)) {
+            return notFound;
+        }
+        return res;
+    }
+
+    bool wordStart = matchWordStart || wholeWords;
+    bool wordEnd = matchWordEnd || wholeWords;
+    if (wordStart && start > pageText && isWordChar(start[-1]) && isWordChar(start[0])) {
         return notFound;
     }
 
@@ -172,9 +396,7 @@ TextSearch::PageAndOffset TextSearch::MatchEnd(const WCHAR* start) const {
         if (caseSensitive) {
             isMatch = *match == *end;
         } else {
-            WCHAR matchLower = CharToLower(*match);
-            WCHAR matchEnd = CharToLower(*end);
-            isMatch = matchLower == matchEnd;
+            isMatch = findTextLower[match - findText] == currentPageLower[end - currentPageText];
         }
         if (isMatch) {
             /* characters are identical */;
@@ -204,7 +426,7 @@ TextSearch::PageAndOffset TextSearch::MatchEnd(const WCHAR* start) const {
             // ... or because we were looking at whitespace in the pattern and we were at a page break
             // -> skip to next page
             ++currentPage;
-            end = currentPageText = textCache->GetTextForPage(currentPage);
+            end = currentPageText = GetSearchText(currentPage, nullptr, &currentPageLower);
         }
         // treat "??" and "? ?" differently, since '?' could have been a word
         // character that's just missing an encoding (and '?' is the replacement
@@ -216,12 +438,12 @@ TextSearch::PageAndOffset TextSearch::MatchEnd(const WCHAR* start) const {
             while ((!*end) && (currentPage < nPages)) {
                 // treat page break as whitespace, too
                 ++currentPage;
-                end = currentPageText = textCache->GetTextForPage(currentPage);
+                end = currentPageText = GetSearchText(currentPage, nullptr, &currentPageLower);
                 SkipWhitespace(end);
             }
         }
     }
-    if (matchWordEnd && end > currentPageText && isWordChar(end[-1]) && isWordChar(end[0])) {
+    if (wordEnd && end > currentPageText && isWordChar(end[-1]) && isWordChar(end[0])) {
         return notFound;
     }
 
@@ -229,6 +451,79 @@ TextSearch::PageAndOffset TextSearch::MatchEnd(const WCHAR* start) const {
     return {currentPage, off};
 }
 
+// the anchor scans compare 8 candidate positions at once by their first two
+// characters and only compare the rest of the needle where both match
+
+const WCHAR* FindAnchorForward(const WCHAR* s, int len, const WCHAR* needle, int n) {
+    if (n <= 0 || len < n) {
+        return nullptr;
+    }
+    int last = len - n; // the last position where needle fits
+    int i = 0;
+#if IS_INTEL_32 || IS_INTEL_64
+    if (n >= 2) {
+        __m128i first = _mm_set1_epi16((short)needle[0]);
+        __m128i second = _mm_set1_epi16((short)needle[1]);
+        for (; i + 7 <= last; i += 8) {
+            __m128i c1 = _mm_loadu_si128((const __m128i*)(s + i));
+            __m128i c2 = _mm_loadu_si128((const __m128i*)(s + i + 1));
+            __m128i eq = _mm_and_si128(_mm_cmpeq_epi16(c1, first), _mm_cmpeq_epi16(c2, second));
+            // two bits per matching position
+            uint mask = (uint)_mm_movemask_epi8(eq);
+            while (mask) {
+                unsigned long bit;
+                _BitScanForward(&bit, mask);
+                const WCHAR* c = s + i + bit / 2;
+                if (memeq(c + 2, needle + 2, (n - 2) * sizeof(WCHAR))) {
+                    return c;
+                }
+                mask &= ~(3u << bit);
+            }
+        }
+    }
+#endif
+    for (; i <= last; i++) {
+        if (s[i] == needle[0] && memeq(s + i + 1, needle + 1, (n - 1) * sizeof(WCHAR))) {
+            return s + i;
+        }
+    }
+    return nullptr;
+}
+
+const WCHAR* FindAnchorBackward(const WCHAR* s, int len, int end, const WCHAR* needle, int n) {
+    if (n <= 0 || len < n) {
+        return nullptr;
+    }
+    int i = std::min(end - 1, len - n); // the first position to try
+#if IS_INTEL_32 || IS_INTEL_64
+    if (n >= 2) {
+        __m128i first = _mm_set1_epi16((short)needle[0]);
+        __m128i second = _mm_set1_epi16((short)needle[1]);
+        for (; i - 7 >= 0; i -= 8) {
+            __m128i c1 = _mm_loadu_si128((const __m128i*)(s + i - 7));
+            __m128i c2 = _mm_loadu_si128((const __m128i*)(s + i - 6));
+            __m128i eq = _mm_and_si128(_mm_cmpeq_epi16(c1, first), _mm_cmpeq_epi16(c2, second));
+            uint mask = (uint)_mm_movemask_epi8(eq);
+            while (mask) {
+                unsigned long bit;
+                _BitScanReverse(&bit, mask);
+                const WCHAR* c = s + i - 7 + bit / 2;
+                if (memeq(c + 2, needle + 2, (n - 2) * sizeof(WCHAR))) {
+                    return c;
+                }
+                mask &= ~(3u << (bit - 1));
+            }
+        }
+    }
+#endif
+    for (; i >= 0; i--) {
+        if (s[i] == needle[0] && memeq(s + i + 1, needle + 1, (n - 1) * sizeof(WCHAR))) {
+            return s + i;
+        }
+    }
+    return nullptr;
+}
+
 static const WCHAR* GetNextIndex(const WCHAR* base, int offset, bool forward) {
     const WCHAR* c = base + offset + (forward ? 0 : -1);
     if (c < base || !*c) {
@@ -238,7 +533,7 @@ static const WCHAR* GetNextIndex(const WCHAR* base, int offset, bool forward) {
 }
 
 bool TextSearch::FindTextInPage(int pageNo, TextSearch::PageAndOffset* finalGlyph) {
-    if (str::IsEmpty(findText)) {
+    if (!HasPattern()) {
         return false;
     }
     if (!pageNo) {
@@ -254,15 +549,21 @@ bool TextSearch::FindTextInPage(int pageNo, TextSearch::PageAndOffset* finalGlyp
     do {
         if (!anchor) {
             found = GetNextIndex(pageText, findIndex, forward);
-        } else if (forward) {
-            const WCHAR* s = pageText + findIndex;
-            if (caseSensitive) {
-                found = StrStr(s, anchor);
+        } else {
+            // scan the lower-cased text for a case-insensitive search
+            // (MatchEnd checks the case for a case-sensitive one)
+            const WCHAR* s = caseSensitive && forward ? pageText : pageTextLower;
+            const WCHAR* needle = caseSensitive && forward ? anchor : anchorLower;
+            int n = (int)str::Len(needle);
+            if (forward) {
+                int start = std::min(findIndex, pageTextLen);
+                found = FindAnchorForward(s + start, pageTextLen - start, needle, n);
             } else {
-                found = StrStrI(s, anchor);
+                found = FindAnchorBackward(s, pageTextLen, findIndex, needle, n);
+            }
+            if (found) {
+                found = pageText + (found - s);
             }
-        } else {
-            found = StrRStrI(pageText, pageText + findIndex, anchor);
         }
         if (!found) {
             return false;
@@ -273,8 +574,8 @@ bool TextSearch::FindTextInPage(int pageNo, TextSearch::PageAndOffset* finalGlyp
 
     int offset = (int)(found - pageText);
     searchHitStartAt = pageNo;
-    StartAt(pageNo, offset);
-    SelectUpTo(fg.page, fg.offset);
+    StartAt(pageNo, StartGlyph(pageNo, offset));
+    SelectUpTo(fg.page, EndGlyph(fg.page, fg.offset));
     findIndex = forward ? fg.offset : offset;
 
     // try again if the found text is completely outside the page's mediabox
@@ -288,11 +589,26 @@ bool TextSearch::FindTextInPage(int pageNo, TextSearch::PageAndOffset* finalGlyp
     return true;
 }
 
+// how many of the following pages to extract in parallel while searching a page
+constexpr int kPrefetchPages = 16;
+
+void TextSearch::PrefetchPagesAfter(int pageNo, int next) {
+    Vec<int> pages;
+    for (int n = pageNo + next; 1 <= n && n <= nPages && pages.isize() < kPrefetchPages; n += next) {
+        if (!pagesToSkip[n - 1] && !textCache->HasTextForPage(n)) {
+            pages.Append(n);
+        }
+    }
+    textCache->PrefetchPages(pages);
+}
+
 bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker) {
-    if (str::IsEmpty(findText)) {
+    if (!HasPattern()) {
         return false;
     }
 
+    // pages are still searched one after another, in order, so that hits are
+    // found in document order; only their text is extracted in parallel
     int next = forward ? 1 : -1;
     while (1 <= pageNo && pageNo <= nPages && (!tracker || !tracker->WasCanceled())) {
         if (tracker) {
@@ -303,10 +619,17 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker) {
             pageNo += next;
             continue;
         }
+        if (!MayContainAnchor(pageNo)) {
+            pagesToSkip[pageNo - 1] = true;
+            pageNo += next;
+            continue;
+        }
 
         Reset();
 
-        pageText = textCache->GetTextForPage(pageNo, &findIndex);
+        PrefetchPagesAfter(pageNo, next);
+        SetPageText(pageNo);
+        findIndex = pageTextLen;
         if (pageText) {
             if (forward) {
                 findIndex = 0;
@@ -316,10 +639,11 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker) {
                 if (forward) {
                     if (findPage != r.page) {
                         findPage = r.page;
-                        pageText = textCache->GetTextForPage(findPage);
+                        SetPageText(findPage);
                     }
                     findIndex = r.offset;
                 }
+                textCache->PrefetchPages(Vec<int>());
                 return true;
             }
             pagesToSkip[pageNo - 1] = true;
@@ -327,6 +651,7 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker) {
 
         pageNo += next;
     }
+    textCache->PrefetchPages(Vec<int>());
 
     // allow for the first/last page to be included in the next search
     searchHitStartAt = findPage = forward ? nPages + 1 : 0;
@@ -334,6 +659,123 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker) {
     return false;
 }
 
+// appends the hits starting on the current page from hits->nextGlyph on,
+// without going through the selection (and reallocating it) for every hit
+void TextSearch::FindAllInPage(int pageNo, SearchHits* hits) {
+    const WCHAR* s = caseSensitive ? pageText : pageTextLower;
+    const WCHAR* needle = caseSensitive ? anchor : anchorLower;
+    int n = anchor ? (int)str::Len(needle) : 0;
+    int start = std::min(hits->nextGlyph, pageTextLen);
+
+    hits->nextPage = pageNo + 1;
+    hits->nextGlyph = 0;
+    for (;;) {
+        const WCHAR* found;
+        if (anchor) {
+            found = FindAnchorForward(s + start, pageTextLen - start, needle, n);
+            if (found) {
+                found = pageText + (found - s);
+            }
+        } else {
+            found = GetNextIndex(pageText, start, true);
+        }
+        if (!found) {
+            return;
+        }
+        int offset = (int)(found - pageText);
+        PageAndOffset fg = MatchEnd(found);
+        if (fg.page <= 0) {
+            start = offset + 1;
+            continue;
+        }
+
+        SearchHit hit;
+        hit.startPage = pageNo;
+        hit.startGlyph = StartGlyph(pageNo, offset);
+        hit.endPage = fg.page;
+        hit.endGlyph = EndGlyph(fg.page, fg.offset);
+        hit.firstRect = hits->rects.isize();
+        for (int p = pageNo; p <= fg.page; p++) {
+            int from = p == pageNo ? hit.startGlyph : 0;
+            int to = hit.endGlyph;
+            if (p != fg.page) {
+                textCache->GetTextForPage(p, &to);
+            }
+            AppendGlyphRects(textCache, engine, p, from, to - from, hits->rectPages, hits->rects);
+        }
+        hit.nRects = hits->rects.isize() - hit.firstRect;
+        // as for FindNext, skip hits that are completely outside the page's mediabox
+        if (hit.nRects > 0) {
+            hits->hits.Append(hit);
+        }
+
+        // continue after the hit, on the page it ends on
+        if (fg.page != pageNo) {
+            hits->nextPage = fg.page;
+            hits->nextGlyph = fg.offset;
+            return;
+        }
+        start = fg.offset;
+    }
+}
+
+bool TextSearch::FindAll(const WCHAR* text, SearchHits* hits, bool onlyExtracted, ProgressUpdateUI* tracker) {
+    SetText(text);
+    if (!HasPattern()) {
+        return true;
+    }
+
+    // FindAll only borrows the page from FindFirst/FindNext
+    int prevFindPage = findPage;
+    bool done = true;
+    while (hits->nextPage <= nPages) {
+        int pageNo = hits->nextPage;
+        if (tracker) {
+            if (tracker->WasCanceled()) {
+                done = false;
+                break;
+            }
+            tracker->UpdateProgress(pageNo, nPages);
+        }
+        if (onlyExtracted && !textCache->HasTextForPage(pageNo)) {
+            done = false;
+            break;
+        }
+
+        bool fromStart = hits->nextGlyph == 0;
+        if (fromStart && (pagesToSkip[pageNo - 1] || !MayContainAnchor(pageNo))) {
+            pagesToSkip[pageNo - 1] = true;
+            hits->nextPage++;
+            continue;
+        }
+
+        if (!onlyExtracted) {
+            PrefetchPagesAfter(pageNo, 1);
+        }
+        findPage = pageNo;
+        SetPageText(pageNo);
+        int nHits = hits->hits.isize();
+        if (pageText) {
+            FindAllInPage(pageNo, hits);
+        } else {
+            hits->nextPage++;
+            hits->nextGlyph = 0;
+        }
+        if (fromStart && hits->hits.isize() == nHits && hits->nextPage == pageNo + 1) {
+            pagesToSkip[pageNo - 1] = true;
+        }
+    }
+    if (!onlyExtracted) {
+        textCache->PrefetchPages(Vec<int>());
+    }
+
+    findPage = prevFindPage;
+    if (1 <= findPage && findPage <= nPages) {
+        SetPageText(findPage);
+    }
+    return done;
+}
+
 TextSel* TextSearch::FindFirst(int page, const WCHAR* text, ProgressUpdateUI* tracker) {
     SetText(text);
 
@@ -356,12 +798,18 @@ TextSel* TextSearch::FindNext(ProgressUpdateUI* tracker) {
         tracker->UpdateProgress(findPage, nPages);
     }
 
+    // the page's text might have been evicted from the cache since the last call
+    // (and there's nothing left to search on a page beyond the document's ones)
     PageAndOffset finalGlyph;
-    if (FindTextInPage(findPage, &finalGlyph)) {
+    bool onPage = 1 <= findPage && findPage <= nPages;
+    if (onPage) {
+        SetPageText(findPage);
+    }
+    if (onPage && FindTextInPage(findPage, &finalGlyph)) {
         if (forward) {
             findPage = finalGlyph.page;
             findIndex = finalGlyph.offset;
-            pageText = textCache->GetTextForPage(findPage);
+            SetPageText(findPage);
         }
         return &result;
     }
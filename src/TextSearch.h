@@ -4,6 +4,30 @@
 enum class TextSearchDirection : bool { Backward = false, Forward = true };
 
 struct ProgressUpdateUI;
+struct TextRegex;
+
+// a single hit of TextSearch::FindAll, from startGlyph on startPage up to
+// (excluding) endGlyph on endPage, highlighted by rects[firstRect .. firstRect + nRects)
+struct SearchHit {
+    int startPage = 0;
+    int startGlyph = 0;
+    int endPage = 0;
+    int endGlyph = 0;
+    int firstRect = 0;
+    int nRects = 0;
+};
+
+// all hits of a search, in document order; the rects of all hits
+// are stored together, rectPages[i] being the page of rects[i]
+struct SearchHits {
+    Vec<SearchHit> hits;
+    Vec<int> rectPages;
+    Vec<Rect> rects;
+    // where to continue searching when extending the hits
+    // (nextGlyph being an offset into the folded text when folding)
+    int nextPage = 1;
+    int nextGlyph = 0;
+};
 
 class TextSearch : public TextSelection {
   public:
@@ -11,10 +35,22 @@ class TextSearch : public TextSelection {
     ~TextSearch();
 
     void SetSensitive(bool sensitive);
+    // the search text is a regular expression (cf. TextRegex.h) instead of literal text
+    void SetRegex(bool enable);
+    // hits can neither start nor end within a word
+    void SetWholeWords(bool enable);
+    // the search text is matched against the page text folded by FoldText, ignoring
+    // case, diacritics, ligatures and full-width forms (a regex isn't folded, though)
+    void SetFolding(bool enable);
     void SetDirection(TextSearchDirection direction);
     void SetLastResult(TextSelection* sel);
     TextSel* FindFirst(int page, const WCHAR* text, ProgressUpdateUI* tracker = nullptr);
     TextSel* FindNext(ProgressUpdateUI* tracker = nullptr);
+    // appends all the hits from hits->nextPage on to hits, in a single pass over the
+    // document. With onlyExtracted, stops at the first page whose text hasn't been
+    // extracted yet (e.g. by the indexer), so that hits can be extended later on.
+    // returns true once the whole document has been searched
+    bool FindAll(const WCHAR* text, SearchHits* hits, bool onlyExtracted = false, ProgressUpdateUI* tracker = nullptr);
 
     // note: the result might not be a valid page number!
     [[nodiscard]] int GetCurrentPageNo() const {
@@ -26,6 +62,12 @@ class TextSearch : public TextSelection {
         return searchHitStartAt;
     }
 
+    // false if the search text is a regular expression that doesn't compile
+    // (in which case nothing is found)
+    [[nodiscard]] bool IsPatternValid() const {
+        return !invalidPattern;
+    }
+
   protected:
     // Lightweight container for page and offset within the page to use as return value of MatchEnd
     struct PageAndOffset {
@@ -35,6 +77,9 @@ class TextSearch : public TextSelection {
 
     WCHAR* findText = nullptr;
     WCHAR* anchor = nullptr;
+    // lower-cased copies, compared against the lower-cased page text
+    WCHAR* findTextLower = nullptr;
+    WCHAR* anchorLower = nullptr;
     int findPage = 0;
     int searchHitStartAt = 0; // when text found spans several pages, searchHitStartAt < findPage
     bool forward = true;
@@ -44,25 +89,55 @@ class TextSearch : public TextSelection {
     // combining them yields a 'Whole words' search
     bool matchWordStart = false;
     bool matchWordEnd = false;
+    bool wholeWords = false;
+    bool useRegex = false;
+    bool folding = false;
+    // the compiled findText, unless it's matched as literal text
+    TextRegex* regex = nullptr;
+    bool invalidPattern = false;
 
     void SetText(const WCHAR* text);
+    void SetPattern(const WCHAR* pattern);
+    void UpdatePattern();
+    [[nodiscard]] bool HasPattern() const;
     bool FindTextInPage(int pageNo, PageAndOffset* finalGlyph);
     bool FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker);
     PageAndOffset MatchEnd(const WCHAR* start) const;
+    void FindAllInPage(int pageNo, SearchHits* hits);
+    void SetPageText(int pageNo);
+    const WCHAR* GetSearchText(int pageNo, int* lenOut, const WCHAR** lowerOut) const;
+    [[nodiscard]] int StartGlyph(int pageNo, int offset) const;
+    [[nodiscard]] int EndGlyph(int pageNo, int offset) const;
+    [[nodiscard]] int GlyphOffset(int pageNo, int glyph) const;
+    [[nodiscard]] bool MayContainAnchor(int pageNo) const;
+    void PrefetchPagesAfter(int pageNo, int next);
 
     void Clear() {
         str::ReplaceWithCopy(&findText, nullptr);
         str::ReplaceWithCopy(&anchor, nullptr);
+        str::ReplaceWithCopy(&findTextLower, nullptr);
+        str::ReplaceWithCopy(&anchorLower, nullptr);
         str::ReplaceWithCopy(&lastText, nullptr);
+        ClearRegex();
         Reset();
     }
+    void ClearRegex();
     void Reset();
 
   private:
+    // the page pageText is from, held in textCache (see HoldPage)
+    int pageTextPage = 0;
     const WCHAR* pageText = nullptr;
+    const WCHAR* pageTextLower = nullptr;
+    int pageTextLen = 0;
     int findIndex = 0;
 
     WCHAR* lastText = nullptr;
     int nPages = 0;
     Vec<bool> pagesToSkip;
 };
+
+// return the first occurrence of the n characters of needle in s[0..len),
+// resp. the last one that starts before s + end
+const WCHAR* FindAnchorForward(const WCHAR* s, int len, const WCHAR* needle, int n);
+const WCHAR* FindAnchorBackward(const WCHAR* s, int len, int end, const WCHAR* needle, int n);
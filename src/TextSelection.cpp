@@ -4,6 +4,13 @@
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Timer.h"
+#include "utils/FileUtil.h"
+#include "utils/CryptoUtil.h"
+#include "utils/ByteReader.h"
+#include "utils/ByteWriter.h"
+#include "utils/ZipUtil.h"
 
 #include "wingui/UIModels.h"
 
@@ -11,6 +18,8 @@
 #include "EngineBase.h"
 #include "TextSelection.h"
 
+#include "utils/Log.h"
+
 uint distSq(int x, int y) {
     return x * x + y * y;
 }
@@ -19,56 +28,1163 @@ bool isWordChar(WCHAR c) {
     return IsCharAlphaNumeric(c) || c == '_';
 }
 
+// extracts the text of all pages in the background, so that searches
+// can skip the pages that don't contain the search term right away
+class TextIndexer : public ThreadBase {
+    DocumentTextCache* textCache = nullptr;
+
+  public:
+    explicit TextIndexer(DocumentTextCache* textCache) : ThreadBase("TextIndexer"), textCache(textCache) {
+    }
+    void Run() override;
+};
+
+void TextIndexer::Run() {
+    // don't compete with rendering and the UI for the CPU (but not lower than
+    // that, as extracting holds engine locks that rendering also needs)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+    textCache->LoadIndex();
+    auto t = TimeGet();
+    int nPages = textCache->nPages;
+    for (int pageNo = 1; pageNo <= nPages && !WasCancelRequested(); pageNo++) {
+        textCache->CacheTextForPage(pageNo);
+    }
+    int nPagesIndexed;
+    i64 memory;
+    textCache->GetIndexProgress(&nPagesIndexed, &memory);
+    logf("TextIndexer: indexed %d of %d pages in %.2f ms, using %d kB\n", nPagesIndexed, nPages, TimeSinceInMs(t),
+         (int)(memory / 1024));
+    if (!WasCancelRequested()) {
+        textCache->SaveIndex();
+    }
+    DestroyTempAllocator();
+}
+
+// extracts the pages queued by DocumentTextCache::PrefetchPages with
+// its own clone of the engine, so that several pages can be extracted
+// at once (engines only extract one page at a time)
+class TextExtractionWorker : public ThreadBase {
+    DocumentTextCache* textCache = nullptr;
+
+  public:
+    explicit TextExtractionWorker(DocumentTextCache* textCache)
+        : ThreadBase("TextExtractionWorker"), textCache(textCache) {
+    }
+    void Run() override;
+};
+
+void TextExtractionWorker::Run() {
+    DocumentTextCache* tc = textCache;
+    EngineBase* clone = nullptr;
+    EnterCriticalSection(&tc->access);
+    while (!WasCancelRequested()) {
+        if (tc->prefetchQueue.size() == 0) {
+            // free the clone (and the memory it holds) once searching is over
+            BOOL woken = SleepConditionVariableCS(&tc->prefetchAvailable, &tc->access, 5000);
+            if (!woken && clone && tc->prefetchQueue.size() == 0) {
+                LeaveCriticalSection(&tc->access);
+                delete clone;
+                clone = nullptr;
+                EnterCriticalSection(&tc->access);
+            }
+            continue;
+        }
+        if (!clone) {
+            LeaveCriticalSection(&tc->access);
+            clone = tc->engine->Clone();
+            EnterCriticalSection(&tc->access);
+            if (!clone) {
+                // leave the queued pages to the threads that need them
+                break;
+            }
+            continue;
+        }
+        int pageNo = tc->prefetchQueue.PopAt(0);
+        if (!tc->HasTextForPage(pageNo) && !tc->pagesInProgress[pageNo - 1]) {
+            tc->ExtractPage(clone, pageNo, false);
+        }
+    }
+    LeaveCriticalSection(&tc->access);
+    delete clone;
+    DestroyTempAllocator();
+}
+
+static u32 HashTrigram(WCHAR c1, WCHAR c2, WCHAR c3) {
+    u32 h = ((u32)c1 * 0x9E3779B1 + c2) * 0x9E3779B1 + c3;
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+// lower is the lower-cased text of the page
+static PageTrigrams BuildPageTrigrams(const WCHAR* lower, int len) {
+    PageTrigrams res;
+    // 2 to 4 bits per character: typical text has far fewer distinct
+    // trigrams than characters, so only a small fraction of bits are set
+    // and a word's trigrams are all set by chance on very few pages
+    res.nBits = 512;
+    while (res.nBits < len * 2 && res.nBits < (1 << 24)) {
+        res.nBits *= 2;
+    }
+    res.bits = AllocArray<u64>(res.nBits / 64);
+    if (len < 3) {
+        return res;
+    }
+    u32 mask = (u32)res.nBits - 1;
+    for (int i = 0; i + 2 < len; i++) {
+        u32 bit = HashTrigram(lower[i], lower[i + 1], lower[i + 2]) & mask;
+        res.bits[bit / 64] |= (u64)1 << (bit % 64);
+    }
+    return res;
+}
+
+// glyphs of a page bucketed into square cells, so that hit-testing only has
+// to look at the glyphs near the mouse instead of at all glyphs of the page
+struct GlyphGrid {
+    Rect bounds; // of all glyphs and their centers
+    int cellSize = 1;
+    int cols = 1;
+    int rows = 1;
+    // glyphs by the cell their center is in, those of cell i being
+    // centerGlyphs[centerStart[i] .. centerStart[i + 1])
+    Vec<int> centerStart;
+    Vec<int> centerGlyphs;
+    // glyphs by the cells their bbox overlaps (the same way)
+    Vec<int> coverStart;
+    Vec<int> coverGlyphs;
+    // glyphs overlapping too many cells to be added to each of them
+    Vec<int> largeGlyphs;
+
+    int CellX(int x) const {
+        return std::clamp((x - bounds.x) / cellSize, 0, cols - 1);
+    }
+    int CellY(int y) const {
+        return std::clamp((y - bounds.y) / cellSize, 0, rows - 1);
+    }
+};
+
+// glyphs without coordinates (e.g. line breaks) can't be hit
+static bool IsHittableGlyph(const Rect& r) {
+    return r.x || r.dx;
+}
+
+static Point GlyphCenter(const Rect& r) {
+    return Point(r.x + r.dx / 2, r.y + r.dy / 2);
+}
+
+// fills start and glyphs for the glyphs that cellsOf (called twice per glyph)
+// assigns a range of cells, as in GlyphGrid
+template <typename Fn>
+static void BucketGlyphs(int nCells, int nGlyphs, const Fn& cellsOf, Vec<int>& start, Vec<int>& glyphs) {
+    start.SetSize(nCells + 1);
+    memset(start.LendData(), 0, (nCells + 1) * sizeof(int));
+    for (int i = 0; i < nGlyphs; i++) {
+        cellsOf(i, [&](int cell) { start[cell + 1]++; });
+    }
+    for (int i = 0; i < nCells; i++) {
+        start[i + 1] += start[i];
+    }
+    glyphs.SetSize(start[nCells]);
+    Vec<int> next;
+    next.SetSize(nCells);
+    memcpy(next.LendData(), start.LendData(), nCells * sizeof(int));
+    for (int i = 0; i < nGlyphs; i++) {
+        cellsOf(i, [&](int cell) { glyphs[next[cell]++] = i; });
+    }
+}
+
+static GlyphGrid* BuildGlyphGrid(const Rect* coords, int len) {
+    auto grid = new GlyphGrid();
+    int n = 0;
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for (int i = 0; i < len; i++) {
+        const Rect& r = coords[i];
+        if (!IsHittableGlyph(r)) {
+            continue;
+        }
+        Point c = GlyphCenter(r);
+        x0 = std::min({x0, r.x, r.x + r.dx, c.x});
+        y0 = std::min({y0, r.y, r.y + r.dy, c.y});
+        x1 = std::max({x1, r.x, r.x + r.dx, c.x});
+        y1 = std::max({y1, r.y, r.y + r.dy, c.y});
+        n++;
+    }
+    if (n == 0) {
+        return grid;
+    }
+    grid->bounds = Rect(x0, y0, x1 - x0, y1 - y0);
+
+    // about 2 glyphs per cell
+    double area = (double)(grid->bounds.dx + 1) * (grid->bounds.dy + 1);
+    grid->cellSize = std::max((int)sqrt(area * 2 / n), 1);
+    for (;;) {
+        grid->cols = grid->bounds.dx / grid->cellSize + 1;
+        grid->rows = grid->bounds.dy / grid->cellSize + 1;
+        if ((i64)grid->cols * grid->rows <= 2 * n + 16) {
+            break;
+        }
+        grid->cellSize *= 2;
+    }
+    int nCells = grid->cols * grid->rows;
+
+    BucketGlyphs(
+        nCells, len,
+        [&](int i, const auto& add) {
+            if (IsHittableGlyph(coords[i])) {
+                Point c = GlyphCenter(coords[i]);
+                add(grid->CellY(c.y) * grid->cols + grid->CellX(c.x));
+            }
+        },
+        grid->centerStart, grid->centerGlyphs);
+
+    // glyphs with a negative size don't contain any point (cf. Rect::Contains)
+    const int kMaxCellsPerGlyph = 16;
+    BucketGlyphs(
+        nCells, len,
+        [&](int i, const auto& add) {
+            const Rect& r = coords[i];
+            if (!IsHittableGlyph(r) || r.dx < 0 || r.dy < 0) {
+                return;
+            }
+            int cx0 = grid->CellX(r.x), cx1 = grid->CellX(r.x + r.dx);
+            int cy0 = grid->CellY(r.y), cy1 = grid->CellY(r.y + r.dy);
+            if ((cx1 - cx0 + 1) * (cy1 - cy0 + 1) > kMaxCellsPerGlyph) {
+                return;
+            }
+            for (int cy = cy0; cy <= cy1; cy++) {
+                for (int cx = cx0; cx <= cx1; cx++) {
+                    add(cy * grid->cols + cx);
+                }
+            }
+        },
+        grid->coverStart, grid->coverGlyphs);
+    for (int i = 0; i < len; i++) {
+        const Rect& r = coords[i];
+        if (IsHittableGlyph(r) && r.dx >= 0 && r.dy >= 0 &&
+            (grid->CellX(r.x + r.dx) - grid->CellX(r.x) + 1) * (grid->CellY(r.y + r.dy) - grid->CellY(r.y) + 1) >
+                kMaxCellsPerGlyph) {
+            grid->largeGlyphs.Append(i);
+        }
+    }
+    return grid;
+}
+
+static i64 GlyphGridSize(GlyphGrid* grid) {
+    return sizeof(GlyphGrid) + (grid->centerStart.size() + grid->centerGlyphs.size() + grid->coverStart.size() +
+                                grid->coverGlyphs.size() + grid->largeGlyphs.size()) *
+                                   sizeof(int);
+}
+
+// picks the same glyph as a linear scan over all glyphs would: of the glyphs
+// the point is over (if any, else of all of them) the one whose center is
+// closest, the first one of these if several are equally close
+static int FindClosestGlyphInGrid(GlyphGrid* grid, const Rect* coords, Point pt) {
+    int best = -1;
+    uint bestDist = UINT_MAX;
+    auto consider = [&](int i) {
+        Point c = GlyphCenter(coords[i]);
+        uint dist = distSq(pt.x - c.x, pt.y - c.y);
+        if (dist < bestDist || (dist == bestDist && i < best)) {
+            best = i;
+            bestDist = dist;
+        }
+    };
+    if (grid->centerStart.size() == 0) {
+        return -1;
+    }
+
+    // all the glyphs the point can be over are in the point's cell
+    int cx = grid->CellX(pt.x), cy = grid->CellY(pt.y);
+    if (grid->bounds.Contains(pt)) {
+        int cell = cy * grid->cols + cx;
+        for (int k = grid->coverStart[cell]; k < grid->coverStart[cell + 1]; k++) {
+            if (coords[grid->coverGlyphs[k]].Contains(pt)) {
+                consider(grid->coverGlyphs[k]);
+            }
+        }
+        for (int i : grid->largeGlyphs) {
+            if (coords[i].Contains(pt)) {
+                consider(i);
+            }
+        }
+        if (best != -1) {
+            return best;
+        }
+    }
+
+    // look at the cells in rings around the point's cell until the closest
+    // center found is closer than any center in the cells not looked at yet
+    // (those are more than r cells, i.e. r * cellSize, away in x or y)
+    int maxR = std::max(grid->cols, grid->rows);
+    for (int r = 0; r <= maxR; r++) {
+        for (int y = std::max(cy - r, 0); y <= std::min(cy + r, grid->rows - 1); y++) {
+            int step = (y == cy - r || y == cy + r) ? 1 : 2 * r;
+            for (int x = cx - r; x <= cx + r; x += step) {
+                if (x < 0 || x >= grid->cols) {
+                    continue;
+                }
+                int cell = y * grid->cols + x;
+                for (int k = grid->centerStart[cell]; k < grid->centerStart[cell + 1]; k++) {
+                    consider(grid->centerGlyphs[k]);
+                }
+            }
+        }
+        i64 ringDist = (i64)r * grid->cellSize;
+        if (best != -1 && (i64)bestDist <= ringDist * ringDist) {
+            break;
+        }
+    }
+    return best;
+}
+
+// the compact encoding of a page's text and glyph coordinates: the text as
+// UTF-8, converting each UTF-16 code unit on its own (so that surrogates are
+// kept as they are and glyph indices don't change), followed by the boxes of
+// the glyphs as varints, relative to the previous box: the gap to its right
+// edge (with two bits telling whether the box is on the same line, on another
+// line or empty, as line breaks are), then the width and for boxes on another
+// line the offset and difference in height. This is lossless and usually takes
+// 3 to 4 bytes per glyph instead of 2 * 2 + 16 when decoded
+
+enum class BoxKind { SameLine = 0, OtherLine = 1, Empty = 2 };
+
+static u8* AppendVarint(u8* d, u64 v) {
+    while (v >= 0x80) {
+        *d++ = (u8)(v | 0x80);
+        v >>= 7;
+    }
+    *d++ = (u8)v;
+    return d;
+}
+
+static u64 ReadVarint(const u8*& s) {
+    u64 v = 0;
+    for (int shift = 0;; shift += 7) {
+        u8 b = *s++;
+        v |= (u64)(b & 0x7f) << shift;
+        if (b < 0x80) {
+            return v;
+        }
+    }
+}
+
+static u64 ZigZag(i64 v) {
+    return ((u64)v << 1) ^ (u64)(v >> 63);
+}
+
+static i64 UnZigZag(u64 v) {
+    return (i64)(v >> 1) ^ -(i64)(v & 1);
+}
+
+static u8* EncodePageText(const WCHAR* text, const Rect* coords, int len, int* sizeOut) {
+    // at most 3 bytes per character and 4 varints per box
+    u8* buf = AllocArray<u8>((size_t)len * (3 + 4 * 10) + 1);
+    u8* d = buf;
+    for (int i = 0; i < len; i++) {
+        WCHAR c = text[i];
+        if (c < 0x80) {
+            *d++ = (u8)c;
+        } else if (c < 0x800) {
+            *d++ = (u8)(0xc0 | (c >> 6));
+            *d++ = (u8)(0x80 | (c & 0x3f));
+        } else {
+            *d++ = (u8)(0xe0 | (c >> 12));
+            *d++ = (u8)(0x80 | ((c >> 6) & 0x3f));
+            *d++ = (u8)(0x80 | (c & 0x3f));
+        }
+    }
+    Rect prev;
+    for (int i = 0; i < len; i++) {
+        const Rect& r = coords[i];
+        if (!r.x && !r.y && !r.dx && !r.dy) {
+            d = AppendVarint(d, (u64)BoxKind::Empty);
+            continue;
+        }
+        bool sameLine = r.y == prev.y && r.dy == prev.dy;
+        u64 gap = ZigZag((i64)r.x - ((i64)prev.x + prev.dx));
+        d = AppendVarint(d, gap << 2 | (u64)(sameLine ? BoxKind::SameLine : BoxKind::OtherLine));
+        d = AppendVarint(d, ZigZag(r.dx));
+        if (!sameLine) {
+            d = AppendVarint(d, ZigZag((i64)r.y - prev.y));
+            d = AppendVarint(d, ZigZag((i64)r.dy - prev.dy));
+        }
+        prev = r;
+    }
+    int size = (int)(d - buf);
+    u8* data = AllocArray<u8>(size + 1);
+    memcpy(data, buf, size);
+    free(buf);
+    *sizeOut = size;
+    return data;
+}
+
+static void DecodePageText(const u8* data, int len, WCHAR* text, Rect* coords) {
+    const u8* s = data;
+    for (int i = 0; i < len; i++) {
+        u8 b = *s++;
+        if (b < 0x80) {
+            text[i] = b;
+        } else if (b < 0xe0) {
+            text[i] = (WCHAR)((b & 0x1f) << 6 | (s[0] & 0x3f));
+            s += 1;
+        } else {
+            text[i] = (WCHAR)((b & 0x0f) << 12 | (s[0] & 0x3f) << 6 | (s[1] & 0x3f));
+            s += 2;
+        }
+    }
+    text[len] = 0;
+    Rect prev;
+    for (int i = 0; i < len; i++) {
+        u64 head = ReadVarint(s);
+        BoxKind kind = (BoxKind)(head & 3);
+        if (kind == BoxKind::Empty) {
+            coords[i] = Rect();
+            continue;
+        }
+        Rect r;
+        r.x = (int)((i64)prev.x + prev.dx + UnZigZag(head >> 2));
+        r.dx = (int)UnZigZag(ReadVarint(s));
+        r.y = prev.y;
+        r.dy = prev.dy;
+        if (kind == BoxKind::OtherLine) {
+            r.y = (int)(prev.y + UnZigZag(ReadVarint(s)));
+            r.dy = (int)(prev.dy + UnZigZag(ReadVarint(s)));
+        }
+        coords[i] = r;
+        prev = r;
+    }
+}
+
+static i64 DecodedPageSize(int len) {
+    return (i64)(len + 1) * 2 * sizeof(WCHAR) + (i64)len * sizeof(Rect);
+}
+
+static i64 FoldedPageSize(int foldedLen) {
+    return (i64)(foldedLen + 1) * (sizeof(WCHAR) + sizeof(int));
+}
+
+// the pages a thread has asked for last, most recent first
+struct TextCacheReader {
+    DWORD threadId = 0;
+    int pages[kPinnedPages] = {};
+    u64 lastUse = 0;
+};
+
+// threads that use the cache at the same time (the UI, searching, rendering)
+constexpr int kMaxReaders = 8;
+
 DocumentTextCache::DocumentTextCache(EngineBase* engine) : engine(engine) {
     nPages = engine->PageCount();
-    pagesText = AllocArray<PageText>(nPages);
-    debugSize = nPages * (sizeof(Rect*) + sizeof(WCHAR*) + sizeof(int));
+    pages = AllocArray<CachedPageText>(nPages);
+    pagesTrigrams = AllocArray<PageTrigrams>(nPages);
+    pagesInProgress = AllocArray<bool>(nPages);
+    readers = AllocArray<TextCacheReader>(kMaxReaders);
+    cachedPages.links = AllocArray<PageLink>(nPages);
+    decodedPages.links = AllocArray<PageLink>(nPages);
+    indexSize = nPages * sizeof(PageTrigrams);
 
     InitializeCriticalSection(&access);
+    InitializeConditionVariable(&prefetchAvailable);
+    InitializeConditionVariable(&pageExtracted);
+}
+
+static void FreeDecodedText(CachedPageText* page) {
+    str::Free(page->text);
+    str::Free(page->lower);
+    free(page->coords);
+    delete page->grid;
+    str::Free(page->folded);
+    free(page->foldedGlyphs);
+    page->text = nullptr;
+    page->lower = nullptr;
+    page->coords = nullptr;
+    page->grid = nullptr;
+    page->folded = nullptr;
+    page->foldedGlyphs = nullptr;
+    page->foldedLen = 0;
 }
 
 DocumentTextCache::~DocumentTextCache() {
+    if (indexer) {
+        indexer->RequestCancel();
+        indexer->Join();
+        delete indexer;
+    }
+    for (auto worker : workers) {
+        worker->RequestCancel();
+    }
+    WakeAllConditionVariable(&prefetchAvailable);
+    for (auto worker : workers) {
+        worker->Join();
+        delete worker;
+    }
+
+    TextCacheMemory mem;
+    GetMemoryReport(&mem);
+    logf("DocumentTextCache: %d of %d pages cached, %d decoded, text: %d kB + %d kB decoded, index: %d kB, %d pages "
+         "evicted, %d extracted again\n",
+         mem.nPagesCached, mem.nPages, mem.nPagesDecoded, (int)(mem.compactSize / 1024),
+         (int)(mem.decodedSize / 1024), (int)(mem.indexSize / 1024), mem.nEvicted, mem.nReextracted);
+
     EnterCriticalSection(&access);
 
-    int nPages = engine->PageCount();
     for (int i = 0; i < nPages; i++) {
-        PageText* pageText = &pagesText[i];
-        free(pageText->coords);
-        free(pageText->text);
+        free(pages[i].data);
+        FreeDecodedText(&pages[i]);
+        free(pagesTrigrams[i].bits);
     }
-    free(pagesText);
+    free(pages);
+    free(pagesTrigrams);
+    free(pagesInProgress);
+    free(readers);
+    free(cachedPages.links);
+    free(decodedPages.links);
+    str::Free(indexPath);
     LeaveCriticalSection(&access);
     DeleteCriticalSection(&access);
 }
 
 bool DocumentTextCache::HasTextForPage(int pageNo) const {
     CrashIf(pageNo < 1 || pageNo > nPages);
-    PageText* pageText = &pagesText[pageNo - 1];
-    return pageText->text != nullptr;
+    CachedPageText* page = &pages[pageNo - 1];
+    return page->data != nullptr || page->text != nullptr;
 }
 
-const WCHAR* DocumentTextCache::GetTextForPage(int pageNo, int* lenOut, Rect** coordsOut) {
+const WCHAR* DocumentTextCache::GetTextForPage(int pageNo, int* lenOut, Rect** coordsOut, const WCHAR** lowerOut) {
     CrashIf(pageNo < 1 || pageNo > nPages);
 
-    ScopedCritSec scope(&access);
-    PageText* pageText = &pagesText[pageNo - 1];
-
-    if (!pageText->text) {
-        *pageText = engine->ExtractPageText(pageNo);
-        if (!pageText->text) {
-            pageText->text = str::Dup(L"");
-            pageText->len = 0;
+    CachedPageText* page = &pages[pageNo - 1];
+    EnterCriticalSection(&access);
+    // wait for the thread already extracting the page rather than extracting it again
+    while (!HasTextForPage(pageNo) && pagesInProgress[pageNo - 1]) {
+        SleepConditionVariableCS(&pageExtracted, &access, INFINITE);
+    }
+    if (!page->text) {
+        if (page->data) {
+            DecodePage(pageNo);
+        } else {
+            if (page->evicted) {
+                nReextracted++;
+            }
+            ExtractPage(engine, pageNo, true);
         }
-        debugSize += (pageText->len + 1) * (int)(sizeof(WCHAR) + sizeof(Rect));
     }
+    useCount++;
+    cachedPages.MoveToEnd(pageNo);
+    decodedPages.MoveToEnd(pageNo);
+    PinPage(pageNo);
+    TrimMemory();
 
     if (lenOut) {
-        *lenOut = pageText->len;
+        *lenOut = page->len;
     }
     if (coordsOut) {
-        *coordsOut = pageText->coords;
+        *coordsOut = page->coords;
     }
-    return pageText->text;
+    if (lowerOut) {
+        *lowerOut = page->lower;
+    }
+    const WCHAR* text = page->text;
+    LeaveCriticalSection(&access);
+    return text;
+}
+
+const WCHAR* DocumentTextCache::GetFoldedTextForPage(int pageNo, int* lenOut, const int** glyphsOut) {
+    int len;
+    const WCHAR* text = GetTextForPage(pageNo, &len);
+
+    // the text stays decoded (and the folded text with it) as the page is pinned
+    ScopedCritSec scope(&access);
+    CachedPageText* page = &pages[pageNo - 1];
+    if (!page->folded) {
+        page->folded = FoldText(text, len, &page->foldedLen, &page->foldedGlyphs);
+        decodedSize += FoldedPageSize(page->foldedLen);
+        TrimMemory();
+    }
+    if (lenOut) {
+        *lenOut = page->foldedLen;
+    }
+    if (glyphsOut) {
+        *glyphsOut = page->foldedGlyphs;
+    }
+    return page->folded;
+}
+
+void DocumentTextCache::CacheTextForPage(int pageNo) {
+    CrashIf(pageNo < 1 || pageNo > nPages);
+
+    ScopedCritSec scope(&access);
+    // pages that have been indexed already have been evicted, if they
+    // aren't cached, and will be extracted again when needed
+    if (!HasTextForPage(pageNo) && !pagesInProgress[pageNo - 1] && !pagesTrigrams[pageNo - 1].bits) {
+        ExtractPage(engine, pageNo, false);
+    }
+}
+
+void DocumentTextCache::ExtractPage(EngineBase* engine, int pageNo, bool decode) {
+    CrashIf(HasTextForPage(pageNo) || pagesInProgress[pageNo - 1]);
+    pagesInProgress[pageNo - 1] = true;
+    bool indexed = pagesTrigrams[pageNo - 1].bits != nullptr;
+    // extract without holding the lock, so that other threads
+    // can access (and extract) other pages in the meantime
+    LeaveCriticalSection(&access);
+    PageText extracted = engine->ExtractPageText(pageNo);
+    if (!extracted.text) {
+        extracted.text = str::Dup(L"");
+        extracted.len = 0;
+    }
+    // lower-case the whole text at once rather than each character when searching
+    WCHAR* lower = str::Dup(extracted.text, extracted.len);
+    CharLowerBuffW(lower, (DWORD)extracted.len);
+    PageTrigrams trigrams;
+    if (!indexed) {
+        trigrams = BuildPageTrigrams(lower, extracted.len);
+    }
+    int dataSize;
+    u8* data = EncodePageText(extracted.text, extracted.coords, extracted.len, &dataSize);
+    EnterCriticalSection(&access);
+
+    CachedPageText* page = &pages[pageNo - 1];
+    page->data = data;
+    page->dataSize = dataSize;
+    page->len = extracted.len;
+    page->evicted = false;
+    cachedPages.Insert(pageNo);
+    compactSize += dataSize;
+    if (decode) {
+        page->text = extracted.text;
+        page->coords = extracted.coords;
+        page->lower = lower;
+        decodedPages.Insert(pageNo);
+        decodedSize += DecodedPageSize(page->len);
+    } else {
+        FreePageText(&extracted);
+        str::Free(lower);
+    }
+    if (!indexed) {
+        pagesTrigrams[pageNo - 1] = trigrams;
+        indexSize += trigrams.nBits / 8;
+        nPagesIndexed++;
+    }
+    pagesInProgress[pageNo - 1] = false;
+    WakeAllConditionVariable(&pageExtracted);
+    // a page extracted for GetTextForPage is pinned and trimmed for by it
+    if (!decode) {
+        TrimMemory();
+    }
+}
+
+void DocumentTextCache::DecodePage(int pageNo) {
+    CachedPageText* page = &pages[pageNo - 1];
+    CrashIf(!page->data || page->text);
+    page->text = AllocArray<WCHAR>(page->len + 1);
+    page->coords = AllocArray<Rect>(page->len + 1);
+    DecodePageText(page->data, page->len, page->text, page->coords);
+    page->lower = str::Dup(page->text, page->len);
+    CharLowerBuffW(page->lower, (DWORD)page->len);
+    decodedPages.Insert(pageNo);
+    decodedSize += DecodedPageSize(page->len);
+}
+
+void DocumentTextCache::PinPage(int pageNo) {
+    DWORD threadId = GetCurrentThreadId();
+    TextCacheReader* reader = nullptr;
+    TextCacheReader* lru = &readers[0];
+    for (int i = 0; i < kMaxReaders && !reader; i++) {
+        if (readers[i].threadId == threadId) {
+            reader = &readers[i];
+        } else if (readers[i].lastUse < lru->lastUse) {
+            lru = &readers[i];
+        }
+    }
+    if (!reader) {
+        // take over the slot of the thread that hasn't asked for a page for the longest time
+        reader = lru;
+        for (int p : reader->pages) {
+            if (p) {
+                pages[p - 1].nPins--;
+            }
+        }
+        *reader = TextCacheReader();
+        reader->threadId = threadId;
+    }
+    reader->lastUse = useCount;
+
+    int i = 0;
+    while (i < kPinnedPages - 1 && reader->pages[i] != pageNo) {
+        i++;
+    }
+    if (reader->pages[i] != pageNo) {
+        if (reader->pages[i]) {
+            pages[reader->pages[i] - 1].nPins--;
+        }
+        pages[pageNo - 1].nPins++;
+    }
+    for (; i > 0; i--) {
+        reader->pages[i] = reader->pages[i - 1];
+    }
+    reader->pages[0] = pageNo;
+}
+
+void DocumentTextCache::HoldPage(int pageNo) {
+    ScopedCritSec scope(&access);
+    // the page is still pinned by the reader that has just asked for it
+    CrashIf(!pages[pageNo - 1].text);
+    pages[pageNo - 1].nPins++;
+}
+
+void DocumentTextCache::ReleasePage(int pageNo) {
+    ScopedCritSec scope(&access);
+    CrashIf(pages[pageNo - 1].nPins <= 0);
+    pages[pageNo - 1].nPins--;
+    TrimMemory();
+}
+
+bool PageLruList::Contains(int pageNo) const {
+    return first == pageNo || links[pageNo - 1].prev != 0;
+}
+
+void PageLruList::Insert(int pageNo, int beforePageNo) {
+    CrashIf(Contains(pageNo));
+    PageLink& link = links[pageNo - 1];
+    link.next = beforePageNo;
+    link.prev = beforePageNo ? links[beforePageNo - 1].prev : last;
+    if (link.prev) {
+        links[link.prev - 1].next = pageNo;
+    } else {
+        first = pageNo;
+    }
+    if (beforePageNo) {
+        links[beforePageNo - 1].prev = pageNo;
+    } else {
+        last = pageNo;
+    }
+}
+
+void PageLruList::Remove(int pageNo) {
+    CrashIf(!Contains(pageNo));
+    PageLink& link = links[pageNo - 1];
+    if (link.prev) {
+        links[link.prev - 1].next = link.next;
+    } else {
+        first = link.next;
+    }
+    if (link.next) {
+        links[link.next - 1].prev = link.prev;
+    } else {
+        last = link.prev;
+    }
+    link = PageLink();
+}
+
+void PageLruList::MoveToEnd(int pageNo) {
+    if (last != pageNo) {
+        Remove(pageNo);
+        Insert(pageNo);
+    }
+}
+
+void DocumentTextCache::TrimMemory() {
+    while (compactSize + decodedSize + indexSize > maxMemory) {
+        // first the least recently used decoded text, then the least recently
+        // used compact text (of pages that aren't decoded). only pinned pages
+        // are skipped, so that this doesn't depend on the number of pages
+        int decoded = decodedPages.first;
+        while (decoded && pages[decoded - 1].nPins > 0) {
+            decoded = decodedPages.links[decoded - 1].next;
+        }
+        if (decoded) {
+            CachedPageText* page = &pages[decoded - 1];
+            decodedSize -= DecodedPageSize(page->len);
+            if (page->folded) {
+                decodedSize -= FoldedPageSize(page->foldedLen);
+            }
+            if (page->grid) {
+                indexSize -= GlyphGridSize(page->grid);
+            }
+            FreeDecodedText(page);
+            decodedPages.Remove(decoded);
+            continue;
+        }
+        // all decoded pages are pinned now
+        int compact = cachedPages.first;
+        while (compact && pages[compact - 1].text) {
+            compact = cachedPages.links[compact - 1].next;
+        }
+        if (!compact) {
+            // all remaining text is in use
+            break;
+        }
+        CachedPageText* page = &pages[compact - 1];
+        compactSize -= page->dataSize;
+        free(page->data);
+        page->data = nullptr;
+        page->dataSize = 0;
+        page->evicted = true;
+        cachedPages.Remove(compact);
+        nEvicted++;
+    }
+}
+
+void DocumentTextCache::GetMemoryReport(TextCacheMemory* mem) {
+    ScopedCritSec scope(&access);
+    mem->nPages = nPages;
+    mem->nPagesCached = 0;
+    mem->nPagesDecoded = 0;
+    for (int i = 0; i < nPages; i++) {
+        if (pages[i].data) {
+            mem->nPagesCached++;
+        }
+        if (pages[i].text) {
+            mem->nPagesDecoded++;
+        }
+    }
+    mem->compactSize = compactSize;
+    mem->decodedSize = decodedSize;
+    mem->indexSize = indexSize;
+    mem->nEvicted = nEvicted;
+    mem->nReextracted = nReextracted;
+}
+
+void DocumentTextCache::PrefetchPages(const Vec<int>& pageNos) {
+    ScopedCritSec scope(&access);
+    prefetchQueue.Reset();
+    if (maxWorkers == 0) {
+        return;
+    }
+    for (int pageNo : pageNos) {
+        if (!HasTextForPage(pageNo) && !pagesInProgress[pageNo - 1]) {
+            prefetchQueue.Append(pageNo);
+        }
+    }
+    if (prefetchQueue.size() == 0) {
+        return;
+    }
+    if (workers.size() == 0) {
+        // leave one core to the thread that consumes the pages
+        SYSTEM_INFO si{};
+        GetSystemInfo(&si);
+        int nWorkers = std::clamp((int)si.dwNumberOfProcessors - 1, 1, maxWorkers);
+        for (int i = 0; i < nWorkers; i++) {
+            auto worker = new TextExtractionWorker(this);
+            workers.Append(worker);
+            worker->Start();
+        }
+    }
+    WakeAllConditionVariable(&prefetchAvailable);
+}
+
+void DocumentTextCache::StartIndexing() {
+    if (indexer) {
+        return;
+    }
+    indexer = new TextIndexer(this);
+    indexer->Start();
+}
+
+// a persisted index starts with a header of kTextIndexHeaderSize bytes:
+// magic, version, the TextIndexStamp of the document, the number of pages,
+// the size and the MD5 of the body, followed by the body, compressed with
+// DeflateData. for each page the body has its number of glyphs, the size of
+// its compact text (kNoPageText if it wasn't cached) and the compact text,
+// the number of bits of its trigrams and the bits
+constexpr u32 kTextIndexMagic = 0x58444953; // "SIDX"
+constexpr u32 kTextIndexVersion = 1;
+constexpr size_t kTextIndexHeaderSize = 4 + 4 + 8 + 8 + 16 + 4 + 4 + 16;
+constexpr u32 kNoPageText = (u32)-1;
+
+static bool GetTextIndexStamp(const WCHAR* filePath, TextIndexStamp* stamp) {
+    if (!filePath) {
+        return false;
+    }
+    AutoCloseHandle h = file::OpenReadOnly(filePath);
+    if (!h.IsValid()) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(h, &size) || !GetFileTime(h, nullptr, nullptr, &stamp->modTime)) {
+        return false;
+    }
+    stamp->fileSize = size.QuadPart;
+
+    // hashing all of a big file takes longer than extracting the text that is saved
+    // by it, so only the start and the end are hashed (together with the size and
+    // the modification time, this should catch all changes that matter)
+    constexpr DWORD kHashedSize = 64 * 1024;
+    AutoFree buf(AllocArray<char>(2 * kHashedSize));
+    DWORD nStart = 0;
+    DWORD nEnd = 0;
+    if (!ReadFile(h, buf.Get(), kHashedSize, &nStart, nullptr)) {
+        return false;
+    }
+    if (size.QuadPart > (i64)kHashedSize) {
+        LARGE_INTEGER off;
+        off.QuadPart = std::max(size.QuadPart - (i64)kHashedSize, (i64)kHashedSize);
+        if (!SetFilePointerEx(h, off, nullptr, FILE_BEGIN) ||
+            !ReadFile(h, buf.Get() + nStart, kHashedSize, &nEnd, nullptr)) {
+            return false;
+        }
+    }
+    CalcMD5Digest(buf.Get(), nStart + nEnd, stamp->digest);
+    return true;
+}
+
+static bool IsSameStamp(const TextIndexStamp& s1, const TextIndexStamp& s2) {
+    return s1.fileSize == s2.fileSize && FileTimeEq(s1.modTime, s2.modTime) &&
+           memcmp(s1.digest, s2.digest, sizeof(s1.digest)) == 0;
+}
+
+void DocumentTextCache::SetIndexPath(const char* path) {
+    ScopedCritSec scope(&access);
+    CrashIf(indexLoaded);
+    str::ReplaceWithCopy(&indexPath, path);
+}
+
+// the text and the index of a page, as read from a persisted index
+struct SavedPageText {
+    u32 len = 0;
+    u32 dataSize = kNoPageText;
+    const u8* data = nullptr;
+    u32 nBits = 0;
+    const u8* bits = nullptr;
+};
+
+static bool ParseTextIndexBody(ByteSlice body, int nPages, Vec<SavedPageText>& saved) {
+    ByteReader r(body);
+    size_t off = 0;
+    for (int i = 0; i < nPages; i++) {
+        SavedPageText page;
+        if (off + 8 > r.len) {
+            return false;
+        }
+        page.len = r.DWordLE(off);
+        page.dataSize = r.DWordLE(off + 4);
+        off += 8;
+        if (page.dataSize != kNoPageText) {
+            if (page.len > (u32)INT_MAX / 64 || page.dataSize > r.len - off) {
+                return false;
+            }
+            page.data = r.d + off;
+            off += page.dataSize;
+        }
+        if (off + 4 > r.len) {
+            return false;
+        }
+        page.nBits = r.DWordLE(off);
+        off += 4;
+        // as built by BuildPageTrigrams
+        bool validBits = page.nBits >= 512 && page.nBits <= (1 << 24) && (page.nBits & (page.nBits - 1)) == 0;
+        if (!validBits || page.nBits / 8 > r.len - off) {
+            return false;
+        }
+        page.bits = r.d + off;
+        off += page.nBits / 8;
+        saved.Append(page);
+    }
+    return off == r.len;
+}
+
+static bool ParseTextIndex(ByteSlice d, int nPages, const TextIndexStamp& stamp, AutoFree& body,
+                           Vec<SavedPageText>& saved) {
+    ByteReader r(d);
+    if (d.size() < kTextIndexHeaderSize || r.DWordLE(0) != kTextIndexMagic || r.DWordLE(4) != kTextIndexVersion) {
+        return false;
+    }
+    TextIndexStamp savedStamp;
+    savedStamp.fileSize = (i64)r.QWordLE(8);
+    savedStamp.modTime.dwHighDateTime = r.DWordLE(16);
+    savedStamp.modTime.dwLowDateTime = r.DWordLE(20);
+    memcpy(savedStamp.digest, r.d + 24, 16);
+    if (!IsSameStamp(stamp, savedStamp) || r.DWordLE(40) != (u32)nPages) {
+        return false;
+    }
+    u32 bodySize = r.DWordLE(44);
+    ByteSlice compressed(d.data() + kTextIndexHeaderSize, d.size() - kTextIndexHeaderSize);
+    body.Set(InflateData(compressed, bodySize));
+    if (!body.data) {
+        return false;
+    }
+    // the compact text is decoded without checks, so make sure it hasn't been corrupted
+    u8 digest[16];
+    CalcMD5Digest(body.data, body.len, digest);
+    if (memcmp(digest, r.d + 48, 16) != 0) {
+        return false;
+    }
+    return ParseTextIndexBody(body.AsSpan(), nPages, saved);
+}
+
+void DocumentTextCache::LoadIndex() {
+    AutoFreeStr path;
+    {
+        ScopedCritSec scope(&access);
+        if (!indexPath || indexLoaded) {
+            return;
+        }
+        indexLoaded = true;
+        path.SetCopy(indexPath);
+    }
+
+    // the file is read and checked without holding access
+    auto t = TimeGet();
+    TextIndexStamp stamp;
+    if (!GetTextIndexStamp(engine->FileName(), &stamp)) {
+        // without a stamp, a saved index couldn't be told apart from a stale one
+        ScopedCritSec scope(&access);
+        str::FreePtr(&indexPath);
+        return;
+    }
+    AutoFree d = file::ReadFile(path.Get());
+    AutoFree body;
+    Vec<SavedPageText> saved;
+    bool isValid = d.data && ParseTextIndex(d.AsSpan(), nPages, stamp, body, saved);
+    if (d.data && !isValid) {
+        // the document has changed since (or the index is corrupted)
+        logf("DocumentTextCache: discarding stale text index '%s'\n", path.Get());
+        file::Delete(path.Get());
+    }
+
+    ScopedCritSec scope(&access);
+    indexStamp = stamp;
+    if (!isValid) {
+        return;
+    }
+    // the loaded text hasn't been used yet, so it's evicted before the text extracted so far
+    int firstUsed = cachedPages.first;
+    for (int i = 0; i < nPages; i++) {
+        const SavedPageText& s = saved.at(i);
+        CachedPageText* page = &pages[i];
+        // pages extracted in the meantime are up to date already
+        if (HasTextForPage(i + 1) || pagesInProgress[i] || pagesTrigrams[i].bits) {
+            continue;
+        }
+        PageTrigrams* trigrams = &pagesTrigrams[i];
+        trigrams->nBits = (int)s.nBits;
+        trigrams->bits = AllocArray<u64>(s.nBits / 64);
+        memcpy(trigrams->bits, s.bits, s.nBits / 8);
+        indexSize += s.nBits / 8;
+        nPagesIndexed++;
+        nPagesLoaded++;
+        // pages that don't fit are extracted again when needed, as if they had been evicted
+        bool fits = compactSize + decodedSize + indexSize + (i64)s.dataSize <= maxMemory;
+        if (s.dataSize == kNoPageText || !fits) {
+            continue;
+        }
+        page->data = AllocArray<u8>((size_t)s.dataSize + 1);
+        memcpy(page->data, s.data, s.dataSize);
+        page->dataSize = (int)s.dataSize;
+        page->len = (int)s.len;
+        cachedPages.Insert(i + 1, firstUsed);
+        compactSize += s.dataSize;
+    }
+    logf("DocumentTextCache: loaded the text index of %d pages in %.2f ms\n", nPagesLoaded, TimeSinceInMs(t));
+}
+
+// saves the compact text and the index of all pages to indexPath, so that
+// the next session can search right away, without extracting the text again
+bool DocumentTextCache::SaveIndex() {
+    auto t = TimeGet();
+    ByteWriterLE body;
+    // the stamp of the document is taken when loading
+    LoadIndex();
+    {
+        ScopedCritSec scope(&access);
+        // there's nothing new to save if the whole index has been loaded
+        if (!indexPath || nPagesIndexed < nPages || nPagesLoaded == nPages) {
+            return false;
+        }
+        for (int i = 0; i < nPages; i++) {
+            CachedPageText* page = &pages[i];
+            PageTrigrams* trigrams = &pagesTrigrams[i];
+            body.Write32((u32)page->len);
+            if (page->data) {
+                body.Write32((u32)page->dataSize);
+                body.d.Append(page->data, (size_t)page->dataSize);
+            } else {
+                body.Write32(kNoPageText);
+            }
+            body.Write32((u32)trigrams->nBits);
+            body.d.Append((const u8*)trigrams->bits, (size_t)trigrams->nBits / 8);
+        }
+        // don't save it again when indexing is restarted
+        nPagesLoaded = nPages;
+    }
+
+    ByteSlice data = body.AsSpan();
+    AutoFree compressed = DeflateData(data);
+    if (!compressed.data) {
+        return false;
+    }
+    u8 digest[16];
+    CalcMD5Digest(data.data(), data.size(), digest);
+
+    ByteWriterLE out(kTextIndexHeaderSize + compressed.len);
+    out.Write32(kTextIndexMagic);
+    out.Write32(kTextIndexVersion);
+    out.Write64((u64)indexStamp.fileSize);
+    out.Write32(indexStamp.modTime.dwHighDateTime);
+    out.Write32(indexStamp.modTime.dwLowDateTime);
+    out.d.Append(indexStamp.digest, sizeof(indexStamp.digest));
+    out.Write32((u32)nPages);
+    out.Write32((u32)data.size());
+    out.d.Append(digest, sizeof(digest));
+    CrashIf(out.Size() != kTextIndexHeaderSize);
+    out.d.Append(compressed.data, compressed.len);
+
+    WCHAR* pathW = ToWstrTemp(indexPath);
+    bool ok = dir::CreateForFile(pathW) && file::WriteFile(pathW, out.AsSpan());
+    logf("DocumentTextCache: saved the text index (%d kB) in %.2f ms\n", (int)(out.Size() / 1024), TimeSinceInMs(t));
+    return ok;
+}
+
+void DocumentTextCache::GetIndexProgress(int* nPagesIndexedOut, i64* memoryOut) {
+    ScopedCritSec scope(&access);
+    *nPagesIndexedOut = nPagesIndexed;
+    *memoryOut = compactSize + decodedSize + indexSize;
+}
+
+bool DocumentTextCache::MayContainWord(int pageNo, const WCHAR* word) {
+    CrashIf(pageNo < 1 || pageNo > nPages);
+
+    WCHAR lower[64];
+    int len = (int)str::Len(word);
+    if (len < 3) {
+        return true;
+    }
+    len = std::min(len, (int)dimof(lower));
+    memcpy(lower, word, len * sizeof(WCHAR));
+    CharLowerBuffW(lower, (DWORD)len);
+
+    ScopedCritSec scope(&access);
+    PageTrigrams* trigrams = &pagesTrigrams[pageNo - 1];
+    if (!trigrams->bits) {
+        return true;
+    }
+    u32 mask = (u32)trigrams->nBits - 1;
+    for (int i = 0; i + 2 < len; i++) {
+        u32 bit = HashTrigram(lower[i], lower[i + 1], lower[i + 2]) & mask;
+        if (!(trigrams->bits[bit / 64] & ((u64)1 << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int DocumentTextCache::FindClosestGlyph(int pageNo, Point pt) {
+    int len;
+    Rect* coords;
+    GetTextForPage(pageNo, &len, &coords);
+
+    // coords stay decoded (and the grid with them) as the page is pinned
+    ScopedCritSec scope(&access);
+    GlyphGrid*& grid = pages[pageNo - 1].grid;
+    if (!grid) {
+        grid = BuildGlyphGrid(coords, len);
+        indexSize += GlyphGridSize(grid);
+    }
+    return FindClosestGlyphInGrid(grid, coords, pt);
 }
 
 TextSelection::TextSelection(EngineBase* engine, DocumentTextCache* textCache) : engine(engine), textCache(textCache) {
@@ -96,33 +1212,8 @@ static int FindClosestGlyph(TextSelection* ts, int pageNo, double x, double y) {
     ts->textCache->GetTextForPage(pageNo, &textLen, &coords);
     PointF pt = PointF(x, y);
 
-    unsigned int maxDist = UINT_MAX;
-    Point pti = ToPoint(pt);
-    bool overGlyph = false;
-    int result = -1;
-
-    for (int i = 0; i < textLen; i++) {
-        Rect& coord = coords[i];
-        if (!coord.x && !coord.dx) {
-            continue;
-        }
-        if (overGlyph && !coord.Contains(pti)) {
-            continue;
-        }
-
-        uint dist = distSq((int)x - coord.x - coord.dx / 2, (int)y - coord.y - coord.dy / 2);
-        if (dist < maxDist) {
-            result = i;
-            maxDist = dist;
-        }
-        // prefer glyphs the cursor is actually over
-        if (!overGlyph && coord.Contains(pti)) {
-            overGlyph = true;
-            result = i;
-            maxDist = dist;
-        }
-    }
-
+    // prefers glyphs the cursor is actually over
+    int result = ts->textCache->FindClosestGlyph(pageNo, ToPoint(pt));
     if (-1 == result) {
         return 0;
     }
@@ -143,12 +1234,16 @@ static int FindClosestGlyph(TextSelection* ts, int pageNo, double x, double y) {
     return result;
 }
 
-static void FillResultRects(TextSelection* ts, int pageNo, int glyph, int length, WStrVec* lines = nullptr) {
+// calls fn with the bounding box of each line of the glyphs [glyph, glyph + length)
+// of a page and the range of glyphs in it
+template <typename Fn>
+static void ForEachLineRect(DocumentTextCache* textCache, EngineBase* engine, int pageNo, int glyph, int length,
+                            const Fn& fn) {
     int len;
     Rect* coords;
-    const WCHAR* text = ts->textCache->GetTextForPage(pageNo, &len, &coords);
+    textCache->GetTextForPage(pageNo, &len, &coords);
     CrashIf(len < glyph + length);
-    Rect mediabox = ts->engine->PageMediabox(pageNo).Round();
+    Rect mediabox = engine->PageMediabox(pageNo).Round();
     Rect *c = &coords[glyph], *end = c + length;
     while (c < end) {
         // skip line breaks
@@ -166,15 +1261,21 @@ static void FillResultRects(TextSelection* ts, int pageNo, int glyph, int length
             continue;
         }
 
-        if (lines) {
-            lines->Append(str::Dup(text + (c0 - coords), c - c0));
-            continue;
-        }
-
         // cut the right edge, if it overlaps the next character
         if (c < coords + len && (c->x || c->dx) && bbox.x < c->x && bbox.x + bbox.dx > c->x) {
             bbox.dx = c->x - bbox.x;
         }
+        fn(bbox, (int)(c0 - coords), (int)(c - coords));
+    }
+}
+
+static void FillResultRects(TextSelection* ts, int pageNo, int glyph, int length, WStrVec* lines = nullptr) {
+    const WCHAR* text = ts->textCache->GetTextForPage(pageNo);
+    ForEachLineRect(ts->textCache, ts->engine, pageNo, glyph, length, [&](const Rect& bbox, int from, int to) {
+        if (lines) {
+            lines->Append(str::Dup(text + from, to - from));
+            return;
+        }
 
         int currLen = ts->result.len;
         int left = ts->result.cap - currLen;
@@ -196,7 +1297,15 @@ static void FillResultRects(TextSelection* ts, int pageNo, int glyph, int length
         ts->result.pages[currLen] = pageNo;
         ts->result.rects[currLen] = bbox;
         ts->result.len++;
-    }
+    });
+}
+
+void AppendGlyphRects(DocumentTextCache* textCache, EngineBase* engine, int pageNo, int glyph, int length,
+                      Vec<int>& pages, Vec<Rect>& rects) {
+    ForEachLineRect(textCache, engine, pageNo, glyph, length, [&](const Rect& bbox, int, int) {
+        pages.Append(pageNo);
+        rects.Append(bbox);
+    });
 }
 
 bool TextSelection::IsOverGlyph(int pageNo, double x, double y) {
@@ -1,19 +1,179 @@
 /* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
    License: GPLv3 */
 
+class TextIndexer;
+class TextExtractionWorker;
+struct GlyphGrid;
+struct TextCacheReader;
+
+// signature of the (lower-cased) trigrams in the text of a page,
+// built when the text is extracted
+struct PageTrigrams {
+    u64* bits = nullptr;
+    int nBits = 0; // a power of 2, 0 if the page hasn't been indexed yet
+};
+
+// how many pages per thread DocumentTextCache keeps decoded for sure
+constexpr int kPinnedPages = 4;
+
+// the neighbours of a page in a PageLruList (page numbers, 0 for none)
+struct PageLink {
+    int prev = 0;
+    int next = 0;
+};
+
+// pages in the order in which they have been used, least recently used first
+struct PageLruList {
+    int first = 0;
+    int last = 0;
+    // indexed by page number - 1
+    PageLink* links = nullptr;
+
+    bool Contains(int pageNo) const;
+    // inserts the page before beforePageNo or, for 0, at the end
+    void Insert(int pageNo, int beforePageNo = 0);
+    void Remove(int pageNo);
+    void MoveToEnd(int pageNo);
+};
+
+// the text of a page, as cached by DocumentTextCache
+struct CachedPageText {
+    // compact encoding of the text and the glyph coordinates (see EncodePageText),
+    // nullptr if the page hasn't been extracted yet or has been evicted
+    u8* data = nullptr;
+    int dataSize = 0;
+    int len = 0; // number of glyphs
+    // decoded when asked for by GetTextForPage, nullptr otherwise
+    WCHAR* text = nullptr;
+    // the same text, lower-cased (with CharLowerBuff, so that offsets are the same)
+    WCHAR* lower = nullptr;
+    Rect* coords = nullptr;
+    // built by FindClosestGlyph from coords
+    GlyphGrid* grid = nullptr;
+    // built by GetFoldedTextForPage from text (see FoldText), folded[i]
+    // coming from glyph foldedGlyphs[i] (and foldedGlyphs[foldedLen] == len)
+    WCHAR* folded = nullptr;
+    int* foldedGlyphs = nullptr;
+    int foldedLen = 0;
+    // number of TextCacheReaders and HoldPage calls the decoded text is pinned by
+    int nPins = 0;
+    bool evicted = false;
+};
+
+// the memory a DocumentTextCache uses, see GetMemoryReport
+struct TextCacheMemory {
+    int nPages = 0;
+    int nPagesCached = 0;
+    int nPagesDecoded = 0;
+    i64 compactSize = 0;
+    i64 decodedSize = 0;
+    i64 indexSize = 0;
+    int nEvicted = 0;
+    int nReextracted = 0;
+};
+
+// identifies the version of the document a persisted text index was built from
+struct TextIndexStamp {
+    i64 fileSize = 0;
+    FILETIME modTime{};
+    // MD5 of the start and the end of the file, see GetTextIndexStamp
+    u8 digest[16]{};
+};
+
 struct DocumentTextCache {
     EngineBase* engine = nullptr;
     int nPages = 0;
-    PageText* pagesText = nullptr;
-    int debugSize = 0;
+    CachedPageText* pages = nullptr;
+    PageTrigrams* pagesTrigrams = nullptr;
+    // set while a thread extracts the text of a page
+    bool* pagesInProgress = nullptr;
+    // the last pages each thread has asked for, see GetTextForPage
+    TextCacheReader* readers = nullptr;
+    i64 compactSize = 0;
+    i64 decodedSize = 0;
+    // trigrams and glyph grids
+    i64 indexSize = 0;
+    // when the cached text takes up more, the least recently used pages are
+    // evicted: first their decoded text, then the compact one (so that
+    // they're extracted again when needed); the index is always kept
+    i64 maxMemory = 128 * 1024 * 1024;
+    // the pages with compact text and the ones with decoded text, in the
+    // order in which they're evicted
+    PageLruList cachedPages;
+    PageLruList decodedPages;
+    u64 useCount = 0;
+    int nPagesIndexed = 0;
+    int nEvicted = 0;
+    int nReextracted = 0;
+    TextIndexer* indexer = nullptr;
+
+    // file the index and the compact text are persisted in between sessions,
+    // nullptr if they aren't (see SetIndexPath)
+    char* indexPath = nullptr;
+    TextIndexStamp indexStamp;
+    // set once LoadIndex has been called
+    bool indexLoaded = false;
+    // number of pages whose index has been loaded from indexPath
+    int nPagesLoaded = 0;
+
+    // pages to extract on the worker threads, in this order
+    Vec<int> prefetchQueue;
+    Vec<TextExtractionWorker*> workers;
+    // 0 to only extract pages on the threads that need them
+    int maxWorkers = 8;
 
     CRITICAL_SECTION access;
+    CONDITION_VARIABLE prefetchAvailable;
+    CONDITION_VARIABLE pageExtracted;
 
     explicit DocumentTextCache(EngineBase* engine);
     ~DocumentTextCache();
 
     bool HasTextForPage(int pageNo) const;
-    const WCHAR* GetTextForPage(int pageNo, int* lenOut = nullptr, Rect** coordsOut = nullptr);
+    // the returned text and coordinates stay valid until the calling thread
+    // has asked for the text of kPinnedPages other pages
+    const WCHAR* GetTextForPage(int pageNo, int* lenOut = nullptr, Rect** coordsOut = nullptr,
+                                const WCHAR** lowerOut = nullptr);
+    // the text of a page folded for a loose search (see FoldText), built on demand and
+    // valid as long as GetTextForPage's text. glyphsOut maps the folded characters to
+    // the glyphs they come from (with one more entry, the number of glyphs)
+    const WCHAR* GetFoldedTextForPage(int pageNo, int* lenOut = nullptr, const int** glyphsOut = nullptr);
+    // extracts the text of a page into the cache without decoding it
+    void CacheTextForPage(int pageNo);
+
+    // extracts the given pages on worker threads, each with its own clone of
+    // the engine, instead of the pages still queued by a previous call
+    void PrefetchPages(const Vec<int>& pageNos);
+    // must be called with access held, which is released while extracting;
+    // with decode the page's text is kept decoded (and must then be pinned)
+    void ExtractPage(EngineBase* engine, int pageNo, bool decode);
+    void DecodePage(int pageNo);
+    void PinPage(int pageNo);
+    // keeps the text of a page the calling thread has just asked for decoded until
+    // ReleasePage, no matter how many other pages are asked for in the meantime
+    void HoldPage(int pageNo);
+    void ReleasePage(int pageNo);
+    // evicts pages until the cache uses at most maxMemory (if possible)
+    void TrimMemory();
+    void GetMemoryReport(TextCacheMemory* mem);
+
+    // extracts (and thus indexes) the text of all pages on a low priority thread
+    void StartIndexing();
+    void GetIndexProgress(int* nPagesIndexedOut, i64* memoryOut);
+    // persists the index in the given file: it's loaded (if it has been built from
+    // the same version of the document) when indexing starts and it's saved once
+    // all pages have been indexed
+    void SetIndexPath(const char* path);
+    // called on the indexer thread (the file is read without holding access)
+    void LoadIndex();
+    bool SaveIndex();
+    // returns false if the page has been indexed and its text can't contain
+    // the given word (compared case-insensitively, as in TextSearch::MatchEnd)
+    bool MayContainWord(int pageNo, const WCHAR* word);
+
+    // returns the index of the glyph the given point is over (or, if it isn't over
+    // any glyph, whose center is closest to it), -1 if the page has no glyphs
+    int FindClosestGlyph(int pageNo, Point pt);
 };
 
 // TODO: replace with Vec<TextSel>
@@ -51,5 +211,10 @@ struct TextSelection {
     void GetGlyphRange(int* fromPage, int* fromGlyph, int* toPage, int* toGlyph) const;
 };
 
+// appends the bounding boxes of the lines of glyphs [glyph, glyph + length)
+// of a page, as a selection of these glyphs would show them
+void AppendGlyphRects(DocumentTextCache* textCache, EngineBase* engine, int pageNo, int glyph, int length,
+                      Vec<int>& pages, Vec<Rect>& rects);
+
 uint distSq(int x, int y);
 bool isWordChar(WCHAR c);
@@ -10,6 +10,9 @@ extern void BaseUtils_UnitTests();
 // in src/UnitTests.cpp
 extern void SumatraPDF_UnitTests();
 
+// in src/MupdfUnitTests.cpp
+extern void Mupdf_UnitTests();
+
 extern void BaseUtilTest();
 extern void ByteOrderTests();
 extern void CryptoUtilTest();
@@ -54,6 +57,7 @@ int main(__unused int argc, __unused char** argv) {
     VecTest();
     WinUtilTest();
     SumatraPDF_UnitTests();
+    Mupdf_UnitTests();
     StrFormatTest();
 
     int res = utassert_print_results();
@@ -2614,3 +2614,87 @@ bool DestroyIconSafe(HICON* h) {
     *h = nullptr;
     return ToBool(res);
 }
+
+// the combining marks FoldText drops (those of Latin, Greek,
+// Cyrillic, Hebrew and Arabic letters)
+static bool IsDiacriticMark(WCHAR c) {
+    return (0x0300 <= c && c <= 0x036F) || (0x1AB0 <= c && c <= 0x1AFF) || (0x1DC0 <= c && c <= 0x1DFF) ||
+           (0x20D0 <= c && c <= 0x20FF) || (0xFE20 <= c && c <= 0xFE2F) || (0x0591 <= c && c <= 0x05BD) ||
+           c == 0x05BF || c == 0x05C1 || c == 0x05C2 || c == 0x05C4 || c == 0x05C5 || c == 0x05C7 ||
+           (0x064B <= c && c <= 0x065F) || c == 0x0670;
+}
+
+// how each UTF-16 code unit is folded by FoldText: c folds to the
+// characters chars[start[c] .. start[c + 1]) (to none for a diacritic)
+struct FoldTable {
+    u32* start = nullptr;
+    WCHAR* chars = nullptr;
+
+    FoldTable();
+    ~FoldTable() {
+        free(start);
+        free(chars);
+    }
+};
+
+FoldTable::FoldTable() {
+    start = AllocArray<u32>(0x10000 + 1);
+    Vec<WCHAR> folded;
+    for (int i = 0; i < 0x10000; i++) {
+        start[i] = (u32)folded.size();
+        WCHAR c = (WCHAR)i;
+        WCHAR buf[32];
+        int n = 0;
+        // surrogates only make sense in pairs, which are left as is
+        bool isSurrogate = 0xD800 <= c && c <= 0xDFFF;
+        if (c && !isSurrogate && DynNormalizeString) {
+            n = DynNormalizeString(6 /* NormalizationKD */, &c, 1, buf, dimof(buf));
+        } else if (c && !isSurrogate) {
+            // MAP_EXPAND_LIGATURES can't be combined with MAP_COMPOSITE
+            WCHAR expanded[8];
+            int nExpanded = FoldStringW(MAP_FOLDCZONE | MAP_EXPAND_LIGATURES, &c, 1, expanded, dimof(expanded));
+            n = nExpanded > 0 ? FoldStringW(MAP_COMPOSITE, expanded, nExpanded, buf, dimof(buf)) : 0;
+        }
+        if (n <= 0) {
+            buf[0] = c;
+            n = 1;
+        }
+        CharLowerBuffW(buf, (DWORD)n);
+        for (int k = 0; k < n; k++) {
+            if (!IsDiacriticMark(buf[k])) {
+                folded.Append(buf[k]);
+            }
+        }
+    }
+    start[0x10000] = (u32)folded.size();
+    chars = folded.StealData();
+}
+
+WCHAR* FoldText(const WCHAR* s, int len, int* foldedLenOut, int** glyphsOut) {
+    // built on first use (the initialization of a static is thread-safe)
+    static FoldTable table;
+
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        n += (int)(table.start[s[i] + 1] - table.start[s[i]]);
+    }
+    WCHAR* res = AllocArray<WCHAR>(n + 1);
+    int* glyphs = glyphsOut ? AllocArray<int>(n + 1) : nullptr;
+    int k = 0;
+    for (int i = 0; i < len; i++) {
+        for (u32 j = table.start[s[i]]; j < table.start[s[i] + 1]; j++) {
+            if (glyphs) {
+                glyphs[k] = i;
+            }
+            res[k++] = table.chars[j];
+        }
+    }
+    if (glyphsOut) {
+        glyphs[n] = len;
+        *glyphsOut = glyphs;
+    }
+    if (foldedLenOut) {
+        *foldedLenOut = n;
+    }
+    return res;
+}
@@ -143,6 +143,11 @@ ByteSlice GetStreamOrFileData(IStream* stream, const WCHAR* filePath);
 bool ReadDataFromStream(IStream* stream, void* buffer, size_t len, size_t offset = 0);
 uint GuessTextCodepage(const char* data, size_t len, uint defVal = CP_ACP);
 WCHAR* NormalizeString(const WCHAR* str, int /* NORM_FORM */ form);
+// folds text for a loose search: lower-cased, without diacritics and with ligatures,
+// full-width and other compatibility forms replaced with the plain characters (NFKD).
+// if glyphsOut is given, it's set to the index in s each folded character comes
+// from (with one more entry, len)
+WCHAR* FoldText(const WCHAR* s, int len, int* foldedLenOut, int** glyphsOut = nullptr);
 void ResizeHwndToClientArea(HWND hwnd, int dx, int dy, bool hasMenu);
 void ResizeWindow(HWND, int dx, int dy);
 
@@ -100,6 +100,64 @@ static u32 zip_compress(void* dst, u32 dstlen, const void* src, u32 srclen) {
     return newdstlen;
 }
 
+ByteSlice DeflateData(ByteSlice data) {
+    if (data.size() >= UINT32_MAX) {
+        return {};
+    }
+    z_stream stream = {nullptr};
+    int err = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) {
+        return {};
+    }
+    uLong dstlen = deflateBound(&stream, (uLong)data.size());
+    u8* dst = AllocArray<u8>(dstlen);
+    if (!dst) {
+        deflateEnd(&stream);
+        return {};
+    }
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = (uInt)data.size();
+    stream.next_out = dst;
+    stream.avail_out = (uInt)dstlen;
+    err = deflate(&stream, Z_FINISH);
+    size_t newdstlen = stream.total_out;
+    deflateEnd(&stream);
+    if (err != Z_STREAM_END) {
+        free(dst);
+        return {};
+    }
+    return {dst, newdstlen};
+}
+
+ByteSlice InflateData(ByteSlice compressed, size_t size) {
+    if (compressed.size() >= UINT32_MAX || size >= UINT32_MAX) {
+        return {};
+    }
+    // the size comes from the caller's data, so it might be bogus
+    u8* dst = AllocArray<u8>(size + 1);
+    if (!dst) {
+        return {};
+    }
+    z_stream stream = {nullptr};
+    int err = inflateInit2(&stream, -15);
+    if (err != Z_OK) {
+        free(dst);
+        return {};
+    }
+    stream.next_in = (Bytef*)compressed.data();
+    stream.avail_in = (uInt)compressed.size();
+    stream.next_out = dst;
+    stream.avail_out = (uInt)size;
+    err = inflate(&stream, Z_FINISH);
+    size_t dstlen = stream.total_out;
+    inflateEnd(&stream);
+    if (err != Z_STREAM_END || dstlen != size) {
+        free(dst);
+        return {};
+    }
+    return {dst, size};
+}
+
 bool ZipCreator::AddFileData(const char* nameUtf8, const void* data, size_t size, u32 dosdate) {
     CrashIf(size >= UINT32_MAX);
     CrashIf(str::Len(nameUtf8) >= UINT16_MAX);
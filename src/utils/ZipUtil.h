@@ -30,3 +30,8 @@ class ZipCreator {
 };
 
 IStream* OpenDirAsZipStream(const WCHAR* dirPath, bool recursive = false);
+
+// compresses data with raw deflate (as used in zip files), returns an empty slice on failure
+ByteSlice DeflateData(ByteSlice data);
+// uncompresses data returned by DeflateData for data of the given size
+ByteSlice InflateData(ByteSlice compressed, size_t size);
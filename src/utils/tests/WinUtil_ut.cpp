@@ -38,6 +38,28 @@ void WinUtilTest() {
         utassert(allScreens.Intersect(oneScreen) == oneScreen);
     }
 
+    {
+        // precomposed and combining accents, a ligature, full-width letters
+        const WCHAR* s = L"Caf\x00e9 \xfb01le \xff21\xff22 e\x0301x";
+        int len = (int)str::Len(s);
+        int foldedLen;
+        int* glyphs;
+        AutoFreeWstr folded(FoldText(s, len, &foldedLen, &glyphs));
+        utassert(str::Eq(folded, L"cafe file ab ex"));
+        utassert(foldedLen == (int)str::Len(folded));
+        int expected[] = {0, 1, 2, 3, 4, 5, 5, 6, 7, 8, 9, 10, 11, 12, 14, 15};
+        utassert(foldedLen + 1 == (int)dimof(expected));
+        for (int i = 0; i <= foldedLen && i < (int)dimof(expected); i++) {
+            utassert(glyphs[i] == expected[i]);
+        }
+        free(glyphs);
+
+        AutoFreeWstr plain(FoldText(L"Plain Text", 10, &foldedLen));
+        utassert(str::Eq(plain, L"plain text") && foldedLen == 10);
+        AutoFreeWstr empty(FoldText(L"", 0, &foldedLen));
+        utassert(str::Eq(empty, L"") && foldedLen == 0);
+    }
+
     // TODO: moved AdjustLigthness() to Colors.[h|cpp] which is outside of utils directory
 #if 0
     {